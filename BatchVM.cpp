@@ -0,0 +1,499 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+
+#include "BatchVM.h"
+#include "Exceptions.h"
+#include "OutputSink.h"
+#include "Runtime.h"
+#include "ThreadPool.h"
+#include "VM.h"
+
+namespace {
+
+const int LANES = BatchVM::LANES;
+
+//the values of a register in every lane, or a mask: -1 in the selected lanes, 0 elsewhere.
+//The loops over the lanes are simple enough for the compiler to turn them into SIMD instructions
+struct alignas(32) Lanes {
+    int32_t v[LANES];
+};
+
+template<typename F>
+Lanes map(const Lanes& a, const Lanes& b, F f)
+{
+    Lanes d;
+    for(int l = 0; l < LANES; l++)
+        d.v[l] = f(a.v[l], b.v[l]);
+    return d;
+}
+
+Lanes splat(int32_t value)
+{
+    Lanes d;
+    for(int l = 0; l < LANES; l++)
+        d.v[l] = value;
+    return d;
+}
+
+//a in the lanes of mask, b elsewhere
+Lanes select(const Lanes& mask, const Lanes& a, const Lanes& b)
+{
+    Lanes d;
+    for(int l = 0; l < LANES; l++)
+        d.v[l] = (a.v[l] & mask.v[l]) | (b.v[l] & ~mask.v[l]);
+    return d;
+}
+
+//d = x in the lanes of mask
+void assign(Lanes& d, const Lanes& x, const Lanes& mask)
+{
+    d = select(mask, x, d);
+}
+
+bool none(const Lanes& mask)
+{
+    int32_t any = 0;
+    for(int l = 0; l < LANES; l++)
+        any |= mask.v[l];
+    return any == 0;
+}
+
+bool same(const Lanes& a, const Lanes& b)
+{
+    return none(map(a, b, [](int32_t x, int32_t y) {return x ^ y;}));
+}
+
+int count(const Lanes& mask)
+{
+    int32_t n = 0;
+    for(int l = 0; l < LANES; l++)
+        n -= mask.v[l];
+    return n;
+}
+
+int32_t minimum(const Lanes& a)
+{
+    int32_t m = a.v[0];
+    for(int l = 1; l < LANES; l++)
+        m = a.v[l] < m ? a.v[l] : m;
+    return m;
+}
+
+//an array of the instances of a group: cell i of lane l is at i*LANES + l
+struct LaneArray {
+    std::vector<int32_t> cells;
+    std::vector<uint8_t> initialized;
+    Lanes declared{};
+};
+
+void collectDecls(Stmt* stmt, std::map<std::string, Decl*>& decls)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+        {
+            auto block = static_cast<Block*>(stmt);
+            for(Decls* d = block->getDecls(); d; d = d->getDecls())
+                decls[d->getDecl()->getId()->getName()] = d->getDecl();
+            for(Seq* seq = block->getSeq(); seq; seq = seq->getSeq())
+                collectDecls(seq->getStmt(), decls);
+            break;
+        }
+        case Node::IF:
+            collectDecls(static_cast<If*>(stmt)->getStmt(), decls);
+            break;
+        case Node::ELSE:
+            collectDecls(static_cast<Else*>(stmt)->getifTrueStmt(), decls);
+            collectDecls(static_cast<Else*>(stmt)->getifFalseStmt(), decls);
+            break;
+        case Node::WHILE:
+            collectDecls(static_cast<While*>(stmt)->getStmt(), decls);
+            break;
+        case Node::DO:
+            collectDecls(static_cast<Do*>(stmt)->getStmt(), decls);
+            break;
+        case Node::PARALLEL_FOR:
+            collectDecls(static_cast<ParallelFor*>(stmt)->getStmt(), decls);
+            break;
+        default:
+            break;
+    }
+}
+
+}
+
+std::vector<BatchInput> readInstances(std::istream& is, Program* program)
+{
+    std::map<std::string, Decl*> decls;
+    collectDecls(program->getBlock(), decls);
+
+    std::vector<BatchInput> instances;
+    std::string line;
+    while(std::getline(is, line))
+    {
+        std::string where = " on line " + std::to_string(instances.size() + 1);
+        instances.push_back({});
+        std::istringstream pairs(line);
+        std::string pair;
+        while(pairs >> pair)
+        {
+            size_t equal = pair.find('=');
+            if(equal == std::string::npos)
+                throw ParseError("Expecting name=value instead of " + pair + where);
+            std::string name = pair.substr(0, equal);
+            std::string value = pair.substr(equal + 1);
+            auto decl = decls.find(name);
+            if(decl == decls.end() || decl->second->getType()->getKind() == Node::VECTOR_TYPE)
+                throw ParseError("No scalar variable " + name + where);
+
+            int32_t number;
+            if(decl->second->getType()->getTypeCode() == Type::BOOL)
+            {
+                if(value != "true" && value != "false")
+                    throw ParseError("Expecting true or false for " + name + where);
+                number = value == "true";
+            }
+            else
+            {
+                char* end;
+                errno = 0;
+                long parsed = std::strtol(value.c_str(), &end, 10);
+                if(value.empty() || *end || errno == ERANGE || parsed < INT32_MIN || parsed > INT32_MAX)
+                    throw ParseError("Expecting an int for " + name + where);
+                number = parsed;
+            }
+            instances.back().push_back({decl->second, number});
+        }
+    }
+    return instances;
+}
+
+BatchVM::BatchVM(const BytecodeProgram& p, const std::vector<BatchInput>& batchInputs) : program{p},
+    outputs(batchInputs.size()), errors(batchInputs.size()), lengths(NUM_OPCODES)
+{
+    std::map<std::string, int> registers;
+    for(int r = 0; r < program.getNumRegisters(); r++)
+        if(!program.getRegisterName(r).empty())
+            registers[program.getRegisterName(r)] = r;
+    for(auto& batchInput : batchInputs)
+    {
+        inputs.push_back({});
+        for(auto& input : batchInput)
+            inputs.back().push_back({registers.at(input.first->getId()->getName()), input.second});
+    }
+    for(int op = 0; op < NUM_OPCODES; op++)
+        lengths[op] = 1 + BytecodeProgram::numOperands(static_cast<OpCode>(op));
+}
+
+void BatchVM::run()
+{
+    int groups = (inputs.size() + LANES - 1) / LANES;
+    ThreadPool::shared().run(groups, [this](int group) {runGroup(group * LANES);});
+}
+
+#define R(k) r[code[pc + (k)]]
+#define IMM(k) code[pc + (k)]
+
+//the lanes that diverged keep their values
+#define STORE(d, x) if(diverged) {assign(d, x, active);} else {d = x;}
+//ends the instance of lane l with an error
+#define STOP(l, error) do {errors[first + (l)] = error; running.v[l] = active.v[l] = 0; alive--;} while(0)
+//the active lanes go on with the next instruction
+#define ADVANCE() if(diverged) {assign(pcs, splat(next), active);} else {pc = next;} continue;
+
+#define BINARY(op, expr) case op: \
+        STORE(R(1), map(R(2), R(3), [](int32_t a, int32_t b) {return static_cast<int32_t>(expr);})) \
+        ADVANCE()
+#define UNARY(op, expr) case op: \
+        STORE(R(1), map(R(2), R(2), [](int32_t a, int32_t) {return static_cast<int32_t>(expr);})) \
+        ADVANCE()
+#define BINARY_IMM(op, expr) case op: \
+        STORE(R(1), map(R(2), splat(IMM(3)), [](int32_t a, int32_t b) {return static_cast<int32_t>(expr);})) \
+        ADVANCE()
+//the active lanes where cond holds jump to the target, the last operand
+#define BRANCH(op, other, cond) case op: \
+        jumped = map(map(R(1), other, [](int32_t a, int32_t b) {return -static_cast<int32_t>(cond);}), active, \
+                     [](int32_t a, int32_t b) {return a & b;}); \
+        target = code[next - 1]; \
+        break;
+
+void BatchVM::runGroup(int first)
+{
+    const std::vector<int32_t>& code = program.getCode();
+    const std::vector<ArrayInfo>& infos = program.getArrays();
+    int alive = std::min<int>(LANES, inputs.size() - first);
+
+    std::vector<Lanes> r(program.getNumRegisters(), Lanes{});
+    std::vector<LaneArray> arrays(infos.size());
+    Lanes running{};
+    for(int l = 0; l < alive; l++)
+    {
+        running.v[l] = -1;
+        for(auto& input : inputs[first + l])
+            r[input.first].v[l] = input.second;
+    }
+
+    //alive lanes are still running. While all of them run the same instructions pc is the one of
+    //all of them, otherwise the one of the lanes in active, the lowest in pcs. Values are stored
+    //only in the active lanes, in every lane while they don't diverge
+    int pc = 0;
+    Lanes active = running;
+    bool diverged = false;
+    Lanes pcs{};
+    long sparse = 0;
+
+    //a lane that has diverged for long goes on by itself, from its state
+    auto goAlone = [&](int l, int start) {
+        VM vm(program);
+        for(size_t k = 0; k < r.size(); k++)
+            vm.setRegister(k, r[k].v[l]);
+        for(size_t v = 0; v < arrays.size(); v++)
+        {
+            if(!arrays[v].declared.v[l])
+                continue;
+            RuntimeArray& array = vm.getArray(v);
+            array.declare(infos[v].size);
+            for(int i = 0; i < infos[v].size; i++)
+            {
+                array.cells[i] = arrays[v].cells[static_cast<size_t>(i) * LANES + l];
+                array.initialized[i] = arrays[v].initialized[static_cast<size_t>(i) * LANES + l];
+            }
+        }
+
+        std::ostringstream text;
+        OutputSink* previous = &OutputSink::current();
+        {
+            OutputSink sink(text, OutputSink::BUFFERED);
+            OutputSink::setCurrent(&sink);
+            try {
+                vm.resume(start);
+            }
+            catch (EvaluationError const& ee) {
+                errors[first + l] = ee.what();
+            }
+            OutputSink::setCurrent(previous);
+        }
+        outputs[first + l] += text.str();
+    };
+
+    while(alive > 0)
+    {
+        if(diverged)
+        {
+            Lanes live = select(running, pcs, splat(INT_MAX));
+            pc = minimum(live);
+            active = map(live, splat(pc), [](int32_t a, int32_t b) {return -static_cast<int32_t>(a == b);});
+            if(same(active, running))
+                diverged = false;
+            else if(2 * count(active) > alive)
+                sparse = 0;
+            else if(++sparse > DIVERGENCE_LIMIT)
+            {
+                for(int l = 0; l < LANES; l++)
+                {
+                    if(!active.v[l])
+                        continue;
+                    goAlone(l, pc);
+                    running.v[l] = 0;
+                    alive--;
+                }
+                sparse = 0;
+                continue;
+            }
+        }
+
+        OpCode op = static_cast<OpCode>(code[pc]);
+        int next = pc + lengths[op];
+        Lanes jumped;
+        int target;
+        switch(op)
+        {
+            case OP_HALT:
+                alive -= count(active);
+                running = map(running, active, [](int32_t a, int32_t b) {return a & ~b;});
+                continue;
+
+            case OP_LOADI:
+                STORE(R(1), splat(IMM(2)))
+                ADVANCE()
+
+            case OP_MOV:
+                STORE(R(1), R(2))
+                ADVANCE()
+
+            BINARY(OP_ADD, wrapAdd(a, b))
+            BINARY(OP_SUB, wrapSub(a, b))
+            BINARY(OP_MUL, wrapMul(a, b))
+            BINARY_IMM(OP_ADDI, wrapAdd(a, b))
+            BINARY_IMM(OP_MULI, wrapMul(a, b))
+
+            //in double precision, which has room for the exact quotient of two int32 and can be divided
+            //with SIMD instructions. Lanes with a divisor of 0 divide by 1 and stop
+            case OP_DIV:
+                for(int l = 0; l < LANES; l++)
+                    if(active.v[l] && R(3).v[l] == 0)
+                        STOP(l, "Division by 0");
+                STORE(R(1), map(R(2), R(3), [](int32_t a, int32_t b) {
+                    return static_cast<int32_t>(static_cast<double>(a) / static_cast<double>(b | (b == 0)));
+                }))
+                ADVANCE()
+
+            UNARY(OP_NEG, wrapSub(0, a))
+            UNARY(OP_NOT, !a)
+            BINARY(OP_EQ, a == b)
+            BINARY(OP_NE, a != b)
+            BINARY(OP_LT, a < b)
+            BINARY(OP_LE, a <= b)
+            BINARY(OP_GT, a > b)
+            BINARY(OP_GE, a >= b)
+
+            case OP_JMP:
+                jumped = active;
+                target = IMM(1);
+                break;
+
+            BRANCH(OP_JZ, R(1), a == 0)
+            BRANCH(OP_JNZ, R(1), a != 0)
+            BRANCH(OP_BEQ, R(2), a == b)
+            BRANCH(OP_BNE, R(2), a != b)
+            BRANCH(OP_BLT, R(2), a < b)
+            BRANCH(OP_BLE, R(2), a <= b)
+            BRANCH(OP_BGT, R(2), a > b)
+            BRANCH(OP_BGE, R(2), a >= b)
+            BRANCH(OP_BEQI, splat(IMM(2)), a == b)
+            BRANCH(OP_BNEI, splat(IMM(2)), a != b)
+            BRANCH(OP_BLTI, splat(IMM(2)), a < b)
+            BRANCH(OP_BLEI, splat(IMM(2)), a <= b)
+            BRANCH(OP_BGTI, splat(IMM(2)), a > b)
+            BRANCH(OP_BGEI, splat(IMM(2)), a >= b)
+
+            //like RuntimeArray::declare, in the lanes where the array is not declared yet
+            case OP_DECLA:
+            {
+                LaneArray& array = arrays[IMM(1)];
+                size_t size = infos[IMM(1)].size;
+                if(array.cells.empty())
+                {
+                    array.cells.resize(size * LANES);
+                    array.initialized.resize(size * LANES);
+                }
+                for(int l = 0; l < LANES; l++)
+                {
+                    if(!active.v[l] || array.declared.v[l])
+                        continue;
+                    for(size_t i = 0; i < size; i++)
+                    {
+                        array.cells[i * LANES + l] = 0;
+                        array.initialized[i * LANES + l] = 0;
+                    }
+                    array.declared.v[l] = -1;
+                }
+                ADVANCE()
+            }
+
+            case OP_ALOAD:
+            {
+                LaneArray& array = arrays[IMM(2)];
+                uint32_t size = infos[IMM(2)].size;
+                for(int l = 0; l < LANES; l++)
+                {
+                    if(!active.v[l])
+                        continue;
+                    uint32_t index = R(3).v[l];
+                    if(!array.declared.v[l] || index >= size)
+                        STOP(l, "Out of bounds error on " + infos[IMM(2)].name + " array");
+                    else if(!array.initialized[size_t{index} * LANES + l])
+                        STOP(l, "Trying to retrieve a cell from an array which has not been declared");
+                    else
+                        R(1).v[l] = array.cells[size_t{index} * LANES + l];
+                }
+                ADVANCE()
+            }
+
+            case OP_ASTORE:
+            {
+                LaneArray& array = arrays[IMM(1)];
+                uint32_t size = infos[IMM(1)].size;
+                for(int l = 0; l < LANES; l++)
+                {
+                    if(!active.v[l])
+                        continue;
+                    uint32_t index = R(2).v[l];
+                    if(!array.declared.v[l] || index >= size)
+                    {
+                        STOP(l, "Out of bounds error on " + infos[IMM(1)].name + " array");
+                        continue;
+                    }
+                    array.cells[size_t{index} * LANES + l] = R(3).v[l];
+                    array.initialized[size_t{index} * LANES + l] = 1;
+                }
+                ADVANCE()
+            }
+
+            case OP_INDEX:
+                for(int l = 0; l < LANES; l++)
+                {
+                    if(!active.v[l])
+                        continue;
+                    uint32_t row = R(2).v[l];
+                    uint32_t column = R(3).v[l];
+                    if(row >= static_cast<uint32_t>(IMM(4)) || column >= static_cast<uint32_t>(IMM(5)))
+                        STOP(l, "Out of bounds error on " + infos[IMM(6)].name + " array");
+                    else
+                        R(1).v[l] = row * IMM(5) + column;
+                }
+                ADVANCE()
+
+            case OP_PRINTI:
+            case OP_PRINTB:
+                for(int l = 0; l < LANES; l++)
+                {
+                    if(!active.v[l])
+                        continue;
+                    int32_t value = R(1).v[l];
+                    outputs[first + l] += op == OP_PRINTI ? std::to_string(value) : value ? "1" : "0";
+                    outputs[first + l] += '\n';
+                }
+                ADVANCE()
+
+            //the serial code follows
+            case OP_PARLOOP:
+            case OP_TASKS:
+                ADVANCE()
+
+            //only the program calls functions: the lanes calling one go on by themselves, each
+            //with its own stack
+            case OP_CALL:
+                for(int l = 0; l < LANES; l++)
+                {
+                    if(!active.v[l])
+                        continue;
+                    goAlone(l, pc);
+                    running.v[l] = 0;
+                    alive--;
+                }
+                continue;
+
+            default:
+                throw EvaluationError("Invalid bytecode");
+        }
+
+        //the lanes of a branch that goes both ways part
+        if(diverged)
+            assign(pcs, select(jumped, splat(target), splat(next)), active);
+        else if(none(jumped))
+            pc = next;
+        else if(same(jumped, active))
+            pc = target;
+        else
+        {
+            diverged = true;
+            sparse = 0;
+            pcs = select(jumped, splat(target), splat(next));
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef BATCH_VM_H
+#define BATCH_VM_H
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Node.h"
+#include "Bytecode.h"
+
+//The inputs of an instance of a program: the values of some of its scalar variables before it starts,
+//bools as 0/1. The variables keep them when they are declared
+using BatchInput = std::vector<std::pair<Decl*, int32_t>>;
+
+//Reads the inputs of the instances of program, one line each made of name=value pairs: name is a
+//scalar variable of program, value an int or, for a boolean variable, true or false.
+//Throws ParseError on anything else
+std::vector<BatchInput> readInstances(std::istream& is, Program* program);
+
+//Runs a BytecodeProgram once for every input, each instance with its own registers, arrays and output.
+//The instances run LANES at a time in lockstep: a register holds the values of all of them, one per
+//lane, and every instruction runs on the lanes whose next instruction it is, the first one in the code
+//among the lanes still running (the others are masked). The lanes that take different branches meet
+//again at the first instruction they share, after an If or after a loop. When fewer than half of the
+//lanes have run for more than DIVERGENCE_LIMIT instructions in a row, each of them goes on by itself
+//on a VM. A runtime error ends only the instance that raised it. Groups of lanes run on the shared
+//ThreadPool, parallel loops and task graphs run their serial code
+class BatchVM {
+public:
+    static constexpr int LANES = 16;
+    static constexpr long DIVERGENCE_LIMIT = 1 << 16;
+
+    BatchVM(const BytecodeProgram& p, const std::vector<BatchInput>& inputs);
+    ~BatchVM() = default;
+    BatchVM(BatchVM const&) = delete;
+    BatchVM& operator=(BatchVM const&) = delete;
+
+    void run();
+
+    //what an instance printed, and the message of the error that ended it, empty if none
+    const std::string& getOutput(int instance) const {return outputs[instance];}
+    const std::string& getError(int instance) const {return errors[instance];}
+
+private:
+    const BytecodeProgram& program;
+    //the inputs of every instance, as register and value
+    std::vector<std::vector<std::pair<int, int32_t>>> inputs;
+    std::vector<std::string> outputs;
+    std::vector<std::string> errors;
+    //length of every opcode with its operands
+    std::vector<int> lengths;
+
+    //runs the instances from first to first + LANES
+    void runGroup(int first);
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include <cstring>
+#include <iomanip>
+#include <algorithm>
+
+#include "Bytecode.h"
+
+const char* BytecodeProgram::opNames[NUM_OPCODES] = {
+    "HALT", "LOADI", "MOV",
+    "ADD", "SUB", "MUL", "DIV",
+    "ADDI", "MULI",
+    "NEG", "NOT",
+    "EQ", "NE", "LT", "LE", "GT", "GE",
+    "JMP",
+    "JZ", "JNZ",
+    "BEQ", "BNE", "BLT", "BLE", "BGT", "BGE",
+    "BEQI", "BNEI", "BLTI", "BLEI", "BGTI", "BGEI",
+    "DECLA", "ALOAD", "ASTORE", "INDEX",
+    "PRINTI", "PRINTB",
+    "PARLOOP", "TASKS",
+    "CALL", "RET", "TAILCALL", "GLOAD", "GSTORE", "NORET"
+};
+
+const char* BytecodeProgram::opOperands[NUM_OPCODES] = {
+    "", "di", "da",
+    "dab", "dab", "dab", "dab",
+    "dai", "dai",
+    "da", "da",
+    "dab", "dab", "dab", "dab", "dab", "dab",
+    "t",
+    "at", "at",
+    "abt", "abt", "abt", "abt", "abt", "abt",
+    "ait", "ait", "ait", "ait", "ait", "ait",
+    "v", "dva", "vab", "dabiiv",
+    "a", "a",
+    "iat", "it",
+    "dfa", "a", "fa", "dg", "ga", "f"
+};
+
+int BytecodeProgram::numOperands(OpCode op)
+{
+    return std::strlen(opOperands[op]);
+}
+
+int BytecodeProgram::emit(OpCode op, std::initializer_list<int32_t> operands)
+{
+    int pos = code.size();
+    code.push_back(op);
+    code.insert(code.end(), operands.begin(), operands.end());
+    return pos;
+}
+
+void BytecodeProgram::rotate(int from, int middle)
+{
+    int first = middle - from;
+    int second = code.size() - middle;
+    size_t pc = from;
+    while(pc < code.size())
+    {
+        OpCode op = static_cast<OpCode>(code[pc]);
+        const char* kinds = operandKinds(op);
+        for(int k = 0; kinds[k]; k++)
+            if(kinds[k] == 't')
+                code[pc + 1 + k] += static_cast<int>(pc) < middle ? second : -first;
+        pc += 1 + numOperands(op);
+    }
+    std::rotate(code.begin() + from, code.begin() + middle, code.end());
+}
+
+int BytecodeProgram::addRegister(const std::string& name)
+{
+    registerNames.push_back(name);
+    return registerNames.size() - 1;
+}
+
+int BytecodeProgram::addArray(const std::string& name, Type::TypeCode type, int size)
+{
+    arrays.push_back(ArrayInfo{name, type, size});
+    return arrays.size() - 1;
+}
+
+int BytecodeProgram::addParallelLoop(const ParallelLoop& loop)
+{
+    parallelLoops.push_back(loop);
+    return parallelLoops.size() - 1;
+}
+
+int BytecodeProgram::addTaskGraph(const TaskGraph& graph)
+{
+    taskGraphs.push_back(graph);
+    return taskGraphs.size() - 1;
+}
+
+int BytecodeProgram::addFunction(const FunctionInfo& function)
+{
+    functions.push_back(function);
+    return functions.size() - 1;
+}
+
+void BytecodeProgram::disassemble(std::ostream& os) const
+{
+    os << "; " << registerNames.size() << " registers, " << arrays.size() << " arrays" << std::endl;
+    for(size_t i = 0; i < arrays.size(); i++)
+    {
+        os << ";   v" << i << " = " << Type::typeid2String[arrays[i].type]
+           << "[" << arrays[i].size << "] " << arrays[i].name << std::endl;
+    }
+    for(size_t i = 0; i < parallelLoops.size(); i++)
+    {
+        const ParallelLoop& loop = parallelLoops[i];
+        os << ";   parallel loop #" << i << ": r" << loop.induction << "(" << registerNames[loop.induction] << ") += "
+           << loop.step << " up to r" << loop.limit << " at @" << loop.entry;
+        const char* ops[] = {"+", "*", "&&", "||"};     //same order of ReductionOp
+        for(auto& reduction : loop.reductions)
+            os << ", r" << reduction.first << "(" << registerNames[reduction.first] << ") " << ops[reduction.second];
+        if(loop.stated)
+            os << (loop.ordered ? ", stated, ordered" : ", stated");
+        os << std::endl;
+    }
+    for(size_t i = 0; i < taskGraphs.size(); i++)
+    {
+        os << ";   task graph #" << i << ":" << std::endl;
+        const auto& tasks = taskGraphs[i].tasks;
+        for(size_t k = 0; k < tasks.size(); k++)
+        {
+            os << ";     task " << k << " at @" << tasks[k].entry << (tasks[k].prints ? ", prints" : "");
+            for(size_t j = 0; j < tasks[k].writes.size(); j++)
+                os << (j ? ", r" : ", writes r") << tasks[k].writes[j];
+            for(size_t j = 0; j < tasks[k].successors.size(); j++)
+                os << (j ? ", " : ", before ") << tasks[k].successors[j];
+            os << std::endl;
+        }
+    }
+
+    //the code of the functions is at the end, in their order
+    const std::vector<std::string>* names = &registerNames;
+    size_t function = 0;
+    size_t pc = 0;
+    while(pc < code.size())
+    {
+        if(function < functions.size() && static_cast<int>(pc) == functions[function].entry)
+        {
+            const FunctionInfo& info = functions[function++];
+            os << "; function " << info.name << ": " << info.numParams << " parameters, " << info.numLocals
+               << " locals, " << info.numRegisters << " registers" << std::endl;
+            names = &info.localNames;
+        }
+        OpCode op = static_cast<OpCode>(code[pc]);
+        os << std::setw(5) << std::setfill('0') << pc << std::setfill(' ') << "  "
+           << std::left << std::setw(7) << opName(op) << std::right;
+
+        const char* kinds = operandKinds(op);
+        for(int k = 0; kinds[k]; k++)
+        {
+            int32_t operand = code[pc + 1 + k];
+            os << (k ? ", " : " ");
+            switch(kinds[k])
+            {
+                case 'd':
+                case 'a':
+                case 'b':
+                    os << "r" << operand;
+                    if(operand < static_cast<int>(names->size()) && !(*names)[operand].empty())
+                        os << "(" << (*names)[operand] << ")";
+                    break;
+                case 'g':
+                    os << "g" << operand << "(" << registerNames[operand] << ")";
+                    break;
+                case 'f':
+                    os << "f" << operand << "(" << functions[operand].name << ")";
+                    break;
+                case 'v':
+                    os << "v" << operand << "(" << arrays[operand].name << ")";
+                    break;
+                case 't':
+                    os << "@" << operand;
+                    break;
+                default:
+                    os << "#" << operand;
+                    break;
+            }
+        }
+        os << std::endl;
+        pc += 1 + numOperands(op);
+    }
+}
@@ -0,0 +1,161 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <initializer_list>
+
+#include "Node.h"
+
+//Opcodes of the register based bytecode. In the code stream every opcode is followed by its operands:
+//d = destination register, a/b = source registers, i = immediate, t = jump target, v = array,
+//f = function, g = register of the program read or written from the code of a function
+enum OpCode : int32_t {
+    OP_HALT,                                                //
+    OP_LOADI,                                               //d i
+    OP_MOV,                                                 //d a
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV,                         //d a b
+    OP_ADDI, OP_MULI,                                       //d a i
+    OP_NEG, OP_NOT,                                         //d a
+    OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE,               //d a b
+    OP_JMP,                                                 //t
+    OP_JZ, OP_JNZ,                                          //a t
+    OP_BEQ, OP_BNE, OP_BLT, OP_BLE, OP_BGT, OP_BGE,         //a b t
+    OP_BEQI, OP_BNEI, OP_BLTI, OP_BLEI, OP_BGTI, OP_BGEI,   //a i t
+    OP_DECLA,                                               //v
+    OP_ALOAD,                                               //d v a
+    OP_ASTORE,                                              //v a b     (v[a] = b)
+    OP_INDEX,                                               //d a b i i v   (d = a*i2 + b, a < i1, b < i2 in v)
+    OP_PRINTI, OP_PRINTB,                                   //a
+    OP_PARLOOP,                                             //i a t     (parallel loop i with bound a, see ParallelLoop)
+    OP_TASKS,                                               //i t       (task graph i, see TaskGraph)
+    OP_CALL,                                                //d f a     (d = f(a, a+1, ...), see FunctionInfo)
+    OP_RET,                                                 //a
+    OP_TAILCALL,                                            //f a       (return f(a, a+1, ...) in the frame of the caller)
+    OP_GLOAD,                                               //d g
+    OP_GSTORE,                                              //g a
+    OP_NORET,                                               //f         (the end of f was reached without a return)
+    NUM_OPCODES
+};
+
+//What the VM needs to know about an array of the program
+struct ArrayInfo {
+    std::string name;
+    Type::TypeCode type;
+    int size;
+};
+
+//A loop whose iterations are independent (see LoopParallelizer), or a parallel for. OP_PARLOOP either
+//runs it split in chunks and jumps past it, or goes on with its serial code. A chunk runs the code at entry on
+//its own copy of the registers: the body of the loop followed by
+//    ADDI induction, induction, step; BLT induction, limit, entry; HALT
+//The reductions are the only registers written by the body, besides the induction, temporaries and
+//the private variables of a parallel for
+struct ParallelLoop {
+    int induction;
+    int32_t step;
+    bool inclusive;     //the loop goes on while induction <= bound, instead of <
+    int limit;
+    int entry;
+    //largest coefficient of the induction in the subscripts of the arrays written by the body:
+    //the cells of two iterations can't collide as long as their distance times it doesn't wrap around
+    int32_t maxCoefficient;
+    std::vector<std::pair<int, ReductionOp>> reductions;
+    //a parallel for: it runs in parallel whenever it has more than one iteration
+    bool stated = false;
+    //the body prints
+    bool ordered = false;
+};
+
+//The statements of a block whose tasks can run at the same time (see analyzeBlock). OP_TASKS either
+//runs the tasks and jumps past the block, or goes on with its serial code. A task runs the code at
+//entry, its statements followed by HALT, on its own copy of the registers
+struct TaskGraph {
+    struct Task {
+        int entry;
+        //the registers of the variables written by the task, copied back when it ends
+        std::vector<int> writes;
+        std::vector<int> successors;
+        int predecessors;
+        bool prints;
+    };
+    std::vector<Task> tasks;
+};
+
+//A function of the program. A call runs its code at entry on a frame of registers of its own: the
+//locals first, the parameters being the first of them, then the temporaries. The registers of the
+//program are reached through OP_GLOAD and OP_GSTORE
+struct FunctionInfo {
+    std::string name;
+    int entry;
+    int numParams;
+    int numLocals;
+    int numRegisters;
+    std::vector<std::string> localNames;
+};
+
+//A compiled program: the code stream, the number of registers it uses and its arrays.
+//The first registers hold the variables of the program, the others are temporaries
+class BytecodeProgram {
+public:
+    BytecodeProgram() = default;
+
+    static const char* opName(OpCode op) {return opNames[op];}
+    //the operands of an opcode, one letter each (see OpCode)
+    static const char* operandKinds(OpCode op) {return opOperands[op];}
+    static int numOperands(OpCode op);
+
+    //appends an instruction and returns the position of its opcode
+    int emit(OpCode op, std::initializer_list<int32_t> operands);
+
+    //position of the next instruction, used as jump target
+    int here() const {return code.size();}
+
+    //replaces the operand at position pos, used to fix forward jumps
+    void patch(int pos, int32_t value) {code[pos] = value;}
+
+    //moves the instructions from middle to the end before the ones from from to middle, adjusting
+    //the jumps of both parts. Used by the single-pass compiler to emit code out of source order:
+    //jumps into the moved code from elsewhere must be adjusted by the caller
+    void rotate(int from, int middle);
+
+    const std::vector<int32_t>& getCode() const {return code;}
+
+    int addRegister(const std::string& name);
+    int getNumRegisters() const {return registerNames.size();}
+    //name of the variable held by a register, empty for temporaries
+    const std::string& getRegisterName(int r) const {return registerNames[r];}
+
+    int addArray(const std::string& name, Type::TypeCode type, int size);
+    const std::vector<ArrayInfo>& getArrays() const {return arrays;}
+
+    int addParallelLoop(const ParallelLoop& loop);
+    ParallelLoop& getParallelLoop(int loop) {return parallelLoops[loop];}
+    const std::vector<ParallelLoop>& getParallelLoops() const {return parallelLoops;}
+
+    int addTaskGraph(const TaskGraph& graph);
+    TaskGraph& getTaskGraph(int graph) {return taskGraphs[graph];}
+    const std::vector<TaskGraph>& getTaskGraphs() const {return taskGraphs;}
+
+    int addFunction(const FunctionInfo& function);
+    FunctionInfo& getFunction(int function) {return functions[function];}
+    const std::vector<FunctionInfo>& getFunctions() const {return functions;}
+
+    void disassemble(std::ostream& os) const;
+
+private:
+    static const char* opNames[NUM_OPCODES];
+    static const char* opOperands[NUM_OPCODES];
+
+    std::vector<int32_t> code;
+    //name of the variable held by each register, empty for temporaries
+    std::vector<std::string> registerNames;
+    std::vector<ArrayInfo> arrays;
+    std::vector<ParallelLoop> parallelLoops;
+    std::vector<TaskGraph> taskGraphs;
+    std::vector<FunctionInfo> functions;
+};
+
+#endif
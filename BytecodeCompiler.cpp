@@ -0,0 +1,806 @@
+#include <algorithm>
+
+#include "BytecodeCompiler.h"
+#include "Exceptions.h"
+
+namespace {
+
+//relations that compileBranch turns into compare-and-branch instructions
+enum Relation {REL_EQ, REL_NE, REL_LT, REL_LE, REL_GT, REL_GE};
+
+const Relation negated[] = {REL_NE, REL_EQ, REL_GE, REL_GT, REL_LE, REL_LT};
+//relation obtained by swapping the operands
+const Relation mirrored[] = {REL_EQ, REL_NE, REL_GT, REL_GE, REL_LT, REL_LE};
+
+const OpCode branchOps[] = {OP_BEQ, OP_BNE, OP_BLT, OP_BLE, OP_BGT, OP_BGE};
+const OpCode branchImmOps[] = {OP_BEQI, OP_BNEI, OP_BLTI, OP_BLEI, OP_BGTI, OP_BGEI};
+
+bool isLiteral(Expression* exp)
+{
+    return exp->getKind() == Node::INT_CONSTANT || exp->getKind() == Node::BOOL_CONSTANT;
+}
+
+int32_t literalValue(Expression* exp)
+{
+    if(exp->getKind() == Node::INT_CONSTANT)
+        return static_cast<intConstant*>(exp)->getInt();
+    return static_cast<boolConstant*>(exp)->getBool();
+}
+
+//returns false if exp is not a comparison
+bool asRelation(Expression* exp, Relation& rel, Expression*& left, Expression*& right)
+{
+    if(exp->getKind() == Node::REL)
+    {
+        auto relNode = static_cast<Rel*>(exp);
+        const Relation rels[] = {REL_GT, REL_GE, REL_LT, REL_LE};    //same order of Rel::OpCode
+        rel = rels[relNode->getOp()];
+        left = relNode->getLeftExp();
+        right = relNode->getRightExp();
+        return true;
+    }
+    if(exp->getKind() == Node::ARITHM)
+    {
+        auto arithm = static_cast<Arithm*>(exp);
+        if(arithm->getOp() != Op::EQ && arithm->getOp() != Op::NOT_EQ)
+            return false;
+        rel = arithm->getOp() == Op::EQ ? REL_EQ : REL_NE;
+        left = arithm->getLeftExp();
+        right = arithm->getRightExp();
+        return true;
+    }
+    return false;
+}
+
+bool prints(Stmt* stmt)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+            for(Seq* seq = static_cast<Block*>(stmt)->getSeq(); seq; seq = seq->getSeq())
+                if(prints(seq->getStmt()))
+                    return true;
+            return false;
+        case Node::IF:
+            return prints(static_cast<If*>(stmt)->getStmt());
+        case Node::ELSE:
+            return prints(static_cast<Else*>(stmt)->getifTrueStmt()) || prints(static_cast<Else*>(stmt)->getifFalseStmt());
+        case Node::WHILE:
+            return prints(static_cast<While*>(stmt)->getStmt());
+        case Node::DO:
+            return prints(static_cast<Do*>(stmt)->getStmt());
+        case Node::PARALLEL_FOR:
+            return prints(static_cast<ParallelFor*>(stmt)->getStmt());
+        case Node::PRINT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool isLogical(ReductionOp op)
+{
+    return op == REDUCE_AND || op == REDUCE_OR;
+}
+
+}
+
+BytecodeProgram BytecodeCompiler::compile(Program* program)
+{
+    resolver.resolve(program);
+    return generate(program->getBlock(), program->getFunctions());
+}
+
+BytecodeProgram BytecodeCompiler::compileLoop(Stmt* loop, const std::vector<Symbol>& declared)
+{
+    resolver.resolveLoop(loop, declared);
+    return generate(loop);
+}
+
+BytecodeProgram BytecodeCompiler::generate(Stmt* stmt, const std::vector<Function*>& functions)
+{
+    BytecodeProgram bytecode;
+    out = &bytecode;
+    for(auto& var : resolver.getScalars())
+        out->addRegister(var.name);
+    for(auto& array : resolver.getArrays())
+        out->addArray(array.name, array.type, array.size);
+    functionIndex.clear();
+    for(Function* f : functions)
+    {
+        FunctionInfo info{f->getName(), 0, f->getNumParams(), f->getNumLocals(), 0, {}};
+        for(Decl* decl : f->getLocals())
+            info.localNames.push_back(decl->getId()->getName());
+        functionIndex[f] = out->addFunction(info);
+    }
+    independentLoops.clear();
+    forRegisters.clear();
+    parallelLoops.clear();
+    taskGraphs.clear();
+    serial = false;
+    findParallelLoops(stmt);
+    if(!independentLoops.empty() || !forRegisters.empty())
+        limit = out->addRegister("");
+    firstTemp = nextTemp = out->getNumRegisters();
+
+    //a break outside of any loop skips the rest of the program
+    breakJumps.push_back({});
+    compileStmt(stmt);
+    patchHere(breakJumps.back());
+    breakJumps.pop_back();
+    out->emit(OP_HALT, {});
+
+    //the code of the tasks and of the chunks of the parallel loops follows the program. The tasks
+    //and the chunks of a parallel for add the parallel loops nested in them
+    for(size_t k = 0; k < taskGraphs.size(); k++)
+    {
+        //a copy, in case compiling the tasks adds graphs
+        std::pair<int, BlockGraph> graph = taskGraphs[k];
+        compileTaskGraph(graph.first, graph.second);
+    }
+    for(size_t k = 0; k < parallelLoops.size(); k++)
+        compileParallelLoop(parallelLoops[k].first, parallelLoops[k].second);
+    for(size_t k = 0; k < functions.size(); k++)
+        compileFunction(k, functions[k]);
+
+    out = nullptr;
+    return bytecode;
+}
+
+//the temporaries follow the locals in the frame. A break out of every loop ends the body, like the
+//end of the code of the function, without a return
+void BytecodeCompiler::compileFunction(int index, Function* f)
+{
+    out->getFunction(index).entry = out->here();
+    function = f;
+    firstTemp = nextTemp = frameSize = f->getNumLocals();
+    breakJumps.push_back({});
+    compileStmt(f->getBody());
+    patchHere(breakJumps.back());
+    breakJumps.pop_back();
+    out->emit(OP_NORET, {index});
+    out->getFunction(index).numRegisters = frameSize;
+    function = nullptr;
+}
+
+int BytecodeCompiler::newTemp()
+{
+    if(function)
+    {
+        frameSize = std::max(frameSize, nextTemp + 1);
+        return nextTemp++;
+    }
+    if(nextTemp == out->getNumRegisters())
+        out->addRegister("");
+    return nextTemp++;
+}
+
+void BytecodeCompiler::patchHere(const std::vector<int>& jumps)
+{
+    for(int pos : jumps)
+        out->patch(pos, out->here());
+}
+
+void BytecodeCompiler::findParallelLoops(Stmt* stmt)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+            for(Seq* seq = static_cast<Block*>(stmt)->getSeq(); seq; seq = seq->getSeq())
+                findParallelLoops(seq->getStmt());
+            break;
+        case Node::IF:
+            findParallelLoops(static_cast<If*>(stmt)->getStmt());
+            break;
+        case Node::ELSE:
+            findParallelLoops(static_cast<Else*>(stmt)->getifTrueStmt());
+            findParallelLoops(static_cast<Else*>(stmt)->getifFalseStmt());
+            break;
+        case Node::WHILE:
+        {
+            auto whileNode = static_cast<While*>(stmt);
+            IndependentLoop loop;
+            if(analyzeLoop(whileNode, loop))
+                independentLoops.emplace(whileNode, loop);
+            findParallelLoops(whileNode->getStmt());
+            break;
+        }
+        case Node::DO:
+            findParallelLoops(static_cast<Do*>(stmt)->getStmt());
+            break;
+        case Node::PARALLEL_FOR:
+        {
+            auto loop = static_cast<ParallelFor*>(stmt);
+            forRegisters[loop] = out->getNumRegisters();
+            for(size_t k = 0; k <= loop->getReductions().size(); k++)
+                out->addRegister("");
+            findParallelLoops(loop->getStmt());
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void BytecodeCompiler::compileParallelLoop(int index, Stmt* stmt)
+{
+    int entry = out->here();
+    out->getParallelLoop(index).entry = entry;
+    int induction;
+    if(stmt->getKind() == Node::PARALLEL_FOR)
+    {
+        auto loop = static_cast<ParallelFor*>(stmt);
+        induction = resolver.getSymbol(loop->getId()->getName()).slot;
+        compileIteration(loop);
+        out->emit(OP_ADDI, {induction, induction, 1});
+    }
+    else
+    {
+        const IndependentLoop& loop = independentLoops.at(static_cast<While*>(stmt));
+        for(Stmt* bodyStmt : loop.body)
+            compileSerial(bodyStmt);
+        induction = resolver.getSymbol(loop.induction).slot;
+        out->emit(OP_ADDI, {induction, induction, loop.step});
+    }
+    out->emit(OP_BLT, {induction, limit, entry});
+    out->emit(OP_HALT, {});
+}
+
+void BytecodeCompiler::compileTaskGraph(int index, const BlockGraph& graph)
+{
+    for(size_t k = 0; k < graph.tasks.size(); k++)
+    {
+        out->getTaskGraph(index).tasks[k].entry = out->here();
+        for(Stmt* stmt : graph.tasks[k])
+            compileSerial(stmt);
+        out->emit(OP_HALT, {});
+    }
+}
+
+int BytecodeCompiler::compileTasks(Block* block)
+{
+    //the tasks run from the program alone: a break can't leave them, and they don't nest
+    if(function || serial)
+        return -1;
+    BlockGraph graph;
+    if(!analyzeBlock(block, graph))
+        return -1;
+
+    TaskGraph tasks;
+    for(size_t k = 0; k < graph.tasks.size(); k++)
+        tasks.tasks.push_back({0, {}, graph.successors[k], 0, false});
+    for(size_t k = 0; k < graph.tasks.size(); k++)
+    {
+        TaskGraph::Task& task = tasks.tasks[k];
+        for(const std::string& name : graph.writes[k])
+        {
+            const Symbol& symbol = resolver.getSymbol(name);
+            if(!symbol.isArray)
+                task.writes.push_back(symbol.slot);
+        }
+        std::sort(task.writes.begin(), task.writes.end());
+        for(int successor : task.successors)
+            tasks.tasks[successor].predecessors++;
+        for(Stmt* stmt : graph.tasks[k])
+            task.prints = task.prints || prints(stmt);
+    }
+    int index = out->addTaskGraph(tasks);
+    taskGraphs.push_back({index, graph});
+    return out->emit(OP_TASKS, {index, 0}) + 2;
+}
+
+//the private variables start at 0 (false), the && and || reductions at true (false): at the end
+//an iteration combines them with their accumulator, a register reserved to the loop
+void BytecodeCompiler::compileIteration(ParallelFor* loop)
+{
+    for(Decl* decl : loop->getPrivates())
+        out->emit(OP_LOADI, {resolver.getSymbol(decl->getId()->getName()).slot, 0});
+    const std::vector<ParallelFor::Reduction>& reductions = loop->getReductions();
+    for(auto& reduction : reductions)
+        if(isLogical(reduction.op))
+            out->emit(OP_LOADI, {resolver.getSymbol(reduction.var->getName()).slot, reduction.op == REDUCE_AND});
+    compileSerial(loop->getStmt());
+    int accumulators = forRegisters.at(loop) + 1;
+    for(size_t k = 0; k < reductions.size(); k++)
+    {
+        if(!isLogical(reductions[k].op))
+            continue;
+        int var = resolver.getSymbol(reductions[k].var->getName()).slot;
+        int skip = out->emit(reductions[k].op == REDUCE_AND ? OP_JNZ : OP_JZ, {var, 0}) + 2;
+        out->emit(OP_LOADI, {accumulators + static_cast<int>(k), reductions[k].op == REDUCE_OR});
+        out->patch(skip, out->here());
+    }
+}
+
+void BytecodeCompiler::compileSerial(Stmt* stmt)
+{
+    bool wasSerial = serial;
+    serial = true;
+    compileStmt(stmt);
+    serial = wasSerial;
+}
+
+void BytecodeCompiler::compileBlock(Block* block)
+{
+    for(Decls* decls = block->getDecls(); decls; decls = decls->getDecls())
+    {
+        //the locals of a function are zeroed by its call
+        if(decls->getDecl()->getId()->getLocal() >= 0)
+            continue;
+        const Symbol& symbol = resolver.getSymbol(decls->getDecl()->getId()->getName());
+        //scalars live in registers which are already zero, arrays are allocated when declared
+        if(symbol.isArray)
+            out->emit(OP_DECLA, {symbol.slot});
+    }
+    //a task graph may run the statements instead, starting from the same state
+    int toEnd = compileTasks(block);
+    for(Seq* seq = block->getSeq(); seq; seq = seq->getSeq())
+        compileStmt(seq->getStmt());
+    if(toEnd != -1)
+        out->patch(toEnd, out->here());
+}
+
+void BytecodeCompiler::compileStmt(Stmt* stmt)
+{
+    //no temporary survives a statement
+    nextTemp = firstTemp;
+
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+            compileBlock(static_cast<Block*>(stmt));
+            break;
+
+        case Node::SET:
+        {
+            auto set = static_cast<Set*>(stmt);
+            Id* id = set->getId();
+            if(id->getLocal() >= 0)
+                compileExp(set->getExp(), id->getLocal());
+            else if(function)
+            {
+                int value = compileExp(set->getExp());
+                out->emit(OP_GSTORE, {resolver.getSymbol(id->getName()).slot, value});
+            }
+            else
+                compileExp(set->getExp(), resolver.getSymbol(id->getName()).slot);
+            break;
+        }
+
+        case Node::SET_ELEM:
+        {
+            auto setElem = static_cast<SetElem*>(stmt);
+            //the value is evaluated before the index, like in the EvaluationVisitor
+            int value = compileOperand(setElem->getExp(), Resolver::hasCall(setElem->getIndex()));
+            int index = compileExp(setElem->getIndex());
+            out->emit(OP_ASTORE, {resolver.getSymbol(setElem->getId()->getName()).slot, index, value});
+            break;
+        }
+
+        case Node::IF:
+        {
+            auto ifNode = static_cast<If*>(stmt);
+            std::vector<int> skip;
+            compileBranch(ifNode->getCondition(), false, skip);
+            compileStmt(ifNode->getStmt());
+            patchHere(skip);
+            break;
+        }
+
+        case Node::ELSE:
+        {
+            auto elseNode = static_cast<Else*>(stmt);
+            std::vector<int> toFalse;
+            compileBranch(elseNode->getCondition(), false, toFalse);
+            compileStmt(elseNode->getifTrueStmt());
+            int toEnd = out->emit(OP_JMP, {0}) + 1;
+            patchHere(toFalse);
+            compileStmt(elseNode->getifFalseStmt());
+            out->patch(toEnd, out->here());
+            break;
+        }
+
+        case Node::WHILE:
+        {
+            //the condition is placed after the body, so that an iteration costs a single jump
+            auto whileNode = static_cast<While*>(stmt);
+            //an independent loop may run in parallel instead, starting from the same state
+            int toEnd = -1;
+            auto independent = independentLoops.find(whileNode);
+            if(independent != independentLoops.end())
+            {
+                const IndependentLoop& loop = independent->second;
+                ParallelLoop parallel{resolver.getSymbol(loop.induction).slot, loop.step, loop.inclusive,
+                                      limit, 0, loop.maxCoefficient, {}};
+                for(auto& reduction : loop.reductions)
+                    parallel.reductions.push_back({resolver.getSymbol(reduction.first).slot, reduction.second});
+                int index = out->addParallelLoop(parallel);
+                parallelLoops.push_back({index, whileNode});
+                int bound = compileExp(loop.bound);
+                toEnd = out->emit(OP_PARLOOP, {index, bound, 0}) + 3;
+                nextTemp = firstTemp;
+            }
+            int toTest = out->emit(OP_JMP, {0}) + 1;
+            int bodyStart = out->here();
+            breakJumps.push_back({});
+            compileSerial(whileNode->getStmt());
+            out->patch(toTest, out->here());
+            nextTemp = firstTemp;
+            std::vector<int> back;
+            compileBranch(whileNode->getCondition(), true, back);
+            for(int pos : back)
+                out->patch(pos, bodyStart);
+            patchHere(breakJumps.back());
+            breakJumps.pop_back();
+            if(toEnd != -1)
+                out->patch(toEnd, out->here());
+            break;
+        }
+
+        //the + and * reductions add up in their variable, like in the serial loop
+        case Node::PARALLEL_FOR:
+        {
+            auto loop = static_cast<ParallelFor*>(stmt);
+            int induction = resolver.getSymbol(loop->getId()->getName()).slot;
+            int bound = forRegisters.at(loop);
+            int first = compileOperand(loop->getFirst(), Resolver::hasCall(loop->getLast()));
+            compileExp(loop->getLast(), bound);
+            if(first != induction)
+                out->emit(OP_MOV, {induction, first});
+            ParallelLoop parallel{induction, 1, false, limit, 0, 0, {}, true, prints(loop->getStmt())};
+            const std::vector<ParallelFor::Reduction>& reductions = loop->getReductions();
+            for(size_t k = 0; k < reductions.size(); k++)
+            {
+                int var = resolver.getSymbol(reductions[k].var->getName()).slot;
+                int accumulator = bound + 1 + k;
+                if(isLogical(reductions[k].op))
+                    out->emit(OP_MOV, {accumulator, var});
+                parallel.reductions.push_back({isLogical(reductions[k].op) ? accumulator : var, reductions[k].op});
+            }
+            int index = out->addParallelLoop(parallel);
+            parallelLoops.push_back({index, loop});
+            int toEnd = out->emit(OP_PARLOOP, {index, bound, 0}) + 3;
+            int toTest = out->emit(OP_JMP, {0}) + 1;
+            int bodyStart = out->here();
+            compileIteration(loop);
+            out->emit(OP_ADDI, {induction, induction, 1});
+            out->patch(toTest, out->here());
+            if(isLiteral(loop->getLast()))
+                out->emit(OP_BLTI, {induction, literalValue(loop->getLast()), bodyStart});
+            else
+                out->emit(OP_BLT, {induction, bound, bodyStart});
+            out->patch(toEnd, out->here());
+            for(size_t k = 0; k < reductions.size(); k++)
+                if(isLogical(reductions[k].op))
+                    out->emit(OP_MOV, {resolver.getSymbol(reductions[k].var->getName()).slot, bound + 1 + static_cast<int>(k)});
+            break;
+        }
+
+        case Node::DO:
+        {
+            auto doNode = static_cast<Do*>(stmt);
+            int bodyStart = out->here();
+            breakJumps.push_back({});
+            compileSerial(doNode->getStmt());
+            nextTemp = firstTemp;
+            std::vector<int> back;
+            compileBranch(doNode->getCondition(), true, back);
+            for(int pos : back)
+                out->patch(pos, bodyStart);
+            patchHere(breakJumps.back());
+            breakJumps.pop_back();
+            break;
+        }
+
+        case Node::BREAK:
+            breakJumps.back().push_back(out->emit(OP_JMP, {0}) + 1);
+            break;
+
+        case Node::PRINT:
+        {
+            Expression* exp = static_cast<Print*>(stmt)->getExp();
+            int value = compileExp(exp);
+            out->emit(resolver.typeOf(exp) == Type::INT ? OP_PRINTI : OP_PRINTB, {value});
+            break;
+        }
+
+        case Node::RETURN:
+        {
+            auto returnNode = static_cast<Return*>(stmt);
+            Call* call = returnNode->getTailCall(function);
+            if(call)
+            {
+                int first = compileArgs(call);
+                out->emit(OP_TAILCALL, {functionIndex.at(call->getFunction()), first});
+            }
+            else
+            {
+                int value = compileExp(returnNode->getExp());
+                out->emit(OP_RET, {value});
+            }
+            break;
+        }
+
+        default:
+            throw CompileError("Invalid statement");
+    }
+}
+
+int BytecodeCompiler::compileExp(Expression* exp, int dest)
+{
+    switch(exp->getKind())
+    {
+        case Node::FUSED:
+            return compileExp(static_cast<Fused*>(exp)->getOriginal(), dest);
+
+        case Node::INT_CONSTANT:
+        case Node::BOOL_CONSTANT:
+        {
+            int d = dest != -1 ? dest : newTemp();
+            out->emit(OP_LOADI, {d, literalValue(exp)});
+            return d;
+        }
+
+        case Node::ID:
+        {
+            auto id = static_cast<Id*>(exp);
+            int reg;
+            if(id->getLocal() >= 0)
+                reg = id->getLocal();
+            else if(function)
+            {
+                //the variables of the program are out of the frame
+                int d = dest != -1 ? dest : newTemp();
+                out->emit(OP_GLOAD, {d, resolver.getSymbol(id->getName()).slot});
+                return d;
+            }
+            else
+                reg = resolver.getSymbol(id->getName()).slot;
+            if(dest == -1 || dest == reg)
+                return reg;
+            out->emit(OP_MOV, {dest, reg});
+            return dest;
+        }
+
+        case Node::ACCESS:
+        {
+            auto access = static_cast<Access*>(exp);
+            int index = compileExp(access->getIndex());
+            int d = dest != -1 ? dest : newTemp();
+            out->emit(OP_ALOAD, {d, resolver.getSymbol(access->getId()->getName()).slot, index});
+            return d;
+        }
+
+        //every subscript is evaluated before any of them is checked, then each OP_INDEX
+        //folds the next one into the position computed so far
+        case Node::INDEX:
+        {
+            auto index = static_cast<Index*>(exp);
+            const Symbol& array = resolver.getSymbol(index->getId()->getName());
+            std::vector<int> subscripts;
+            const std::vector<Expression*>& exps = index->getSubscripts();
+            for(size_t k = 0; k < exps.size(); k++)
+                subscripts.push_back(compileOperand(exps[k], std::any_of(exps.begin() + k + 1, exps.end(), Resolver::hasCall)));
+            int d = dest != -1 ? dest : newTemp();
+            //dest can be read by the subscripts still to be folded
+            int partial = subscripts.size() > 2 ? newTemp() : d;
+            int left = subscripts[0];
+            int cells = array.dims[0];
+            for(size_t k = 1; k < subscripts.size(); k++)
+            {
+                int target = k + 1 == subscripts.size() ? d : partial;
+                out->emit(OP_INDEX, {target, left, subscripts[k], cells, array.dims[k], array.slot});
+                left = target;
+                cells *= array.dims[k];
+            }
+            return d;
+        }
+
+        case Node::UNARY:
+        {
+            int a = compileExp(static_cast<Unary*>(exp)->getExp());
+            int d = dest != -1 ? dest : newTemp();
+            out->emit(OP_NEG, {d, a});
+            return d;
+        }
+
+        case Node::NOT:
+        {
+            int a = compileExp(static_cast<Not*>(exp)->getExp());
+            int d = dest != -1 ? dest : newTemp();
+            out->emit(OP_NOT, {d, a});
+            return d;
+        }
+
+        case Node::AND:
+        case Node::OR:
+        {
+            //the result is built in a temporary: dest could be read by the right operand
+            Expression* left;
+            Expression* right;
+            if(exp->getKind() == Node::AND)
+            {
+                left = static_cast<And*>(exp)->getLeftExp();
+                right = static_cast<And*>(exp)->getRightExp();
+            }
+            else
+            {
+                left = static_cast<Or*>(exp)->getLeftExp();
+                right = static_cast<Or*>(exp)->getRightExp();
+            }
+            int t = newTemp();
+            compileExp(left, t);
+            int toEnd = out->emit(exp->getKind() == Node::AND ? OP_JZ : OP_JNZ, {t, 0}) + 2;
+            compileExp(right, t);
+            out->patch(toEnd, out->here());
+            if(dest == -1)
+                return t;
+            out->emit(OP_MOV, {dest, t});
+            return dest;
+        }
+
+        case Node::REL:
+        {
+            auto rel = static_cast<Rel*>(exp);
+            const OpCode ops[] = {OP_GT, OP_GE, OP_LT, OP_LE};    //same order of Rel::OpCode
+            int a = compileOperand(rel->getLeftExp(), Resolver::hasCall(rel->getRightExp()));
+            int b = compileExp(rel->getRightExp());
+            int d = dest != -1 ? dest : newTemp();
+            out->emit(ops[rel->getOp()], {d, a, b});
+            return d;
+        }
+
+        case Node::ARITHM:
+        {
+            auto arithm = static_cast<Arithm*>(exp);
+            Expression* left = arithm->getLeftExp();
+            Expression* right = arithm->getRightExp();
+            Op::BinOpCode op = arithm->getOp();
+
+            //additions and multiplications by a literal take it as immediate operand
+            if((op == Op::ADD || op == Op::SUB || op == Op::MUL) && right->getKind() == Node::INT_CONSTANT)
+            {
+                int32_t imm = literalValue(right);
+                if(op == Op::SUB)
+                    imm = static_cast<int32_t>(0u - static_cast<uint32_t>(imm));
+                int a = compileExp(left);
+                int d = dest != -1 ? dest : newTemp();
+                out->emit(op == Op::MUL ? OP_MULI : OP_ADDI, {d, a, imm});
+                return d;
+            }
+            if((op == Op::ADD || op == Op::MUL) && left->getKind() == Node::INT_CONSTANT)
+            {
+                int a = compileExp(right);
+                int d = dest != -1 ? dest : newTemp();
+                out->emit(op == Op::MUL ? OP_MULI : OP_ADDI, {d, a, literalValue(left)});
+                return d;
+            }
+
+            const OpCode ops[] = {OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_EQ, OP_NE};  //same order of Op::BinOpCode
+            int a = compileOperand(left, Resolver::hasCall(right));
+            int b = compileExp(right);
+            int d = dest != -1 ? dest : newTemp();
+            out->emit(ops[op], {d, a, b});
+            return d;
+        }
+
+        case Node::CALL:
+        {
+            auto call = static_cast<Call*>(exp);
+            int first = compileArgs(call);
+            int d = dest != -1 ? dest : newTemp();
+            out->emit(OP_CALL, {d, functionIndex.at(call->getFunction()), first});
+            return d;
+        }
+
+        default:
+            throw CompileError("Invalid expression");
+    }
+}
+
+//in a function the variables that a call may change are out of its frame, and are loaded in temporaries
+int BytecodeCompiler::compileOperand(Expression* exp, bool callFollows)
+{
+    int reg = compileExp(exp);
+    if(!callFollows || function || reg >= firstTemp)
+        return reg;
+    int t = newTemp();
+    out->emit(OP_MOV, {t, reg});
+    return t;
+}
+
+int BytecodeCompiler::compileArgs(Call* call)
+{
+    const std::vector<Expression*>& args = call->getArgs();
+    int first = nextTemp;
+    for(size_t k = 0; k < args.size(); k++)
+        newTemp();
+    for(size_t k = 0; k < args.size(); k++)
+        compileExp(args[k], first + k);
+    return first;
+}
+
+void BytecodeCompiler::compileBranch(Expression* cond, bool jumpIf, std::vector<int>& jumps)
+{
+    switch(cond->getKind())
+    {
+        case Node::FUSED:
+            compileBranch(static_cast<Fused*>(cond)->getOriginal(), jumpIf, jumps);
+            return;
+
+        case Node::BOOL_CONSTANT:
+            if(static_cast<boolConstant*>(cond)->getBool() == jumpIf)
+                jumps.push_back(out->emit(OP_JMP, {0}) + 1);
+            return;
+
+        case Node::NOT:
+            compileBranch(static_cast<Not*>(cond)->getExp(), !jumpIf, jumps);
+            return;
+
+        case Node::AND:
+        {
+            auto andNode = static_cast<And*>(cond);
+            if(!jumpIf)
+            {
+                compileBranch(andNode->getLeftExp(), false, jumps);
+                compileBranch(andNode->getRightExp(), false, jumps);
+            }
+            else
+            {
+                std::vector<int> skip;
+                compileBranch(andNode->getLeftExp(), false, skip);
+                compileBranch(andNode->getRightExp(), true, jumps);
+                patchHere(skip);
+            }
+            return;
+        }
+
+        case Node::OR:
+        {
+            auto orNode = static_cast<Or*>(cond);
+            if(jumpIf)
+            {
+                compileBranch(orNode->getLeftExp(), true, jumps);
+                compileBranch(orNode->getRightExp(), true, jumps);
+            }
+            else
+            {
+                std::vector<int> skip;
+                compileBranch(orNode->getLeftExp(), true, skip);
+                compileBranch(orNode->getRightExp(), false, jumps);
+                patchHere(skip);
+            }
+            return;
+        }
+
+        default:
+            break;
+    }
+
+    Relation rel;
+    Expression* left;
+    Expression* right;
+    if(asRelation(cond, rel, left, right))
+    {
+        if(!jumpIf)
+            rel = negated[rel];
+        //a literal has no side effects, so it can be moved to the right
+        if(isLiteral(left) && !isLiteral(right))
+        {
+            std::swap(left, right);
+            rel = mirrored[rel];
+        }
+        int a = compileOperand(left, Resolver::hasCall(right));
+        if(isLiteral(right))
+        {
+            jumps.push_back(out->emit(branchImmOps[rel], {a, literalValue(right), 0}) + 3);
+            return;
+        }
+        int b = compileExp(right);
+        jumps.push_back(out->emit(branchOps[rel], {a, b, 0}) + 3);
+        return;
+    }
+
+    int a = compileExp(cond);
+    jumps.push_back(out->emit(jumpIf ? OP_JNZ : OP_JZ, {a, 0}) + 2);
+}
@@ -0,0 +1,98 @@
+#ifndef BYTECODE_COMPILER_H
+#define BYTECODE_COMPILER_H
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Node.h"
+#include "Bytecode.h"
+#include "Resolver.h"
+#include "LoopParallelizer.h"
+#include "TaskGraph.h"
+
+//Translates a resolved Program into register based bytecode. The parallel fors, and the loops whose
+//iterations are independent, are also compiled as parallel loops (see ParallelLoop), and the blocks
+//of the program outside of loops whose loops can run at the same time as task graphs (see TaskGraph).
+//The code of the functions follows the one of the program, with their loops left serial.
+//Throws CompileError if the Resolver rejects the program
+class BytecodeCompiler {
+public:
+    BytecodeCompiler() : out{nullptr}, firstTemp{0}, nextTemp{0}, serial{false}, limit{0}, function{nullptr}, frameSize{0} {}
+    ~BytecodeCompiler() = default;
+    BytecodeCompiler(BytecodeCompiler const&) = delete;
+    BytecodeCompiler& operator=(BytecodeCompiler const&) = delete;
+
+    BytecodeProgram compile(Program* program);
+
+    //compiles a single loop of a running program (see Resolver::resolveLoop). The variables in
+    //declared take the first registers, and the arrays the first array slots, in their order
+    BytecodeProgram compileLoop(Stmt* loop, const std::vector<Symbol>& declared);
+
+private:
+    Resolver resolver;
+    BytecodeProgram* out;
+
+    //temporaries are allocated like a stack, after the registers of the variables
+    int firstTemp;
+    int nextTemp;
+
+    //for every enclosing loop, the positions of the jumps emitted by its breaks
+    std::vector<std::vector<int>> breakJumps;
+
+    //the task graphs whose task code is compiled after the end of the program
+    std::vector<std::pair<int, BlockGraph>> taskGraphs;
+    //the code being compiled is in a loop or in a task, where the blocks run serially
+    bool serial;
+    //the independent loops of the code being compiled, and the parallel loops whose chunk code
+    //is compiled after the end of the program
+    std::unordered_map<While*, IndependentLoop> independentLoops;
+    std::vector<std::pair<int, Stmt*>> parallelLoops;
+    //register of the limit of every parallel loop. A chunk running a nested parallel loop keeps its
+    //own, as the chunks of the nested loop run on copies of its registers
+    int limit;
+    //the first of the registers reserved to a parallel for: its bound, then one for each reduction
+    std::unordered_map<ParallelFor*, int> forRegisters;
+
+    //index of every function among the FunctionInfo of the program
+    std::unordered_map<Function*, int> functionIndex;
+    //the function being compiled, nullptr for the code of the program, and the size of its frame so far
+    Function* function;
+    int frameSize;
+
+    //finds the independent loops and reserves the registers of the parallel fors
+    void findParallelLoops(Stmt* stmt);
+    void compileParallelLoop(int loop, Stmt* stmt);
+    void compileTaskGraph(int graph, const BlockGraph& tasks);
+    //emits OP_TASKS if block is worth a task graph, and returns the position of its target or -1
+    int compileTasks(Block* block);
+    //stmt is in a loop or in a task
+    void compileSerial(Stmt* stmt);
+    //an iteration of a parallel for, without the increment of its index
+    void compileIteration(ParallelFor* loop);
+
+    //code of a resolved program or loop
+    BytecodeProgram generate(Stmt* stmt, const std::vector<Function*>& functions = {});
+    void compileFunction(int index, Function* function);
+
+    int newTemp();
+    void patchHere(const std::vector<int>& jumps);
+
+    void compileBlock(Block* block);
+    void compileStmt(Stmt* stmt);
+
+    //compiles exp and returns the register holding its value. If dest is not -1
+    //the value is left in dest
+    int compileExp(Expression* exp, int dest = -1);
+    //like compileExp, for an operand read only once the operands after it are evaluated: callFollows
+    //is true if they call a function, which may change the variable read by the operand
+    int compileOperand(Expression* exp, bool callFollows);
+    //evaluates the arguments of a call in consecutive registers, and returns the first of them
+    int compileArgs(Call* call);
+
+    //emits the jumps taken when cond evaluates to jumpIf, appending the positions
+    //of their targets to jumps
+    void compileBranch(Expression* cond, bool jumpIf, std::vector<int>& jumps);
+};
+
+#endif
@@ -0,0 +1,485 @@
+#include <algorithm>
+
+#include "CTranslator.h"
+#include "Exceptions.h"
+
+namespace {
+
+std::string scalarName(const std::string& name) {return "v_" + name;}
+std::string arrayName(const std::string& name) {return "a_" + name;}
+std::string initializedName(const std::string& name) {return "i_" + name;}
+
+bool isConstant(Expression* exp)
+{
+    return exp->getKind() == Node::INT_CONSTANT || exp->getKind() == Node::BOOL_CONSTANT;
+}
+
+const char* preamble =
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "\n"
+    "static inline void fail(const char* message)\n"
+    "{\n"
+    "    fflush(stdout);\n"
+    "    fprintf(stderr, \"Errore nella valutazione\\n%s\\n\", message);\n"
+    "    exit(EXIT_FAILURE);\n"
+    "}\n"
+    "\n"
+    "/* wrap-around arithmetic, like the interpreter */\n"
+    "static inline int32_t wrap_add(int32_t l, int32_t r) {return (int32_t)((uint32_t)l + (uint32_t)r);}\n"
+    "static inline int32_t wrap_sub(int32_t l, int32_t r) {return (int32_t)((uint32_t)l - (uint32_t)r);}\n"
+    "static inline int32_t wrap_mul(int32_t l, int32_t r) {return (int32_t)((uint32_t)l * (uint32_t)r);}\n"
+    "\n";
+
+}
+
+void CTranslator::translate(Program* program, std::ostream& out)
+{
+    resolver.resolve(program);
+    functions = program->getFunctions();
+    indent = 2;
+    for(Function* function : functions)
+        translateFunction(function);
+    std::vector<std::string> functionLines;
+    functionLines.swap(lines);
+    indent = 1;
+    translateBlock(program->getBlock());
+
+    out << preamble;
+    for(auto& var : resolver.getScalars())
+        out << "static int32_t " << scalarName(var.name) << ";" << std::endl;
+    for(auto& array : resolver.getArrays())
+    {
+        //C has no empty arrays, an array of size 0 keeps a cell that is never accessed
+        int cells = array.size > 0 ? array.size : 1;
+        out << "static int32_t " << arrayName(array.name) << "[" << cells << "];" << std::endl;
+        out << "static unsigned char " << initializedName(array.name) << "[" << cells << "];" << std::endl;
+    }
+
+    //a tail call jumps back to the switch, with its arguments in next
+    if(!functions.empty())
+    {
+        size_t maxParams = 1;
+        for(Function* function : functions)
+            maxParams = std::max<size_t>(maxParams, function->getNumParams());
+        out << std::endl << "static int call_depth;" << std::endl << std::endl
+            << "static int32_t call(int fn, const int32_t* args)" << std::endl << "{" << std::endl;
+        if(tailCalls)
+            out << "    int32_t next[" << maxParams << "];" << std::endl << "dispatch:" << std::endl;
+        out << "    switch (fn) {" << std::endl;
+        for(auto& l : functionLines)
+            out << l << std::endl;
+        out << "    }" << std::endl << "    return 0;" << std::endl << "}" << std::endl;
+    }
+
+    out << std::endl << "int main(void)" << std::endl << "{" << std::endl;
+    for(auto& l : lines)
+        out << l << std::endl;
+    if(exitUsed)
+        out << "end:" << std::endl;
+    out << "    return 0;" << std::endl << "}" << std::endl;
+}
+
+void CTranslator::line(const std::string& text)
+{
+    lines.push_back(std::string(4 * indent, ' ') + text);
+}
+
+std::string CTranslator::newTemp()
+{
+    return "t" + std::to_string(nextTemp++);
+}
+
+int CTranslator::functionCase(Function* function)
+{
+    return std::find(functions.begin(), functions.end(), function) - functions.begin();
+}
+
+//the locals are C locals of the case, the parameters copied from the arguments
+void CTranslator::translateFunction(Function* function)
+{
+    current = function;
+    indent = 1;
+    line("case " + std::to_string(functionCase(function)) + ": {    /* " + function->getName() + " */");
+    indent = 2;
+    const std::vector<Decl*>& locals = function->getLocals();
+    for(size_t k = 0; k < locals.size(); k++)
+    {
+        std::string init = static_cast<int>(k) < function->getNumParams() ? "args[" + std::to_string(k) + "]" : "0";
+        line("int32_t " + scalarName(locals[k]->getId()->getName()) + " = " + init + ";");
+    }
+    translateBlock(function->getBody());
+    line("fail(\"Function " + function->getName() + " ended without returning a value\");");
+    indent = 1;
+    line("}");
+    current = nullptr;
+}
+
+void CTranslator::translateBlock(Block* block)
+{
+    //scalars and arrays are static globals, so declarations need no code
+    for(Seq* seq = block->getSeq(); seq; seq = seq->getSeq())
+        translateStmt(seq->getStmt());
+}
+
+void CTranslator::translateBody(Stmt* stmt)
+{
+    indent++;
+    translateStmt(stmt);
+    indent--;
+}
+
+void CTranslator::translateStmt(Stmt* stmt)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+            translateBlock(static_cast<Block*>(stmt));
+            break;
+
+        case Node::SET:
+        {
+            auto set = static_cast<Set*>(stmt);
+            std::string value = translateExp(set->getExp());
+            line(scalarName(set->getId()->getName()) + " = " + value + ";");
+            break;
+        }
+
+        case Node::SET_ELEM:
+        {
+            auto setElem = static_cast<SetElem*>(stmt);
+            const Symbol& array = resolver.getSymbol(setElem->getId()->getName());
+            //the value is evaluated before the index, like in the EvaluationVisitor
+            std::string value = translateOperand(setElem->getExp(), Resolver::hasCall(setElem->getIndex()));
+            std::string index = newTemp();
+            line("int32_t " + index + " = " + translateExp(setElem->getIndex()) + ";");
+            line("if ((uint32_t)" + index + " >= " + std::to_string(array.size) + "u) fail(\"Out of bounds error on "
+                 + array.name + " array\");");
+            line(arrayName(array.name) + "[" + index + "] = " + value + ";");
+            line(initializedName(array.name) + "[" + index + "] = 1;");
+            break;
+        }
+
+        case Node::IF:
+        {
+            auto ifNode = static_cast<If*>(stmt);
+            line("if (" + translateExp(ifNode->getCondition()) + ") {");
+            translateBody(ifNode->getStmt());
+            line("}");
+            break;
+        }
+
+        case Node::ELSE:
+        {
+            auto elseNode = static_cast<Else*>(stmt);
+            line("if (" + translateExp(elseNode->getCondition()) + ") {");
+            translateBody(elseNode->getifTrueStmt());
+            line("} else {");
+            translateBody(elseNode->getifFalseStmt());
+            line("}");
+            break;
+        }
+
+        case Node::WHILE:
+        case Node::DO:
+        {
+            Expression* condition;
+            Stmt* body;
+            if(stmt->getKind() == Node::WHILE)
+            {
+                condition = static_cast<While*>(stmt)->getCondition();
+                body = static_cast<While*>(stmt)->getStmt();
+            }
+            else
+            {
+                condition = static_cast<Do*>(stmt)->getCondition();
+                body = static_cast<Do*>(stmt)->getStmt();
+            }
+
+            //the checks of the condition are emitted inside the loop, which then
+            //becomes an endless one left when the condition is false
+            line("for (;;) {");
+            loopDepth++;
+            indent++;
+            if(stmt->getKind() == Node::DO)
+                translateStmt(body);
+            std::string cond = translateExp(condition);
+            line("if (!(" + cond + ")) break;");
+            if(stmt->getKind() == Node::WHILE)
+                translateStmt(body);
+            indent--;
+            loopDepth--;
+            line("}");
+            break;
+        }
+
+        case Node::PARALLEL_FOR:
+            translateParallelFor(static_cast<ParallelFor*>(stmt));
+            break;
+
+        case Node::RETURN:
+        {
+            auto returnNode = static_cast<Return*>(stmt);
+            Call* call = returnNode->getTailCall(current);
+            if(!call)
+            {
+                line("return " + translateExp(returnNode->getExp()) + ";");
+                break;
+            }
+            std::vector<std::string> args = translateArgs(call);
+            for(size_t k = 0; k < args.size(); k++)
+                line("next[" + std::to_string(k) + "] = " + args[k] + ";");
+            line("args = next;");
+            line("fn = " + std::to_string(functionCase(call->getFunction())) + ";");
+            line("goto dispatch;");
+            tailCalls = true;
+            break;
+        }
+
+        case Node::BREAK:
+            if(loopDepth > 0)
+                line("break;");
+            //the function stops, like at the end of its body
+            else if(current)
+                line("fail(\"Function " + current->getName() + " ended without returning a value\");");
+            else
+            {
+                line("goto end;");
+                exitUsed = true;
+            }
+            break;
+
+        case Node::PRINT:
+        {
+            Expression* exp = static_cast<Print*>(stmt)->getExp();
+            std::string value = translateExp(exp);
+            if(resolver.typeOf(exp) == Type::INT)
+                line("printf(\"%d\\n\", (int)" + value + ");");
+            else
+                line("printf(\"%d\\n\", " + value + " != 0);");
+            break;
+        }
+
+        default:
+            throw CompileError("Invalid statement");
+    }
+}
+
+//the iterations run in order. The logical reductions start every iteration at the value that
+//doesn't change their total, like in the EvaluationVisitor
+void CTranslator::translateParallelFor(ParallelFor* loop)
+{
+    std::string first = newTemp();
+    line("int32_t " + first + " = " + translateExp(loop->getFirst()) + ";");
+    std::string last = newTemp();
+    line("int32_t " + last + " = " + translateExp(loop->getLast()) + ";");
+    std::vector<std::pair<std::string, ParallelFor::Reduction>> logical;
+    for(auto& reduction : loop->getReductions())
+    {
+        if(reduction.op != REDUCE_AND && reduction.op != REDUCE_OR)
+            continue;
+        logical.push_back({newTemp(), reduction});
+        line("int32_t " + logical.back().first + " = " + scalarName(reduction.var->getName()) + ";");
+    }
+
+    std::string i = newTemp();
+    line("for (int32_t " + i + " = " + first + "; " + i + " < " + last + "; " + i + "++) {");
+    loopDepth++;
+    indent++;
+    line(scalarName(loop->getId()->getName()) + " = " + i + ";");
+    for(Decl* decl : loop->getPrivates())
+        line(scalarName(decl->getId()->getName()) + " = 0;");
+    for(auto& reduction : logical)
+        line(scalarName(reduction.second.var->getName()) + (reduction.second.op == REDUCE_AND ? " = 1;" : " = 0;"));
+    translateStmt(loop->getStmt());
+    for(auto& reduction : logical)
+    {
+        line(reduction.first + " = " + reduction.first + (reduction.second.op == REDUCE_AND ? " && " : " || ")
+             + scalarName(reduction.second.var->getName()) + ";");
+    }
+    indent--;
+    loopDepth--;
+    line("}");
+    for(auto& reduction : logical)
+        line(scalarName(reduction.second.var->getName()) + " = " + reduction.first + ";");
+    line(scalarName(loop->getId()->getName()) + " = " + first + " < " + last + " ? " + last + " : " + first + ";");
+}
+
+std::vector<std::string> CTranslator::translateArgs(Call* call)
+{
+    std::vector<std::string> args;
+    for(Expression* arg : call->getArgs())
+    {
+        std::string value = translateExp(arg);
+        args.push_back(newTemp());
+        line("int32_t " + args.back() + " = " + value + ";");
+    }
+    return args;
+}
+
+std::string CTranslator::translateOperand(Expression* exp, bool callFollows)
+{
+    std::string value = translateExp(exp);
+    if(!callFollows || isConstant(exp))
+        return value;
+    std::string t = newTemp();
+    line("int32_t " + t + " = " + value + ";");
+    return t;
+}
+
+std::string CTranslator::translateBinary(const std::string& left, const std::string& right, Op::BinOpCode op)
+{
+    switch(op)
+    {
+        case Op::ADD:
+            return "wrap_add(" + left + ", " + right + ")";
+        case Op::SUB:
+            return "wrap_sub(" + left + ", " + right + ")";
+        case Op::MUL:
+            return "wrap_mul(" + left + ", " + right + ")";
+        case Op::DIV:
+        {
+            line("if (" + right + " == 0) fail(\"Division by 0\");");
+            std::string t = newTemp();
+            line("int32_t " + t + " = " + left + " / " + right + ";");
+            return t;
+        }
+        //bools are 0/1 too, so both types compare the same way
+        case Op::EQ:
+            return "(" + left + " == " + right + ")";
+        case Op::NOT_EQ:
+            return "(" + left + " != " + right + ")";
+    }
+    throw CompileError("Invalid expression");
+}
+
+std::string CTranslator::translateExp(Expression* exp)
+{
+    switch(exp->getKind())
+    {
+        case Node::FUSED:
+            return translateExp(static_cast<Fused*>(exp)->getOriginal());
+
+        case Node::INT_CONSTANT:
+            return std::to_string(static_cast<intConstant*>(exp)->getInt());
+
+        case Node::BOOL_CONSTANT:
+            return static_cast<boolConstant*>(exp)->getBool() ? "1" : "0";
+
+        case Node::ID:
+            return scalarName(static_cast<Id*>(exp)->getName());
+
+        case Node::ACCESS:
+        {
+            auto access = static_cast<Access*>(exp);
+            const Symbol& array = resolver.getSymbol(access->getId()->getName());
+            std::string index = newTemp();
+            line("int32_t " + index + " = " + translateExp(access->getIndex()) + ";");
+            line("if ((uint32_t)" + index + " >= " + std::to_string(array.size) + "u) fail(\"Out of bounds error on "
+                 + array.name + " array\");");
+            line("if (!" + initializedName(array.name) + "[" + index
+                 + "]) fail(\"Trying to retrieve a cell from an array which has not been declared\");");
+            return arrayName(array.name) + "[" + index + "]";
+        }
+
+        //the subscripts are evaluated in order, then checked by a single test
+        case Node::INDEX:
+        {
+            auto index = static_cast<Index*>(exp);
+            const Symbol& array = resolver.getSymbol(index->getId()->getName());
+            std::vector<std::string> subscripts;
+            for(Expression* subscript : index->getSubscripts())
+            {
+                subscripts.push_back(newTemp());
+                line("uint32_t " + subscripts.back() + " = (uint32_t)" + translateExp(subscript) + ";");
+            }
+            std::string check;
+            std::string offset = subscripts[0];
+            for(size_t k = 0; k < subscripts.size(); k++)
+            {
+                check += (k ? " | (" : "(") + subscripts[k] + " >= " + std::to_string(array.dims[k]) + "u)";
+                if(k)
+                    offset = "(" + offset + " * " + std::to_string(array.dims[k]) + "u + " + subscripts[k] + ")";
+            }
+            line("if (" + check + ") fail(\"Out of bounds error on " + array.name + " array\");");
+            return "(int32_t)" + offset;
+        }
+
+        case Node::UNARY:
+            return "wrap_sub(0, " + translateExp(static_cast<Unary*>(exp)->getExp()) + ")";
+
+        case Node::NOT:
+            return "(!" + translateExp(static_cast<Not*>(exp)->getExp()) + ")";
+
+        case Node::AND:
+        case Node::OR:
+        {
+            bool isAnd = exp->getKind() == Node::AND;
+            Expression* leftExp = isAnd ? static_cast<And*>(exp)->getLeftExp() : static_cast<Or*>(exp)->getLeftExp();
+            Expression* rightExp = isAnd ? static_cast<And*>(exp)->getRightExp() : static_cast<Or*>(exp)->getRightExp();
+            std::string left = translateExp(leftExp);
+
+            size_t before = lines.size();
+            indent++;
+            std::string right = translateExp(rightExp);
+            indent--;
+            if(lines.size() == before)
+                return "(" + left + (isAnd ? " && " : " || ") + right + ")";
+
+            //the checks of the right operand must run only when it is evaluated
+            std::vector<std::string> rightLines(lines.begin() + before, lines.end());
+            lines.resize(before);
+            std::string t = newTemp();
+            line("int32_t " + t + " = " + left + ";");
+            line(std::string("if (") + (isAnd ? "" : "!") + t + ") {");
+            lines.insert(lines.end(), rightLines.begin(), rightLines.end());
+            indent++;
+            line(t + " = " + right + ";");
+            indent--;
+            line("}");
+            return t;
+        }
+
+        case Node::REL:
+        {
+            auto rel = static_cast<Rel*>(exp);
+            const char* ops[] = {" > ", " >= ", " < ", " <= "};    //same order of Rel::OpCode
+            std::string left = translateOperand(rel->getLeftExp(), Resolver::hasCall(rel->getRightExp()));
+            std::string right = translateExp(rel->getRightExp());
+            return "(" + left + ops[rel->getOp()] + right + ")";
+        }
+
+        case Node::ARITHM:
+        {
+            auto arithm = static_cast<Arithm*>(exp);
+            std::string left = translateOperand(arithm->getLeftExp(), Resolver::hasCall(arithm->getRightExp()));
+            std::string right = translateExp(arithm->getRightExp());
+            return translateBinary(left, right, arithm->getOp());
+        }
+
+        case Node::CALL:
+        {
+            auto call = static_cast<Call*>(exp);
+            std::vector<std::string> args = translateArgs(call);
+            std::string list = "NULL";
+            if(!args.empty())
+            {
+                list = "(const int32_t[]){" + args[0];
+                for(size_t k = 1; k < args.size(); k++)
+                    list += ", " + args[k];
+                list += "}";
+            }
+            line("if (call_depth == " + std::to_string(Function::MAX_CALL_DEPTH) + ") fail(\"Stack overflow calling "
+                 + call->getName() + "\");");
+            std::string t = newTemp();
+            line("call_depth++;");
+            line("int32_t " + t + " = call(" + std::to_string(functionCase(call->getFunction())) + ", " + list + ");");
+            line("call_depth--;");
+            return t;
+        }
+
+        default:
+            throw CompileError("Invalid expression");
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef C_TRANSLATOR_H
+#define C_TRANSLATOR_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "Node.h"
+#include "Resolver.h"
+
+//Translates a resolved Program into a self-contained C source file, to be built with the
+//system compiler. Variables and arrays become static globals, loops become native loops, and
+//the generated code performs the runtime checks of the EvaluationVisitor with its messages.
+//Operations that can fail are computed into temporaries in evaluation order, so that the first
+//error reported is the same of the interpreter.
+//The functions become the cases of a single C function, so that a tail call can jump to the one it
+//calls without growing the C stack, and a parallel for runs its iterations in order.
+//Throws CompileError if the Resolver rejects the program, or if it uses load or store. Unlike the
+//interpreter, which reports a type error when it runs into it, after the output printed before, the
+//translation rejects the whole program even when that code would never run
+class CTranslator {
+public:
+    CTranslator() : indent{1}, nextTemp{0}, loopDepth{0}, exitUsed{false}, current{nullptr}, tailCalls{false} {}
+    ~CTranslator() = default;
+    CTranslator(CTranslator const&) = delete;
+    CTranslator& operator=(CTranslator const&) = delete;
+
+    void translate(Program* program, std::ostream& out);
+
+private:
+    Resolver resolver;
+
+    //lines of the body of main
+    std::vector<std::string> lines;
+    int indent;
+
+    int nextTemp;
+    int loopDepth;
+    //a break outside of any loop jumps to the end of the program
+    bool exitUsed;
+
+    //the functions of the program, numbered by their case, and the one being translated
+    std::vector<Function*> functions;
+    Function* current;
+    //a tail call needs the buffer of the arguments of the next function
+    bool tailCalls;
+
+    void line(const std::string& text);
+    std::string newTemp();
+
+    void translateBlock(Block* block);
+    void translateStmt(Stmt* stmt);
+    //translates a statement as the body of an if or a loop
+    void translateBody(Stmt* stmt);
+    void translateParallelFor(ParallelFor* loop);
+    //the lines of the case of the function
+    void translateFunction(Function* function);
+
+    //returns a C expression without side effects for exp; the checks it needs are
+    //emitted before it as statements
+    std::string translateExp(Expression* exp);
+    //an operand followed by a call is copied into a temporary, since the call may change it
+    std::string translateOperand(Expression* exp, bool callFollows);
+    std::string translateBinary(const std::string& left, const std::string& right, Op::BinOpCode op);
+    //the arguments of a call, evaluated in order into temporaries
+    std::vector<std::string> translateArgs(Call* call);
+    int functionCase(Function* function);
+};
+
+#endif
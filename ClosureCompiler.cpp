@@ -0,0 +1,356 @@
+#include "ClosureCompiler.h"
+#include "Exceptions.h"
+#include "OutputSink.h"
+
+namespace {
+
+bool isLiteral(Expression* exp)
+{
+    return exp->getKind() == Node::INT_CONSTANT || exp->getKind() == Node::BOOL_CONSTANT;
+}
+
+int32_t literalValue(Expression* exp)
+{
+    if(exp->getKind() == Node::INT_CONSTANT)
+        return static_cast<intConstant*>(exp)->getInt();
+    return static_cast<boolConstant*>(exp)->getBool();
+}
+
+}
+
+std::unique_ptr<ClosureProgram> ClosureCompiler::compile(Program* program)
+{
+    resolver.resolve(program);
+
+    std::unique_ptr<ClosureProgram> compiled(new ClosureProgram());
+    compiled->scalars.assign(resolver.getScalars().size(), 0);
+    compiled->arrays.resize(resolver.getArrays().size());
+
+    target = compiled.get();
+    compiled->body = compileBlock(program->getBlock());
+    target = nullptr;
+    return compiled;
+}
+
+int32_t* ClosureCompiler::scalar(Id* id)
+{
+    return &target->scalars[resolver.getSymbol(id->getName()).slot];
+}
+
+RuntimeArray* ClosureCompiler::array(Id* id)
+{
+    return &target->arrays[resolver.getSymbol(id->getName()).slot];
+}
+
+ClosureCompiler::StmtFn ClosureCompiler::compileBlock(Block* block)
+{
+    std::vector<StmtFn> stmts;
+    for(Decls* decls = block->getDecls(); decls; decls = decls->getDecls())
+    {
+        //scalars are already zero, arrays are allocated when declared
+        const Symbol& symbol = resolver.getSymbol(decls->getDecl()->getId()->getName());
+        if(symbol.isArray)
+        {
+            RuntimeArray* a = &target->arrays[symbol.slot];
+            int size = symbol.size;
+            stmts.push_back([a, size] {a->declare(size); return false;});
+        }
+    }
+    for(Seq* seq = block->getSeq(); seq; seq = seq->getSeq())
+        stmts.push_back(compileStmt(seq->getStmt()));
+
+    if(stmts.empty())
+        return [] {return false;};
+    if(stmts.size() == 1)
+        return stmts[0];
+    return [stmts] {
+        for(auto& stmt : stmts)
+            if(stmt())
+                return true;
+        return false;
+    };
+}
+
+ClosureCompiler::StmtFn ClosureCompiler::compileStmt(Stmt* stmt)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+            return compileBlock(static_cast<Block*>(stmt));
+
+        case Node::SET:
+        {
+            auto set = static_cast<Set*>(stmt);
+            int32_t* var = scalar(set->getId());
+            Expression* exp = set->getExp();
+            if(isLiteral(exp))
+            {
+                int32_t value = literalValue(exp);
+                return [var, value] {*var = value; return false;};
+            }
+            ExpFn value = compileExp(exp);
+            return [var, value] {*var = value(); return false;};
+        }
+
+        case Node::SET_ELEM:
+        {
+            auto setElem = static_cast<SetElem*>(stmt);
+            RuntimeArray* a = array(setElem->getId());
+            std::string name = setElem->getId()->getName();
+            ExpFn value = compileExp(setElem->getExp());
+            ExpFn index = compileExp(setElem->getIndex());
+            return [a, name, value, index] {
+                //the value is evaluated before the index, like in the EvaluationVisitor
+                int32_t v = value();
+                uint32_t i = index();
+                if(i >= a->cells.size())
+                    throw EvaluationError("Out of bounds error on " + name + " array");
+                a->cells[i] = v;
+                a->initialized[i] = 1;
+                return false;
+            };
+        }
+
+        case Node::IF:
+        {
+            auto ifNode = static_cast<If*>(stmt);
+            ExpFn cond = compileExp(ifNode->getCondition());
+            StmtFn body = compileStmt(ifNode->getStmt());
+            return [cond, body] {return cond() ? body() : false;};
+        }
+
+        case Node::ELSE:
+        {
+            auto elseNode = static_cast<Else*>(stmt);
+            ExpFn cond = compileExp(elseNode->getCondition());
+            StmtFn ifTrue = compileStmt(elseNode->getifTrueStmt());
+            StmtFn ifFalse = compileStmt(elseNode->getifFalseStmt());
+            return [cond, ifTrue, ifFalse] {return cond() ? ifTrue() : ifFalse();};
+        }
+
+        case Node::WHILE:
+        {
+            auto whileNode = static_cast<While*>(stmt);
+            ExpFn cond = compileExp(whileNode->getCondition());
+            StmtFn body = compileStmt(whileNode->getStmt());
+            return [cond, body] {
+                while(cond())
+                    if(body())
+                        break;
+                return false;
+            };
+        }
+
+        case Node::DO:
+        {
+            auto doNode = static_cast<Do*>(stmt);
+            ExpFn cond = compileExp(doNode->getCondition());
+            StmtFn body = compileStmt(doNode->getStmt());
+            return [cond, body] {
+                do {
+                    if(body())
+                        break;
+                } while(cond());
+                return false;
+            };
+        }
+
+        case Node::BREAK:
+            return [] {return true;};
+
+        case Node::PRINT:
+        {
+            Expression* exp = static_cast<Print*>(stmt)->getExp();
+            ExpFn value = compileExp(exp);
+            if(resolver.typeOf(exp) == Type::INT)
+                return [value] {OutputSink::current().printInt(value()); return false;};
+            return [value] {OutputSink::current().printBool(value() != 0); return false;};
+        }
+
+        default:
+            throw CompileError("Invalid statement");
+    }
+}
+
+template<class Operation>
+ClosureCompiler::ExpFn ClosureCompiler::compileBinary(Expression* left, Expression* right, Operation op)
+{
+    //variables and literals are read in place instead of through a closure of their own
+    if(isLiteral(right))
+    {
+        int32_t r = literalValue(right);
+        if(left->getKind() == Node::ID)
+        {
+            const int32_t* l = scalar(static_cast<Id*>(left));
+            return [l, r, op] {return op(*l, r);};
+        }
+        ExpFn l = compileExp(left);
+        return [l, r, op] {return op(l(), r);};
+    }
+    if(left->getKind() == Node::ID && right->getKind() == Node::ID)
+    {
+        const int32_t* l = scalar(static_cast<Id*>(left));
+        const int32_t* r = scalar(static_cast<Id*>(right));
+        return [l, r, op] {return op(*l, *r);};
+    }
+    ExpFn l = compileExp(left);
+    ExpFn r = compileExp(right);
+    return [l, r, op] {
+        //the left operand is evaluated first
+        int32_t a = l();
+        return op(a, r());
+    };
+}
+
+ClosureCompiler::ExpFn ClosureCompiler::compileExp(Expression* exp)
+{
+    switch(exp->getKind())
+    {
+        case Node::FUSED:
+            return compileExp(static_cast<Fused*>(exp)->getOriginal());
+
+        case Node::INT_CONSTANT:
+        case Node::BOOL_CONSTANT:
+        {
+            int32_t value = literalValue(exp);
+            return [value] {return value;};
+        }
+
+        case Node::ID:
+        {
+            const int32_t* var = scalar(static_cast<Id*>(exp));
+            return [var] {return *var;};
+        }
+
+        case Node::ACCESS:
+        {
+            auto access = static_cast<Access*>(exp);
+            const RuntimeArray* a = array(access->getId());
+            std::string name = access->getId()->getName();
+            ExpFn index = compileExp(access->getIndex());
+            return [a, name, index] {
+                uint32_t i = index();
+                if(i >= a->cells.size())
+                    throw EvaluationError("Out of bounds error on " + name + " array");
+                if(!a->initialized[i])
+                    throw EvaluationError("Trying to retrieve a cell from an array which has not been declared");
+                return a->cells[i];
+            };
+        }
+
+        //the subscripts are all evaluated, and then checked together
+        case Node::INDEX:
+        {
+            auto index = static_cast<Index*>(exp);
+            std::string name = index->getId()->getName();
+            std::vector<int> dims = resolver.getSymbol(name).dims;
+            std::vector<ExpFn> subscripts;
+            for(Expression* subscript : index->getSubscripts())
+                subscripts.push_back(compileExp(subscript));
+            if(dims.size() == 2)
+            {
+                ExpFn row = subscripts[0];
+                ExpFn column = subscripts[1];
+                uint32_t rows = dims[0];
+                uint32_t columns = dims[1];
+                return [row, column, rows, columns, name] {
+                    uint32_t i = row();
+                    uint32_t j = column();
+                    if((i >= rows) | (j >= columns))
+                        throw EvaluationError("Out of bounds error on " + name + " array");
+                    return static_cast<int32_t>(i * columns + j);
+                };
+            }
+            return [subscripts, dims, name] {
+                uint32_t offset = 0;
+                bool outOfBounds = false;
+                for(size_t k = 0; k < subscripts.size(); k++)
+                {
+                    uint32_t subscript = subscripts[k]();
+                    outOfBounds |= subscript >= static_cast<uint32_t>(dims[k]);
+                    offset = offset * dims[k] + subscript;
+                }
+                if(outOfBounds)
+                    throw EvaluationError("Out of bounds error on " + name + " array");
+                return static_cast<int32_t>(offset);
+            };
+        }
+
+        case Node::UNARY:
+        {
+            ExpFn operand = compileExp(static_cast<Unary*>(exp)->getExp());
+            return [operand] {return wrapSub(0, operand());};
+        }
+
+        case Node::NOT:
+        {
+            ExpFn operand = compileExp(static_cast<Not*>(exp)->getExp());
+            return [operand] {return static_cast<int32_t>(!operand());};
+        }
+
+        case Node::AND:
+        {
+            ExpFn l = compileExp(static_cast<And*>(exp)->getLeftExp());
+            ExpFn r = compileExp(static_cast<And*>(exp)->getRightExp());
+            return [l, r] {return static_cast<int32_t>(l() && r());};
+        }
+
+        case Node::OR:
+        {
+            ExpFn l = compileExp(static_cast<Or*>(exp)->getLeftExp());
+            ExpFn r = compileExp(static_cast<Or*>(exp)->getRightExp());
+            return [l, r] {return static_cast<int32_t>(l() || r());};
+        }
+
+        case Node::REL:
+        {
+            auto rel = static_cast<Rel*>(exp);
+            Expression* l = rel->getLeftExp();
+            Expression* r = rel->getRightExp();
+            switch(rel->getOp())
+            {
+                case Rel::MORE:
+                    return compileBinary(l, r, [](int32_t a, int32_t b) -> int32_t {return a > b;});
+                case Rel::MORE_EQ:
+                    return compileBinary(l, r, [](int32_t a, int32_t b) -> int32_t {return a >= b;});
+                case Rel::LESS:
+                    return compileBinary(l, r, [](int32_t a, int32_t b) -> int32_t {return a < b;});
+                case Rel::LESS_EQ:
+                    return compileBinary(l, r, [](int32_t a, int32_t b) -> int32_t {return a <= b;});
+            }
+            break;
+        }
+
+        case Node::ARITHM:
+        {
+            auto arithm = static_cast<Arithm*>(exp);
+            Expression* l = arithm->getLeftExp();
+            Expression* r = arithm->getRightExp();
+            switch(arithm->getOp())
+            {
+                case Op::ADD:
+                    return compileBinary(l, r, [](int32_t a, int32_t b) {return wrapAdd(a, b);});
+                case Op::SUB:
+                    return compileBinary(l, r, [](int32_t a, int32_t b) {return wrapSub(a, b);});
+                case Op::MUL:
+                    return compileBinary(l, r, [](int32_t a, int32_t b) {return wrapMul(a, b);});
+                case Op::DIV:
+                    return compileBinary(l, r, [](int32_t a, int32_t b) {
+                        if(b == 0)
+                            throw EvaluationError("Division by 0");
+                        return a / b;
+                    });
+                //bools are 0/1 too, so both types compare the same way
+                case Op::EQ:
+                    return compileBinary(l, r, [](int32_t a, int32_t b) -> int32_t {return a == b;});
+                case Op::NOT_EQ:
+                    return compileBinary(l, r, [](int32_t a, int32_t b) -> int32_t {return a != b;});
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+    throw CompileError("Invalid expression");
+}
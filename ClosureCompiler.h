@@ -0,0 +1,70 @@
+#ifndef CLOSURE_COMPILER_H
+#define CLOSURE_COMPILER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Node.h"
+#include "Resolver.h"
+#include "Runtime.h"
+
+//A program converted into a tree of closures. Every closure is bound once to the storage of
+//the variables it uses and to the closures of its operands, so running the program performs
+//no type checks, no environment lookups and no visitor dispatch
+class ClosureProgram {
+public:
+    ClosureProgram() = default;
+    ~ClosureProgram() = default;
+    ClosureProgram(ClosureProgram const&) = delete;
+    ClosureProgram& operator=(ClosureProgram const&) = delete;
+
+    void run() {body();}
+
+private:
+    friend class ClosureCompiler;
+
+    //bools are stored as 0/1; closures keep pointers to these elements,
+    //so they are sized once before compiling
+    std::vector<int32_t> scalars;
+    std::vector<RuntimeArray> arrays;
+
+    //returns true if a break left the program
+    std::function<bool()> body;
+};
+
+//Builds the ClosureProgram of a resolved Program.
+//Throws CompileError if the Resolver rejects the program
+class ClosureCompiler {
+public:
+    ClosureCompiler() : target{nullptr} {}
+    ~ClosureCompiler() = default;
+    ClosureCompiler(ClosureCompiler const&) = delete;
+    ClosureCompiler& operator=(ClosureCompiler const&) = delete;
+
+    std::unique_ptr<ClosureProgram> compile(Program* program);
+
+private:
+    //expressions return ints, and bools as 0/1: the Resolver already checked the types
+    using ExpFn = std::function<int32_t()>;
+    //statements return true when a break is leaving the enclosing loop
+    using StmtFn = std::function<bool()>;
+
+    Resolver resolver;
+    ClosureProgram* target;
+
+    int32_t* scalar(Id* id);
+    RuntimeArray* array(Id* id);
+
+    StmtFn compileBlock(Block* block);
+    StmtFn compileStmt(Stmt* stmt);
+    ExpFn compileExp(Expression* exp);
+
+    //specializes a binary operation on the shape of its operands
+    template<class Operation>
+    ExpFn compileBinary(Expression* left, Expression* right, Operation op);
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Node.h"
+#include "Environment.h"
+#include "Exceptions.h"
+
+#ifdef MAPPED_FILES_AVAILABLE
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#else
+#include <fstream>
+#endif
+
+namespace {
+
+//a piece of the file written by store
+struct Segment {
+    const void* data;
+    size_t size;
+};
+
+//zeros standing for the cells of the pages of a sparse array that have never been written
+const uint64_t zeros[arrayStruct::PAGE_SIZE / 2] = {};
+
+//writes the segments one after the other in a temporary file, which then replaces path: a private
+//mapping of the old file, left by a load, keeps reading what the file held before
+void writeFile(const std::string& path, const std::vector<Segment>& segments)
+{
+    std::string temporary = path + ".tmp";
+#ifdef MAPPED_FILES_AVAILABLE
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        throw EvaluationError("Cannot write " + path + ": " + std::strerror(errno));
+
+    std::vector<iovec> pieces;
+    for(auto& segment : segments)
+        if(segment.size > 0)
+            pieces.push_back(iovec{const_cast<void*>(segment.data), segment.size});
+
+    //a dense array takes a single writev, unless the kernel writes less than asked
+    size_t next = 0;
+    while(next < pieces.size())
+    {
+        int count = std::min<size_t>(pieces.size() - next, IOV_MAX);
+        ssize_t written = writev(fd, &pieces[next], count);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            int error = errno;
+            close(fd);
+            unlink(temporary.c_str());
+            throw EvaluationError("Cannot write " + path + ": " + std::strerror(error));
+        }
+        size_t left = written;
+        while(next < pieces.size() && left >= pieces[next].iov_len)
+            left -= pieces[next++].iov_len;
+        if(left > 0)
+        {
+            pieces[next].iov_base = static_cast<char*>(pieces[next].iov_base) + left;
+            pieces[next].iov_len -= left;
+        }
+    }
+    if(close(fd) != 0)
+    {
+        int error = errno;
+        unlink(temporary.c_str());
+        throw EvaluationError("Cannot write " + path + ": " + std::strerror(error));
+    }
+#else
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        for(auto& segment : segments)
+            out.write(static_cast<const char*>(segment.data), segment.size);
+        if(!out)
+            throw EvaluationError("Cannot write " + path);
+    }
+#endif
+    if(std::rename(temporary.c_str(), path.c_str()) != 0)
+        throw EvaluationError("Cannot write " + path + ": " + std::strerror(errno));
+}
+
+}
+
+std::vector<char> arrayStruct::header() const
+{
+    persistentArrayHeader h{};
+    std::copy(persistentArrayHeader::MAGIC, persistentArrayHeader::MAGIC + 8, h.magic);
+    h.typeCode = typeCode;
+    h.rank = dimensions.size() > 1 ? dimensions.size() : 0;
+    h.size = size;
+    std::vector<char> bytes(headerBytes());
+    std::memcpy(bytes.data(), &h, sizeof(h));
+    for(uint32_t k = 0; k < h.rank; k++)
+    {
+        int64_t dimension = dimensions[k];
+        std::memcpy(bytes.data() + sizeof(h) + 8 * k, &dimension, 8);
+    }
+    return bytes;
+}
+
+void arrayStruct::checkHeader(const std::string& name, const std::string& path, const MappedFile& f) const
+{
+    auto h = static_cast<const persistentArrayHeader*>(f.getData());
+    if(f.getSize() < sizeof(persistentArrayHeader)
+       || !std::equal(h->magic, h->magic + 8, persistentArrayHeader::MAGIC))
+        throw EvaluationError("File " + path + " doesn't hold " + (f.isPrivate() ? "an array" : "a persistent array"));
+
+    //the dimensions in the file, read only as far as it goes
+    std::vector<int64_t> fileDimensions;
+    const char* dimensionBytes = static_cast<const char*>(f.getData()) + sizeof(persistentArrayHeader);
+    for(uint32_t k = 0; k < h->rank && sizeof(persistentArrayHeader) + 8 * (k + 1) <= f.getSize(); k++)
+    {
+        fileDimensions.push_back(0);
+        std::memcpy(&fileDimensions.back(), dimensionBytes + 8 * k, 8);
+    }
+    if(h->rank == 0)
+        fileDimensions.push_back(h->size);
+    std::vector<int64_t> declared(dimensions.begin(), dimensions.end());
+
+    if(h->typeCode != static_cast<uint32_t>(typeCode) || h->size != size || fileDimensions != declared
+       || f.getSize() != headerBytes() + arrayCells::mappedBytes(typeCode, size))
+    {
+        auto shape = [](const std::vector<int64_t>& dims) {
+            std::string text;
+            for(int64_t dimension : dims)
+                text += "[" + std::to_string(dimension) + "]";
+            return text;
+        };
+        throw EvaluationError((f.isPrivate() ? "Array " : "Persistent array ") + name + " is declared as " + Type::typeid2String[typeCode]
+                              + shape(declared) + ", but " + path + " holds "
+                              + (h->typeCode < Type::numOfTypes ? Type::typeid2String[h->typeCode] : "?")
+                              + shape(fileDimensions));
+    }
+}
+
+void arrayStruct::load(const std::string& name, const std::string& path)
+{
+    std::unique_ptr<MappedFile> source{new MappedFile(path)};
+    checkHeader(name, path, *source);
+    char* data = static_cast<char*>(source->getData()) + headerBytes();
+
+    if(sparse)
+        loadPages(data);
+    //a persistent array keeps its own file, which gets the new cells
+    else if(file && !file->isPrivate())
+        std::memcpy(static_cast<char*>(file->getData()) + headerBytes(), data,
+                    arrayCells::mappedBytes(typeCode, size));
+    //the cells are read from the mapping: pages are copied only when they are written
+    else
+    {
+        cells.bindTo(typeCode, size, data);
+        file = std::move(source);
+    }
+}
+
+//only the pages with initialized cells in the file are allocated
+void arrayStruct::loadPages(const char* source)
+{
+    auto bits = reinterpret_cast<const uint64_t*>(source + arrayCells::intBytes(typeCode, size));
+    auto ints = reinterpret_cast<const int32_t*>(source);
+    const uint64_t* bools = bits;
+    const uint64_t* initialized = typeCode == Type::BOOL ? bits + arrayCells::words(size) : bits;
+    const size_t pageWords = PAGE_SIZE / 64;
+
+    for(size_t p = 0; p < pages.size(); p++)
+    {
+        size_t first = p * PAGE_SIZE;
+        int pageCells = std::min<size_t>(PAGE_SIZE, size - first);
+        size_t words = arrayCells::words(pageCells);
+        const uint64_t* pageInitialized = initialized + p * pageWords;
+        if(std::all_of(pageInitialized, pageInitialized + words, [](uint64_t w) {return w == 0;}))
+        {
+            pages[p].reset();
+            continue;
+        }
+        if(!pages[p])
+            pages[p].reset(new arrayCells(typeCode, PAGE_SIZE));
+        arrayCells& page = *pages[p];
+        std::fill(page.initialized, page.initialized + pageWords, 0);
+        std::copy(pageInitialized, pageInitialized + words, page.initialized);
+        if(typeCode == Type::INT)
+            std::copy(ints + first, ints + first + pageCells, page.ints);
+        else
+            std::copy(bools + p * pageWords, bools + p * pageWords + words, page.bools);
+    }
+}
+
+void arrayStruct::store(const std::string& path) const
+{
+    std::vector<char> h = header();
+    std::vector<Segment> segments{{h.data(), h.size()}};
+    size_t intBytes = arrayCells::intBytes(typeCode, size);
+    size_t words = arrayCells::words(size);
+
+    if(!sparse)
+    {
+        //the ints are padded to 8 bytes, and the bitsets (the cells of a bool array, then
+        //the initialized ones) are contiguous
+        if(typeCode == Type::INT)
+            segments.push_back({cells.ints, 4 * static_cast<size_t>(size)});
+        segments.push_back({zeros, intBytes - 4 * static_cast<size_t>(typeCode == Type::INT ? size : 0)});
+        segments.push_back({typeCode == Type::BOOL ? cells.bools : cells.initialized,
+                            8 * (typeCode == Type::BOOL ? 2 : 1) * words});
+        writeFile(path, segments);
+        return;
+    }
+
+    //a sparse array is written page by page, with zeros for the pages never written
+    auto pageCells = [this](size_t p) {return std::min<size_t>(PAGE_SIZE, size - p * PAGE_SIZE);};
+    if(typeCode == Type::INT)
+    {
+        for(size_t p = 0; p < pages.size(); p++)
+            segments.push_back({pages[p] ? static_cast<const void*>(pages[p]->ints) : zeros, 4 * pageCells(p)});
+        segments.push_back({zeros, intBytes - 4 * static_cast<size_t>(size)});
+    }
+    else
+        for(size_t p = 0; p < pages.size(); p++)
+            segments.push_back({pages[p] ? static_cast<const void*>(pages[p]->bools) : zeros,
+                                8 * arrayCells::words(pageCells(p))});
+    for(size_t p = 0; p < pages.size(); p++)
+        segments.push_back({pages[p] ? static_cast<const void*>(pages[p]->initialized) : zeros,
+                            8 * arrayCells::words(pageCells(p))});
+    writeFile(path, segments);
+}
@@ -1,52 +1,225 @@
 #ifndef ENVIRONMENT_H
 #define ENVIRONMENT_H
 #include <map>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <memory>
 #include "Node.h"
-#include "ExpressionManager.h"
+#include "MappedFile.h"
 
-//A struct is created to store additional information of an array object, such as size and type
+//A run of cells of an array, stored by value: the cells of an int array in a contiguous buffer
+//of int32, those of a bool array as a bitset. Cells can be read only after their first assignment.
+//The buffers are owned by the struct, or are part of the memory of a mapped file, where they are
+//laid out one after the other (see mappedBytes)
+struct arrayCells
+{
+  arrayCells(Type::TypeCode t, const int s) :
+    intStorage(t == Type::INT ? s : 0), bitStorage((t == Type::BOOL ? 2 : 1) * words(s))
+  {
+    bind(t, s, intStorage.data(), bitStorage.data());
+  }
+
+  arrayCells(Type::TypeCode t, const int s, void* memory)
+  {
+    char* bytes = static_cast<char*>(memory);
+    bind(t, s, reinterpret_cast<int32_t*>(bytes), reinterpret_cast<uint64_t*>(bytes + intBytes(t, s)));
+  }
+
+  arrayCells(arrayCells const&) = delete;
+  arrayCells& operator=(arrayCells const&) = delete;
+
+  //moves the cells to memory laid out like a mapped file, without copying them: the owned buffers are released
+  void bindTo(Type::TypeCode t, const int s, void* memory) {
+    char* bytes = static_cast<char*>(memory);
+    bind(t, s, reinterpret_cast<int32_t*>(bytes), reinterpret_cast<uint64_t*>(bytes + intBytes(t, s)));
+    std::vector<int32_t>().swap(intStorage);
+    std::vector<uint64_t>().swap(bitStorage);
+  }
+
+  //bytes of the cells of an array in a mapped file
+  static size_t mappedBytes(Type::TypeCode t, const int s) {
+    return intBytes(t, s) + 8 * (t == Type::BOOL ? 2 : 1) * words(s);
+  }
+
+  //the bitsets that follow the ints in a mapped file start at a multiple of 8 bytes
+  static size_t intBytes(Type::TypeCode t, const int s) {
+    return t == Type::INT ? (4 * static_cast<size_t>(s) + 7) / 8 * 8 : 0;
+  }
+  static size_t words(int bits) {return (static_cast<size_t>(bits) + 63) / 64;}
+
+  bool isInitialized(int index) const {return initialized[index / 64] & bit(index);}
+
+  Value get(Type::TypeCode type, int index) const {
+    if(type == Type::INT)
+      return Value::fromInt(ints[index]);
+    return Value::fromBool(getBool(index));
+  }
+
+  void set(Type::TypeCode type, int index, Value value) {
+    if(type == Type::INT)
+      ints[index] = value.getInt();
+    else
+      setBool(index, value.getBool());
+    initialized[index / 64] |= bit(index);
+  }
+
+  bool getBool(int index) const {return bools[index / 64] & bit(index);}
+  void setBool(int index, bool value) {
+    if(value)
+      bools[index / 64] |= bit(index);
+    else
+      bools[index / 64] &= ~bit(index);
+  }
+
+  int32_t* ints;              //cells of an int array
+  uint64_t* bools;            //cells of a bool array, one bit each
+  uint64_t* initialized;
+
+private:
+  std::vector<int32_t> intStorage;
+  std::vector<uint64_t> bitStorage;
+
+  void bind(Type::TypeCode t, const int s, int32_t* intCells, uint64_t* bits) {
+    ints = t == Type::INT ? intCells : nullptr;
+    bools = t == Type::BOOL ? bits : nullptr;
+    initialized = t == Type::BOOL ? bits + words(s) : bits;
+  }
+
+  static uint64_t bit(int index) {return uint64_t{1} << (index % 64);}
+};
+
+//Header of the file holding a persistent array, or one written by store, followed by its cells
+//in native byte order. A multi-dimensional array has the number of its dimensions in rank, and
+//their sizes right after the header, each one in 8 bytes; rank is 0 for the other arrays
+struct persistentArrayHeader
+{
+  char magic[8];
+  uint32_t typeCode;
+  uint32_t rank;
+  int64_t size;
+  uint64_t unused;
+
+  static constexpr char MAGIC[8] = {'A', 'R', 'R', 'A', 'Y', '0', '1', '\0'};
+};
+
+//A struct is created to store additional information of an array object, such as size and type.
+//A dense array keeps all its cells in a single arrayCells. A sparse array is split in pages of
+//PAGE_SIZE cells, each one allocated on the first assignment of one of its cells: its memory grows
+//with the pages touched instead of its size, and a page never written holds no initialized cell.
+//A persistent array keeps its cells in a mapped file, so that they survive the run. A dense array
+//loaded from a file reads its cells from a private mapping of the file
 struct arrayStruct
 {
-  arrayStruct( Type::TypeCode t, const int s, std::vector<Constant**>& allocatedArrs) : typeCode{t}, size{s}
+  static constexpr int PAGE_BITS = 12;
+  static constexpr int PAGE_SIZE = 1 << PAGE_BITS;
+
+  arrayStruct(Type::TypeCode t, const int s, bool isSparse = false) : size{s}, typeCode{t}, dimensions{s}, sparse{isSparse},
+    cells(t, isSparse ? 0 : s), pages(isSparse ? (static_cast<size_t>(s) + PAGE_SIZE - 1) / PAGE_SIZE : 0)
+  {
+  }
+
+  //array stored in the file at path, which is created if missing. The type and the dimensions recorded
+  //in the file header must be the ones of the declaration, and the file is not touched otherwise
+  arrayStruct(const std::string& name, Type::TypeCode t, const int s, const std::vector<int>& dims, const std::string& path) :
+    size{s}, typeCode{t}, dimensions{dims}, sparse{false},
+    file{new MappedFile(path, headerBytes() + arrayCells::mappedBytes(t, s))},
+    cells(t, s, static_cast<char*>(file->getData()) + headerBytes())
   {
-    Constant** arr = new Constant*[size]; 
-    
-    //Individual cells are later declared, during assignment 
-    for(int i=0; i<size; i++)
+    if(file->getOriginalSize() == 0)
     {
-      arr[i] = nullptr;
+      std::vector<char> h = header();
+      std::copy(h.begin(), h.end(), static_cast<char*>(file->getData()));
+      return;
     }
-   array = arr;
-   //an array of consts is deallocated when destructor is called
-   allocatedArrs.push_back(array);
+    checkHeader(name, path, *file);
   }
-    
+
+  //value of a cell, the caller has already checked the bounds
+  Value getCell(int index) const
+  {
+    if(!isInitialized(index)) //if array cell has not been declared, error
+      throw EvaluationError("Trying to retrieve a cell from an array which has not been declared");
+
+    if(!sparse)
+      return cells.get(typeCode, index);
+    return pages[index >> PAGE_BITS]->get(typeCode, index & (PAGE_SIZE - 1));
+  }
+
+  //the caller has already checked the bounds, and that value has the type of the array
+  void setCell(int index, Value value)
+  {
+    if(!sparse)
+    {
+      cells.set(typeCode, index, value);
+      return;
+    }
+    std::unique_ptr<arrayCells>& page = pages[index >> PAGE_BITS];
+    if(!page)
+      page.reset(new arrayCells(typeCode, PAGE_SIZE));
+    page->set(typeCode, index & (PAGE_SIZE - 1), value);
+  }
+
+  //Individual cells are later declared, during assignment
+  bool isInitialized(int index) const
+  {
+    if(!sparse)
+      return cells.isInitialized(index);
+    const arrayCells* page = pages[index >> PAGE_BITS].get();
+    return page && page->isInitialized(index & (PAGE_SIZE - 1));
+  }
+
+  //replaces every cell with the ones of the array stored in the file at path, which must have the
+  //type and the dimensions of this one. Cells not initialized in the file are not initialized anymore
+  void load(const std::string& name, const std::string& path);
+  //writes the array to the file at path, replacing it, in the format read by load
+  void store(const std::string& path) const;
+
+  bool isSparse() const {return sparse;}
+  //cells of a dense or persistent array
+  const arrayCells& getCells() const {return cells;}
+
   const int size;
-  Constant** array;  //pointer points to arrays of Constants 
-  Type::TypeCode typeCode;
+  const Type::TypeCode typeCode;
+  //sizes of the dimensions of a multi-dimensional array, whose cells are stored in row-major order
+  std::vector<int> dimensions;
+
+private:
+  const bool sparse;
+  std::unique_ptr<MappedFile> file;     //persistent arrays, and dense arrays loaded from a file
+  arrayCells cells;
+  std::vector<std::unique_ptr<arrayCells>> pages;
+
+  //the header of the files of this array, with its dimensions
+  std::vector<char> header() const;
+  size_t headerBytes() const {return sizeof(persistentArrayHeader) + (dimensions.size() > 1 ? 8 * dimensions.size() : 0);}
+  //throws EvaluationError if the file doesn't hold an array of the type and dimensions of this one
+  void checkHeader(const std::string& name, const std::string& path, const MappedFile& f) const;
+  void loadPages(const char* source);
 };
 
 
 //This is the class that handles creation and manipulation of variables and arrays 
 class Environment {
 public:
-  Environment(ExpressionManager& e) : em{e}{}
+  Environment() = default;
   
   ~Environment(){
     clearMemory();
   }
 
-  void declareVar(std::string name_, Type* type_){
+  void declareVar(const std::string& name_, Type* type_){
     if(isAlreadyDeclared(name_))
       return;
    Type::TypeCode typeCode = type_->getTypeCode();
     switch (typeCode)
     {
         case Type::INT:
-          declaredVars[name_] = em.makeIntConstant();
+          declaredVars[name_] = Value::fromInt(0);
           break;
         case Type::BOOL:
-          declaredVars[name_] = em.makeBoolConstant();
+          declaredVars[name_] = Value::fromBool(false);
           break;
         default:
           throw EvaluationError("identifier "+ name_+ " is being declared with invalid type");
@@ -55,49 +228,75 @@ public:
   }         
 
  //declaring an array of name "x" corresponds to adding a tuple ("x",arraystruct) in the dictionary
-  void declareArrayVar(std::string name_, vectorType* type){
+  void declareArrayVar(const std::string& name_, vectorType* type){
     //double declaration is illegal, the reason that here an error is not thrown is because
     //double declaration checking is done at parsing time, not execution time
     if(isAlreadyDeclared(name_))
       return;
 
-    auto arrayStrct = new arrayStruct(type->getTypeCode(),type->getSize(),allocatedArraysOfConstants);
+    arrayStruct* arrayStrct;
+    auto persistent = persistentArrays.find(name_);
+    if(persistent != persistentArrays.end())
+      arrayStrct = new arrayStruct(name_, type->getTypeCode(), type->getSize(), type->getDimensions(), persistent->second);
+    else
+    {
+      //large arrays are sparse, so that they cost only the memory of the cells that are written
+      bool sparse = type->getSize() >= SPARSE_ARRAY_SIZE;
+      arrayStrct = new arrayStruct(type->getTypeCode(),type->getSize(),sparse);
+    }
+    arrayStrct->dimensions = type->getDimensions();
     declaredArrays[name_] = arrayStrct;
     allocatedArrayStructs.push_back(arrayStrct); 
   }         
 
+  //the array called name, when it is declared, is stored in the file at path and keeps its cells across runs
+  void bindArrayToFile(const std::string& name, const std::string& path){
+    persistentArrays[name] = path;
+  }
+
+  //the statements load and store of the program
+  void loadArray(const std::string& name, const std::string& path){
+    getArray(name)->load(name, path);
+  }
+  void storeArray(const std::string& name, const std::string& path){
+    getArray(name)->store(path);
+  }
+
   //it's illegal to declare multiple variables with the same name, even if they don't share type
   //or one of them is a array and the other a primitive type
-  bool isAlreadyDeclared(std::string idName){
+  bool isAlreadyDeclared(const std::string& idName){
     return (declaredVars.find(idName) != declaredVars.end()) ||
           (declaredArrays.find(idName) != declaredArrays.end());
   }
 
-  Constant* getIdValue(std::string idName){
+  Value getIdValue(const std::string& idName){
     auto it = declaredVars.find(idName);
     if(it == declaredVars.end())
       throw EvaluationError("Trying to access identifier " + idName + " , which has not been declared");
     return it->second; 
   }
 
-  void assignConstant(std::string idName, Constant* value)
-  {
+  //everything declared so far, used to move the state of the program to a compiled loop and back
+  const std::map<std::string, Value>& getDeclaredVars() const {return declaredVars;}
+  const std::map<std::string, arrayStruct*>& getDeclaredArrays() const {return declaredArrays;}
+
+  //the slot of a variable stays valid as long as the Environment: variables are never removed
+  Value* getIdSlot(const std::string& idName){
     auto it = declaredVars.find(idName);
     if(it == declaredVars.end())
       throw EvaluationError("Trying to access identifier " + idName + " , which has not been declared");
-    switch(value->getTypeCode())
-    {
-      //dynamic casting is necessary to do a deep copy instead of a shallow one 
-      case Type::INT:
-      dynamic_cast<intConstant*>(it->second)->set(dynamic_cast<intConstant*>(value)->getInt());
-      break;
+    return &it->second;
+  }
 
-      case Type::BOOL:
-      dynamic_cast<boolConstant*>(it->second)->set(dynamic_cast<boolConstant*>(value)->getBool());
-    }
+  void assignConstant(const std::string& idName, Value value)
+  {
+    auto it = declaredVars.find(idName);
+    if(it == declaredVars.end())
+      throw EvaluationError("Trying to access identifier " + idName + " , which has not been declared");
+    it->second = value;
   }
 
-  void assignConstantToArray(std::string idName, Constant* value, int index){
+  void assignConstantToArray(const std::string& idName, Value value, int index){
     auto it = declaredArrays.find(idName);
     if(it == declaredArrays.end())
       throw EvaluationError("Trying to access identifier " + idName + " , which has not been declared");
@@ -105,23 +304,11 @@ public:
    if(index < 0 || index >= it->second->size)
       throw EvaluationError("Out of bounds error on " + idName + " array");
   
-    switch(value->getTypeCode())
-    {
-      case Type::INT:
-      if(!it->second->array[index]) //if element has not yet been declared we declare it
-        it->second->array[index] = em.makeIntConstant(); 
-      dynamic_cast<intConstant*>(it->second->array[index])->set(dynamic_cast<intConstant*>(value)->getInt());
-      break;
-
-      case Type::BOOL:
-      if(!it->second->array[index]) //if element has not yet been declared we declare it
-        it->second->array[index] = em.makeBoolConstant(); 
-      dynamic_cast<boolConstant*>(it->second->array[index])->set(dynamic_cast<boolConstant*>(value)->getBool());
-    }
-    
+    //the caller has already checked that value has the type of the array
+    it->second->setCell(index, value);
   }
 
-  Constant* getArrayValue(std::string idName, int index){
+  Value getArrayValue(const std::string& idName, int index){
     auto it = declaredArrays.find(idName);
     if(it == declaredArrays.end())
       throw EvaluationError("Trying to access identifier " + idName + " , which has not been declared");
@@ -129,13 +316,10 @@ public:
     if(index < 0 || index >= it->second->size)
       throw EvaluationError("Out of bounds error on " + idName + " array");
 
-    if(!it->second->array[index]) //if array cell has not been declared, error
-      throw EvaluationError("Trying to retrieve a cell from an array which has not been declared");
-   
-    return it->second->array[index];
+    return it->second->getCell(index);
   }
 
-  arrayStruct* getArray(std::string idName){
+  arrayStruct* getArray(const std::string& idName){
     auto it = declaredArrays.find(idName);
     if(it == declaredArrays.end())
       throw EvaluationError("Trying to access identifier " + idName + " , which has not been declared");
@@ -145,27 +329,26 @@ public:
 
 
 
+  //arrays with at least this number of cells are stored as sparse arrays
+  static constexpr int SPARSE_ARRAY_SIZE = 1 << 20;
+
 private:
 
   //the recipients of the actual data of variables and vectors
-  std::map<std::string, Constant*> declaredVars;
+  std::map<std::string, Value> declaredVars;
   std::map<std::string, arrayStruct*> declaredArrays;
 
-  //expression manager handles pointers of type Constant*, the other vectors handle pointers of different type
-  ExpressionManager& em;
+  //name of a persistent array -> its file
+  std::map<std::string, std::string> persistentArrays;
+
   std::vector<arrayStruct*> allocatedArrayStructs;
-  std::vector<Constant**> allocatedArraysOfConstants;
 
   void clearMemory()
   {
-    for (auto i = allocatedArraysOfConstants.begin(); i != allocatedArraysOfConstants.end(); ++i) 
-        delete(*i);
-    
     for (auto i = allocatedArrayStructs.begin(); i != allocatedArrayStructs.end(); ++i) 
         delete(*i);
 
     allocatedArrayStructs.resize(0);
-    allocatedArraysOfConstants.resize(0);
   }
 };
 
@@ -19,5 +19,12 @@ struct EvaluationError : std::runtime_error {
 	EvaluationError(std::string msg) : std::runtime_error(msg.c_str()) { }
 };
 
+//thrown when a program can't be translated by one of the compiled engines,
+//which then leave its execution to the EvaluationVisitor
+struct CompileError : std::runtime_error {
+	CompileError(const char* msg) : std::runtime_error(msg) { }
+	CompileError(std::string msg) : std::runtime_error(msg.c_str()) { }
+};
+
 #endif
 
@@ -23,9 +23,10 @@ public:
     ExpressionManager(const ExpressionManager& other) = delete;
     ExpressionManager& operator=(const ExpressionManager& other) = delete;
 
-    Program* makeProgram(Block* block)
+    // i nodi con una ExpressionCache sono creati tutti dal Parser, prima del loro Program
+    Program* makeProgram(Block* block, const std::vector<Function*>& functions = {})
     {
-        Program* o = new Program(block);
+        Program* o = new Program(block, functions, numCaches);
         allocated.push_back(o);
         return o;
     }
@@ -59,6 +60,12 @@ public:
         return o;
     }
 
+    vectorType* makeVectorType(Type::TypeCode type, const std::vector<int>& dims){
+        vectorType* o = new vectorType(type, dims);
+        allocated.push_back(o);
+        return o;
+    }
+
     intConstant* makeIntConstant(int value) {
         intConstant* o = new intConstant(value);
         allocated.push_back(o);
@@ -84,6 +91,14 @@ public:
 
     Arithm* makeBinOp(Op::BinOpCode op, Expression* l, Expression* r) {
         Arithm* o = new Arithm(l, r, op);
+        o->setCacheIndex(numCaches++);
+        allocated.push_back(o);
+        return o;
+    }
+
+    Index* makeIndex(Id* idName, const std::vector<Expression*>& subscripts)
+    {
+        Index* o = new Index(idName, subscripts);
         allocated.push_back(o);
         return o;
     }
@@ -91,6 +106,7 @@ public:
     Access* makeAccess(Id* idName, Expression* index)
     {
         Access* o = new Access(idName, index);
+        o->setCacheIndex(numCaches++);
         allocated.push_back(o);
         return o;
     }
@@ -103,6 +119,7 @@ public:
 
     Id* makeId(std::string idName) {
         Id* o = new Id(idName);
+        o->setCacheIndex(numCaches++);
         allocated.push_back(o);
         return o;
     }
@@ -186,6 +203,51 @@ public:
         return o;        
     }
     
+    Load* makeLoad(Id* array, const std::string& path)
+    {
+        Load* o = new Load(array, path);
+        allocated.push_back(o);
+        return o;
+    }
+
+    Store* makeStore(Id* array, const std::string& path)
+    {
+        Store* o = new Store(array, path);
+        allocated.push_back(o);
+        return o;
+    }
+
+    ParallelFor* makeParallelFor(Id* induction, Expression* first, Expression* last,
+                                 const std::vector<ParallelFor::Reduction>& reductions, Stmt* stmt)
+    {
+        ParallelFor* o = new ParallelFor(induction, first, last, reductions, stmt);
+        allocated.push_back(o);
+        return o;
+    }
+
+    Function* makeFunction(Type::TypeCode returnType, const std::string& name, int numParams,
+                           const std::vector<Decl*>& locals, Block* body)
+    {
+        Function* o = new Function(returnType, name, numParams, locals, body);
+        allocated.push_back(o);
+        return o;
+    }
+
+    // la funzione chiamata viene collegata dal Parser alla fine del programma
+    Call* makeCall(const std::string& name, const std::vector<Expression*>& args)
+    {
+        Call* o = new Call(name, args);
+        allocated.push_back(o);
+        return o;
+    }
+
+    Return* makeReturn(Expression* exp)
+    {
+        Return* o = new Return(exp);
+        allocated.push_back(o);
+        return o;
+    }
+
     Print* makePrint(Expression* expToPrint)
     {
         Print* o = new Print(expToPrint);
@@ -193,6 +255,15 @@ public:
         return o;
     }
 
+    // fused nodes (see Fused.h) are instances of many templates, built by the FusionPass
+    template<class N, class... Args>
+    N* makeFused(Args... args)
+    {
+        N* o = new N(args...);
+        allocated.push_back(o);
+        return o;
+    }
+
 
     void clearMemory() {
         auto i = allocated.begin();
@@ -207,6 +278,8 @@ public:
 
 private:
     std::vector<Node*> allocated;
+    // indice della prossima ExpressionCache (vedi Expression::getCacheIndex)
+    int numCaches = 0;
 };
 
 
@@ -0,0 +1,95 @@
+#include <type_traits>
+
+#include "Fused.h"
+
+namespace {
+
+using fused::Var;
+using fused::Const;
+using fused::Any;
+
+bool isLeaf(Expression* e)
+{
+    return e->getKind() == Node::ID || e->getKind() == Node::INT_CONSTANT;
+}
+
+//calls f with the shape of e
+template<class F>
+Fused* withShape(Expression* e, F f)
+{
+    if(e->getKind() == Node::ID)
+        return f(Var{static_cast<Id*>(e)});
+    if(e->getKind() == Node::INT_CONSTANT)
+        return f(Const{static_cast<intConstant*>(e)->getInt()});
+    return f(Any{e});
+}
+
+template<class Make>
+Fused* withShapes(Expression* left, Expression* right, Make make)
+{
+    if(!isLeaf(left) && !isLeaf(right))
+        return nullptr;
+    return withShape(left, [&](auto l) {
+        return withShape(right, [&](auto r) {return make(l, r);});
+    });
+}
+
+template<class L, class R>
+Fused* makeBinOp(ExpressionManager& em, Arithm* arithm, L l, R r)
+{
+    switch(arithm->getOp())
+    {
+        case Op::ADD:
+            return em.makeFused<FusedBinOp<Op::ADD, L, R>>(arithm, l, r);
+        case Op::SUB:
+            return em.makeFused<FusedBinOp<Op::SUB, L, R>>(arithm, l, r);
+        case Op::MUL:
+            return em.makeFused<FusedBinOp<Op::MUL, L, R>>(arithm, l, r);
+        case Op::DIV:
+            return em.makeFused<FusedBinOp<Op::DIV, L, R>>(arithm, l, r);
+        //the right operand decides the type of the comparison, which is known only for a literal
+        case Op::EQ:
+            if constexpr (std::is_same<R, Const>::value)
+                return em.makeFused<FusedBinOp<Op::EQ, L, R>>(arithm, l, r);
+            break;
+        case Op::NOT_EQ:
+            if constexpr (std::is_same<R, Const>::value)
+                return em.makeFused<FusedBinOp<Op::NOT_EQ, L, R>>(arithm, l, r);
+            break;
+        default:
+            break;
+    }
+    return nullptr;
+}
+
+template<class L, class R>
+Fused* makeRel(ExpressionManager& em, Rel* rel, L l, R r)
+{
+    switch(rel->getOp())
+    {
+        case Rel::MORE:
+            return em.makeFused<FusedRel<Rel::MORE, L, R>>(rel, l, r);
+        case Rel::MORE_EQ:
+            return em.makeFused<FusedRel<Rel::MORE_EQ, L, R>>(rel, l, r);
+        case Rel::LESS:
+            return em.makeFused<FusedRel<Rel::LESS, L, R>>(rel, l, r);
+        case Rel::LESS_EQ:
+            return em.makeFused<FusedRel<Rel::LESS_EQ, L, R>>(rel, l, r);
+        default:
+            return nullptr;
+    }
+}
+
+}
+
+Fused* makeFused(ExpressionManager& em, Arithm* arithm)
+{
+    return withShapes(arithm->getLeftExp(), arithm->getRightExp(),
+        [&](auto l, auto r) {return makeBinOp(em, arithm, l, r);});
+}
+
+Fused* makeFused(ExpressionManager& em, Rel* rel)
+{
+    return withShapes(rel->getLeftExp(), rel->getRightExp(),
+        [&](auto l, auto r) {return makeRel(em, rel, l, r);});
+}
@@ -0,0 +1,100 @@
+#ifndef FUSED_H
+#define FUSED_H
+
+#include "Node.h"
+#include "Visitor.h"
+#include "ExpressionManager.h"
+
+//Fused nodes are Arithm and Rel nodes specialized at compile time on their operation and on the
+//shape of their operands, like FusedBinOp<Op::ADD, Var, Const> for i + 1. Loading a leaf operand
+//is inlined into the operation, so evaluating i + 1 costs a single dispatch instead of three.
+//Every shape loads its operand, and the operation converts it to int afterwards, in the order
+//of the EvaluationVisitor, so that the same error is raised first
+namespace fused {
+
+//an Id, read through the slot cache of the EvaluationVisitor
+struct Var {
+    Id* id;
+    Value load(EvaluationVisitor& v) const {return v.readVariable(id);}
+};
+
+//an int literal
+struct Const {
+    int value;
+    int load(EvaluationVisitor&) const {return value;}
+};
+
+//any other expression, evaluated as usual
+struct Any {
+    Expression* exp;
+    Value load(EvaluationVisitor& v) const {return v.evaluate(exp);}
+};
+
+inline int toInt(Value v) {return v.getInt();}
+inline int toInt(int v) {return v;}
+
+}
+
+template<Op::BinOpCode OP, class L, class R>
+class FusedBinOp : public Fused {
+public:
+    FusedBinOp(Arithm* original, L l, R r) : Fused(original), left{l}, right{r} {}
+
+    Value evaluate(EvaluationVisitor& v) override {
+        auto l = left.load(v);
+        auto r = right.load(v);
+        if constexpr (OP == Op::ADD)
+            return Value::fromInt(fused::toInt(l) + fused::toInt(r));
+        else if constexpr (OP == Op::SUB)
+            return Value::fromInt(fused::toInt(l) - fused::toInt(r));
+        else if constexpr (OP == Op::MUL)
+            return Value::fromInt(fused::toInt(l) * fused::toInt(r));
+        else if constexpr (OP == Op::DIV)
+        {
+            int divisor = fused::toInt(r);
+            if(divisor == 0)
+                throw EvaluationError("Division by 0");
+            return Value::fromInt(fused::toInt(l) / divisor);
+        }
+        //equalities are fused only with an int literal on the right, which makes them int comparisons
+        else if constexpr (OP == Op::EQ)
+            return Value::fromBool(fused::toInt(l) == fused::toInt(r));
+        else
+            return Value::fromBool(fused::toInt(l) != fused::toInt(r));
+    }
+
+private:
+    L left;
+    R right;
+};
+
+template<Rel::OpCode OP, class L, class R>
+class FusedRel : public Fused {
+public:
+    FusedRel(Rel* original, L l, R r) : Fused(original), left{l}, right{r} {}
+
+    Value evaluate(EvaluationVisitor& v) override {
+        //the left operand is converted before the right one is evaluated
+        int l = fused::toInt(left.load(v));
+        int r = fused::toInt(right.load(v));
+        if constexpr (OP == Rel::MORE)
+            return Value::fromBool(l > r);
+        else if constexpr (OP == Rel::MORE_EQ)
+            return Value::fromBool(l >= r);
+        else if constexpr (OP == Rel::LESS)
+            return Value::fromBool(l < r);
+        else
+            return Value::fromBool(l <= r);
+    }
+
+private:
+    L left;
+    R right;
+};
+
+//Return the fused node replacing the operation, or nullptr if none of its operands
+//is a variable or an int literal
+Fused* makeFused(ExpressionManager& em, Arithm* arithm);
+Fused* makeFused(ExpressionManager& em, Rel* rel);
+
+#endif
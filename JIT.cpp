@@ -0,0 +1,479 @@
+#include <cstring>
+#include <string>
+
+#include "JIT.h"
+#include "Exceptions.h"
+#include "OutputSink.h"
+#include "LoopParallelizer.h"
+#include "TaskGraph.h"
+
+#ifdef JIT_AVAILABLE
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+//x86-64 general purpose registers, in encoding order
+enum Reg : uint8_t {EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI};
+
+//condition codes of jcc and setcc
+enum Cond : uint8_t {CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF};
+
+//A minimal x86-64 encoder, with just the instructions the JIT needs.
+//The bytecode registers are addressed through rbx
+class Assembler {
+public:
+    std::vector<uint8_t> bytes;
+
+    size_t here() const {return bytes.size();}
+
+    void emit(std::initializer_list<uint8_t> b) {bytes.insert(bytes.end(), b.begin(), b.end());}
+
+    void imm32(int32_t v)
+    {
+        uint8_t b[4];
+        std::memcpy(b, &v, 4);
+        bytes.insert(bytes.end(), b, b + 4);
+    }
+
+    void imm64(uint64_t v)
+    {
+        uint8_t b[8];
+        std::memcpy(b, &v, 8);
+        bytes.insert(bytes.end(), b, b + 8);
+    }
+
+    //opcode reg, [rbx + 4*r]
+    void onRegister(std::initializer_list<uint8_t> opcode, uint8_t reg, int32_t r)
+    {
+        emit(opcode);
+        emit({static_cast<uint8_t>(0x80 | (reg << 3) | EBX)});
+        imm32(4 * r);
+    }
+
+    void load(Reg dst, int32_t r) {onRegister({0x8B}, dst, r);}
+    void store(int32_t r, Reg src) {onRegister({0x89}, src, r);}
+
+    //mov rax, imm64
+    void movRax(const void* p)
+    {
+        emit({0x48, 0xB8});
+        imm64(reinterpret_cast<uint64_t>(p));
+    }
+
+    //setcc al; movzx eax, al
+    void setEax(Cond cc) {emit({0x0F, static_cast<uint8_t>(0x90 | cc), 0xC0, 0x0F, 0xB6, 0xC0});}
+
+    //jcc/jmp rel32; return the position of the displacement, to be patched
+    size_t jcc(Cond cc)
+    {
+        emit({0x0F, static_cast<uint8_t>(0x80 | cc)});
+        imm32(0);
+        return here() - 4;
+    }
+
+    size_t jmp()
+    {
+        emit({0xE9});
+        imm32(0);
+        return here() - 4;
+    }
+
+    void patch(size_t at, size_t target)
+    {
+        int32_t rel = static_cast<int32_t>(target - (at + 4));
+        std::memcpy(&bytes[at], &rel, 4);
+    }
+
+    //call a C++ function: mov rax, fn; call rax
+    void call(const void* fn)
+    {
+        movRax(fn);
+        emit({0xFF, 0xD0});
+    }
+};
+
+//condition of the relational opcodes, in the order EQ, NE, LT, LE, GT, GE
+const Cond relConds[] = {CC_E, CC_NE, CC_L, CC_LE, CC_G, CC_GE};
+
+//push rbp; mov rbp, rsp; push rbx; push r13 (the stack stays 16 bytes aligned for the calls);
+//mov rbx, rdi (registers); mov r13, rsi (this)
+const std::initializer_list<uint8_t> prologue = {0x55, 0x48, 0x89, 0xE5, 0x53, 0x41, 0x55, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF5};
+
+//raised by a chunk of a parallel loop or by a task, thrown again by the code that called it on the same
+//thread: the tasks of a graph run at the same time, and so can their nested parallel loops
+thread_local std::exception_ptr parallelError;
+
+}
+
+JIT::JIT(const BytecodeProgram& p) : program{p}, registers(p.getNumRegisters(), 0),
+    arrays(p.getArrays().size()), nativeArrays(p.getArrays().size(), NativeArray{nullptr, nullptr, 0}),
+    code{nullptr}, codeSize{0}
+{
+#ifdef JIT_AVAILABLE
+    generate();
+#else
+    throw CompileError("JIT not available on this platform");
+#endif
+}
+
+JIT::~JIT()
+{
+#ifdef JIT_AVAILABLE
+    if(code)
+        munmap(code, codeSize);
+#endif
+}
+
+void JIT::declareArray(JIT* jit, int32_t array) noexcept
+{
+    RuntimeArray& a = jit->arrays[array];
+    a.declare(jit->program.getArrays()[array].size);
+    jit->nativeArrays[array] = NativeArray{a.cells.data(), a.initialized.data(), static_cast<uint32_t>(a.cells.size())};
+}
+
+void JIT::printInt(int32_t value) noexcept
+{
+    OutputSink::current().printInt(value);
+}
+
+void JIT::printBool(int32_t value) noexcept
+{
+    OutputSink::current().printBool(value != 0);
+}
+
+int32_t JIT::parallelLoop(JIT* jit, int32_t loop, int32_t* registers, int32_t bound) noexcept
+{
+    try {
+        auto entry = reinterpret_cast<Entry>(static_cast<char*>(jit->code) + jit->entries[loop]);
+        bool parallel = runParallelLoop(jit->program.getParallelLoops()[loop], registers, jit->registers.size(), bound,
+                                        [jit, entry](int32_t* chunk) {
+            int32_t status = entry(chunk, jit);
+            if(status != STATUS_OK)
+                jit->raise(status);
+        });
+        return parallel ? STATUS_OK : -1;
+    }
+    catch (...) {
+        parallelError = std::current_exception();
+        return STATUS_PARALLEL_ERROR;
+    }
+}
+
+int32_t JIT::taskGraph(JIT* jit, int32_t graph, int32_t* registers) noexcept
+{
+    try {
+        const std::vector<size_t>& entries = jit->taskEntries[graph];
+        bool parallel = runTaskGraph(jit->program.getTaskGraphs()[graph], registers, jit->registers.size(),
+                                     [jit, &entries](int task, int32_t* copy) {
+            int32_t status = reinterpret_cast<Entry>(static_cast<char*>(jit->code) + entries[task])(copy, jit);
+            if(status != STATUS_OK)
+                jit->raise(status);
+        });
+        return parallel ? STATUS_OK : -1;
+    }
+    catch (...) {
+        parallelError = std::current_exception();
+        return STATUS_PARALLEL_ERROR;
+    }
+}
+
+void JIT::generate()
+{
+#ifdef JIT_AVAILABLE
+    const std::vector<int32_t>& bytecode = program.getCode();
+    Assembler as;
+
+    as.emit(prologue);
+
+    //native position of every bytecode instruction, and the jumps to resolve at the end
+    std::vector<size_t> native(bytecode.size() + 1, 0);
+    std::vector<std::pair<size_t, int32_t>> jumps;
+    std::vector<size_t> toExit;
+    std::vector<size_t> toDivisionByZero;
+    std::vector<size_t> toUninitialized;
+    std::vector<std::vector<size_t>> toOutOfBounds(arrays.size());
+
+    const uint8_t sizeOffset = offsetof(NativeArray, size);
+    const uint8_t initializedOffset = offsetof(NativeArray, initialized);
+    static_assert(offsetof(NativeArray, cells) == 0, "cells are loaded with [rax]");
+
+    size_t pc = 0;
+    while(pc < bytecode.size())
+    {
+        native[pc] = as.here();
+        OpCode op = static_cast<OpCode>(bytecode[pc]);
+        const int32_t* operand = &bytecode[pc];
+        switch(op)
+        {
+            case OP_HALT:
+                as.emit({0x31, 0xC0});              //xor eax, eax
+                toExit.push_back(as.jmp());
+                break;
+
+            case OP_LOADI:
+                as.onRegister({0xC7}, 0, operand[1]);  //mov dword [d], imm
+                as.imm32(operand[2]);
+                break;
+
+            case OP_MOV:
+                as.load(EAX, operand[2]);
+                as.store(operand[1], EAX);
+                break;
+
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            {
+                as.load(EAX, operand[2]);
+                if(op == OP_ADD)
+                    as.onRegister({0x03}, EAX, operand[3]);
+                else if(op == OP_SUB)
+                    as.onRegister({0x2B}, EAX, operand[3]);
+                else
+                    as.onRegister({0x0F, 0xAF}, EAX, operand[3]);
+                as.store(operand[1], EAX);
+                break;
+            }
+
+            case OP_ADDI:
+                as.load(EAX, operand[2]);
+                as.emit({0x05});                    //add eax, imm
+                as.imm32(operand[3]);
+                as.store(operand[1], EAX);
+                break;
+
+            case OP_MULI:
+                as.load(EAX, operand[2]);
+                as.emit({0x69, 0xC0});              //imul eax, eax, imm
+                as.imm32(operand[3]);
+                as.store(operand[1], EAX);
+                break;
+
+            case OP_DIV:
+                as.load(ECX, operand[3]);
+                as.emit({0x85, 0xC9});              //test ecx, ecx
+                toDivisionByZero.push_back(as.jcc(CC_E));
+                as.load(EAX, operand[2]);
+                as.emit({0x99, 0xF7, 0xF9});        //cdq; idiv ecx
+                as.store(operand[1], EAX);
+                break;
+
+            case OP_NEG:
+                as.load(EAX, operand[2]);
+                as.emit({0xF7, 0xD8});              //neg eax
+                as.store(operand[1], EAX);
+                break;
+
+            case OP_NOT:
+                as.load(EAX, operand[2]);
+                as.emit({0x85, 0xC0});              //test eax, eax
+                as.setEax(CC_E);
+                as.store(operand[1], EAX);
+                break;
+
+            case OP_EQ: case OP_NE: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+                as.load(EAX, operand[2]);
+                as.onRegister({0x3B}, EAX, operand[3]);    //cmp eax, [b]
+                as.setEax(relConds[op - OP_EQ]);
+                as.store(operand[1], EAX);
+                break;
+
+            case OP_JMP:
+                jumps.push_back({as.jmp(), operand[1]});
+                break;
+
+            case OP_JZ:
+            case OP_JNZ:
+                as.onRegister({0x83}, 7, operand[1]);      //cmp dword [a], 0
+                as.emit({0x00});
+                jumps.push_back({as.jcc(op == OP_JZ ? CC_E : CC_NE), operand[2]});
+                break;
+
+            case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BLE: case OP_BGT: case OP_BGE:
+                as.load(EAX, operand[1]);
+                as.onRegister({0x3B}, EAX, operand[2]);
+                jumps.push_back({as.jcc(relConds[op - OP_BEQ]), operand[3]});
+                break;
+
+            case OP_BEQI: case OP_BNEI: case OP_BLTI: case OP_BLEI: case OP_BGTI: case OP_BGEI:
+                as.onRegister({0x81}, 7, operand[1]);      //cmp dword [a], imm
+                as.imm32(operand[2]);
+                jumps.push_back({as.jcc(relConds[op - OP_BEQI]), operand[3]});
+                break;
+
+            case OP_DECLA:
+                as.emit({0x4C, 0x89, 0xEF, 0xBE});         //mov rdi, r13; mov esi, imm
+                as.imm32(operand[1]);
+                as.call(reinterpret_cast<const void*>(&JIT::declareArray));
+                break;
+
+            case OP_ALOAD:
+            case OP_ASTORE:
+            {
+                int32_t array = op == OP_ALOAD ? operand[2] : operand[1];
+                int32_t index = op == OP_ALOAD ? operand[3] : operand[2];
+                as.load(ECX, index);
+                as.movRax(&nativeArrays[array]);
+                as.emit({0x3B, 0x48, sizeOffset});           //cmp ecx, [rax + size]
+                toOutOfBounds[array].push_back(as.jcc(CC_AE)); //unsigned, negative indexes too
+                as.emit({0x48, 0x8B, 0x50, initializedOffset}); //mov rdx, [rax + initialized]
+                if(op == OP_ALOAD)
+                {
+                    as.emit({0x80, 0x3C, 0x0A, 0x00});    //cmp byte [rdx + rcx], 0
+                    toUninitialized.push_back(as.jcc(CC_E));
+                    as.emit({0x48, 0x8B, 0x10});          //mov rdx, [rax]
+                    as.emit({0x8B, 0x04, 0x8A});          //mov eax, [rdx + 4*rcx]
+                    as.store(operand[1], EAX);
+                }
+                else
+                {
+                    as.emit({0xC6, 0x04, 0x0A, 0x01});    //mov byte [rdx + rcx], 1
+                    as.emit({0x48, 0x8B, 0x10});          //mov rdx, [rax]
+                    as.load(ESI, operand[3]);
+                    as.emit({0x89, 0x34, 0x8A});          //mov [rdx + 4*rcx], esi
+                }
+                break;
+            }
+
+            case OP_INDEX:
+            {
+                as.load(EAX, operand[2]);
+                as.emit({0x3D});                            //cmp eax, rows
+                as.imm32(operand[4]);
+                toOutOfBounds[operand[6]].push_back(as.jcc(CC_AE));
+                as.load(ECX, operand[3]);
+                as.emit({0x81, 0xF9});                      //cmp ecx, columns
+                as.imm32(operand[5]);
+                toOutOfBounds[operand[6]].push_back(as.jcc(CC_AE));
+                as.emit({0x69, 0xC0});                      //imul eax, eax, columns
+                as.imm32(operand[5]);
+                as.emit({0x01, 0xC8});                      //add eax, ecx
+                as.store(operand[1], EAX);
+                break;
+            }
+
+            case OP_PRINTI:
+            case OP_PRINTB:
+                as.load(EDI, operand[1]);
+                as.call(op == OP_PRINTI ? reinterpret_cast<const void*>(&JIT::printInt)
+                                        : reinterpret_cast<const void*>(&JIT::printBool));
+                break;
+
+            //the status of a loop run in parallel is -1 if it has to run serially
+            case OP_PARLOOP:
+            {
+                as.emit({0x4C, 0x89, 0xEF, 0xBE});         //mov rdi, r13; mov esi, imm
+                as.imm32(operand[1]);
+                as.emit({0x48, 0x89, 0xDA});               //mov rdx, rbx
+                as.load(ECX, operand[2]);
+                as.call(reinterpret_cast<const void*>(&JIT::parallelLoop));
+                as.emit({0x83, 0xF8, 0xFF});               //cmp eax, -1
+                size_t serial = as.jcc(CC_E);
+                as.emit({0x85, 0xC0});                     //test eax, eax
+                jumps.push_back({as.jcc(CC_E), operand[3]});
+                toExit.push_back(as.jmp());
+                as.patch(serial, as.here());
+                break;
+            }
+
+            //like OP_PARLOOP, without a bound
+            case OP_TASKS:
+            {
+                as.emit({0x4C, 0x89, 0xEF, 0xBE});         //mov rdi, r13; mov esi, imm
+                as.imm32(operand[1]);
+                as.emit({0x48, 0x89, 0xDA});               //mov rdx, rbx
+                as.call(reinterpret_cast<const void*>(&JIT::taskGraph));
+                as.emit({0x83, 0xF8, 0xFF});               //cmp eax, -1
+                size_t serial = as.jcc(CC_E);
+                as.emit({0x85, 0xC0});                     //test eax, eax
+                jumps.push_back({as.jcc(CC_E), operand[2]});
+                toExit.push_back(as.jmp());
+                as.patch(serial, as.here());
+                break;
+            }
+
+            default:
+                throw CompileError("JIT: unsupported opcode " + std::to_string(op));
+        }
+        pc += 1 + BytecodeProgram::numOperands(op);
+    }
+    native[pc] = as.here();
+
+    //exits with an error status
+    auto errorExit = [&](const std::vector<size_t>& from, int32_t status) {
+        if(from.empty())
+            return;
+        for(size_t at : from)
+            as.patch(at, as.here());
+        as.emit({0xB8});                            //mov eax, status
+        as.imm32(status);
+        toExit.push_back(as.jmp());
+    };
+    errorExit(toDivisionByZero, STATUS_DIVISION_BY_ZERO);
+    errorExit(toUninitialized, STATUS_UNINITIALIZED_CELL);
+    for(size_t i = 0; i < toOutOfBounds.size(); i++)
+        errorExit(toOutOfBounds[i], STATUS_OUT_OF_BOUNDS + i);
+
+    //pop r13; pop rbx; pop rbp; ret
+    for(size_t at : toExit)
+        as.patch(at, as.here());
+    as.emit({0x41, 0x5D, 0x5B, 0x5D, 0xC3});
+
+    //the entry of a parallel loop or of a task jumps to its code, which shares the exit with the program
+    for(auto& loop : program.getParallelLoops())
+    {
+        entries.push_back(as.here());
+        as.emit(prologue);
+        jumps.push_back({as.jmp(), loop.entry});
+    }
+    for(auto& graph : program.getTaskGraphs())
+    {
+        taskEntries.push_back({});
+        for(auto& task : graph.tasks)
+        {
+            taskEntries.back().push_back(as.here());
+            as.emit(prologue);
+            jumps.push_back({as.jmp(), task.entry});
+        }
+    }
+
+    for(auto& jump : jumps)
+        as.patch(jump.first, native[jump.second]);
+
+    //the code is written and then made executable, never both at once
+    codeSize = as.bytes.size();
+    void* memory = mmap(nullptr, codeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED)
+        throw CompileError("JIT: cannot allocate executable memory");
+    std::memcpy(memory, as.bytes.data(), codeSize);
+    if(mprotect(memory, codeSize, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, codeSize);
+        throw CompileError("JIT: cannot make the code executable");
+    }
+    code = memory;
+#endif
+}
+
+void JIT::run()
+{
+    int32_t status = reinterpret_cast<Entry>(code)(registers.data(), this);
+    if(status != STATUS_OK)
+        raise(status);
+}
+
+void JIT::raise(int32_t status)
+{
+    switch(status)
+    {
+        case STATUS_PARALLEL_ERROR:
+            std::rethrow_exception(parallelError);
+        case STATUS_DIVISION_BY_ZERO:
+            throw EvaluationError("Division by 0");
+        case STATUS_UNINITIALIZED_CELL:
+            throw EvaluationError("Trying to retrieve a cell from an array which has not been declared");
+        default:
+            throw EvaluationError("Out of bounds error on " + program.getArrays()[status - STATUS_OUT_OF_BOUNDS].name + " array");
+    }
+}
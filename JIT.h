@@ -0,0 +1,72 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <vector>
+
+#include "Bytecode.h"
+#include "Runtime.h"
+
+//native code is generated only for x86-64 Unix systems, elsewhere the JIT
+//throws CompileError and the program is left to the interpreter
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_AVAILABLE
+#endif
+
+//Translates a BytecodeProgram into x86-64 machine code placed in executable memory.
+//The registers of the bytecode stay in memory, every instruction becomes a short native
+//sequence and jumps become native jumps. Prints and array declarations call back into C++;
+//runtime errors leave the native code with a status that run() turns into the same
+//EvaluationError messages of the EvaluationVisitor. The chunks of a parallel loop run the native
+//code of the loop, entered with their own registers
+class JIT {
+public:
+    //throws CompileError if the program can't be translated
+    JIT(const BytecodeProgram& p);
+    ~JIT();
+    JIT(JIT const&) = delete;
+    JIT& operator=(JIT const&) = delete;
+
+    void run();
+
+    size_t getCodeSize() const {return codeSize;}
+
+private:
+    //what the native code sees of an array. The layout is hardcoded in the generated code
+    struct NativeArray {
+        int32_t* cells;
+        uint8_t* initialized;
+        uint32_t size;
+    };
+
+    //status returned by the native code; out of bounds errors add the index of the array
+    enum Status {STATUS_OK, STATUS_DIVISION_BY_ZERO, STATUS_UNINITIALIZED_CELL, STATUS_PARALLEL_ERROR, STATUS_OUT_OF_BOUNDS};
+
+    using Entry = int32_t (*)(int32_t* registers, JIT* jit);
+
+    const BytecodeProgram& program;
+    std::vector<int32_t> registers;
+    std::vector<RuntimeArray> arrays;
+    std::vector<NativeArray> nativeArrays;
+
+    void* code;
+    size_t codeSize;
+    //offset of the entry of the code of every parallel loop, and of every task of every task graph
+    std::vector<size_t> entries;
+    std::vector<std::vector<size_t>> taskEntries;
+
+    void generate();
+    [[noreturn]] void raise(int32_t status);
+
+    //called by the native code, they must not throw
+    static void declareArray(JIT* jit, int32_t array) noexcept;
+    static void printInt(int32_t value) noexcept;
+    static void printBool(int32_t value) noexcept;
+    //returns -1 if the loop is left to its serial code, otherwise the status it ended with
+    static int32_t parallelLoop(JIT* jit, int32_t loop, int32_t* registers, int32_t bound) noexcept;
+    static int32_t taskGraph(JIT* jit, int32_t graph, int32_t* registers) noexcept;
+};
+
+#endif
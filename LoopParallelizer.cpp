@@ -0,0 +1,889 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdlib>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+#include "LoopParallelizer.h"
+#include "Fused.h"
+#include "Runtime.h"
+#include "OutputSink.h"
+#include "ThreadPool.h"
+
+namespace {
+
+//loops with fewer iterations run serially: waking the threads would cost more than they save
+const int64_t MIN_PARALLEL_TRIPS = 4096;
+//a loop is split in up to CHUNKS_PER_THREAD chunks per thread, so that threads finishing
+//early take the chunks left, of at least MIN_CHUNK_TRIPS iterations
+const int64_t MIN_CHUNK_TRIPS = 1024;
+const int CHUNKS_PER_THREAD = 4;
+//a parallel for runs in parallel from 2 iterations, which may be long ones. Its chunks are smaller,
+//down to a single iteration, so that the threads can balance iterations of different lengths
+const int STATED_CHUNKS_PER_THREAD = 16;
+
+//coefficients of the induction above it are not analyzed, so that their arithmetic can't overflow
+const int64_t MAX_COEFFICIENT = 1 << 20;
+
+Expression* unwrap(Expression* exp)
+{
+    while(exp->getKind() == Node::FUSED)
+        exp = static_cast<Fused*>(exp)->getOriginal();
+    return exp;
+}
+
+bool isId(Expression* exp, const std::string& name)
+{
+    exp = unwrap(exp);
+    return exp->getKind() == Node::ID && static_cast<Id*>(exp)->getName() == name;
+}
+
+//the expressions read to evaluate exp
+std::vector<Expression*> operands(Expression* exp)
+{
+    switch(exp->getKind())
+    {
+        case Node::FUSED:
+            return {static_cast<Fused*>(exp)->getOriginal()};
+        case Node::ACCESS:
+            return {static_cast<Access*>(exp)->getIndex()};
+        case Node::INDEX:
+            return static_cast<Index*>(exp)->getSubscripts();
+        case Node::NOT:
+            return {static_cast<Not*>(exp)->getExp()};
+        case Node::UNARY:
+            return {static_cast<Unary*>(exp)->getExp()};
+        case Node::AND:
+            return {static_cast<And*>(exp)->getLeftExp(), static_cast<And*>(exp)->getRightExp()};
+        case Node::OR:
+            return {static_cast<Or*>(exp)->getLeftExp(), static_cast<Or*>(exp)->getRightExp()};
+        case Node::REL:
+            return {static_cast<Rel*>(exp)->getLeftExp(), static_cast<Rel*>(exp)->getRightExp()};
+        case Node::ARITHM:
+            return {static_cast<Arithm*>(exp)->getLeftExp(), static_cast<Arithm*>(exp)->getRightExp()};
+        default:
+            return {};
+    }
+}
+
+//expressions with the same tree, which have the same value when evaluated on the same state
+bool sameExpression(Expression* a, Expression* b)
+{
+    a = unwrap(a);
+    b = unwrap(b);
+    if(a->getKind() != b->getKind())
+        return false;
+    switch(a->getKind())
+    {
+        case Node::ID:
+            return static_cast<Id*>(a)->getName() == static_cast<Id*>(b)->getName();
+        case Node::INT_CONSTANT:
+            return static_cast<intConstant*>(a)->getInt() == static_cast<intConstant*>(b)->getInt();
+        case Node::BOOL_CONSTANT:
+            return static_cast<boolConstant*>(a)->getBool() == static_cast<boolConstant*>(b)->getBool();
+        //a function may read what the other changes
+        case Node::CALL:
+            return false;
+        case Node::ACCESS:
+            if(static_cast<Access*>(a)->getId()->getName() != static_cast<Access*>(b)->getId()->getName())
+                return false;
+            break;
+        case Node::UNARY:
+            if(static_cast<Unary*>(a)->getOp() != static_cast<Unary*>(b)->getOp())
+                return false;
+            break;
+        case Node::REL:
+            if(static_cast<Rel*>(a)->getOp() != static_cast<Rel*>(b)->getOp())
+                return false;
+            break;
+        case Node::ARITHM:
+            if(static_cast<Arithm*>(a)->getOp() != static_cast<Arithm*>(b)->getOp())
+                return false;
+            break;
+        default:
+            break;
+    }
+    std::vector<Expression*> left = operands(a);
+    std::vector<Expression*> right = operands(b);
+    if(left.size() != right.size())
+        return false;
+    for(size_t k = 0; k < left.size(); k++)
+        if(!sameExpression(left[k], right[k]))
+            return false;
+    return true;
+}
+
+//array reads, divisions and calls can raise an error
+bool canFail(Expression* exp)
+{
+    exp = unwrap(exp);
+    if(exp->getKind() == Node::ACCESS || exp->getKind() == Node::INDEX || exp->getKind() == Node::CALL
+       || (exp->getKind() == Node::ARITHM && static_cast<Arithm*>(exp)->getOp() == Op::DIV))
+        return true;
+    for(Expression* operand : operands(exp))
+        if(canFail(operand))
+            return true;
+    return false;
+}
+
+//returns false if set is not s = s + e, s = s - e, s = s * e, s = s && e, s = s || e or one of them
+//with the operands swapped, otherwise the operation of the update and e
+bool asUpdate(Set* set, ReductionOp& op, Expression*& operand)
+{
+    const std::string& name = set->getId()->getName();
+    Expression* exp = unwrap(set->getExp());
+    Expression* left;
+    Expression* right;
+    switch(exp->getKind())
+    {
+        case Node::ARITHM:
+        {
+            auto arithm = static_cast<Arithm*>(exp);
+            left = arithm->getLeftExp();
+            right = arithm->getRightExp();
+            //s = s - e sums -e
+            if(arithm->getOp() == Op::SUB)
+            {
+                op = REDUCE_ADD;
+                operand = right;
+                return isId(left, name);
+            }
+            if(arithm->getOp() != Op::ADD && arithm->getOp() != Op::MUL)
+                return false;
+            op = arithm->getOp() == Op::ADD ? REDUCE_ADD : REDUCE_MUL;
+            break;
+        }
+
+        case Node::AND:
+        case Node::OR:
+            if(exp->getKind() == Node::AND)
+            {
+                left = static_cast<And*>(exp)->getLeftExp();
+                right = static_cast<And*>(exp)->getRightExp();
+            }
+            else
+            {
+                left = static_cast<Or*>(exp)->getLeftExp();
+                right = static_cast<Or*>(exp)->getRightExp();
+            }
+            op = exp->getKind() == Node::AND ? REDUCE_AND : REDUCE_OR;
+            break;
+
+        default:
+            return false;
+    }
+    if(isId(left, name))
+        operand = right;
+    else if(isId(right, name))
+        operand = left;
+    else
+        return false;
+    return true;
+}
+
+//returns false if exp is not affine in the induction, otherwise its coefficient. The parts of exp
+//that don't read the induction must be invariant
+bool affineIn(Expression* exp, const std::string& induction, const std::function<bool(Expression*)>& invariant,
+              int64_t& coefficient)
+{
+    exp = unwrap(exp);
+    switch(exp->getKind())
+    {
+        case Node::ID:
+            if(static_cast<Id*>(exp)->getName() != induction)
+                break;
+            coefficient = 1;
+            return true;
+
+        case Node::UNARY:
+            if(!affineIn(static_cast<Unary*>(exp)->getExp(), induction, invariant, coefficient))
+                return false;
+            coefficient = -coefficient;
+            return true;
+
+        case Node::ARITHM:
+        {
+            auto arithm = static_cast<Arithm*>(exp);
+            Op::BinOpCode op = arithm->getOp();
+            if(op != Op::ADD && op != Op::SUB && op != Op::MUL)
+                break;
+            int64_t left, right;
+            if(!affineIn(arithm->getLeftExp(), induction, invariant, left)
+               || !affineIn(arithm->getRightExp(), induction, invariant, right))
+                return false;
+            if(op == Op::ADD)
+                coefficient = left + right;
+            else if(op == Op::SUB)
+                coefficient = left - right;
+            else if(left == 0 && right == 0)
+                coefficient = 0;
+            //a multiple of the induction by a literal
+            else if(unwrap(arithm->getRightExp())->getKind() == Node::INT_CONSTANT)
+                coefficient = left * static_cast<intConstant*>(unwrap(arithm->getRightExp()))->getInt();
+            else if(unwrap(arithm->getLeftExp())->getKind() == Node::INT_CONSTANT)
+                coefficient = right * static_cast<intConstant*>(unwrap(arithm->getLeftExp()))->getInt();
+            else
+                return false;
+            return std::abs(coefficient) <= MAX_COEFFICIENT;
+        }
+
+        default:
+            break;
+    }
+    coefficient = 0;
+    return invariant(exp);
+}
+
+//The state of the analysis of a loop: the writes of its body are collected first, then its reads
+//are checked against them
+class LoopAnalyzer {
+public:
+    LoopAnalyzer(IndependentLoop& r) : result{r} {}
+
+    bool analyze(While* loop);
+
+private:
+    IndependentLoop& result;
+    std::map<std::string, ReductionOp> reductions;
+    //array written by the body -> the index of its cells written by an iteration
+    std::map<std::string, Expression*> writtenArrays;
+
+    bool collectWrites(Stmt* stmt);
+    bool checkReads(Stmt* stmt);
+    bool checkReads(Expression* exp);
+
+    //returns false if set is not the update of a reduction, otherwise its operation and the other operand
+    bool asReduction(Set* set, ReductionOp& op, Expression*& operand);
+    //returns false if exp is not affine in the induction, otherwise its coefficient
+    bool affine(Expression* exp, int64_t& coefficient);
+    //exp has the same value in every iteration
+    bool invariant(Expression* exp);
+};
+
+bool LoopAnalyzer::analyze(While* loop)
+{
+    Expression* condition = unwrap(loop->getCondition());
+    if(condition->getKind() != Node::REL)
+        return false;
+    auto rel = static_cast<Rel*>(condition);
+    Expression* counter;
+    if(rel->getOp() == Rel::LESS || rel->getOp() == Rel::LESS_EQ)
+    {
+        counter = unwrap(rel->getLeftExp());
+        result.bound = rel->getRightExp();
+        result.inclusive = rel->getOp() == Rel::LESS_EQ;
+    }
+    else
+    {
+        counter = unwrap(rel->getRightExp());
+        result.bound = rel->getLeftExp();
+        result.inclusive = rel->getOp() == Rel::MORE_EQ;
+    }
+    if(counter->getKind() != Node::ID)
+        return false;
+    result.induction = static_cast<Id*>(counter)->getName();
+
+    if(loop->getStmt()->getKind() != Node::BLOCK)
+        return false;
+    auto block = static_cast<Block*>(loop->getStmt());
+    if(block->getDecls())
+        return false;
+    for(Seq* seq = block->getSeq(); seq; seq = seq->getSeq())
+        result.body.push_back(seq->getStmt());
+    //a body made of the increment alone is not worth a thread
+    if(result.body.size() < 2)
+        return false;
+
+    Stmt* last = result.body.back();
+    result.body.pop_back();
+    if(last->getKind() != Node::SET || static_cast<Set*>(last)->getId()->getName() != result.induction)
+        return false;
+    Expression* increment = unwrap(static_cast<Set*>(last)->getExp());
+    if(increment->getKind() != Node::ARITHM || static_cast<Arithm*>(increment)->getOp() != Op::ADD)
+        return false;
+    Expression* step = unwrap(static_cast<Arithm*>(increment)->getRightExp());
+    if(!isId(static_cast<Arithm*>(increment)->getLeftExp(), result.induction))
+    {
+        step = unwrap(static_cast<Arithm*>(increment)->getLeftExp());
+        if(!isId(static_cast<Arithm*>(increment)->getRightExp(), result.induction))
+            return false;
+    }
+    if(step->getKind() != Node::INT_CONSTANT || static_cast<intConstant*>(step)->getInt() <= 0)
+        return false;
+    result.step = static_cast<intConstant*>(step)->getInt();
+
+    for(Stmt* stmt : result.body)
+        if(!collectWrites(stmt))
+            return false;
+    for(Stmt* stmt : result.body)
+        if(!checkReads(stmt))
+            return false;
+    //the bound is evaluated once, before the first iteration
+    if(!invariant(result.bound) || canFail(result.bound))
+        return false;
+
+    //the cells written by an iteration are the ones it reads: they must change with the induction
+    int64_t maxCoefficient = 0;
+    for(auto& array : writtenArrays)
+    {
+        Expression* index = unwrap(array.second);
+        std::vector<Expression*> subscripts{index};
+        if(index->getKind() == Node::INDEX)
+            subscripts = static_cast<Index*>(index)->getSubscripts();
+        int64_t largest = 0;
+        for(Expression* subscript : subscripts)
+        {
+            int64_t coefficient;
+            if(!affine(subscript, coefficient))
+                return false;
+            largest = std::max(largest, std::abs(coefficient));
+        }
+        if(largest == 0)
+            return false;
+        maxCoefficient = std::max(maxCoefficient, largest);
+    }
+    result.maxCoefficient = maxCoefficient;
+    result.reductions.assign(reductions.begin(), reductions.end());
+    return true;
+}
+
+bool LoopAnalyzer::collectWrites(Stmt* stmt)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+        {
+            auto block = static_cast<Block*>(stmt);
+            if(block->getDecls())
+                return false;
+            for(Seq* seq = block->getSeq(); seq; seq = seq->getSeq())
+                if(!collectWrites(seq->getStmt()))
+                    return false;
+            return true;
+        }
+
+        case Node::IF:
+            return collectWrites(static_cast<If*>(stmt)->getStmt());
+
+        case Node::ELSE:
+            return collectWrites(static_cast<Else*>(stmt)->getifTrueStmt())
+                   && collectWrites(static_cast<Else*>(stmt)->getifFalseStmt());
+
+        case Node::SET:
+        {
+            auto set = static_cast<Set*>(stmt);
+            const std::string& name = set->getId()->getName();
+            ReductionOp op;
+            Expression* operand;
+            if(name == result.induction || !asReduction(set, op, operand))
+                return false;
+            auto it = reductions.find(name);
+            if(it != reductions.end() && it->second != op)
+                return false;
+            reductions[name] = op;
+            return true;
+        }
+
+        case Node::SET_ELEM:
+        {
+            auto setElem = static_cast<SetElem*>(stmt);
+            auto it = writtenArrays.find(setElem->getId()->getName());
+            if(it == writtenArrays.end())
+                writtenArrays[setElem->getId()->getName()] = setElem->getIndex();
+            else if(!sameExpression(it->second, setElem->getIndex()))
+                return false;
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+bool LoopAnalyzer::checkReads(Stmt* stmt)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+            for(Seq* seq = static_cast<Block*>(stmt)->getSeq(); seq; seq = seq->getSeq())
+                if(!checkReads(seq->getStmt()))
+                    return false;
+            return true;
+
+        case Node::IF:
+            return checkReads(static_cast<If*>(stmt)->getCondition())
+                   && checkReads(static_cast<If*>(stmt)->getStmt());
+
+        case Node::ELSE:
+        {
+            auto elseNode = static_cast<Else*>(stmt);
+            return checkReads(elseNode->getCondition()) && checkReads(elseNode->getifTrueStmt())
+                   && checkReads(elseNode->getifFalseStmt());
+        }
+
+        //a reduction reads itself only in its update
+        case Node::SET:
+        {
+            ReductionOp op;
+            Expression* operand;
+            asReduction(static_cast<Set*>(stmt), op, operand);
+            return checkReads(operand);
+        }
+
+        case Node::SET_ELEM:
+            return checkReads(static_cast<SetElem*>(stmt)->getExp()) && checkReads(static_cast<SetElem*>(stmt)->getIndex());
+
+        default:
+            return false;
+    }
+}
+
+bool LoopAnalyzer::checkReads(Expression* exp)
+{
+    exp = unwrap(exp);
+    //a function may read and write any variable of the program
+    if(exp->getKind() == Node::CALL)
+        return false;
+    if(exp->getKind() == Node::ID)
+        return !reductions.count(static_cast<Id*>(exp)->getName());
+    if(exp->getKind() == Node::ACCESS)
+    {
+        auto access = static_cast<Access*>(exp);
+        auto it = writtenArrays.find(access->getId()->getName());
+        if(it != writtenArrays.end() && !sameExpression(it->second, access->getIndex()))
+            return false;
+    }
+    for(Expression* operand : operands(exp))
+        if(!checkReads(operand))
+            return false;
+    return true;
+}
+
+//a chunk evaluates e also where the serial loop would skip it, having s already false (or true)
+bool LoopAnalyzer::asReduction(Set* set, ReductionOp& op, Expression*& operand)
+{
+    if(!asUpdate(set, op, operand))
+        return false;
+    if(op == REDUCE_AND || op == REDUCE_OR)
+    {
+        Expression* exp = unwrap(set->getExp());
+        return !canFail(operands(exp)[0]) && !canFail(operands(exp)[1]);
+    }
+    return true;
+}
+
+bool LoopAnalyzer::affine(Expression* exp, int64_t& coefficient)
+{
+    return affineIn(exp, result.induction, [this](Expression* e) {return invariant(e);}, coefficient);
+}
+
+bool LoopAnalyzer::invariant(Expression* exp)
+{
+    exp = unwrap(exp);
+    if(exp->getKind() == Node::CALL)
+        return false;
+    if(exp->getKind() == Node::ID)
+        return static_cast<Id*>(exp)->getName() != result.induction && !reductions.count(static_cast<Id*>(exp)->getName());
+    if(exp->getKind() == Node::ACCESS && writtenArrays.count(static_cast<Access*>(exp)->getId()->getName()))
+        return false;
+    for(Expression* operand : operands(exp))
+        if(!invariant(operand))
+            return false;
+    return true;
+}
+
+//The checks of checkParallelFor on the statements of the body of a loop
+class ParallelForChecker {
+public:
+    ParallelForChecker(ParallelFor* loop);
+
+    //the arrays written by stmt, to be collected before the body is checked
+    void collectWrites(Stmt* stmt);
+    //then the subscript telling apart the cells written by each iteration
+    void findSubscripts();
+    //inLoop: stmt is in a loop nested in the body
+    void check(Stmt* stmt, bool inLoop);
+
+private:
+    std::string induction;
+    std::map<std::string, ReductionOp> reductions;
+    std::set<std::string> privates;
+    //an array written by the body: the subscript of its first write that is affine in the index, with a
+    //coefficient other than 0, its position among the subscripts, and their number (1 for a flat access)
+    struct WrittenArray {
+        Expression* subscript;
+        size_t position;
+        size_t subscripts;
+    };
+    std::map<std::string, WrittenArray> writtenArrays;
+
+    void checkWrite(Id* var);
+    void checkReads(Expression* exp);
+    //an access to an array written by the body must be to the cells of the iteration
+    void checkAccess(Id* array, Expression* index);
+    //exp has the same value in every iteration
+    bool invariant(Expression* exp);
+};
+
+ParallelForChecker::ParallelForChecker(ParallelFor* loop) : induction{loop->getId()->getName()}
+{
+    for(Decl* decl : loop->getPrivates())
+    {
+        if(decl->getType()->getKind() == Node::VECTOR_TYPE)
+            throw ParseError("Arrays can't be declared in the body of a parallel for");
+        privates.insert(decl->getId()->getName());
+    }
+    for(auto& reduction : loop->getReductions())
+    {
+        const std::string& name = reduction.var->getName();
+        if(name == induction || privates.count(name) || !reductions.emplace(name, reduction.op).second)
+            throw ParseError("Invalid reduction " + name + " of a parallel for");
+    }
+}
+
+void ParallelForChecker::collectWrites(Stmt* stmt)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+            for(Seq* seq = static_cast<Block*>(stmt)->getSeq(); seq; seq = seq->getSeq())
+                collectWrites(seq->getStmt());
+            break;
+        case Node::IF:
+            collectWrites(static_cast<If*>(stmt)->getStmt());
+            break;
+        case Node::ELSE:
+            collectWrites(static_cast<Else*>(stmt)->getifTrueStmt());
+            collectWrites(static_cast<Else*>(stmt)->getifFalseStmt());
+            break;
+        case Node::WHILE:
+            collectWrites(static_cast<While*>(stmt)->getStmt());
+            break;
+        case Node::DO:
+            collectWrites(static_cast<Do*>(stmt)->getStmt());
+            break;
+        case Node::PARALLEL_FOR:
+            collectWrites(static_cast<ParallelFor*>(stmt)->getStmt());
+            break;
+
+        //the whole index of the first write, until findSubscripts
+        case Node::SET_ELEM:
+            writtenArrays.emplace(static_cast<SetElem*>(stmt)->getId()->getName(),
+                                  WrittenArray{static_cast<SetElem*>(stmt)->getIndex(), 0, 0});
+            break;
+
+        default:
+            break;
+    }
+}
+
+//the cells written by an iteration are told apart by a subscript c * i + e, where e is the same in
+//every iteration: no other iteration writes them
+void ParallelForChecker::findSubscripts()
+{
+    for(auto& array : writtenArrays)
+    {
+        Expression* index = unwrap(array.second.subscript);
+        std::vector<Expression*> subscripts{index};
+        if(index->getKind() == Node::INDEX)
+            subscripts = static_cast<Index*>(index)->getSubscripts();
+        size_t k = 0;
+        for(; k < subscripts.size(); k++)
+        {
+            int64_t coefficient;
+            if(affineIn(subscripts[k], induction, [this](Expression* e) {return invariant(e);}, coefficient)
+               && coefficient != 0)
+                break;
+        }
+        if(k == subscripts.size())
+            throw ParseError("A parallel for can write the cells of " + array.first + " only at a subscript like "
+                             + induction + " + c, which changes with its index");
+        array.second = {subscripts[k], k, subscripts.size()};
+    }
+}
+
+void ParallelForChecker::check(Stmt* stmt, bool inLoop)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+            for(Seq* seq = static_cast<Block*>(stmt)->getSeq(); seq; seq = seq->getSeq())
+                check(seq->getStmt(), inLoop);
+            break;
+
+        case Node::IF:
+            checkReads(static_cast<If*>(stmt)->getCondition());
+            check(static_cast<If*>(stmt)->getStmt(), inLoop);
+            break;
+
+        case Node::ELSE:
+        {
+            auto elseNode = static_cast<Else*>(stmt);
+            checkReads(elseNode->getCondition());
+            check(elseNode->getifTrueStmt(), inLoop);
+            check(elseNode->getifFalseStmt(), inLoop);
+            break;
+        }
+
+        case Node::WHILE:
+            checkReads(static_cast<While*>(stmt)->getCondition());
+            check(static_cast<While*>(stmt)->getStmt(), true);
+            break;
+
+        case Node::DO:
+            checkReads(static_cast<Do*>(stmt)->getCondition());
+            check(static_cast<Do*>(stmt)->getStmt(), true);
+            break;
+
+        //the nested loop writes its index and its reductions, which may be reductions of this loop too
+        case Node::PARALLEL_FOR:
+        {
+            auto loop = static_cast<ParallelFor*>(stmt);
+            checkWrite(loop->getId());
+            checkReads(loop->getFirst());
+            checkReads(loop->getLast());
+            for(auto& reduction : loop->getReductions())
+            {
+                auto it = reductions.find(reduction.var->getName());
+                if(it == reductions.end() || it->second != reduction.op)
+                    checkWrite(reduction.var);
+            }
+            check(loop->getStmt(), true);
+            break;
+        }
+
+        case Node::SET:
+        {
+            auto set = static_cast<Set*>(stmt);
+            const std::string& name = set->getId()->getName();
+            auto it = reductions.find(name);
+            if(it == reductions.end())
+            {
+                checkWrite(set->getId());
+                checkReads(set->getExp());
+                break;
+            }
+            ReductionOp op;
+            Expression* operand;
+            if(!asUpdate(set, op, operand) || op != it->second)
+            {
+                const char* ops[] = {"+", "*", "&&", "||"};     //same order of ReductionOp
+                throw ParseError("Reduction " + name + " can only be updated as " + name + " = " + name
+                                 + " " + ops[it->second] + " e");
+            }
+            checkReads(operand);
+            break;
+        }
+
+        case Node::SET_ELEM:
+        {
+            auto setElem = static_cast<SetElem*>(stmt);
+            checkReads(setElem->getExp());
+            checkReads(setElem->getIndex());
+            checkAccess(setElem->getId(), setElem->getIndex());
+            break;
+        }
+
+        case Node::PRINT:
+            checkReads(static_cast<Print*>(stmt)->getExp());
+            break;
+
+        case Node::BREAK:
+            if(!inLoop)
+                throw ParseError("A break can't leave a parallel for");
+            break;
+
+        case Node::LOAD:
+        case Node::STORE:
+            throw ParseError("load and store can't be run by a parallel for");
+
+        default:
+            break;
+    }
+}
+
+void ParallelForChecker::checkWrite(Id* var)
+{
+    const std::string& name = var->getName();
+    if(name == induction)
+        throw ParseError("The index " + name + " of a parallel for can't be assigned in its body");
+    if(!privates.count(name))
+        throw ParseError("A parallel for can't assign " + name + ", which is neither declared in its body nor a reduction");
+}
+
+void ParallelForChecker::checkReads(Expression* exp)
+{
+    exp = unwrap(exp);
+    if(exp->getKind() == Node::CALL)
+        throw ParseError("A parallel for can't call " + static_cast<Call*>(exp)->getName());
+    if(exp->getKind() == Node::ID && reductions.count(static_cast<Id*>(exp)->getName()))
+        throw ParseError("Reduction " + static_cast<Id*>(exp)->getName() + " can only be read by its update");
+    if(exp->getKind() == Node::ACCESS)
+        checkAccess(static_cast<Access*>(exp)->getId(), static_cast<Access*>(exp)->getIndex());
+    for(Expression* operand : operands(exp))
+        checkReads(operand);
+}
+
+void ParallelForChecker::checkAccess(Id* array, Expression* index)
+{
+    auto it = writtenArrays.find(array->getName());
+    if(it == writtenArrays.end())
+        return;
+    index = unwrap(index);
+    std::vector<Expression*> subscripts{index};
+    if(index->getKind() == Node::INDEX)
+        subscripts = static_cast<Index*>(index)->getSubscripts();
+    //a flat access and an access by subscripts don't see the same cells as the writes
+    const WrittenArray& written = it->second;
+    if(subscripts.size() != written.subscripts || !sameExpression(subscripts[written.position], written.subscript))
+        throw ParseError("A parallel for can access " + array->getName() + " only at the cells of its iteration,"
+                         + " which are written by it and by no other");
+}
+
+//the index and the private variables change in every iteration, and so do the arrays it writes
+bool ParallelForChecker::invariant(Expression* exp)
+{
+    exp = unwrap(exp);
+    if(exp->getKind() == Node::ID)
+        return static_cast<Id*>(exp)->getName() != induction && !privates.count(static_cast<Id*>(exp)->getName());
+    if(exp->getKind() == Node::ACCESS && writtenArrays.count(static_cast<Access*>(exp)->getId()->getName()))
+        return false;
+    for(Expression* operand : operands(exp))
+        if(!invariant(operand))
+            return false;
+    return true;
+}
+
+int32_t identity(ReductionOp op)
+{
+    return op == REDUCE_MUL || op == REDUCE_AND;
+}
+
+int32_t combine(ReductionOp op, int32_t l, int32_t r)
+{
+    switch(op)
+    {
+        case REDUCE_ADD:
+            return wrapAdd(l, r);
+        case REDUCE_MUL:
+            return wrapMul(l, r);
+        case REDUCE_AND:
+            return l && r;
+        default:
+            return l || r;
+    }
+}
+
+}
+
+bool analyzeLoop(While* loop, IndependentLoop& result)
+{
+    LoopAnalyzer analyzer(result);
+    return analyzer.analyze(loop);
+}
+
+void checkParallelFor(ParallelFor* loop)
+{
+    ParallelForChecker checker(loop);
+    checker.collectWrites(loop->getStmt());
+    checker.findSubscripts();
+    checker.check(loop->getStmt(), false);
+}
+
+bool runParallelLoop(const ParallelLoop& loop, int32_t* registers, int numRegisters, int32_t bound,
+                     const std::function<void(int32_t*)>& runChunk)
+{
+    ThreadPool& pool = ThreadPool::shared();
+    int64_t start = registers[loop.induction];
+    int64_t last = loop.inclusive ? int64_t{bound} : int64_t{bound} - 1;
+    if(pool.getThreads() < 2 || last < start)
+        return false;
+    int64_t trips = (last - start) / loop.step + 1;
+    int64_t end = start + trips * loop.step;
+    if(trips < (loop.stated ? 2 : MIN_PARALLEL_TRIPS) || end > INT_MAX
+       || (trips - 1) * loop.step * loop.maxCoefficient >= int64_t{1} << 32)
+        return false;
+
+    int chunks = loop.stated ? std::min<int64_t>(STATED_CHUNKS_PER_THREAD * pool.getThreads(), trips)
+                             : std::min<int64_t>(CHUNKS_PER_THREAD * pool.getThreads(), trips / MIN_CHUNK_TRIPS);
+    size_t numReductions = loop.reductions.size();
+    std::vector<int32_t> partials(chunks * numReductions);
+    std::vector<std::exception_ptr> errors(chunks);
+    //the first chunk that raised an error: the chunks after it are not run
+    std::atomic<int> firstError{chunks};
+
+    //an ordered chunk prints on its own sink, and its lines are written to the sink of the caller
+    //as soon as the chunks before it have been written: the first chunk not written yet is written
+    OutputSink& output = OutputSink::current();
+    std::vector<std::string> printed(loop.ordered ? chunks : 0);
+    std::vector<char> done(loop.ordered ? chunks : 0);
+    int written = 0;
+    std::mutex writing;
+    auto write = [&](int chunk) {
+        std::lock_guard<std::mutex> lock(writing);
+        done[chunk] = true;
+        for(; written < chunks && done[written]; written++)
+        {
+            output.printText(printed[written]);
+            std::string().swap(printed[written]);
+            //nothing after an error is printed
+            if(errors[written])
+                written = chunks;
+        }
+    };
+
+    pool.run(chunks, [&](int chunk) {
+        if(chunk > firstError.load(std::memory_order_relaxed))
+            return;
+        std::vector<int32_t> r(registers, registers + numRegisters);
+        r[loop.induction] = start + trips * chunk / chunks * loop.step;
+        r[loop.limit] = start + trips * (chunk + 1) / chunks * loop.step;
+        for(auto& reduction : loop.reductions)
+            r[reduction.first] = identity(reduction.second);
+        std::ostringstream text;
+        std::unique_ptr<OutputSink> sink;
+        OutputSink* previous = &OutputSink::current();
+        if(loop.ordered)
+        {
+            sink = std::make_unique<OutputSink>(text, OutputSink::BUFFERED);
+            OutputSink::setCurrent(sink.get());
+        }
+        try {
+            runChunk(r.data());
+        }
+        catch (...) {
+            errors[chunk] = std::current_exception();
+            int first = firstError.load();
+            while(chunk < first && !firstError.compare_exchange_weak(first, chunk))
+                ;
+        }
+        if(loop.ordered)
+        {
+            OutputSink::setCurrent(previous);
+            sink->flush();
+            printed[chunk] = text.str();
+            write(chunk);
+        }
+        if(errors[chunk])
+            return;
+        for(size_t k = 0; k < numReductions; k++)
+            partials[chunk * numReductions + k] = r[loop.reductions[k].first];
+    });
+
+    for(auto& error : errors)
+        if(error)
+            std::rethrow_exception(error);
+    for(size_t k = 0; k < numReductions; k++)
+    {
+        int32_t& value = registers[loop.reductions[k].first];
+        for(int chunk = 0; chunk < chunks; chunk++)
+            value = combine(loop.reductions[k].second, value, partials[chunk * numReductions + k]);
+    }
+    registers[loop.induction] = end;
+    return true;
+}
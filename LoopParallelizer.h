@@ -0,0 +1,58 @@
+#ifndef LOOP_PARALLELIZER_H
+#define LOOP_PARALLELIZER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Node.h"
+#include "Bytecode.h"
+
+//A counted While loop whose iterations can run in any order, found by analyzeLoop:
+//    while(i < bound) {body; i = i + step;}
+//with i <= bound, bound > i and bound >= i as conditions too
+struct IndependentLoop {
+    std::string induction;
+    int32_t step;
+    Expression* bound;
+    bool inclusive;
+    std::vector<Stmt*> body;    //the statements before the increment
+    std::vector<std::pair<std::string, ReductionOp>> reductions;
+    int32_t maxCoefficient;     //see ParallelLoop
+};
+
+//Dependence analysis of a While loop of a resolved program. The loop is independent when:
+//- its condition compares the induction, an int variable, with a bound that doesn't change in the
+//  loop and can't fail, and the last statement of its body (a Block without declarations) adds a
+//  positive literal step to the induction
+//- its body has no loops, Break, Print, load or store
+//- the only other variables it writes are reductions: s = s + e, s = s - e, s = s * e, and, if e
+//  can't fail, s = s && e, s = s || e. s is read nowhere else in the body
+//- every access to an array it writes has the same subscripts, which are affine in the induction with
+//  a coefficient other than 0 and don't change in the loop otherwise, so that an iteration writes
+//  cells that no other iteration reads or writes
+bool analyzeLoop(While* loop, IndependentLoop& result);
+
+//Throws ParseError if the body of a parallel for can't run its iterations in any order (see ParallelFor):
+//- it assigns a variable that is neither declared in the body nor a reduction, or it assigns the index
+//- it updates a reduction other than with s = s op e (s - e for +), with the op of the reduction,
+//  or it reads a reduction anywhere else
+//- it declares an array, runs a load or a store, or has a break out of the parallel for
+//- it writes an array without a subscript c * i + e, with c a literal other than 0 and e the same in
+//  every iteration, or it accesses that array with another expression in the place of that subscript,
+//  or with another number of subscripts (a flat a[k] reaches the cells of a[i][j] of other iterations)
+void checkParallelFor(ParallelFor* loop);
+
+//Runs a parallel loop of a bytecode program which is about to start, with its induction in registers
+//and the given bound: its iterations are split in chunks, and runChunk runs the code of the loop
+//on the registers of a chunk. Then the reductions and the induction get their final value in registers.
+//Returns false, without running anything, if the loop is better left to its serial code: too few
+//iterations, a single thread or an induction that would wrap around. If some chunks raise an error,
+//the one of the first of them is raised, which is the first one the serial loop would raise.
+//The lines printed by the chunks of an ordered loop are written to the sink of the caller in the
+//order of the chunks, up to the first that raised an error
+bool runParallelLoop(const ParallelLoop& loop, int32_t* registers, int numRegisters, int32_t bound,
+                     const std::function<void(int32_t*)>& runChunk);
+
+#endif
@@ -2,96 +2,357 @@
 #include <string>
 #include <stdlib.h>
 #include <fstream>
+#include <sstream>
+#include <vector>
 
 #include "Exceptions.h"
 #include "Token.h"
-#include "Tokenizer.h"
-#include "Parser.h"
 #include "Visitor.h"
+#include "PassManager.h"
+#include "BytecodeCompiler.h"
+#include "CTranslator.h"
+#include "OutputSink.h"
+#include "ThreadPool.h"
+#include "BatchVM.h"
+#include "Runner.h"
+#include "Server.h"
 
 
-int main(int argc, char* argv[]) {
+// Runs the program once for every line of instancesFile, which gives the inputs of the instance.
+// The instances run on the BatchVM, or on the EvaluationVisitor if scalar is set or the program
+// can't be compiled: each one on a thread of the pool with its own Environment, all of them on the
+// same tree. Returns the exit status
+static int runInstances(Program* program, const std::string& instancesFile, bool scalar, bool disasm) {
+    std::ifstream file(instancesFile);
+    if (!file) {
+        std::cerr << "Cannot open " << instancesFile << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<BatchInput> inputs;
+    try {
+        inputs = readInstances(file, program);
+    }
+    catch (ParseError const& pe) {
+        std::cerr << "Invalid instances in " << instancesFile << std::endl;
+        std::cerr << pe.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> outputs(inputs.size());
+    std::vector<std::string> errors(inputs.size());
+    BytecodeProgram bytecode;
+    if (!scalar) {
+        try {
+            BytecodeCompiler compiler;
+            bytecode = compiler.compile(program);
+        }
+        catch (CompileError const& ce) {
+            if (disasm)
+                std::cerr << "Bytecode not available: " << ce.what() << std::endl;
+            scalar = true;
+        }
+    }
+    if (!scalar) {
+        if (disasm)
+            bytecode.disassemble(std::cout);
+        BatchVM batch(bytecode, inputs);
+        batch.run();
+        for (size_t i = 0; i < inputs.size(); i++) {
+            outputs[i] = batch.getOutput(i);
+            errors[i] = batch.getError(i);
+        }
+    }
+    else {
+        ThreadPool::shared().run(inputs.size(), [&](int i) {
+            OutputSink* previous = &OutputSink::current();
+            std::ostringstream text;
+            OutputSink sink(text, OutputSink::BUFFERED);
+            OutputSink::setCurrent(&sink);
+            try {
+                Environment env;
+                for (auto& input : inputs[i]) {
+                    Type* type = input.first->getType();
+                    const std::string& name = input.first->getId()->getName();
+                    env.declareVar(name, type);
+                    env.assignConstant(name, type->getTypeCode() == Type::INT ? Value::fromInt(input.second)
+                                                                              : Value::fromBool(input.second));
+                }
+                EvaluationVisitor v(env);
+                program->accept(&v);
+            }
+            catch (EvaluationError const& ee) {
+                errors[i] = ee.what();
+            }
+            OutputSink::setCurrent(previous);
+            sink.flush();
+            outputs[i] = text.str();
+        });
+    }
+
+    // The output of every instance follows a line with its number, its error goes to std::cerr
+    OutputSink& output = OutputSink::current();
+    bool failed = false;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        output.printText("[instance " + std::to_string(i + 1) + "]\n" + outputs[i]);
+        if (!errors[i].empty()) {
+            output.flush();
+            std::cerr << "Errore nella valutazione (instance " << i + 1 << ")" << std::endl;
+            std::cerr << errors[i] << std::endl;
+            failed = true;
+        }
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+static int runCommandLine(int argc, char* argv[]) {
 
     // Command line parsing
-    if (argc < 2) {
-        std::cerr << "File not found!" << std::endl;
-        std::cerr << "Usage: " << argv[0] << " <file_name>" << std::endl;
+    std::string fileName;
+    RunOptions options;
+    bool quiet = false;
+    bool engineGiven = false;
+    std::string cFileName;
+    std::string instancesFile;
+    std::string batchSource;
+    std::string batchOutput;
+    std::string serverSocket;
+    long cacheSize = 64;
+    OutputSink::Mode outputMode = OutputSink::LINE;
+    long flushBytes = OutputSink::DEFAULT_FLUSH_BYTES;
+    long flushMillis = OutputSink::DEFAULT_FLUSH_MILLIS;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '0' + PassManager::MAX_OPT_LEVEL)
+            options.optLevel = arg[2] - '0';
+        else if (arg.rfind("--passes=", 0) == 0)
+            options.passList = arg.substr(std::string("--passes=").size());
+        else if (arg == "--pass-stats")
+            options.printPassStats = true;
+        else if (arg == "-q" || arg == "--quiet")
+            quiet = true;
+        else if (arg.rfind("--engine=", 0) == 0) {
+            options.engine = arg.substr(std::string("--engine=").size());
+            engineGiven = true;
+        }
+        else if (arg == "--disasm")
+            options.disasm = true;
+        else if (arg.rfind("--emit-c=", 0) == 0)
+            cFileName = arg.substr(std::string("--emit-c=").size());
+        else if (arg.rfind("--tier-threshold=", 0) == 0) {
+            try {
+                options.tierThreshold = std::stoi(arg.substr(std::string("--tier-threshold=").size()));
+            }
+            catch (std::exception const&) {
+                options.tierThreshold = -1;
+            }
+            if (options.tierThreshold < 0) {
+                std::cerr << "Invalid tier threshold " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--tier-log")
+            options.tierLog = true;
+        else if (arg.rfind("--persist-array=", 0) == 0) {
+            std::string binding = arg.substr(std::string("--persist-array=").size());
+            size_t colon = binding.find(':');
+            if (colon == 0 || colon == std::string::npos || colon + 1 == binding.size()) {
+                std::cerr << "Expecting --persist-array=<array>:<file>" << std::endl;
+                return EXIT_FAILURE;
+            }
+            options.persistentArrays.push_back({binding.substr(0, colon), binding.substr(colon + 1)});
+        }
+        else if (arg.rfind("--instances=", 0) == 0)
+            instancesFile = arg.substr(std::string("--instances=").size());
+        else if (arg.rfind("--batch=", 0) == 0)
+            batchSource = arg.substr(std::string("--batch=").size());
+        else if (arg.rfind("--batch-output=", 0) == 0)
+            batchOutput = arg.substr(std::string("--batch-output=").size());
+        else if (arg.rfind("--serve=", 0) == 0)
+            serverSocket = arg.substr(std::string("--serve=").size());
+        else if (arg.rfind("--cache-size=", 0) == 0) {
+            try {
+                cacheSize = std::stol(arg.substr(std::string("--cache-size=").size()));
+            }
+            catch (std::exception const&) {
+                cacheSize = -1;
+            }
+            if (cacheSize < 0) {
+                std::cerr << "Invalid cache size " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--output=line")
+            outputMode = OutputSink::LINE;
+        else if (arg == "--output=buffered")
+            outputMode = OutputSink::BUFFERED;
+        else if (arg == "--output=async")
+            outputMode = OutputSink::ASYNC;
+        else if (arg.rfind("--flush-bytes=", 0) == 0 || arg.rfind("--flush-ms=", 0) == 0) {
+            long value;
+            try {
+                value = std::stol(arg.substr(arg.find('=') + 1));
+            }
+            catch (std::exception const&) {
+                value = -1;
+            }
+            if (value <= 0 || value > 1L << 30) {
+                std::cerr << "Invalid value " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            (arg.rfind("--flush-bytes=", 0) == 0 ? flushBytes : flushMillis) = value;
+        }
+        else if (arg.rfind("--threads=", 0) == 0) {
+            int threads;
+            try {
+                threads = std::stoi(arg.substr(std::string("--threads=").size()));
+            }
+            catch (std::exception const&) {
+                threads = 0;
+            }
+            if (threads <= 0 || threads > 1024) {
+                std::cerr << "Invalid number of threads " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            ThreadPool::setSharedThreads(threads);
+        }
+        else if (arg[0] == '-') {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+        else
+            fileName = arg;
+    }
+
+    // A file, a batch or the server
+    int modes = !fileName.empty() + !batchSource.empty() + !serverSocket.empty();
+    if (modes != 1) {
+        std::cerr << (modes == 0 ? "File not found!" : "Only one of a file, --batch and --serve can be given") << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [-O0|-O1|-O2|-O3] [--passes=p1,p2,...] [--pass-stats] [-q]"
+                  << " [--engine=tree|bytecode|closure|jit|tiered|onepass] [--tier-threshold=N] [--tier-log] [--disasm]"
+                  << " [--persist-array=<array>:<file>]... [--instances=<file>]"
+                  << " [--output=line|buffered|async] [--flush-bytes=N] [--flush-ms=N] [--threads=N]"
+                  << " [--emit-c=<out.c>] <file_name>" << std::endl;
+        std::cerr << "       " << argv[0] << " [options] --batch=<directory>|<list> [--batch-output=<directory>]" << std::endl;
+        std::cerr << "       " << argv[0] << " [--threads=N] --serve=<socket> [--cache-size=N]" << std::endl;
+        std::cerr << "--emit-c translates the program instead of running it, and rejects a program with a type error"
+                  << " anywhere, which the interpreter reports only if it runs into it" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string& engine = options.engine;
+    if (engine != "tree" && engine != "bytecode" && engine != "closure" && engine != "jit" && engine != "tiered" && engine != "onepass") {
+        std::cerr << "Unknown engine " << engine << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!instancesFile.empty() && !options.persistentArrays.empty()) {
+        std::cerr << "Persistent arrays can't be used with --instances" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // The options of the programs come with the requests
+    if (!serverSocket.empty())
+        return runServer(serverSocket, cacheSize);
+
+    // The programs of a batch run at the same time, each one with its own output
+    if (!batchSource.empty()) {
+        if (!options.persistentArrays.empty() || !instancesFile.empty() || !cFileName.empty() || options.disasm) {
+            std::cerr << "--batch can't be used with --persist-array, --instances, --emit-c or --disasm" << std::endl;
+            return EXIT_FAILURE;
+        }
+        OutputSink output(std::cout, outputMode, flushBytes, flushMillis);
+        OutputSink::setCurrent(&output);
+        return runBatch(batchSource, batchOutput, options);
+    }
+    if (!batchOutput.empty()) {
+        std::cerr << "--batch-output can be used only with --batch" << std::endl;
         return EXIT_FAILURE;
     }
 
     // Opening input file
     std::ifstream inputFile;
     try {
-        inputFile.open(argv[1]);
+        inputFile.open(fileName);
     }
     catch (std::exception const& exc) {
-        std::cerr << "Cannot open " << argv[1] << std::endl;
+        std::cerr << "Cannot open " << fileName << std::endl;
         std::cerr << exc.what() << std::endl;
         return EXIT_FAILURE;
     }
 
     // Lexical analysis
-    Tokenizer tokenize;
     std::vector<Token> inputTokens;
-    try {
-        inputTokens = std::move(tokenize(inputFile));
-        inputFile.close();
-    }
-    catch (LexicalError const& le) {
-        std::cerr << "Lexical error" << std::endl;
-        std::cerr << le.what() << std::endl;
-        return EXIT_FAILURE;
-    }
-    catch (std::exception const& exc) {
-        std::cerr << "Cannot read from " << argv[1] << std::endl;
-        std::cerr << exc.what() << std::endl;
+    if (!tokenizeProgram(inputFile, fileName, inputTokens, std::cerr))
         return EXIT_FAILURE;
+    inputFile.close();
+
+    if (!quiet) {
+        for(int i = 0; i<inputTokens.size(); i++)
+        {
+            std::cout<<inputTokens[i].tag<<" "<<inputTokens[i].word<<std::endl;
+        }
     }
 
-    for(int i = 0; i<inputTokens.size(); i++)
-    {
-        std::cout<<inputTokens[i].tag<<" "<<inputTokens[i].word<<std::endl;
+    // The values printed by the program: the output printed before an error is written before the error
+    OutputSink output(std::cout, outputMode, flushBytes, flushMillis);
+    OutputSink::setCurrent(&output);
+
+    // Persistent arrays live in the Environment, so programs using them run in the EvaluationVisitor
+    // (or in the tiered engine, which shares its Environment)
+    if (!options.persistentArrays.empty() && engine != "tiered")
+        options.engine = "tree";
+
+    // Single-pass compilation straight from the tokens, without building the tree.
+    // Programs it can't compile are parsed and evaluated as usual
+    if (engine == "onepass" && instancesFile.empty()) {
+        int status = runOnePass(inputTokens, options, std::cerr);
+        if (status >= 0)
+            return status;
     }
 
-    // Analisi sinttattica
+    // Analisi sinttattica e ottimizzazione
     ExpressionManager manager;
-    Program* program = nullptr;
-    try {
-        Parser parser(manager, inputTokens);
-        program = parser();
-    }
-    catch (ParseError const& pe) {
-        std::cerr << "Parse error" << std::endl;
-        std::cerr << pe.what() << std::endl;
-        return EXIT_FAILURE;
-    }
-    catch (std::exception const& exc) {
-        std::cerr << "Unknown error" << std::endl;
-        std::cerr << exc.what() << std::endl;
+    Program* program = parseProgram(manager, inputTokens, options, std::cerr);
+    if (!program)
         return EXIT_FAILURE;
+
+    // Traduzione in C: the program is written to cFileName instead of being run
+    if (!cFileName.empty()) {
+        std::ofstream cFile(cFileName);
+        if (!cFile) {
+            std::cerr << "Cannot open " << cFileName << std::endl;
+            return EXIT_FAILURE;
+        }
+        try {
+            CTranslator translator;
+            translator.translate(program, cFile);
+        }
+        catch (CompileError const& ce) {
+            std::cerr << "Cannot translate to C" << std::endl;
+            std::cerr << ce.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
     }
 
+    // Many runs of the same program, each one with its own inputs: --engine=tree runs them one
+    // after the other on the EvaluationVisitor, any other engine on the BatchVM
+    if (!instancesFile.empty())
+        return runInstances(program, instancesFile, engineGiven && engine == "tree", options.disasm);
+
     // Valutazione (Analisi semantica)
-    try {
+    if (!quiet) {
         PrintVisitor* p = new PrintVisitor();
         std::cout << "PrintVisitor: \n";
         program->accept(p);
         std::cout << std::endl;
-        Environment env(manager);
-        EvaluationVisitor* v = new EvaluationVisitor(env);
         std::cout << "\nEvaluationVisitor: \n";
-        program->accept(v);
-    }
-    catch (EvaluationError const& ee) {
-        std::cerr << "Errore nella valutazione" << std::endl;
-        std::cerr << ee.what() << std::endl;
-        return EXIT_FAILURE;
-    }
-    catch (std::exception const& exc) {
-        std::cerr << "Errore generico " << std::endl;
-        std::cerr << exc.what() << std::endl;
-        return EXIT_FAILURE;
     }
+    return runProgram(program, options, std::cerr);
+}
+
 
-    return EXIT_SUCCESS;
+int main(int argc, char* argv[]) {
+    return runWithCallStack([&] { return runCommandLine(argc, argv); });
 }
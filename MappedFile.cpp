@@ -0,0 +1,100 @@
+#include <cerrno>
+#include <cstring>
+
+#include "MappedFile.h"
+#include "Exceptions.h"
+
+#ifdef MAPPED_FILES_AVAILABLE
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef MAPPED_FILES_AVAILABLE
+
+MappedFile::MappedFile(const std::string& p, size_t s) : path{p}, privateMapping{false}, fd{-1}, data{nullptr}, size{s}, originalSize{0}
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+        throw EvaluationError("Cannot open " + path + ": " + std::strerror(errno));
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        int error = errno;
+        close(fd);
+        throw EvaluationError("Cannot read " + path + ": " + std::strerror(error));
+    }
+    originalSize = st.st_size;
+    //an existing file is mapped as it is, a new one is filled with zeros, which are
+    //a hole on the disk until they are written
+    if(originalSize > 0)
+        size = originalSize;
+    else if(ftruncate(fd, size) != 0)
+    {
+        int error = errno;
+        close(fd);
+        throw EvaluationError("Cannot grow " + path + ": " + std::strerror(error));
+    }
+
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED)
+    {
+        int error = errno;
+        close(fd);
+        throw EvaluationError("Cannot map " + path + ": " + std::strerror(error));
+    }
+}
+
+MappedFile::MappedFile(const std::string& p) : path{p}, privateMapping{true}, fd{-1}, data{nullptr}, size{0}, originalSize{0}
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw EvaluationError("Cannot open " + path + ": " + std::strerror(errno));
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        int error = errno;
+        close(fd);
+        throw EvaluationError("Cannot read " + path + ": " + std::strerror(error));
+    }
+    size = originalSize = st.st_size;
+    //an empty file has nothing to map, and its data stays nullptr
+    if(size == 0)
+        return;
+
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED)
+    {
+        int error = errno;
+        close(fd);
+        throw EvaluationError("Cannot map " + path + ": " + std::strerror(error));
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if(data)
+        munmap(data, size);
+    close(fd);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& p, size_t s) : path{p}, privateMapping{false}, fd{-1}, data{nullptr}, size{s}, originalSize{0}
+{
+    throw EvaluationError("Cannot map " + path + ": memory mapped files are not supported on this platform");
+}
+
+MappedFile::MappedFile(const std::string& p) : path{p}, privateMapping{true}, fd{-1}, data{nullptr}, size{0}, originalSize{0}
+{
+    throw EvaluationError("Cannot map " + path + ": memory mapped files are not supported on this platform");
+}
+
+MappedFile::~MappedFile()
+{
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+//file mappings need POSIX mmap
+#if defined(__unix__)
+#define MAPPED_FILES_AVAILABLE
+#endif
+
+//A file mapped in memory with shared writes: what is written in the mapping ends up in the file,
+//and the OS pages it in and out on demand. A private mapping reads the file in the same way, but
+//its writes stay in memory (copy on write). Throws EvaluationError if the file can't be mapped
+class MappedFile {
+public:
+    //maps path. A missing or empty file is created with size bytes, all zeros,
+    //an existing one is mapped with its own size
+    MappedFile(const std::string& path, size_t size);
+    //maps privately the existing file at path, which is opened read only
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    void* getData() const {return data;}
+    size_t getSize() const {return size;}
+    //size of the file before it was mapped, 0 if it has just been created
+    size_t getOriginalSize() const {return originalSize;}
+    bool isPrivate() const {return privateMapping;}
+
+private:
+    std::string path;
+    bool privateMapping;
+    int fd;
+    void* data;
+    size_t size;
+    size_t originalSize;
+};
+
+#endif
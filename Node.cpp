@@ -16,6 +16,99 @@ Constant*  Access::accept(Visitor* v)
     return v->visitAccess(this);
 }
 
+Constant*  Load::accept(Visitor* v)
+{
+    return v->visitLoad(this);
+}
+
+Constant*  Store::accept(Visitor* v)
+{
+    return v->visitStore(this);
+}
+
+Constant*  ParallelFor::accept(Visitor* v)
+{
+    return v->visitParallelFor(this);
+}
+
+namespace {
+
+void collectPrivates(Stmt* stmt, std::vector<Decl*>& privates)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+        {
+            auto block = static_cast<Block*>(stmt);
+            for(Decls* decls = block->getDecls(); decls; decls = decls->getDecls())
+                privates.push_back(decls->getDecl());
+            for(Seq* seq = block->getSeq(); seq; seq = seq->getSeq())
+                collectPrivates(seq->getStmt(), privates);
+            break;
+        }
+        case Node::IF:
+            collectPrivates(static_cast<If*>(stmt)->getStmt(), privates);
+            break;
+        case Node::ELSE:
+            collectPrivates(static_cast<Else*>(stmt)->getifTrueStmt(), privates);
+            collectPrivates(static_cast<Else*>(stmt)->getifFalseStmt(), privates);
+            break;
+        case Node::WHILE:
+            collectPrivates(static_cast<While*>(stmt)->getStmt(), privates);
+            break;
+        case Node::DO:
+            collectPrivates(static_cast<Do*>(stmt)->getStmt(), privates);
+            break;
+        case Node::PARALLEL_FOR:
+            collectPrivates(static_cast<ParallelFor*>(stmt)->getStmt(), privates);
+            break;
+        default:
+            break;
+    }
+}
+
+}
+
+std::vector<Decl*> ParallelFor::getPrivates()
+{
+    std::vector<Decl*> privates;
+    collectPrivates(stmt, privates);
+    return privates;
+}
+
+Constant*  Index::accept(Visitor* v)
+{
+    return v->visitIndex(this);
+}
+
+Constant*  Fused::accept(Visitor* v)
+{
+    return v->visitFused(this);
+}
+
+Constant*  Call::accept(Visitor* v)
+{
+    return v->visitCall(this);
+}
+
+Constant*  Return::accept(Visitor* v)
+{
+    return v->visitReturn(this);
+}
+
+Call* Return::getTailCall(Function* function)
+{
+    if(exp->getKind() != Node::CALL)
+        return nullptr;
+    auto call = static_cast<Call*>(exp);
+    return call->getFunction()->getReturnType() == function->getReturnType() ? call : nullptr;
+}
+
+Constant*  Function::accept(Visitor* v)
+{
+    return v->visitFunction(this);
+}
+
 Constant*  If::accept(Visitor* v)
 {
     return v->visitIf(this);
@@ -2,6 +2,7 @@
 #define NODE_H
 #include <string>
 #include <map>
+#include <vector>
 #include "Exceptions.h"
 //forward declaration essenziali per evitare errori di compilazipone
 class Visitor;  
@@ -10,13 +11,28 @@ class Seq;
 class Stmt;
 class Block;
 class Constant;
+class Value;
+class EvaluationVisitor;
+class Function;
 
 class Node
 {
     public:
+    //every concrete node carries a tag with its kind, so that the evaluator can dispatch
+    //with a switch instead of going through accept and a virtual visit method
+    enum Kind {PROGRAM, BLOCK, TYPE, VECTOR_TYPE, DECLS, DECL, SEQ,
+        IF, ELSE, WHILE, DO, SET, SET_ELEM, BREAK, PRINT, LOAD, STORE, PARALLEL_FOR,
+        ID, INT_CONSTANT, BOOL_CONSTANT, NOT, AND, OR, REL, ARITHM, UNARY, ACCESS, INDEX, FUSED,
+        FUNCTION, CALL, RETURN};
+
     virtual ~Node() = default;
-    Node() = default;
+    Node(Kind k) : kind{k} {}
     virtual Constant* accept(Visitor* v) = 0;
+
+    Kind getKind() const {return kind;}
+
+    private:
+    Kind kind;
 };
 
 //Type
@@ -27,12 +43,15 @@ public:
     static const int numOfTypes = 2;
     static std::string  typeid2String [numOfTypes]; 
 
-    Type(TypeCode t) : type{t}{}
+    Type(TypeCode t) : Node(TYPE), type{t}{}
 
     TypeCode getTypeCode() {return type;}
 
     Constant* accept(Visitor* v) override;   
 
+protected:
+    Type(Kind k, TypeCode t) : Node(k), type{t}{}
+
 private:
     TypeCode type;
 };
@@ -40,14 +59,23 @@ private:
 class vectorType : public Type{
 public: 
 
-    vectorType(Type::TypeCode t, int s) : Type(t), size{s}{}
+    vectorType(Type::TypeCode t, int s) : Type(VECTOR_TYPE, t), size{s}, dimensions{s}{}
+    //multi-dimensional array, stored in row-major order: the parser has checked that
+    //the number of cells fits in an int
+    vectorType(Type::TypeCode t, const std::vector<int>& dims) : Type(VECTOR_TYPE, t), size{1}, dimensions{dims}{
+        for(int d : dims)
+            size *= d;
+    }
     
+    //number of cells
     int getSize(){return size;}
+    const std::vector<int>& getDimensions(){return dimensions;}
 
     Constant* accept(Visitor* v) override;   
 
 private:
     int size;
+    std::vector<int> dimensions;
     
 };
 
@@ -56,7 +84,7 @@ private:
 class Decl : public Node{
 public:
 
-    Decl(Type* t, Id* i): type{t}, id{i}{}
+    Decl(Type* t, Id* i): Node(DECL), type{t}, id{i}{}
     Type* getType(){return type;}
     Id* getId(){return id;}
 
@@ -71,7 +99,7 @@ public:
 
     //it's better to treat the empty decls object as something more abstract than just nullptr
     static constexpr Decls* EMPTY_DECLS = nullptr; 
-    Decls(Decl* dec, Decls* decs ): declaration{dec}, declarations{decs}{}
+    Decls(Decl* dec, Decls* decs ): Node(DECLS), declaration{dec}, declarations{decs}{}
 
     Decl* getDecl(){return declaration;}
     Decls* getDecls(){return declarations;}
@@ -89,26 +117,49 @@ private:
 class Program : public Node{
 public:
 
-    Program(Block* b) : block{b}{}
+    Program(Block* b, const std::vector<Function*>& f = {}, int caches = 0)
+     : Node(PROGRAM), block{b}, functions{f}, numCaches{caches}{}
 
     Block* getBlock() {return block;}
+    //the functions declared before the block, in their order
+    const std::vector<Function*>& getFunctions() {return functions;}
+    //number of the ExpressionCaches of a run (see Expression::getCacheIndex)
+    int getNumCaches() const {return numCaches;}
     
     Constant* accept(Visitor* v) override;
 
 private:
     Block* block;
+    std::vector<Function*> functions;
+    const int numCaches;
 };
 
 
 
 //Expression
 class Expression : public Node{
+public:
+    //the variants an expression is rewritten into by the EvaluationVisitor, after observing
+    //its first executions. They are kept by the run, in the ExpressionCache of the node, so the
+    //other passes don't see them and the tree is never written while it runs
+    enum Specialization : unsigned char {UNINITIALIZED, GENERIC, INT_EQUALITY, BOOL_EQUALITY,
+        CACHED_VARIABLE, CACHED_ARRAY, CONSTANT_INDEX};
+
+    Expression(Kind k) : Node(k), cacheIndex{-1} {}
+
+    //position of the ExpressionCache of the node among the ones of a run, -1 for the
+    //expressions that never specialize. Given by the ExpressionManager
+    int getCacheIndex() const {return cacheIndex;}
+    void setCacheIndex(int index) {cacheIndex = index;}
+
+private:
+    int cacheIndex;
 };
     
 class Constant : public Expression {
     
 public: 
-    Constant(Type::TypeCode t) : typeCode{t}{}
+    Constant(Kind k, Type::TypeCode t) : Expression(k), typeCode{t}{}
 
     Type::TypeCode getTypeCode() {return typeCode;}
 
@@ -132,26 +183,32 @@ private:
 class Id: public Expression
 {
 public:
-  Id(std::string name_) : name{name_} {};
+  Id(std::string name_) : Expression(ID), name{name_}, local{-1} {};
   Id& operator= (const Id& other) = default;
   
-  std::string getName() {
+  const std::string& getName() {
     return name;
   }
 
+  //slot of the identifier in the frame of its function (see Function::getLocals), -1 for
+  //the variables of the program. Given by the Parser
+  int getLocal() const {return local;}
+  void setLocal(int slot) {local = slot;}
+
   Constant* accept(Visitor* v) override;
 
 private:
   std::string name; 
+  int local;
 };
 
 class intConstant : public Constant{
 public:
 
-    intConstant() : value{0}, Constant(Type::INT){}
-    intConstant(int v) : value{v}, Constant(Type::INT){}
+    intConstant() : Constant(INT_CONSTANT, Type::INT), value{0}{}
+    intConstant(int v) : Constant(INT_CONSTANT, Type::INT), value{v}{}
 
-    int getInt() override {
+    int getInt() final {
         return value;
     }
 
@@ -170,12 +227,11 @@ private:
 class boolConstant : public Constant{
 public:
     
-    boolConstant() : value{false}, Constant(Type::BOOL) {}
-    boolConstant(bool v) : value{v}, Constant(Type::BOOL) {}
+    boolConstant() : Constant(BOOL_CONSTANT, Type::BOOL), value{false} {}
+    boolConstant(bool v) : Constant(BOOL_CONSTANT, Type::BOOL), value{v} {}
 
-    bool getBool() override {
+    bool getBool() final {
         return value;
-
     }
     boolConstant* set (bool val)
     {
@@ -191,17 +247,61 @@ private:
 };
 
 
+//Value is what the evaluation of an expression produces. Unlike Constant it is not a node
+//of the tree, just a tagged int/bool that is passed around by value
+class Value {
+public:
+    Value() : typeCode{Type::INT}, intValue{0} {}
+
+    static Value fromInt(int v) {
+        Value val;
+        val.intValue = v;
+        return val;
+    }
+
+    static Value fromBool(bool v) {
+        Value val;
+        val.typeCode = Type::BOOL;
+        val.boolValue = v;
+        return val;
+    }
+
+    Type::TypeCode getTypeCode() const {return typeCode;}
+
+    int getInt() const {
+        if(typeCode != Type::INT)
+            throw EvaluationError("Expecting an integer");
+        return intValue;
+    }
+
+    bool getBool() const {
+        if(typeCode != Type::BOOL)
+            throw EvaluationError("Expecting a boolean");
+        return boolValue;
+    }
+
+private:
+    Type::TypeCode typeCode;
+    union {
+        int intValue;
+        bool boolValue;
+    };
+};
+
+
 //Logical
 class Logical : public Expression{
-
+public:
+    Logical(Kind k) : Expression(k) {}
 };
 
 class Not : public Logical{
 
 public:
 
-    Not(Expression* e) : exp{e}{}
+    Not(Expression* e) : Logical(NOT), exp{e}{}
     Expression* getExp() {return exp;}
+    void setExp(Expression* e) {exp = e;}
 
     Constant* accept(Visitor* v) override;
 
@@ -214,9 +314,11 @@ class And : public Logical{
 
 public:
 
-    And(Expression* l, Expression* r) : left{l}, right{r}{}
+    And(Expression* l, Expression* r) : Logical(AND), left{l}, right{r}{}
     Expression* getLeftExp() {return left;}
     Expression* getRightExp() {return right;}
+    void setLeftExp(Expression* l) {left = l;}
+    void setRightExp(Expression* r) {right = r;}
 
     Constant* accept(Visitor* v) override;
 
@@ -230,9 +332,11 @@ class Or : public Logical{
 
 public:
 
-    Or(Expression* l, Expression* r) : left{l}, right{r}{}
+    Or(Expression* l, Expression* r) : Logical(OR), left{l}, right{r}{}
     Expression* getLeftExp() {return left;}
     Expression* getRightExp() {return right;}
+    void setLeftExp(Expression* l) {left = l;}
+    void setRightExp(Expression* r) {right = r;}
 
     Constant* accept(Visitor* v) override;
 
@@ -251,9 +355,11 @@ public:
     static std::string opCode2String[numOfOps];
 
     Rel(Expression* l, Expression* r, OpCode op) :
-    left{l}, right{r}, operation{op}{}
+    Logical(REL), left{l}, right{r}, operation{op}{}
     Expression* getLeftExp() {return left;}
     Expression* getRightExp() {return right;}
+    void setLeftExp(Expression* l) {left = l;}
+    void setRightExp(Expression* r) {right = r;}
     OpCode getOp(){return operation;} 
 
     Constant* accept(Visitor* v) override;
@@ -278,15 +384,18 @@ public:
   enum UnaryOpCode {UNARY_MIN};
   static const int numOfUnaryOps = 1; 
   static std::string unaryOp2String[numOfUnaryOps];
+
+  Op(Kind k) : Expression(k) {}
 };
 
 //operatori unari
 class Unary : public Op{
 
 public:
-    Unary( Expression* ex, UnaryOpCode op) : exp{ex}, operation{op} {}
+    Unary( Expression* ex, UnaryOpCode op) : Op(UNARY), exp{ex}, operation{op} {}
 
     Expression* getExp() {return exp;}
+    void setExp(Expression* e) {exp = e;}
     UnaryOpCode getOp(){return operation;} 
 
     Constant* accept(Visitor* v) override;
@@ -303,9 +412,11 @@ class Arithm : public Op{
 public:
 
     Arithm(Expression* l, Expression* r, BinOpCode op) :
-    left{l}, right{r}, operation{op}{} 
+    Op(ARITHM), left{l}, right{r}, operation{op}{} 
     Expression* getLeftExp() {return left;}
     Expression* getRightExp() {return right;}
+    void setLeftExp(Expression* l) {left = l;}
+    void setRightExp(Expression* r) {right = r;}
     BinOpCode getOp() {return operation;} 
 
     Constant* accept(Visitor* v) override;
@@ -320,9 +431,10 @@ private:
 class Access : public Op{
 public:
 
-    Access(Id* vec, Expression* ind) : vector{vec}, index{ind}{}
+    Access(Id* vec, Expression* ind) : Op(ACCESS), vector{vec}, index{ind}{}
     Id* getId() {return vector;}
     Expression* getIndex() {return index;}
+    void setIndex(Expression* i) {index = i;}
 
     Constant* accept(Visitor* v) override;
 
@@ -334,16 +446,76 @@ private:
 
 
 
+//Position in row-major order of the cell m[i][j]... of a multi-dimensional array, used as index of the
+//Access or SetElem of the cell. Every subscript is checked against its dimension, and the result is
+//always inside the array. A single subscript, which is a plain index, addresses the cells in row-major order
+class Index : public Expression{
+public:
+    Index(Id* a, const std::vector<Expression*>& s) : Expression(INDEX), array{a}, subscripts{s}{}
+    Id* getId() {return array;}
+    const std::vector<Expression*>& getSubscripts() {return subscripts;}
+    void setSubscript(size_t k, Expression* e) {subscripts[k] = e;}
+
+    Constant* accept(Visitor* v) override;
+
+private:
+    Id* array;
+    std::vector<Expression*> subscripts;
+};
+
+
+
+//f(a, b): the arguments are evaluated from left to right, then the body of f runs in a frame of its own.
+//The Parser links every call to its function once the whole program has been read
+class Call : public Expression{
+public:
+    Call(const std::string& n, const std::vector<Expression*>& a) : Expression(CALL), name{n}, args{a}, function{nullptr}{}
+    const std::string& getName() {return name;}
+    const std::vector<Expression*>& getArgs() {return args;}
+    void setArg(size_t k, Expression* e) {args[k] = e;}
+    Function* getFunction() {return function;}
+    void setFunction(Function* f) {function = f;}
+
+    Constant* accept(Visitor* v) override;
+
+private:
+    std::string name;
+    std::vector<Expression*> args;
+    Function* function;
+};
+
+
+
+//An Arithm or Rel with its leaf operands fused into it, built by the FusionPass (see Fused.h).
+//It keeps the node it replaces, which is what the visitors and the compiled engines look at
+class Fused : public Expression{
+public:
+    Fused(Expression* o) : Expression(FUSED), original{o}{}
+    Expression* getOriginal() {return original;}
+
+    //same result and same errors of the evaluation of the original node
+    virtual Value evaluate(EvaluationVisitor& v) = 0;
+
+    Constant* accept(Visitor* v) override;
+
+private:
+    Expression* original;
+};
+
+
+
 //Seq
 class Seq: public Node{
 public:
 
 //it's better to treat the empty Seq object as something more abstract than just nullptr
 static constexpr Seq* EMPTY_SEQ = nullptr; 
-Seq(Seq* seq_, Stmt* stmt_) : seq{seq_}, stmt{stmt_}{}
+Seq(Seq* seq_, Stmt* stmt_) : Node(SEQ), seq{seq_}, stmt{stmt_}{}
 
 Seq* getSeq() {return seq;}
 Stmt* getStmt() {return stmt;}
+void setSeq(Seq* s) {seq = s;}
+void setStmt(Stmt* s) {stmt = s;}
 
 Constant* accept(Visitor* v) override;   
 
@@ -355,6 +527,7 @@ Stmt* stmt;
 class Stmt : public Node{
   
 public:
+    Stmt(Kind k) : Node(k) {}
     Constant* accept(Visitor* v) override;   
 
 };
@@ -362,10 +535,12 @@ public:
 class If : public Stmt {
 public:
 
-    If(Stmt* s, Expression* e) : stmt{s}, condition{e}{}
+    If(Stmt* s, Expression* e) : Stmt(IF), stmt{s}, condition{e}{}
 
     Stmt* getStmt() {return stmt;}
     Expression* getCondition () {return condition;}
+    void setStmt(Stmt* s) {stmt = s;}
+    void setCondition(Expression* e) {condition = e;}
 
     Constant* accept(Visitor* v) override;   
 
@@ -378,11 +553,14 @@ class Else : public Stmt{
 public:
 
     Else(Stmt* stmtTrue, Stmt* stmtFalse, Expression* e)
-     : stmtIfTrue{stmtTrue}, stmtIfFalse{stmtFalse}, condition{e}{}
+     : Stmt(ELSE), condition{e}, stmtIfTrue{stmtTrue}, stmtIfFalse{stmtFalse}{}
 
     Stmt* getifTrueStmt() {return stmtIfTrue;}
     Stmt* getifFalseStmt() {return stmtIfFalse;}
     Expression* getCondition () {return condition;}
+    void setifTrueStmt(Stmt* s) {stmtIfTrue = s;}
+    void setifFalseStmt(Stmt* s) {stmtIfFalse = s;}
+    void setCondition(Expression* e) {condition = e;}
 
     Constant* accept(Visitor* v) override;   
 
@@ -395,10 +573,12 @@ private:
 class While : public Stmt{
 public:
 
-    While(Stmt* s, Expression* e) : stmt{s}, condition{e}{}
+    While(Stmt* s, Expression* e) : Stmt(WHILE), stmt{s}, condition{e}{}
     
     Stmt* getStmt() {return stmt;}
     Expression* getCondition () {return condition;}
+    void setStmt(Stmt* s) {stmt = s;}
+    void setCondition(Expression* e) {condition = e;}
 
  
     Constant* accept(Visitor* v) override;   
@@ -408,12 +588,17 @@ private:
     Expression* condition;
 };
 
+//do stmt while (condition): the condition is evaluated after every run of stmt, except one that ends
+//with a break, which leaves the loop like the break of a while. The first interpreter evaluated it
+//after a break too, and when it was false the break went on to skip the statements after the loop
 class Do : public Stmt{
 public:
 
-    Do(Stmt* s, Expression* e) : stmt{s}, condition{e}{}
+    Do(Stmt* s, Expression* e) : Stmt(DO), stmt{s}, condition{e}{}
     Stmt* getStmt() {return stmt;}
     Expression* getCondition () {return condition;}
+    void setStmt(Stmt* s) {stmt = s;}
+    void setCondition(Expression* e) {condition = e;}
 
 
     Constant* accept(Visitor* v) override;   
@@ -427,9 +612,10 @@ private:
 class Set : public Stmt{
 public:
 
-    Set(Id* var, Expression* e) : variable{var}, exp{e}{}
+    Set(Id* var, Expression* e) : Stmt(SET), variable{var}, exp{e}{}
     Id* getId(){return variable;}
     Expression* getExp(){return exp;}
+    void setExp(Expression* e) {exp = e;}
 
     Constant* accept(Visitor* v) override;   
 
@@ -442,12 +628,13 @@ class SetElem : public Stmt{
 public:
 
     SetElem(Id* v, Expression* e, Expression* i) :
-         arrayName{v}, exp{e}, index{i} {}
+         Stmt(SET_ELEM), arrayName{v}, exp{e}, index{i} {}
 
     Id* getId(){return arrayName;}
     Expression* getExp(){return exp;}
     Expression* getIndex(){return index;}
-
+    void setExp(Expression* e) {exp = e;}
+    void setIndex(Expression* i) {index = i;}
 
     Constant* accept(Visitor* v) override;   
 
@@ -460,7 +647,7 @@ private:
 
 class Break : public Stmt{
 public:
-    Break() = default;
+    Break() : Stmt(BREAK) {}
     Constant* accept(Visitor* v) override;   
 
 };
@@ -468,8 +655,9 @@ public:
 class Print : public Stmt{
 public:
 
-    Print(Expression* e) : expToPrint{e}{}
+    Print(Expression* e) : Stmt(PRINT), expToPrint{e}{}
     Expression* getExp(){return expToPrint;}
+    void setExp(Expression* e) {expToPrint = e;}
    
     Constant* accept(Visitor* v) override;   
 
@@ -477,12 +665,104 @@ private:
     Expression* expToPrint;    
 };
 
+//return e; ends the function running it, which takes the value of e
+class Return : public Stmt{
+public:
+
+    Return(Expression* e) : Stmt(RETURN), exp{e}{}
+    Expression* getExp(){return exp;}
+    void setExp(Expression* e) {exp = e;}
+
+    //e is a call of a function with the same return type of the function running the return: the
+    //callee can take the frame of the caller, whose value is the one of the callee (see EvaluationVisitor)
+    Call* getTailCall(Function* function);
+
+    Constant* accept(Visitor* v) override;
+
+private:
+    Expression* exp;
+};
+
+//load(a, "file"): replaces all the cells of the array with the ones stored in the file,
+//which must hold an array of the same type and dimensions (see Environment.h)
+class Load : public Stmt{
+public:
+
+    Load(Id* a, const std::string& p) : Stmt(LOAD), array{a}, path{p}{}
+    Id* getId(){return array;}
+    const std::string& getPath(){return path;}
+
+    Constant* accept(Visitor* v) override;
+
+private:
+    Id* array;
+    std::string path;
+};
+
+//store(a, "file"): writes all the cells of the array to the file, in the format read by load
+class Store : public Stmt{
+public:
+
+    Store(Id* a, const std::string& p) : Stmt(STORE), array{a}, path{p}{}
+    Id* getId(){return array;}
+    const std::string& getPath(){return path;}
+
+    Constant* accept(Visitor* v) override;
+
+private:
+    Id* array;
+    std::string path;
+};
+
+//How the values of a reduction variable computed by the iterations of a parallel loop are combined
+enum ReductionOp {REDUCE_ADD, REDUCE_MUL, REDUCE_AND, REDUCE_OR};
+
+//parallel for (i = first, last; + s, && b) stmt: runs stmt for i going from first to last - 1,
+//with first and last evaluated once. The iterations can run at the same time on different threads,
+//so the Parser accepts only bodies that don't depend on their order (see checkParallelFor): they
+//write only the reductions, through s = s + e and alike, the scalars declared in the body, which are
+//private to the iteration and start it at 0 (false), and array cells that belong to the iteration,
+//like a[i + 1] or a[2 * i][j], which no other iteration reads or writes.
+//After the loop i holds last, or first if the loop had no iterations
+class ParallelFor : public Stmt{
+public:
+    struct Reduction {
+        ReductionOp op;
+        Id* var;
+    };
+
+    ParallelFor(Id* i, Expression* f, Expression* l, const std::vector<Reduction>& r, Stmt* s)
+     : Stmt(PARALLEL_FOR), induction{i}, first{f}, last{l}, reductions{r}, stmt{s}{}
+
+    Id* getId(){return induction;}
+    Expression* getFirst(){return first;}
+    Expression* getLast(){return last;}
+    const std::vector<Reduction>& getReductions(){return reductions;}
+    Stmt* getStmt(){return stmt;}
+    void setFirst(Expression* e) {first = e;}
+    void setLast(Expression* e) {last = e;}
+    void setStmt(Stmt* s) {stmt = s;}
+
+    //the declarations of the private variables, anywhere in the body
+    std::vector<Decl*> getPrivates();
+
+    Constant* accept(Visitor* v) override;
+
+private:
+    Id* induction;
+    Expression* first;
+    Expression* last;
+    std::vector<Reduction> reductions;
+    Stmt* stmt;
+};
+
 class Block : public Stmt{
 public:
 
-    Block(Decls* decs, Seq* Seq) : declarations{decs}, statements{Seq}{}
+    Block(Decls* decs, Seq* Seq) : Stmt(BLOCK), declarations{decs}, statements{Seq}{}
     Decls* getDecls(){return declarations;}
     Seq* getSeq(){return statements;}
+    void setSeq(Seq* s) {statements = s;}
 
     Constant* accept(Visitor* v) override;   
 
@@ -492,6 +772,38 @@ private:
 
 };
 
+//int f(int a, bool b) { ... }: a function, declared before the block of the program. Its parameters and
+//the variables declared in its body are its locals, which live in the frame of a call, hidden from the
+//rest of the program, and start it at 0 (false): they exist from the start of the body, wherever they
+//are declared. A call that reaches the end of the body without a return fails. The body may use the
+//variables of the program
+class Function : public Node{
+public:
+    //calls nested deeper than this fail with a stack overflow, in every engine. The calls of the
+    //tree walker recurse on the native stack, which is sized for them (see runWithCallStack)
+    static constexpr int MAX_CALL_DEPTH = 4000;
+
+    Function(Type::TypeCode t, const std::string& n, int p, const std::vector<Decl*>& l, Block* b)
+     : Node(FUNCTION), returnType{t}, name{n}, numParams{p}, locals{l}, body{b}{}
+
+    Type::TypeCode getReturnType() {return returnType;}
+    const std::string& getName() {return name;}
+    int getNumParams() {return numParams;}
+    int getNumLocals() {return locals.size();}
+    //the declaration of every local in the order of its slot, the parameters first
+    const std::vector<Decl*>& getLocals() {return locals;}
+    Block* getBody() {return body;}
+
+    Constant* accept(Visitor* v) override;
+
+private:
+    Type::TypeCode returnType;
+    std::string name;
+    int numParams;
+    std::vector<Decl*> locals;
+    Block* body;
+};
+
 //Visitor is declared here to avoid circular dependency
 #include "Visitor.h"
 
@@ -0,0 +1,105 @@
+#include <iostream>
+
+#include "OutputSink.h"
+
+namespace {
+
+thread_local OutputSink* currentSink = nullptr;
+
+}
+
+OutputSink::OutputSink(std::ostream& o, Mode m, size_t bytes, int millis) :
+    os{o}, mode{m}, flushBytes{bytes}, flushMillis{millis}, prints{0},
+    lastWrite{std::chrono::steady_clock::now()}, stopping{false}
+{
+    if(mode != LINE)
+        buffer.reserve(flushBytes + 16);
+    if(mode == ASYNC)
+        writer = std::thread(&OutputSink::writerLoop, this);
+}
+
+OutputSink::~OutputSink()
+{
+    if(mode == ASYNC)
+    {
+        {
+            std::lock_guard<std::mutex> lock(bufferMutex);
+            stopping = true;
+        }
+        pending.notify_one();
+        writer.join();
+    }
+    flush();
+}
+
+OutputSink& OutputSink::current()
+{
+    static OutputSink standardOutput(std::cout, LINE);
+    return currentSink ? *currentSink : standardOutput;
+}
+
+void OutputSink::setCurrent(OutputSink* sink)
+{
+    currentSink = sink;
+}
+
+void OutputSink::flush()
+{
+    if(mode == ASYNC)
+    {
+        std::unique_lock<std::mutex> lock(bufferMutex);
+        writeAsync(lock);
+        return;
+    }
+    if(!buffer.empty())
+        write();
+}
+
+void OutputSink::write()
+{
+    os.write(buffer.data(), buffer.size());
+    os.flush();
+    buffer.clear();
+    lastWrite = std::chrono::steady_clock::now();
+}
+
+void OutputSink::appendAsync(const char* text, size_t size)
+{
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    buffer.append(text, size);
+    if(buffer.size() >= flushBytes)
+        pending.notify_one();
+}
+
+//writeMutex is released before bufferMutex is taken again: the mutexes are always taken in
+//the order bufferMutex, writeMutex. An empty buffer still waits for the write of the previous
+//one, so that a flush returns when all the lines printed so far are written
+void OutputSink::writeAsync(std::unique_lock<std::mutex>& lock)
+{
+    std::string full;
+    if(!buffer.empty())
+    {
+        full.reserve(flushBytes + 16);
+        full.swap(buffer);
+    }
+    {
+        std::lock_guard<std::mutex> writing(writeMutex);
+        lock.unlock();
+        if(!full.empty())
+        {
+            os.write(full.data(), full.size());
+            os.flush();
+        }
+    }
+    lock.lock();
+}
+
+void OutputSink::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(bufferMutex);
+    while(!stopping)
+    {
+        pending.wait_for(lock, flushMillis, [this] {return stopping || buffer.size() >= flushBytes;});
+        writeAsync(lock);
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+//Destination of the values printed by the Print statements of every engine. Lines are collected
+//in a buffer and written to the stream in the order they were printed:
+//- LINE writes every line as soon as it is printed, like std::endl
+//- BUFFERED writes when flushBytes are pending or, checked while printing, when flushMillis
+//  have passed since the last write
+//- ASYNC hands the buffer to a writer thread, which also writes it every flushMillis
+//Whatever is pending is written by flush and by the destructor: the caller flushes before reporting
+//an error, so that the output printed before the error comes first. A process that dies or is killed
+//loses what is pending, so the command line uses LINE unless --output asks for another mode
+class OutputSink {
+public:
+    enum Mode {LINE, BUFFERED, ASYNC};
+
+    static constexpr size_t DEFAULT_FLUSH_BYTES = 1 << 16;
+    static constexpr int DEFAULT_FLUSH_MILLIS = 100;
+
+    OutputSink(std::ostream& os, Mode mode, size_t flushBytes = DEFAULT_FLUSH_BYTES,
+               int flushMillis = DEFAULT_FLUSH_MILLIS);
+    ~OutputSink();
+    OutputSink(OutputSink const&) = delete;
+    OutputSink& operator=(OutputSink const&) = delete;
+
+    void printInt(int32_t value) {
+        char line[12];      //"-2147483648\n"
+        char* end = std::to_chars(line, line + 11, value).ptr;
+        *end++ = '\n';
+        append(line, end - line);
+    }
+
+    //bools are printed as 1/0
+    void printBool(bool value) {
+        const char line[2] = {value ? '1' : '0', '\n'};
+        append(line, 2);
+    }
+
+    //lines printed through another sink, text included as it is
+    void printText(const std::string& text) {
+        append(text.data(), text.size());
+    }
+
+    void flush();
+
+    //sink of the Print statements run by the calling thread. Unless another one is set, it is
+    //a LINE sink on std::cout
+    static OutputSink& current();
+    //nullptr restores the default sink
+    static void setCurrent(OutputSink* sink);
+
+private:
+    //in BUFFERED mode the clock is read once every TIME_CHECK_INTERVAL prints
+    static constexpr unsigned TIME_CHECK_INTERVAL = 64;
+
+    std::ostream& os;
+    const Mode mode;
+    const size_t flushBytes;
+    const std::chrono::milliseconds flushMillis;
+
+    std::string buffer;
+    unsigned prints;
+    std::chrono::steady_clock::time_point lastWrite;
+
+    //ASYNC only: bufferMutex guards buffer, writeMutex the stream. A writer takes writeMutex
+    //before releasing bufferMutex, so buffers are written in the order they are taken, and
+    //releases it before taking bufferMutex again
+    std::mutex bufferMutex;
+    std::mutex writeMutex;
+    std::condition_variable pending;
+    bool stopping;
+    std::thread writer;
+
+    void append(const char* text, size_t size) {
+        if(mode == ASYNC)
+        {
+            appendAsync(text, size);
+            return;
+        }
+        if(mode == LINE)
+        {
+            os.write(text, size);
+            os.flush();
+            return;
+        }
+        buffer.append(text, size);
+        if(buffer.size() >= flushBytes
+           || (++prints % TIME_CHECK_INTERVAL == 0 && std::chrono::steady_clock::now() - lastWrite >= flushMillis))
+            write();
+    }
+
+    void appendAsync(const char* text, size_t size);
+    //writes the buffer of the LINE and BUFFERED modes
+    void write();
+    //writes the buffer of the ASYNC mode, lock holds bufferMutex
+    void writeAsync(std::unique_lock<std::mutex>& lock);
+    void writerLoop();
+};
+
+#endif
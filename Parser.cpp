@@ -1,10 +1,97 @@
 #include <sstream>
+#include <limits>
 #include "Parser.h"
+#include "LoopParallelizer.h"
 
 
 Program* Parser::parseProgram()
 {
-    return em.makeProgram(parseBlock());
+    //the functions come before the block of the program
+    while(tag() == Token::INT || tag() == Token::BOOL)
+        functions.push_back(parseFunction());
+    Block* block = parseBlock();
+    linkCalls();
+    return em.makeProgram(block, functions);
+}
+
+//int f(int a, bool b) { ... }
+Function* Parser::parseFunction()
+{
+    Type* type = parseType();
+    if(type->getKind() == Node::VECTOR_TYPE)
+        throw ParseError("A function can only return int or bool");
+    if(tag() != Token::ID)
+        throw ParseError{"Expected function name, not found"};
+    std::string name = tokenItr->word;
+    safe_next();
+    for(Function* function : functions)
+    {
+        if(function->getName() == name)
+            throw ParseError("function " + name + " has already been declared");
+    }
+
+    inFunction = true;
+    locals.clear();
+    localSlots.clear();
+    consumeToken(Token::LP);
+    if(tag() != Token::RP)
+    {
+        for(;;)
+        {
+            if(tag() != Token::INT && tag() != Token::BOOL)
+                throw ParseError("Parameters can only be int or bool");
+            Type* paramType = parseType();
+            if(paramType->getKind() == Node::VECTOR_TYPE)
+                throw ParseError("Parameters can only be int or bool");
+            declareLocal(em.makeDecl(paramType, parseId()));
+            if(tag() != Token::COMMA)
+                break;
+            safe_next();
+        }
+    }
+    int numParams = locals.size();
+    consumeToken(Token::RP);
+    Block* body = parseBlock();
+    inFunction = false;
+    return em.makeFunction(type->getTypeCode(), name, numParams, locals, body);
+}
+
+//the parameters and the variables of a function get the next slot of its frame
+void Parser::declareLocal(Decl* decl)
+{
+    const std::string& name = decl->getId()->getName();
+    if(!localSlots.emplace(name, locals.size()).second)
+        throw ParseError("identifier " + name + " has already been declared");
+    decl->getId()->setLocal(locals.size());
+    locals.push_back(decl);
+}
+
+//a function may be called before it is declared, so the calls are linked once the program has been read
+void Parser::linkCalls()
+{
+    for(Call* call : calls)
+    {
+        const std::string& name = call->getName();
+        auto found = std::find_if(functions.begin(), functions.end(),
+                                  [&name](Function* function) {return function->getName() == name;});
+        if(found == functions.end())
+            throw ParseError("function " + name + " has not been declared");
+        size_t numParams = (*found)->getNumParams();
+        if(call->getArgs().size() != numParams)
+            throw ParseError(name + " takes " + std::to_string(numParams) + " arguments, "
+                             + std::to_string(call->getArgs().size()) + " given");
+        call->setFunction(*found);
+    }
+    //a local can't hide a variable of the program
+    for(Function* function : functions)
+    {
+        for(Decl* decl : function->getLocals())
+        {
+            const std::string& name = decl->getId()->getName();
+            if(std::find(declaredVars.begin(), declaredVars.end(), name) != declaredVars.end())
+                throw ParseError("identifier " + name + " is declared both in " + function->getName() + " and in the program");
+        }
+    }
 }
 
 
@@ -20,7 +107,7 @@ Block* Parser::parseBlock()
 
 Seq* Parser::parseSeq()
 {
-    if(tokenItr->tag == Token::RIGHT_CURLY) //end of block reached
+    if(tag() == Token::RIGHT_CURLY) //end of block reached
         return Seq::EMPTY_SEQ;
 
     Stmt* stmt = parseStmt();
@@ -30,17 +117,15 @@ Seq* Parser::parseSeq()
 
 Stmt* Parser::parseStmt()
 {
-    switch(tokenItr->tag)
+    switch(tag())
     {
         case Token::ID:
         {   
             Id* id = parseId();
 
-            if(tokenItr->tag == Token::LEFT_SQUARE)  //assignment to array cell
+            if(tag() == Token::LEFT_SQUARE)  //assignment to array cell
             {
-                safe_next();
-                Expression* index = parseExpression();
-                consumeToken(Token::RIGHT_SQUARE);
+                Expression* index = parseIndex(id);
                 consumeToken(Token::ASSIGN);
                 Expression* expr = parseExpression();
                 consumeToken(Token::END_STMT);
@@ -63,7 +148,7 @@ Stmt* Parser::parseStmt()
             Expression* condition = parseExpression();
             consumeToken(Token::RP);
             Stmt* ifTrueStmt = parseStmt();
-            if(tokenItr->tag == Token::ELSE)
+            if(tag() == Token::ELSE)
             {
                 safe_next();
                 Stmt* ifFalseStmt = parseStmt();
@@ -111,11 +196,81 @@ Stmt* Parser::parseStmt()
             return em.makePrint(exprToPrint);
         }
 
+        //load(array, "file"); and store(array, "file");
+        case Token::LOAD:
+        case Token::STORE:
+        {
+            bool isLoad = tag() == Token::LOAD;
+            safe_next();
+            consumeToken(Token::LP);
+            Id* id = parseId();
+            consumeToken(Token::COMMA);
+            if(tag() != Token::STRING)
+                throw ParseError{"Expected file name, not found"};
+            std::string path = tokenItr->word;
+            safe_next();
+            consumeToken(Token::RP);
+            consumeToken(Token::END_STMT);
+            if(isLoad)
+                return em.makeLoad(id, path);
+            return em.makeStore(id, path);
+        }
+
+        //parallel for (i = first, last; + s, && b) stmt, the reductions are optional
+        case Token::PARALLEL:
+        {
+            if(inFunction)
+                throw ParseError("A parallel for can't be in a function");
+            safe_next();
+            consumeToken(Token::FOR);
+            consumeToken(Token::LP);
+            Id* induction = parseId();
+            consumeToken(Token::ASSIGN);
+            Expression* first = parseExpression();
+            consumeToken(Token::COMMA);
+            Expression* last = parseExpression();
+            std::vector<ParallelFor::Reduction> reductions;
+            if(tag() == Token::END_STMT)
+            {
+                do
+                {
+                    safe_next();
+                    ReductionOp op;
+                    switch(tag())
+                    {
+                        case Token::ADD: op = REDUCE_ADD; break;
+                        case Token::MUL: op = REDUCE_MUL; break;
+                        case Token::AND: op = REDUCE_AND; break;
+                        case Token::OR:  op = REDUCE_OR; break;
+                        default:
+                            throw ParseError("Expected reduction operator, not found");
+                    }
+                    safe_next();
+                    reductions.push_back({op, parseId()});
+                } while(tag() == Token::COMMA);
+            }
+            consumeToken(Token::RP);
+            Stmt* stmt = parseStmt();
+            ParallelFor* loop = em.makeParallelFor(induction, first, last, reductions, stmt);
+            checkParallelFor(loop);
+            return loop;
+        }
+
         case Token::LEFT_CURLY:
         {
             return parseBlock();
         }
 
+        case Token::RETURN:
+        {
+            if(!inFunction)
+                throw ParseError("return outside of a function");
+            safe_next();
+            Expression* exp = parseExpression();
+            consumeToken(Token::END_STMT);
+            return em.makeReturn(exp);
+        }
+
         default:    
         {
             throw ParseError("No valid symbol at start of Stmt Parsing");
@@ -127,7 +282,7 @@ Stmt* Parser::parseStmt()
 Decls* Parser::parseDecls()
 {
     //if condition is true, decls is not null, so it contains at least one declaration
-    if(tokenItr->tag == Token::BOOL || tokenItr->tag == Token::INT)
+    if(tag() == Token::BOOL || tag() == Token::INT)
     {
         Decl* decl = parseDecl();
         return em.makeDecls(decl, parseDecls());
@@ -140,6 +295,17 @@ Decl* Parser::parseDecl()
 {
   Type* type = parseType();
   Id* id = parseId();
+
+  //the variables of a function are its locals
+  if(inFunction)
+  {
+    if(type->getKind() == Node::VECTOR_TYPE)
+      throw ParseError("Arrays can't be declared in a function");
+    consumeToken(Token::END_STMT);
+    Decl* decl = em.makeDecl(type, id);
+    declareLocal(decl);
+    return decl;
+  }
   
   //double declaration checking
   auto it = std::find(declaredVars.begin(), declaredVars.end(),id->getName());
@@ -154,19 +320,41 @@ Decl* Parser::parseDecl()
 
 Id* Parser::parseId()
 {
-    if(tokenItr->tag != Token::ID)
+    if(tag() != Token::ID)
         throw ParseError{"Expected identifier, not found"};
         
     auto id = em.makeId(tokenItr->word);
+    if(inFunction)
+    {
+        auto local = localSlots.find(id->getName());
+        if(local != localSlots.end())
+            id->setLocal(local->second);
+    }
     safe_next();
     return id;
     
 }
 
+//subscripts of an array cell, from the left bracket: a single one is the index itself,
+//more of them are combined by an Index node
+Expression* Parser::parseIndex(Id* id)
+{
+    std::vector<Expression*> subscripts;
+    while(tag() == Token::LEFT_SQUARE)
+    {
+        safe_next();
+        subscripts.push_back(parseExpression());
+        consumeToken(Token::RIGHT_SQUARE);
+    }
+    if(subscripts.size() == 1)
+        return subscripts[0];
+    return em.makeIndex(id, subscripts);
+}
+
 Type* Parser::parseType()
 {
     Type::TypeCode typeCode;
-    switch (tokenItr->tag)
+    switch (tag())
     {
     case Token::INT:
         typeCode = Type::INT;
@@ -182,17 +370,28 @@ Type* Parser::parseType()
 
     safe_next(); //skip typeCode
 
-    //if condition true, type is a vector type (for example, "int [10] myArray")
-    if(tokenItr->tag == Token::LEFT_SQUARE)
+    //if condition true, type is a vector type (for example, "int [10] myArray"),
+    //with one size for every dimension (for example, "int [3][4] myMatrix")
+    if(tag() == Token::LEFT_SQUARE)
     {
-        safe_next();    //skip bracket
-        if(tokenItr->tag != Token::NUM)
-            throw ParseError{"Expected numeric constant, not found"};
-        
-        Type* type = em.makeVectorType(typeCode, std::stoi(tokenItr->word));
-        safe_next();    //skip number
-        consumeToken(Token::RIGHT_SQUARE);  //skip bracket  
-        return type;
+        std::vector<int> dims;
+        long long cells = 1;
+        while(tag() == Token::LEFT_SQUARE)
+        {
+            safe_next();    //skip bracket
+            if(tag() != Token::NUM)
+                throw ParseError{"Expected numeric constant, not found"};
+
+            dims.push_back(std::stoi(tokenItr->word));
+            cells *= dims.back();
+            if(cells > std::numeric_limits<int>::max())
+                throw ParseError{"Array has too many cells"};
+            safe_next();    //skip number
+            consumeToken(Token::RIGHT_SQUARE);  //skip bracket
+        }
+        if(dims.size() == 1)
+            return em.makeVectorType(typeCode, dims[0]);
+        return em.makeVectorType(typeCode, dims);
     }
     //return non-vector basic type
     return em.makeType(typeCode);
@@ -205,7 +404,7 @@ Type* Parser::parseType()
 Expression* Parser::parseExpression()
 {
     Expression* exp = parseAnd();
-    while(tokenItr->tag == Token::OR)
+    while(tag() == Token::OR)
     {
         safe_next();
         exp = em.makeOr(exp, parseAnd());
@@ -216,7 +415,7 @@ Expression* Parser::parseExpression()
 Expression* Parser::parseAnd()
 {
     Expression* exp = parseEquality();
-    while(tokenItr->tag == Token::AND)
+    while(tag() == Token::AND)
     {
         safe_next();
         exp = em.makeAnd(exp, parseEquality());
@@ -228,14 +427,14 @@ Expression* Parser::parseAnd()
 Expression* Parser::parseEquality()
 {
     Expression* exp = parseRel();
-    while(tokenItr->tag == Token::EQ || tokenItr->tag == Token::NOT_EQ)
+    while(tag() == Token::EQ || tag() == Token::NOT_EQ)
     {
-        if(tokenItr->tag == Token::EQ)
+        if(tag() == Token::EQ)
         {
             safe_next();
             exp = em.makeBinOp(Op::EQ, exp, parseRel());
         }
-        else if(tokenItr->tag == Token::NOT_EQ)
+        else if(tag() == Token::NOT_EQ)
         {
             safe_next();
             exp = em.makeBinOp(Op::NOT_EQ, exp, parseRel());
@@ -247,7 +446,7 @@ Expression* Parser::parseEquality()
 Expression* Parser::parseRel()
 {
     Expression* exp1 = parseLowerPrecedenceBinOp();   
-    switch(tokenItr->tag)
+    switch(tag())
     {
         case Token::LESS:
         {
@@ -289,14 +488,14 @@ Expression* Parser::parseRel()
 Expression* Parser::parseLowerPrecedenceBinOp()
 {
     Expression* exp = parseHigerPrecedenceBinOp();
-    while(tokenItr->tag == Token::ADD || tokenItr->tag == Token::MIN)
+    while(tag() == Token::ADD || tag() == Token::MIN)
     {
-        if(tokenItr->tag == Token::ADD)
+        if(tag() == Token::ADD)
         {
             safe_next();
             exp = em.makeBinOp(Op::ADD, exp, parseHigerPrecedenceBinOp());
         }
-        else if(tokenItr->tag == Token::MIN)
+        else if(tag() == Token::MIN)
         {
             safe_next();
             exp = em.makeBinOp(Op::SUB, exp, parseHigerPrecedenceBinOp());
@@ -308,14 +507,14 @@ Expression* Parser::parseLowerPrecedenceBinOp()
 Expression* Parser::parseHigerPrecedenceBinOp()
 {
     Expression* exp = parseUnaryOp();
-    while(tokenItr->tag == Token::MUL || tokenItr->tag == Token::DIV)
+    while(tag() == Token::MUL || tag() == Token::DIV)
     {
-        if(tokenItr->tag == Token::MUL)
+        if(tag() == Token::MUL)
         {
             safe_next();
             exp = em.makeBinOp(Op::MUL, exp, parseUnaryOp());
         }
-        else if(tokenItr->tag == Token::DIV)
+        else if(tag() == Token::DIV)
         {
             safe_next();
             exp = em.makeBinOp(Op::DIV, exp, parseUnaryOp());
@@ -326,7 +525,7 @@ Expression* Parser::parseHigerPrecedenceBinOp()
 
 Expression* Parser::parseUnaryOp()
 {
-    switch(tokenItr->tag)
+    switch(tag())
     {
         case Token::NOT:
             safe_next();
@@ -344,9 +543,32 @@ Expression* Parser::parseUnaryOp()
 }
 
 
+//f(a, b): the function is linked by linkCalls
+Expression* Parser::parseCall()
+{
+    std::string name = tokenItr->word;
+    safe_next();
+    consumeToken(Token::LP);
+    std::vector<Expression*> args;
+    if(tag() != Token::RP)
+    {
+        args.push_back(parseExpression());
+        while(tag() == Token::COMMA)
+        {
+            safe_next();
+            args.push_back(parseExpression());
+        }
+    }
+    consumeToken(Token::RP);
+    Call* call = em.makeCall(name, args);
+    calls.push_back(call);
+    return call;
+}
+
+
 Expression* Parser::parseFactor()
 {
-    switch(tokenItr->tag)
+    switch(tag())
     {
         case Token::LP:
         {
@@ -358,12 +580,12 @@ Expression* Parser::parseFactor()
         
         case Token::ID:
         {
+            if(tokenItr + 1 != streamEnd && (tokenItr + 1)->tag == Token::LP)
+                return parseCall();
             Id* id = parseId();
-            if(tokenItr->tag == Token::LEFT_SQUARE) 
+            if(tag() == Token::LEFT_SQUARE) 
             {
-                safe_next();
-                Expression* index = parseExpression();
-                consumeToken(Token::RIGHT_SQUARE);
+                Expression* index = parseIndex(id);
                 return em.makeAccess(id, index);
             }
             return id;
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <algorithm>
 
 #include "Node.h"
@@ -50,13 +51,27 @@ private:
     //declare "a" multiple times, but this behaviour is allowed, so double declarations checking is 
     //done by simply counting how many declarations with the same idName appear in the program
     std::vector<std::string> declaredVars;
+
+    //the functions declared so far, and the calls to link to them at the end of the program
+    std::vector<Function*> functions;
+    std::vector<Call*> calls;
+
+    //while a function is parsed: its locals, in the order of their slots, and the slot of every name
+    bool inFunction = false;
+    std::vector<Decl*> locals;
+    std::map<std::string, int> localSlots;
     
     Program* parseProgram();
+    Function* parseFunction();
+    void declareLocal(Decl* decl);
+    void linkCalls();
+    Expression* parseCall();
     Block* parseBlock();
     Decls* parseDecls();
     Decl* parseDecl();
     Type* parseType();
     Id* parseId();
+    Expression* parseIndex(Id* id);
     Seq* parseSeq();
     Stmt* parseStmt();
     Expression* parseExpression();
@@ -70,6 +85,14 @@ private:
     Expression* parseFactor();
 
 
+    //tag of the current token, the input must not be over
+    int tag() const {
+        if (tokenItr == streamEnd) {
+            throw ParseError("Unexpected end of input");
+        }
+        return tokenItr->tag;
+    }
+
     // Safely skipping token
     void safe_next() {
         if (tokenItr == streamEnd) {
@@ -81,14 +104,14 @@ private:
     //Checking that token is the expected one before skipping it
     void consumeToken(const int tokenId)
     {
-        if (tokenItr->tag == tokenId)
+        if (tag() == tokenId)
             safe_next();
         else 
             throw ParseError{
             std::string("Expecting ").
             append(Token::id2word[tokenId]).
             append(", instead found ").
-            append(Token::id2word[tokenItr->tag])};
+            append(Token::id2word[tag()])};
     }
 
 };
@@ -0,0 +1,825 @@
+#include <stdexcept>
+
+#include "Pass.h"
+#include "Fused.h"
+
+namespace {
+
+//wrap-around arithmetic, to avoid undefined behaviour while folding
+int wrapAdd(int l, int r) {return static_cast<int>(static_cast<unsigned>(l) + static_cast<unsigned>(r));}
+int wrapSub(int l, int r) {return static_cast<int>(static_cast<unsigned>(l) - static_cast<unsigned>(r));}
+int wrapMul(int l, int r) {return static_cast<int>(static_cast<unsigned>(l) * static_cast<unsigned>(r));}
+
+intConstant* asIntLiteral(Expression* e) {
+    return e->getKind() == Node::INT_CONSTANT ? static_cast<intConstant*>(e) : nullptr;
+}
+
+boolConstant* asBoolLiteral(Expression* e) {
+    return e->getKind() == Node::BOOL_CONSTANT ? static_cast<boolConstant*>(e) : nullptr;
+}
+
+
+//Every visit of an expression returns the literal the expression folds to, or nullptr if
+//it can't be folded. Statements replace their expressions with the folded ones
+class ConstantFoldingVisitor : public Visitor {
+public:
+    ConstantFoldingVisitor(ExpressionManager& manager) : em{manager}, changed{false} {}
+
+    bool hasChanged() {return changed;}
+
+    //returns the expression that has to replace e
+    Expression* fold(Expression* e) {
+        Constant* folded = e->accept(this);
+        if(folded && folded != e)
+        {
+            changed = true;
+            return folded;
+        }
+        return e;
+    }
+
+    Constant* visitProgram(Program* program) override {
+        for(Function* function : program->getFunctions())
+            function->accept(this);
+        program->getBlock()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitFunction(Function* functionNode) override {
+        functionNode->getBody()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitBlock(Block* block) override {
+        if(block->getSeq())
+            block->getSeq()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitType(Type* type) override {return nullptr;}
+    Constant* visitVectorType(vectorType* type) override {return nullptr;}
+    Constant* visitDecls(Decls* decls) override {return nullptr;}
+    Constant* visitDecl(Decl* decl) override {return nullptr;}
+
+    Constant* visitSeq(Seq* seq) override {
+        seq->getStmt()->accept(this);
+        if(seq->getSeq())
+            seq->getSeq()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitIf(If* ifNode) override {
+        ifNode->setCondition(fold(ifNode->getCondition()));
+        ifNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitElse(Else* elseNode) override {
+        elseNode->setCondition(fold(elseNode->getCondition()));
+        elseNode->getifTrueStmt()->accept(this);
+        elseNode->getifFalseStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitWhile(While* whileNode) override {
+        whileNode->setCondition(fold(whileNode->getCondition()));
+        whileNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitDo(Do* doNode) override {
+        doNode->setCondition(fold(doNode->getCondition()));
+        doNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitParallelFor(ParallelFor* parallelForNode) override {
+        parallelForNode->setFirst(fold(parallelForNode->getFirst()));
+        parallelForNode->setLast(fold(parallelForNode->getLast()));
+        parallelForNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitSet(Set* setNode) override {
+        setNode->setExp(fold(setNode->getExp()));
+        return nullptr;
+    }
+
+    Constant* visitSetElem(SetElem* setElemNode) override {
+        setElemNode->setIndex(fold(setElemNode->getIndex()));
+        setElemNode->setExp(fold(setElemNode->getExp()));
+        return nullptr;
+    }
+
+    Constant* visitBreak(Break* breakNode) override {return nullptr;}
+
+    Constant* visitPrint(Print* printNode) override {
+        printNode->setExp(fold(printNode->getExp()));
+        return nullptr;
+    }
+
+    Constant* visitReturn(Return* returnNode) override {
+        returnNode->setExp(fold(returnNode->getExp()));
+        return nullptr;
+    }
+
+    //a call is never folded, its arguments are
+    Constant* visitCall(Call* callNode) override {
+        for(size_t k = 0; k < callNode->getArgs().size(); k++)
+            callNode->setArg(k, fold(callNode->getArgs()[k]));
+        return nullptr;
+    }
+
+    Constant* visitLoad(Load* loadNode) override {return nullptr;}
+    Constant* visitStore(Store* storeNode) override {return nullptr;}
+
+    Constant* visitId(Id* idNode) override {return nullptr;}
+    Constant* visitIntConstant(intConstant* numNode) override {return numNode;}
+    Constant* visitBoolConstant(boolConstant* boolNode) override {return boolNode;}
+
+    Constant* visitAccess(Access* accessNode) override {
+        accessNode->setIndex(fold(accessNode->getIndex()));
+        return nullptr;
+    }
+
+    //an Index with literal subscripts still has to check them against the array at run time
+    Constant* visitIndex(Index* indexNode) override {
+        for(size_t k = 0; k < indexNode->getSubscripts().size(); k++)
+            indexNode->setSubscript(k, fold(indexNode->getSubscripts()[k]));
+        return nullptr;
+    }
+
+    Constant* visitNot(Not* notNode) override {
+        notNode->setExp(fold(notNode->getExp()));
+        if(auto b = asBoolLiteral(notNode->getExp()))
+            return em.makeBoolConstant(!b->getBool());
+        return nullptr;
+    }
+
+    Constant* visitUnaryOp(Unary* unaryNode) override {
+        unaryNode->setExp(fold(unaryNode->getExp()));
+        auto i = asIntLiteral(unaryNode->getExp());
+        if(i && unaryNode->getOp() == Op::UNARY_MIN)
+            return em.makeIntConstant(wrapSub(0, i->getInt()));
+        return nullptr;
+    }
+
+    //the right operand of && and || is evaluated only when needed, so
+    //false && e and true || e can be folded whatever e is
+    Constant* visitAnd(And* andNode) override {
+        andNode->setLeftExp(fold(andNode->getLeftExp()));
+        andNode->setRightExp(fold(andNode->getRightExp()));
+        auto l = asBoolLiteral(andNode->getLeftExp());
+        auto r = asBoolLiteral(andNode->getRightExp());
+        if(l && !l->getBool())
+            return em.makeBoolConstant(false);
+        if(l && r)
+            return em.makeBoolConstant(r->getBool());
+        return nullptr;
+    }
+
+    Constant* visitOr(Or* orNode) override {
+        orNode->setLeftExp(fold(orNode->getLeftExp()));
+        orNode->setRightExp(fold(orNode->getRightExp()));
+        auto l = asBoolLiteral(orNode->getLeftExp());
+        auto r = asBoolLiteral(orNode->getRightExp());
+        if(l && l->getBool())
+            return em.makeBoolConstant(true);
+        if(l && r)
+            return em.makeBoolConstant(r->getBool());
+        return nullptr;
+    }
+
+    Constant* visitRel(Rel* relNode) override {
+        relNode->setLeftExp(fold(relNode->getLeftExp()));
+        relNode->setRightExp(fold(relNode->getRightExp()));
+        auto l = asIntLiteral(relNode->getLeftExp());
+        auto r = asIntLiteral(relNode->getRightExp());
+        if(!l || !r)
+            return nullptr;
+
+        switch(relNode->getOp())
+        {
+            case Rel::MORE:
+                return em.makeBoolConstant(l->getInt() > r->getInt());
+            case Rel::MORE_EQ:
+                return em.makeBoolConstant(l->getInt() >= r->getInt());
+            case Rel::LESS:
+                return em.makeBoolConstant(l->getInt() < r->getInt());
+            case Rel::LESS_EQ:
+                return em.makeBoolConstant(l->getInt() <= r->getInt());
+            default:
+                return nullptr;
+        }
+    }
+
+    Constant* visitBinOp(Arithm* arithmNode) override {
+        arithmNode->setLeftExp(fold(arithmNode->getLeftExp()));
+        arithmNode->setRightExp(fold(arithmNode->getRightExp()));
+        auto li = asIntLiteral(arithmNode->getLeftExp());
+        auto ri = asIntLiteral(arithmNode->getRightExp());
+        auto lb = asBoolLiteral(arithmNode->getLeftExp());
+        auto rb = asBoolLiteral(arithmNode->getRightExp());
+
+        switch(arithmNode->getOp())
+        {
+            case Op::ADD:
+                if(li && ri) return em.makeIntConstant(wrapAdd(li->getInt(), ri->getInt()));
+                break;
+            case Op::SUB:
+                if(li && ri) return em.makeIntConstant(wrapSub(li->getInt(), ri->getInt()));
+                break;
+            case Op::MUL:
+                if(li && ri) return em.makeIntConstant(wrapMul(li->getInt(), ri->getInt()));
+                break;
+            case Op::DIV:
+                //division by 0 (and the overflowing INT_MIN / -1) must still happen at runtime
+                if(li && ri && ri->getInt() != 0 && ri->getInt() != -1)
+                    return em.makeIntConstant(li->getInt() / ri->getInt());
+                break;
+            case Op::EQ:
+                if(li && ri) return em.makeBoolConstant(li->getInt() == ri->getInt());
+                if(lb && rb) return em.makeBoolConstant(lb->getBool() == rb->getBool());
+                break;
+            case Op::NOT_EQ:
+                if(li && ri) return em.makeBoolConstant(li->getInt() != ri->getInt());
+                if(lb && rb) return em.makeBoolConstant(lb->getBool() != rb->getBool());
+                break;
+            default:
+                break;
+        }
+        return nullptr;
+    }
+
+private:
+    ExpressionManager& em;
+    bool changed;
+};
+
+
+//Every visit of a statement stores in replacement the statement that has to take its place,
+//nullptr meaning that the statement can be removed
+class DeadCodeVisitor : public Visitor {
+public:
+    DeadCodeVisitor(ExpressionManager& manager) : em{manager}, replacement{nullptr}, changed{false} {}
+
+    bool hasChanged() {return changed;}
+
+    Stmt* simplify(Stmt* stmt) {
+        replacement = stmt;
+        stmt->accept(this);
+        return replacement;
+    }
+
+    //like simplify, for the positions in which a statement is mandatory (body of a loop, branch of an if)
+    Stmt* simplifyBody(Stmt* stmt) {
+        Stmt* simplified = simplify(stmt);
+        if(simplified)
+            return simplified;
+        if(isEmptyBlock(stmt))
+            return stmt;
+        return em.makeBlock(Decls::EMPTY_DECLS, Seq::EMPTY_SEQ);
+    }
+
+    Seq* simplifySeq(Seq* seq) {
+        if(!seq)
+            return Seq::EMPTY_SEQ;
+
+        Stmt* stmt = simplify(seq->getStmt());
+
+        //statements following a break or a return are never executed
+        Seq* rest = Seq::EMPTY_SEQ;
+        if(!stmt || (stmt->getKind() != Node::BREAK && stmt->getKind() != Node::RETURN))
+            rest = simplifySeq(seq->getSeq());
+
+        if(rest != seq->getSeq())
+        {
+            seq->setSeq(rest);
+            changed = true;
+        }
+        if(!stmt)
+        {
+            changed = true;
+            return rest;
+        }
+        if(stmt != seq->getStmt())
+        {
+            seq->setStmt(stmt);
+            changed = true;
+        }
+        return seq;
+    }
+
+    Constant* visitProgram(Program* program) override {
+        for(Function* function : program->getFunctions())
+            function->accept(this);
+        program->getBlock()->accept(this);
+        return nullptr;
+    }
+
+    //the body of a function stays, even if empty
+    Constant* visitFunction(Function* functionNode) override {
+        functionNode->getBody()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitBlock(Block* block) override {
+        Seq* seq = simplifySeq(block->getSeq());
+        block->setSeq(seq);
+        replacement = (!block->getDecls() && !seq) ? nullptr : block;
+        return nullptr;
+    }
+
+    Constant* visitIf(If* ifNode) override {
+        if(auto cond = asBoolLiteral(ifNode->getCondition()))
+        {
+            replacement = cond->getBool() ? simplify(ifNode->getStmt()) : nullptr;
+            return nullptr;
+        }
+        replaceBody(ifNode->getStmt(), [ifNode](Stmt* s) {ifNode->setStmt(s);});
+        replacement = ifNode;
+        return nullptr;
+    }
+
+    Constant* visitElse(Else* elseNode) override {
+        if(auto cond = asBoolLiteral(elseNode->getCondition()))
+        {
+            replacement = simplify(cond->getBool() ? elseNode->getifTrueStmt() : elseNode->getifFalseStmt());
+            return nullptr;
+        }
+        replaceBody(elseNode->getifTrueStmt(), [elseNode](Stmt* s) {elseNode->setifTrueStmt(s);});
+        replaceBody(elseNode->getifFalseStmt(), [elseNode](Stmt* s) {elseNode->setifFalseStmt(s);});
+        replacement = elseNode;
+        return nullptr;
+    }
+
+    Constant* visitWhile(While* whileNode) override {
+        auto cond = asBoolLiteral(whileNode->getCondition());
+        if(cond && !cond->getBool())
+        {
+            replacement = nullptr;
+            return nullptr;
+        }
+        replaceBody(whileNode->getStmt(), [whileNode](Stmt* s) {whileNode->setStmt(s);});
+        replacement = whileNode;
+        return nullptr;
+    }
+
+    Constant* visitDo(Do* doNode) override {
+        replaceBody(doNode->getStmt(), [doNode](Stmt* s) {doNode->setStmt(s);});
+        replacement = doNode;
+        return nullptr;
+    }
+
+    //a parallel for with an empty body still assigns its index
+    Constant* visitParallelFor(ParallelFor* parallelForNode) override {
+        replaceBody(parallelForNode->getStmt(), [parallelForNode](Stmt* s) {parallelForNode->setStmt(s);});
+        replacement = parallelForNode;
+        return nullptr;
+    }
+
+    //simple statements are never removed
+    Constant* visitSet(Set* setNode) override {return nullptr;}
+    Constant* visitSetElem(SetElem* setElemNode) override {return nullptr;}
+    Constant* visitBreak(Break* breakNode) override {return nullptr;}
+    Constant* visitPrint(Print* printNode) override {return nullptr;}
+    Constant* visitLoad(Load* loadNode) override {return nullptr;}
+    Constant* visitStore(Store* storeNode) override {return nullptr;}
+    Constant* visitReturn(Return* returnNode) override {return nullptr;}
+
+    //expressions and declarations are not touched by this pass
+    Constant* visitType(Type* type) override {return nullptr;}
+    Constant* visitVectorType(vectorType* type) override {return nullptr;}
+    Constant* visitDecls(Decls* decls) override {return nullptr;}
+    Constant* visitDecl(Decl* decl) override {return nullptr;}
+    Constant* visitSeq(Seq* seq) override {return nullptr;}
+    Constant* visitId(Id* idNode) override {return nullptr;}
+    Constant* visitIntConstant(intConstant* numNode) override {return nullptr;}
+    Constant* visitBoolConstant(boolConstant* boolNode) override {return nullptr;}
+    Constant* visitBinOp(Arithm* arithmNode) override {return nullptr;}
+    Constant* visitUnaryOp(Unary* unaryNode) override {return nullptr;}
+    Constant* visitAccess(Access* accessNode) override {return nullptr;}
+    Constant* visitIndex(Index* indexNode) override {return nullptr;}
+    Constant* visitNot(Not* notNode) override {return nullptr;}
+    Constant* visitAnd(And* andNode) override {return nullptr;}
+    Constant* visitOr(Or* orNode) override {return nullptr;}
+    Constant* visitRel(Rel* relNode) override {return nullptr;}
+    Constant* visitCall(Call* callNode) override {return nullptr;}
+
+private:
+    ExpressionManager& em;
+    Stmt* replacement;
+    bool changed;
+
+    template<class Setter>
+    void replaceBody(Stmt* body, Setter set) {
+        Stmt* simplified = simplifyBody(body);
+        if(simplified != body)
+        {
+            set(simplified);
+            changed = true;
+        }
+    }
+
+    static bool isEmptyBlock(Stmt* stmt) {
+        if(stmt->getKind() != Node::BLOCK)
+            return false;
+        auto block = static_cast<Block*>(stmt);
+        return !block->getDecls() && !block->getSeq();
+    }
+};
+
+
+//Every visit of an expression stores in replacement the expression that has to take its
+//place. Operands are fused before their operation, so an operand that is not a leaf can
+//be a fused node itself
+class FusionVisitor : public Visitor {
+public:
+    FusionVisitor(ExpressionManager& manager) : em{manager}, replacement{nullptr}, changed{false} {}
+
+    bool hasChanged() {return changed;}
+
+    Expression* fuse(Expression* e) {
+        replacement = e;
+        e->accept(this);
+        if(replacement != e)
+            changed = true;
+        return replacement;
+    }
+
+    Constant* visitProgram(Program* program) override {
+        for(Function* function : program->getFunctions())
+            function->accept(this);
+        program->getBlock()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitFunction(Function* functionNode) override {
+        functionNode->getBody()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitBlock(Block* block) override {
+        if(block->getSeq())
+            block->getSeq()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitSeq(Seq* seq) override {
+        seq->getStmt()->accept(this);
+        if(seq->getSeq())
+            seq->getSeq()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitIf(If* ifNode) override {
+        ifNode->setCondition(fuse(ifNode->getCondition()));
+        ifNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitElse(Else* elseNode) override {
+        elseNode->setCondition(fuse(elseNode->getCondition()));
+        elseNode->getifTrueStmt()->accept(this);
+        elseNode->getifFalseStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitWhile(While* whileNode) override {
+        whileNode->setCondition(fuse(whileNode->getCondition()));
+        whileNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitDo(Do* doNode) override {
+        doNode->setCondition(fuse(doNode->getCondition()));
+        doNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitParallelFor(ParallelFor* parallelForNode) override {
+        parallelForNode->setFirst(fuse(parallelForNode->getFirst()));
+        parallelForNode->setLast(fuse(parallelForNode->getLast()));
+        parallelForNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitSet(Set* setNode) override {
+        setNode->setExp(fuse(setNode->getExp()));
+        return nullptr;
+    }
+
+    Constant* visitSetElem(SetElem* setElemNode) override {
+        setElemNode->setIndex(fuse(setElemNode->getIndex()));
+        setElemNode->setExp(fuse(setElemNode->getExp()));
+        return nullptr;
+    }
+
+    Constant* visitPrint(Print* printNode) override {
+        printNode->setExp(fuse(printNode->getExp()));
+        return nullptr;
+    }
+
+    Constant* visitReturn(Return* returnNode) override {
+        returnNode->setExp(fuse(returnNode->getExp()));
+        return nullptr;
+    }
+
+    Constant* visitLoad(Load* loadNode) override {return nullptr;}
+    Constant* visitStore(Store* storeNode) override {return nullptr;}
+
+    Constant* visitAccess(Access* accessNode) override {
+        accessNode->setIndex(fuse(accessNode->getIndex()));
+        replacement = accessNode;
+        return nullptr;
+    }
+
+    Constant* visitIndex(Index* indexNode) override {
+        for(size_t k = 0; k < indexNode->getSubscripts().size(); k++)
+            indexNode->setSubscript(k, fuse(indexNode->getSubscripts()[k]));
+        replacement = indexNode;
+        return nullptr;
+    }
+
+    Constant* visitNot(Not* notNode) override {
+        notNode->setExp(fuse(notNode->getExp()));
+        replacement = notNode;
+        return nullptr;
+    }
+
+    Constant* visitCall(Call* callNode) override {
+        for(size_t k = 0; k < callNode->getArgs().size(); k++)
+            callNode->setArg(k, fuse(callNode->getArgs()[k]));
+        replacement = callNode;
+        return nullptr;
+    }
+
+    Constant* visitUnaryOp(Unary* unaryNode) override {
+        unaryNode->setExp(fuse(unaryNode->getExp()));
+        replacement = unaryNode;
+        return nullptr;
+    }
+
+    Constant* visitAnd(And* andNode) override {
+        andNode->setLeftExp(fuse(andNode->getLeftExp()));
+        andNode->setRightExp(fuse(andNode->getRightExp()));
+        replacement = andNode;
+        return nullptr;
+    }
+
+    Constant* visitOr(Or* orNode) override {
+        orNode->setLeftExp(fuse(orNode->getLeftExp()));
+        orNode->setRightExp(fuse(orNode->getRightExp()));
+        replacement = orNode;
+        return nullptr;
+    }
+
+    Constant* visitRel(Rel* relNode) override {
+        relNode->setLeftExp(fuse(relNode->getLeftExp()));
+        relNode->setRightExp(fuse(relNode->getRightExp()));
+        Fused* fused = makeFused(em, relNode);
+        replacement = fused ? static_cast<Expression*>(fused) : relNode;
+        return nullptr;
+    }
+
+    Constant* visitBinOp(Arithm* arithmNode) override {
+        arithmNode->setLeftExp(fuse(arithmNode->getLeftExp()));
+        arithmNode->setRightExp(fuse(arithmNode->getRightExp()));
+        Fused* fused = makeFused(em, arithmNode);
+        replacement = fused ? static_cast<Expression*>(fused) : arithmNode;
+        return nullptr;
+    }
+
+    //an expression that is already fused is left as it is
+    Constant* visitFused(Fused* fusedNode) override {return nullptr;}
+
+    Constant* visitType(Type* type) override {return nullptr;}
+    Constant* visitVectorType(vectorType* type) override {return nullptr;}
+    Constant* visitDecls(Decls* decls) override {return nullptr;}
+    Constant* visitDecl(Decl* decl) override {return nullptr;}
+    Constant* visitBreak(Break* breakNode) override {return nullptr;}
+    Constant* visitId(Id* idNode) override {return nullptr;}
+    Constant* visitIntConstant(intConstant* numNode) override {return nullptr;}
+    Constant* visitBoolConstant(boolConstant* boolNode) override {return nullptr;}
+
+private:
+    ExpressionManager& em;
+    Expression* replacement;
+    bool changed;
+};
+
+
+//Throws std::logic_error on the first node missing a mandatory child
+class VerifyVisitor : public Visitor {
+public:
+    VerifyVisitor() = default;
+
+    void check(Node* n, const char* what) {
+        if(!n)
+            throw std::logic_error(std::string("verify: missing ") + what);
+        n->accept(this);
+    }
+
+    Constant* visitProgram(Program* program) override {
+        for(Function* function : program->getFunctions())
+            check(function, "function of Program");
+        check(program->getBlock(), "block of Program");
+        return nullptr;
+    }
+
+    Constant* visitFunction(Function* functionNode) override {
+        for(Decl* local : functionNode->getLocals())
+            check(local, "local of Function");
+        check(functionNode->getBody(), "body of Function");
+        return nullptr;
+    }
+
+    Constant* visitCall(Call* callNode) override {
+        if(!callNode->getFunction())
+            throw std::logic_error("verify: call of " + callNode->getName() + " not linked");
+        for(Expression* arg : callNode->getArgs())
+            check(arg, "argument of Call");
+        return nullptr;
+    }
+
+    Constant* visitReturn(Return* returnNode) override {
+        check(returnNode->getExp(), "expression of Return");
+        return nullptr;
+    }
+
+    Constant* visitBlock(Block* block) override {
+        if(block->getDecls())
+            block->getDecls()->accept(this);
+        if(block->getSeq())
+            block->getSeq()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitDecls(Decls* decls) override {
+        check(decls->getDecl(), "declaration of Decls");
+        if(decls->getDecls())
+            decls->getDecls()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitDecl(Decl* decl) override {
+        check(decl->getType(), "type of Decl");
+        check(decl->getId(), "identifier of Decl");
+        return nullptr;
+    }
+
+    Constant* visitSeq(Seq* seq) override {
+        check(seq->getStmt(), "statement of Seq");
+        if(seq->getSeq())
+            seq->getSeq()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitIf(If* ifNode) override {
+        check(ifNode->getCondition(), "condition of If");
+        check(ifNode->getStmt(), "statement of If");
+        return nullptr;
+    }
+
+    Constant* visitElse(Else* elseNode) override {
+        check(elseNode->getCondition(), "condition of Else");
+        check(elseNode->getifTrueStmt(), "true branch of Else");
+        check(elseNode->getifFalseStmt(), "false branch of Else");
+        return nullptr;
+    }
+
+    Constant* visitWhile(While* whileNode) override {
+        check(whileNode->getCondition(), "condition of While");
+        check(whileNode->getStmt(), "statement of While");
+        return nullptr;
+    }
+
+    Constant* visitDo(Do* doNode) override {
+        check(doNode->getCondition(), "condition of Do");
+        check(doNode->getStmt(), "statement of Do");
+        return nullptr;
+    }
+
+    Constant* visitParallelFor(ParallelFor* parallelForNode) override {
+        check(parallelForNode->getId(), "index of ParallelFor");
+        check(parallelForNode->getFirst(), "first bound of ParallelFor");
+        check(parallelForNode->getLast(), "last bound of ParallelFor");
+        for(auto& reduction : parallelForNode->getReductions())
+            check(reduction.var, "reduction of ParallelFor");
+        check(parallelForNode->getStmt(), "statement of ParallelFor");
+        return nullptr;
+    }
+
+    Constant* visitSet(Set* setNode) override {
+        check(setNode->getId(), "identifier of Set");
+        check(setNode->getExp(), "expression of Set");
+        return nullptr;
+    }
+
+    Constant* visitSetElem(SetElem* setElemNode) override {
+        check(setElemNode->getId(), "identifier of SetElem");
+        check(setElemNode->getIndex(), "index of SetElem");
+        check(setElemNode->getExp(), "expression of SetElem");
+        return nullptr;
+    }
+
+    Constant* visitPrint(Print* printNode) override {
+        check(printNode->getExp(), "expression of Print");
+        return nullptr;
+    }
+
+    Constant* visitLoad(Load* loadNode) override {
+        check(loadNode->getId(), "identifier of Load");
+        return nullptr;
+    }
+
+    Constant* visitStore(Store* storeNode) override {
+        check(storeNode->getId(), "identifier of Store");
+        return nullptr;
+    }
+
+    Constant* visitNot(Not* notNode) override {
+        check(notNode->getExp(), "operand of Not");
+        return nullptr;
+    }
+
+    Constant* visitAnd(And* andNode) override {
+        check(andNode->getLeftExp(), "left operand of And");
+        check(andNode->getRightExp(), "right operand of And");
+        return nullptr;
+    }
+
+    Constant* visitOr(Or* orNode) override {
+        check(orNode->getLeftExp(), "left operand of Or");
+        check(orNode->getRightExp(), "right operand of Or");
+        return nullptr;
+    }
+
+    Constant* visitRel(Rel* relNode) override {
+        check(relNode->getLeftExp(), "left operand of Rel");
+        check(relNode->getRightExp(), "right operand of Rel");
+        return nullptr;
+    }
+
+    Constant* visitBinOp(Arithm* arithmNode) override {
+        check(arithmNode->getLeftExp(), "left operand of Arithm");
+        check(arithmNode->getRightExp(), "right operand of Arithm");
+        return nullptr;
+    }
+
+    Constant* visitUnaryOp(Unary* unaryNode) override {
+        check(unaryNode->getExp(), "operand of Unary");
+        return nullptr;
+    }
+
+    Constant* visitAccess(Access* accessNode) override {
+        check(accessNode->getId(), "identifier of Access");
+        check(accessNode->getIndex(), "index of Access");
+        return nullptr;
+    }
+
+    Constant* visitIndex(Index* indexNode) override {
+        check(indexNode->getId(), "identifier of Index");
+        for(Expression* subscript : indexNode->getSubscripts())
+            check(subscript, "subscript of Index");
+        return nullptr;
+    }
+
+    Constant* visitType(Type* type) override {return nullptr;}
+    Constant* visitVectorType(vectorType* type) override {return nullptr;}
+    Constant* visitId(Id* idNode) override {return nullptr;}
+    Constant* visitBreak(Break* breakNode) override {return nullptr;}
+    Constant* visitIntConstant(intConstant* numNode) override {return nullptr;}
+    Constant* visitBoolConstant(boolConstant* boolNode) override {return nullptr;}
+};
+
+}
+
+
+bool ConstantFoldingPass::run(Program* program)
+{
+    ConstantFoldingVisitor folder(em);
+    program->accept(&folder);
+    return folder.hasChanged();
+}
+
+bool DeadCodeEliminationPass::run(Program* program)
+{
+    DeadCodeVisitor eliminator(em);
+    program->accept(&eliminator);
+    return eliminator.hasChanged();
+}
+
+bool FusionPass::run(Program* program)
+{
+    FusionVisitor fuser(em);
+    program->accept(&fuser);
+    return fuser.hasChanged();
+}
+
+bool VerifyPass::run(Program* program)
+{
+    VerifyVisitor verifier;
+    verifier.check(program, "Program");
+    return false;
+}
@@ -0,0 +1,65 @@
+#ifndef PASS_H
+#define PASS_H
+
+#include <string>
+
+#include "Node.h"
+#include "ExpressionManager.h"
+
+//A Pass is either an analysis or a transformation of the AST of a Program.
+//run returns true only if the tree has been modified
+class Pass {
+public:
+    virtual ~Pass() = default;
+    virtual std::string getName() = 0;
+    virtual bool run(Program* program) = 0;
+};
+
+//Replaces operations whose operands are literals with the resulting literal.
+//Operations that would fail at runtime (division by 0, type mismatches) are left untouched,
+//so that the error is still raised during evaluation
+class ConstantFoldingPass : public Pass {
+public:
+    ConstantFoldingPass(ExpressionManager& manager) : em{manager} {}
+    std::string getName() override {return "fold";}
+    bool run(Program* program) override;
+
+private:
+    ExpressionManager& em;
+};
+
+//Removes statements that can never be executed: if/while with a false literal condition,
+//the branch of an else that is never taken and statements following a break in the same Seq
+class DeadCodeEliminationPass : public Pass {
+public:
+    DeadCodeEliminationPass(ExpressionManager& manager) : em{manager} {}
+    std::string getName() override {return "dce";}
+    bool run(Program* program) override;
+
+private:
+    ExpressionManager& em;
+};
+
+//Replaces Arithm and Rel nodes having a variable or an int literal among their operands with
+//Fused nodes (see Fused.h). The fused nodes capture the shape of the operands, so it has
+//to be the last transformation of a pipeline
+class FusionPass : public Pass {
+public:
+    FusionPass(ExpressionManager& manager) : em{manager} {}
+    std::string getName() override {return "fuse";}
+    bool run(Program* program) override;
+
+private:
+    ExpressionManager& em;
+};
+
+//Analysis checking the structural invariants of the tree (mandatory children are not null).
+//It is meant to be scheduled after transformations while debugging them
+class VerifyPass : public Pass {
+public:
+    VerifyPass() = default;
+    std::string getName() override {return "verify";}
+    bool run(Program* program) override;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "PassManager.h"
+#include "Visitor.h"
+
+const char* PassManager::levelPipelines[PassManager::MAX_OPT_LEVEL + 1] = {
+    "",
+    "fold",
+    "fold,dce",
+    "fold,dce,fuse"
+};
+
+std::unique_ptr<Pass> PassManager::createPass(const std::string& name)
+{
+    if(name == "fold")
+        return std::unique_ptr<Pass>(new ConstantFoldingPass(em));
+    if(name == "dce")
+        return std::unique_ptr<Pass>(new DeadCodeEliminationPass(em));
+    if(name == "fuse")
+        return std::unique_ptr<Pass>(new FusionPass(em));
+    if(name == "verify")
+        return std::unique_ptr<Pass>(new VerifyPass());
+    throw std::invalid_argument("Unknown pass: " + name);
+}
+
+void PassManager::addPass(const std::string& name)
+{
+    //only analyses can follow the fusion, which captures the shape of the tree
+    for(auto& pass : pipeline)
+    {
+        if(pass->getName() == "fuse" && name != "verify")
+            throw std::invalid_argument("Pass " + name + " can't be scheduled after fuse");
+    }
+    pipeline.push_back(createPass(name));
+}
+
+void PassManager::addPasses(const std::string& names)
+{
+    std::stringstream list{names};
+    std::string name;
+    while(std::getline(list, name, ','))
+    {
+        if(!name.empty())
+            addPass(name);
+    }
+}
+
+void PassManager::setOptimizationLevel(int level)
+{
+    if(level < 0 || level > MAX_OPT_LEVEL)
+        throw std::invalid_argument("Invalid optimization level: " + std::to_string(level));
+    pipeline.clear();
+    addPasses(levelPipelines[level]);
+}
+
+static int countNodes(Program* program)
+{
+    NodeCountVisitor counter;
+    program->accept(&counter);
+    return counter.getCount();
+}
+
+void PassManager::run(Program* program)
+{
+    for(auto& pass : pipeline)
+    {
+        PassStatistics stats;
+        stats.name = pass->getName();
+        stats.nodesBefore = countNodes(program);
+
+        auto start = std::chrono::steady_clock::now();
+        stats.changed = pass->run(program);
+        auto end = std::chrono::steady_clock::now();
+
+        stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        stats.nodesAfter = countNodes(program);
+        statistics.push_back(stats);
+    }
+}
+
+void PassManager::printStatistics(std::ostream& os)
+{
+    os << std::left << std::setw(10) << "pass"
+       << std::right << std::setw(12) << "time (ms)"
+       << std::setw(10) << "before"
+       << std::setw(10) << "after"
+       << std::setw(10) << "changed" << std::endl;
+    for(auto& stats : statistics)
+    {
+        os << std::left << std::setw(10) << stats.name
+           << std::right << std::setw(12) << std::fixed << std::setprecision(3) << stats.milliseconds
+           << std::setw(10) << stats.nodesBefore
+           << std::setw(10) << stats.nodesAfter
+           << std::setw(10) << (stats.changed ? "yes" : "no") << std::endl;
+    }
+}
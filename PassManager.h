@@ -0,0 +1,59 @@
+#ifndef PASS_MANAGER_H
+#define PASS_MANAGER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <ostream>
+
+#include "Node.h"
+#include "ExpressionManager.h"
+#include "Pass.h"
+
+//What has been measured while running a single pass
+struct PassStatistics {
+    std::string name;
+    double milliseconds;
+    int nodesBefore;
+    int nodesAfter;
+    bool changed;
+};
+
+//The PassManager runs, in the configured order, the passes selected either with an
+//optimization level (-O0 ... -O3) or with an explicit comma separated list (--passes=fold,dce)
+class PassManager {
+public:
+    static constexpr int MAX_OPT_LEVEL = 3;
+
+    PassManager(ExpressionManager& manager) : em{manager} {}
+    ~PassManager() = default;
+    PassManager(PassManager const&) = delete;
+    PassManager& operator=(PassManager const&) = delete;
+
+    //appends a pass to the pipeline, throws std::invalid_argument if the name is unknown
+    //or if the pass would follow fuse
+    void addPass(const std::string& name);
+
+    //appends every pass of a comma separated list
+    void addPasses(const std::string& names);
+
+    //replaces the pipeline with the one of the given optimization level
+    void setOptimizationLevel(int level);
+
+    void run(Program* program);
+
+    const std::vector<PassStatistics>& getStatistics() {return statistics;}
+    void printStatistics(std::ostream& os);
+
+private:
+    ExpressionManager& em;
+    std::vector<std::unique_ptr<Pass>> pipeline;
+    std::vector<PassStatistics> statistics;
+
+    //pipelines of the optimization levels, as lists of pass names
+    static const char* levelPipelines[MAX_OPT_LEVEL + 1];
+
+    std::unique_ptr<Pass> createPass(const std::string& name);
+};
+
+#endif
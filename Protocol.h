@@ -0,0 +1,96 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+//Messages between the server (see Server.h) and its clients, over a Unix domain socket. Every
+//message is a frame: a byte with its kind, the size of the payload in 4 bytes in network order
+//(big endian), then the payload.
+//A request is made of ARGUMENT frames, one for every option of the command line that applies to the
+//run (-O2, --engine=jit...), and a SOURCE frame with the text of the program. The response is made of
+//OUTPUT and ERROR frames, with what the program prints on the standard output and on the standard
+//error, in the order it is printed, and ends with an EXIT frame holding the exit status in 4 bytes
+namespace protocol {
+
+enum Kind : char {ARGUMENT = 'A', SOURCE = 'S', OUTPUT = 'O', ERROR = 'E', EXIT = 'X'};
+
+//larger frames are refused
+constexpr uint32_t MAX_PAYLOAD = 1u << 28;
+
+//every byte of data, or false if the connection is lost
+inline bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+inline bool receiveAll(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = recv(fd, data, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+inline void encodeSize(uint32_t value, char* bytes) {
+    for (int k = 0; k < 4; k++)
+        bytes[k] = static_cast<char>(value >> (24 - 8 * k));
+}
+
+inline uint32_t decodeSize(const char* bytes) {
+    uint32_t value = 0;
+    for (int k = 0; k < 4; k++)
+        value = value << 8 | static_cast<unsigned char>(bytes[k]);
+    return value;
+}
+
+inline bool writeFrame(int fd, Kind kind, const char* payload, size_t size) {
+    char header[5] = {kind};
+    encodeSize(size, header + 1);
+    return size <= MAX_PAYLOAD && sendAll(fd, header, 5) && sendAll(fd, payload, size);
+}
+
+inline bool writeFrame(int fd, Kind kind, const std::string& payload) {
+    return writeFrame(fd, kind, payload.data(), payload.size());
+}
+
+inline bool writeExit(int fd, int status) {
+    char payload[4];
+    encodeSize(static_cast<uint32_t>(status), payload);
+    return writeFrame(fd, EXIT, payload, 4);
+}
+
+//false if the connection is lost, or the frame is too large
+inline bool readFrame(int fd, Kind& kind, std::string& payload) {
+    char header[5];
+    if (!receiveAll(fd, header, 5))
+        return false;
+    kind = static_cast<Kind>(header[0]);
+    uint32_t size = decodeSize(header + 1);
+    if (size > MAX_PAYLOAD)
+        return false;
+    payload.resize(size);
+    return receiveAll(fd, &payload[0], size);
+}
+
+}
+
+#endif
@@ -0,0 +1,367 @@
+#include "Resolver.h"
+#include "Exceptions.h"
+
+void Resolver::resolve(Program* program)
+{
+    resolveBlock(program->getBlock(), program->getFunctions());
+}
+
+void Resolver::resolveLoop(Stmt* loop, const std::vector<Symbol>& declared)
+{
+    for(auto& symbol : declared)
+    {
+        std::vector<Symbol>& table = symbol.isArray ? arrays : scalars;
+        table.push_back(symbol);
+        table.back().slot = table.size() - 1;
+        symbols[symbol.name] = {symbol.isArray, table.back().slot};
+        visible.insert(symbol.name);
+        predeclared.insert(symbol.name);
+    }
+    inLoop = true;
+    resolveStmt(loop);
+}
+
+const Symbol& Resolver::getSymbol(const std::string& name)
+{
+    auto it = symbols.find(name);
+    if(it == symbols.end())
+        throw CompileError("Unknown identifier " + name);
+    return it->second.first ? arrays[it->second.second] : scalars[it->second.second];
+}
+
+Type::TypeCode Resolver::typeOf(Expression* exp)
+{
+    auto it = types.find(exp);
+    if(it == types.end())
+        throw CompileError("Expression has not been resolved");
+    return it->second;
+}
+
+bool Resolver::hasCall(Expression* exp)
+{
+    switch(exp->getKind())
+    {
+        case Node::CALL:
+            return true;
+        case Node::FUSED:
+            return hasCall(static_cast<Fused*>(exp)->getOriginal());
+        case Node::ACCESS:
+            return hasCall(static_cast<Access*>(exp)->getIndex());
+        case Node::INDEX:
+            for(Expression* subscript : static_cast<Index*>(exp)->getSubscripts())
+                if(hasCall(subscript))
+                    return true;
+            return false;
+        case Node::NOT:
+            return hasCall(static_cast<Not*>(exp)->getExp());
+        case Node::UNARY:
+            return hasCall(static_cast<Unary*>(exp)->getExp());
+        case Node::AND:
+            return hasCall(static_cast<And*>(exp)->getLeftExp()) || hasCall(static_cast<And*>(exp)->getRightExp());
+        case Node::OR:
+            return hasCall(static_cast<Or*>(exp)->getLeftExp()) || hasCall(static_cast<Or*>(exp)->getRightExp());
+        case Node::REL:
+            return hasCall(static_cast<Rel*>(exp)->getLeftExp()) || hasCall(static_cast<Rel*>(exp)->getRightExp());
+        case Node::ARITHM:
+            return hasCall(static_cast<Arithm*>(exp)->getLeftExp()) || hasCall(static_cast<Arithm*>(exp)->getRightExp());
+        default:
+            return false;
+    }
+}
+
+void Resolver::declare(Decl* decl)
+{
+    const std::string& name = decl->getId()->getName();
+    //the loop is declaring again a variable of one of its previous iterations
+    if(predeclared.find(name) != predeclared.end())
+    {
+        visible.insert(name);
+        return;
+    }
+    if(symbols.find(name) != symbols.end())
+        throw CompileError("identifier " + name + " is declared more than once");
+
+    Type* type = decl->getType();
+    Symbol symbol{name, type->getTypeCode(), false, 0, 0};
+    if(type->getKind() == Node::VECTOR_TYPE)
+    {
+        symbol.isArray = true;
+        symbol.size = static_cast<vectorType*>(type)->getSize();
+        symbol.dims = static_cast<vectorType*>(type)->getDimensions();
+        symbol.slot = arrays.size();
+        arrays.push_back(symbol);
+    }
+    else
+    {
+        symbol.slot = scalars.size();
+        scalars.push_back(symbol);
+    }
+    symbols[name] = {symbol.isArray, symbol.slot};
+    visible.insert(name);
+}
+
+const Symbol& Resolver::lookup(Id* id, bool asArray)
+{
+    const std::string& name = id->getName();
+    if(id->getLocal() >= 0)
+    {
+        if(!current)
+            throw CompileError("identifier " + name + " is used outside of its function");
+        if(asArray)
+            throw CompileError("identifier " + name + " is not an array");
+        return locals[id->getLocal()];
+    }
+    if(visible.find(name) == visible.end())
+        throw CompileError("identifier " + name + " is used outside of the block that declares it");
+
+    const Symbol& symbol = getSymbol(name);
+    if(symbol.isArray != asArray)
+        throw CompileError("identifier " + name + (asArray ? " is not an array" : " is an array"));
+    return symbol;
+}
+
+//the functions are resolved once the variables of the block of the program are declared
+void Resolver::resolveBlock(Block* block, const std::vector<Function*>& functions)
+{
+    std::vector<std::string> declaredHere;
+    for(Decls* decls = block->getDecls(); decls; decls = decls->getDecls())
+    {
+        //the locals of a function have their slots already
+        if(decls->getDecl()->getId()->getLocal() >= 0)
+            continue;
+        declare(decls->getDecl());
+        declaredHere.push_back(decls->getDecl()->getId()->getName());
+    }
+    for(Function* function : functions)
+        resolveFunction(function);
+
+    for(Seq* seq = block->getSeq(); seq; seq = seq->getSeq())
+        resolveStmt(seq->getStmt());
+
+    for(auto& name : declaredHere)
+        visible.erase(name);
+}
+
+void Resolver::resolveFunction(Function* function)
+{
+    current = function;
+    locals.clear();
+    for(Decl* decl : function->getLocals())
+        locals.push_back({decl->getId()->getName(), decl->getType()->getTypeCode(), false, 0, decl->getId()->getLocal()});
+    resolveBlock(function->getBody());
+    current = nullptr;
+}
+
+void Resolver::expect(Expression* exp, Type::TypeCode type)
+{
+    if(resolveExp(exp) != type)
+        throw CompileError(std::string("Expecting an expression of type ") + Type::typeid2String[type]);
+}
+
+void Resolver::resolveStmt(Stmt* stmt)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+            resolveBlock(static_cast<Block*>(stmt));
+            break;
+
+        case Node::SET:
+        {
+            auto set = static_cast<Set*>(stmt);
+            const Symbol& var = lookup(set->getId(), false);
+            expect(set->getExp(), var.type);
+            break;
+        }
+
+        case Node::SET_ELEM:
+        {
+            auto setElem = static_cast<SetElem*>(stmt);
+            const Symbol& array = lookup(setElem->getId(), true);
+            expect(setElem->getExp(), array.type);
+            expect(setElem->getIndex(), Type::INT);
+            break;
+        }
+
+        case Node::IF:
+        {
+            auto ifNode = static_cast<If*>(stmt);
+            expect(ifNode->getCondition(), Type::BOOL);
+            resolveStmt(ifNode->getStmt());
+            break;
+        }
+
+        case Node::ELSE:
+        {
+            auto elseNode = static_cast<Else*>(stmt);
+            expect(elseNode->getCondition(), Type::BOOL);
+            resolveStmt(elseNode->getifTrueStmt());
+            resolveStmt(elseNode->getifFalseStmt());
+            break;
+        }
+
+        case Node::WHILE:
+        {
+            auto whileNode = static_cast<While*>(stmt);
+            expect(whileNode->getCondition(), Type::BOOL);
+            resolveStmt(whileNode->getStmt());
+            break;
+        }
+
+        case Node::DO:
+        {
+            auto doNode = static_cast<Do*>(stmt);
+            resolveStmt(doNode->getStmt());
+            expect(doNode->getCondition(), Type::BOOL);
+            break;
+        }
+
+        case Node::PARALLEL_FOR:
+        {
+            auto loop = static_cast<ParallelFor*>(stmt);
+            if(lookup(loop->getId(), false).type != Type::INT)
+                throw CompileError("the index of a parallel for must be an int");
+            expect(loop->getFirst(), Type::INT);
+            expect(loop->getLast(), Type::INT);
+            for(auto& reduction : loop->getReductions())
+            {
+                bool isLogical = reduction.op == REDUCE_AND || reduction.op == REDUCE_OR;
+                if(lookup(reduction.var, false).type != (isLogical ? Type::BOOL : Type::INT))
+                    throw CompileError("reduction " + reduction.var->getName() + " has the wrong type");
+            }
+            resolveStmt(loop->getStmt());
+            break;
+        }
+
+        case Node::PRINT:
+            resolveExp(static_cast<Print*>(stmt)->getExp());
+            break;
+
+        case Node::BREAK:
+            break;
+
+        //the arrays of the files are read and written only by the EvaluationVisitor
+        case Node::LOAD:
+            throw CompileError("load of " + static_cast<Load*>(stmt)->getId()->getName() + " is not supported");
+        case Node::STORE:
+            throw CompileError("store of " + static_cast<Store*>(stmt)->getId()->getName() + " is not supported");
+
+        case Node::RETURN:
+            if(!current)
+                throw CompileError("return outside of a function");
+            expect(static_cast<Return*>(stmt)->getExp(), current->getReturnType());
+            break;
+
+        default:
+            throw CompileError("Invalid statement");
+    }
+}
+
+Type::TypeCode Resolver::resolveExp(Expression* exp)
+{
+    Type::TypeCode type;
+    switch(exp->getKind())
+    {
+        //a fused node has the type of the node it replaces
+        case Node::FUSED:
+            type = resolveExp(static_cast<Fused*>(exp)->getOriginal());
+            break;
+
+        case Node::INT_CONSTANT:
+            type = Type::INT;
+            break;
+
+        case Node::BOOL_CONSTANT:
+            type = Type::BOOL;
+            break;
+
+        case Node::ID:
+            type = lookup(static_cast<Id*>(exp), false).type;
+            break;
+
+        case Node::ACCESS:
+        {
+            auto access = static_cast<Access*>(exp);
+            type = lookup(access->getId(), true).type;
+            expect(access->getIndex(), Type::INT);
+            break;
+        }
+
+        case Node::INDEX:
+        {
+            auto index = static_cast<Index*>(exp);
+            const Symbol& array = lookup(index->getId(), true);
+            if(index->getSubscripts().size() != array.dims.size())
+                throw CompileError("Wrong number of subscripts for " + array.name + " array");
+            for(Expression* subscript : index->getSubscripts())
+                expect(subscript, Type::INT);
+            type = Type::INT;
+            break;
+        }
+
+        case Node::NOT:
+            expect(static_cast<Not*>(exp)->getExp(), Type::BOOL);
+            type = Type::BOOL;
+            break;
+
+        case Node::AND:
+            expect(static_cast<And*>(exp)->getLeftExp(), Type::BOOL);
+            expect(static_cast<And*>(exp)->getRightExp(), Type::BOOL);
+            type = Type::BOOL;
+            break;
+
+        case Node::OR:
+            expect(static_cast<Or*>(exp)->getLeftExp(), Type::BOOL);
+            expect(static_cast<Or*>(exp)->getRightExp(), Type::BOOL);
+            type = Type::BOOL;
+            break;
+
+        case Node::REL:
+            expect(static_cast<Rel*>(exp)->getLeftExp(), Type::INT);
+            expect(static_cast<Rel*>(exp)->getRightExp(), Type::INT);
+            type = Type::BOOL;
+            break;
+
+        case Node::UNARY:
+            expect(static_cast<Unary*>(exp)->getExp(), Type::INT);
+            type = Type::INT;
+            break;
+
+        case Node::ARITHM:
+        {
+            auto arithm = static_cast<Arithm*>(exp);
+            if(arithm->getOp() == Op::EQ || arithm->getOp() == Op::NOT_EQ)
+            {
+                //both operands must have the type of the right one
+                Type::TypeCode left = resolveExp(arithm->getLeftExp());
+                if(resolveExp(arithm->getRightExp()) != left)
+                    throw CompileError("Comparing expressions of different types");
+                type = Type::BOOL;
+            }
+            else
+            {
+                expect(arithm->getLeftExp(), Type::INT);
+                expect(arithm->getRightExp(), Type::INT);
+                type = Type::INT;
+            }
+            break;
+        }
+
+        case Node::CALL:
+        {
+            auto call = static_cast<Call*>(exp);
+            if(inLoop)
+                throw CompileError("A loop run apart from its program can't call " + call->getName());
+            Function* function = call->getFunction();
+            for(size_t k = 0; k < call->getArgs().size(); k++)
+                expect(call->getArgs()[k], function->getLocals()[k]->getType()->getTypeCode());
+            type = function->getReturnType();
+            break;
+        }
+
+        default:
+            throw CompileError("Invalid expression");
+    }
+    types[exp] = type;
+    return type;
+}
@@ -0,0 +1,84 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+#include "Node.h"
+
+//A variable or an array of the program, as seen by the compiled engines
+struct Symbol {
+    std::string name;
+    Type::TypeCode type;
+    bool isArray;
+    int size;   //number of cells, arrays only
+    int slot;   //index among the scalars or among the arrays
+    std::vector<int> dims;  //sizes of the dimensions, arrays only
+};
+
+//The Resolver is the static analysis shared by the compiled engines. It assigns a slot to every
+//identifier and computes the type of every expression. The EvaluationVisitor reports type errors
+//and uses of undeclared identifiers only when (and if) they are executed, so instead of reproducing
+//that behaviour the Resolver throws CompileError on them, and the program is left to the tree walker.
+//Identifiers are unique in a program (the Parser rejects double declarations), so a use is valid
+//only inside the block that declares its identifier, where it is always already declared.
+//The functions see the variables declared by the block of the program, and their own locals, whose
+//slot is the one in their frame (see Id::getLocal)
+class Resolver {
+public:
+    Resolver() = default;
+    ~Resolver() = default;
+    Resolver(Resolver const&) = delete;
+    Resolver& operator=(Resolver const&) = delete;
+
+    void resolve(Program* program);
+
+    //resolves a loop that is going to run in the middle of a program: declared are the variables
+    //and arrays that already exist when it starts, which are visible to it and get the first slots
+    void resolveLoop(Stmt* loop, const std::vector<Symbol>& declared);
+
+    const Symbol& getSymbol(const std::string& name);
+    const std::vector<Symbol>& getScalars() {return scalars;}
+    const std::vector<Symbol>& getArrays() {return arrays;}
+
+    //type of an expression of the resolved program
+    Type::TypeCode typeOf(Expression* exp);
+
+    //whether evaluating exp calls a function, which may change the variables read before it
+    static bool hasCall(Expression* exp);
+
+private:
+    std::vector<Symbol> scalars;
+    std::vector<Symbol> arrays;
+
+    //name -> (isArray, slot)
+    std::map<std::string, std::pair<bool, int>> symbols;
+
+    //identifiers declared by the blocks enclosing the node being resolved
+    std::set<std::string> visible;
+
+    //identifiers declared before the loop given to resolveLoop
+    std::set<std::string> predeclared;
+    //a loop given to resolveLoop runs without the functions of its program
+    bool inLoop = false;
+
+    //the function being resolved, nullptr out of the functions, and its locals
+    Function* current = nullptr;
+    std::vector<Symbol> locals;
+
+    std::unordered_map<Expression*, Type::TypeCode> types;
+
+    void declare(Decl* decl);
+    const Symbol& lookup(Id* id, bool asArray);
+
+    void resolveBlock(Block* block, const std::vector<Function*>& functions = {});
+    void resolveFunction(Function* function);
+    void resolveStmt(Stmt* stmt);
+    Type::TypeCode resolveExp(Expression* exp);
+    void expect(Expression* exp, Type::TypeCode type);
+};
+
+#endif
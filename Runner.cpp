@@ -0,0 +1,413 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <system_error>
+#include <thread>
+
+#if defined(__GLIBC__)
+#include <pthread.h>
+#endif
+
+#include "Runner.h"
+#include "Exceptions.h"
+#include "Tokenizer.h"
+#include "Parser.h"
+#include "Visitor.h"
+#include "PassManager.h"
+#include "BytecodeCompiler.h"
+#include "VM.h"
+#include "ClosureCompiler.h"
+#include "JIT.h"
+#include "Tiering.h"
+#include "StreamCompiler.h"
+#include "OutputSink.h"
+#include "ThreadPool.h"
+
+
+// Runs the program on the bytecode VM. Returns false if the program can't be compiled,
+// in which case it is left to the EvaluationVisitor
+static bool runBytecode(Program* program, bool disasm) {
+    BytecodeProgram bytecode;
+    try {
+        BytecodeCompiler compiler;
+        bytecode = compiler.compile(program);
+    }
+    catch (CompileError const& ce) {
+        if (disasm)
+            std::cerr << "Bytecode not available: " << ce.what() << std::endl;
+        return false;
+    }
+    if (disasm)
+        bytecode.disassemble(std::cout);
+    VM vm(bytecode);
+    vm.run();
+    return true;
+}
+
+
+// Runs the program as a tree of closures. Returns false if the program can't be compiled
+static bool runClosures(Program* program) {
+    std::unique_ptr<ClosureProgram> compiled;
+    try {
+        ClosureCompiler compiler;
+        compiled = compiler.compile(program);
+    }
+    catch (CompileError const&) {
+        return false;
+    }
+    compiled->run();
+    return true;
+}
+
+
+// Runs the program as native code generated from its bytecode. Returns false if the program
+// (or the platform) is not supported by the JIT
+static bool runJit(Program* program, bool disasm) {
+    BytecodeProgram bytecode;
+    std::unique_ptr<JIT> jit;
+    try {
+        BytecodeCompiler compiler;
+        bytecode = compiler.compile(program);
+        jit.reset(new JIT(bytecode));
+    }
+    catch (CompileError const& ce) {
+        if (disasm)
+            std::cerr << "JIT not available: " << ce.what() << std::endl;
+        return false;
+    }
+    if (disasm) {
+        bytecode.disassemble(std::cout);
+        std::cout << "; " << jit->getCodeSize() << " bytes of native code" << std::endl;
+    }
+    jit->run();
+    return true;
+}
+
+
+bool tokenizeProgram(std::istream& source, const std::string& fileName, std::vector<Token>& tokens, std::ostream& err) {
+    try {
+        Tokenizer tokenize;
+        tokens = tokenize(source);
+        return true;
+    }
+    catch (LexicalError const& le) {
+        err << "Lexical error" << std::endl;
+        err << le.what() << std::endl;
+    }
+    catch (std::exception const& exc) {
+        err << "Cannot read from " << fileName << std::endl;
+        err << exc.what() << std::endl;
+    }
+    return false;
+}
+
+
+int runOnePass(std::vector<Token>& tokens, const RunOptions& options, std::ostream& err) {
+    BytecodeProgram bytecode;
+    try {
+        StreamCompiler compiler(tokens);
+        bytecode = compiler();
+    }
+    catch (ParseError const& pe) {
+        err << "Parse error" << std::endl;
+        err << pe.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (CompileError const& ce) {
+        if (options.disasm)
+            err << "Bytecode not available: " << ce.what() << std::endl;
+        return -1;
+    }
+    catch (std::exception const& exc) {
+        err << "Unknown error" << std::endl;
+        err << exc.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (options.disasm)
+        bytecode.disassemble(std::cout);
+    try {
+        VM vm(bytecode);
+        vm.run();
+    }
+    catch (EvaluationError const& ee) {
+        OutputSink::current().flush();
+        err << "Errore nella valutazione" << std::endl;
+        err << ee.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+Program* parseProgram(ExpressionManager& manager, std::vector<Token>& tokens, const RunOptions& options, std::ostream& err) {
+    // Analisi sinttattica
+    Program* program = nullptr;
+    try {
+        Parser parser(manager, tokens);
+        program = parser();
+    }
+    catch (ParseError const& pe) {
+        err << "Parse error" << std::endl;
+        err << pe.what() << std::endl;
+        return nullptr;
+    }
+    catch (std::exception const& exc) {
+        err << "Unknown error" << std::endl;
+        err << exc.what() << std::endl;
+        return nullptr;
+    }
+
+    // Ottimizzazione
+    try {
+        PassManager passManager(manager);
+        if (options.passList.empty())
+            passManager.setOptimizationLevel(options.optLevel);
+        else
+            passManager.addPasses(options.passList);
+        passManager.run(program);
+        if (options.printPassStats)
+            passManager.printStatistics(err);
+    }
+    catch (std::exception const& exc) {
+        err << "Optimization error" << std::endl;
+        err << exc.what() << std::endl;
+        return nullptr;
+    }
+    return program;
+}
+
+
+int runProgram(Program* program, const RunOptions& options, std::ostream& err) {
+    try {
+        bool done = false;
+        if (options.engine == "bytecode")
+            done = runBytecode(program, options.disasm);
+        else if (options.engine == "closure")
+            done = runClosures(program);
+        else if (options.engine == "jit")
+            done = runJit(program, options.disasm);
+        if (!done) {
+            Environment env;
+            for (auto& binding : options.persistentArrays)
+                env.bindArrayToFile(binding.first, binding.second);
+            EvaluationVisitor v(env);
+            // Hot loops are moved to the VM, the rest runs in the EvaluationVisitor
+            TierController tiers(env, options.tierThreshold, options.tierLog ? &err : nullptr);
+            if (options.engine == "tiered")
+                v.setLoopObserver(&tiers);
+            program->accept(&v);
+        }
+    }
+    catch (EvaluationError const& ee) {
+        OutputSink::current().flush();
+        err << "Errore nella valutazione" << std::endl;
+        err << ee.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (std::exception const& exc) {
+        OutputSink::current().flush();
+        err << "Errore generico " << std::endl;
+        err << exc.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int runFile(const std::string& path, const RunOptions& options, std::ostream& err) {
+    std::ifstream source(path);
+    if (!source) {
+        err << "Cannot open " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<Token> tokens;
+    if (!tokenizeProgram(source, path, tokens, err))
+        return EXIT_FAILURE;
+    source.close();
+
+    // Persistent arrays live in the Environment, so programs using them run in the EvaluationVisitor
+    // (or in the tiered engine, which shares its Environment)
+    RunOptions run = options;
+    if (!run.persistentArrays.empty() && run.engine != "tiered")
+        run.engine = "tree";
+
+    if (run.engine == "onepass") {
+        int status = runOnePass(tokens, run, err);
+        if (status >= 0)
+            return status;
+    }
+    ExpressionManager manager;
+    Program* program = parseProgram(manager, tokens, run, err);
+    if (!program)
+        return EXIT_FAILURE;
+    return runProgram(program, run, err);
+}
+
+
+int runWithCallStack(const std::function<int()>& main) {
+#if defined(__GLIBC__)
+    // 32 KB for every call: a call of the EvaluationVisitor takes a couple of KB when its body
+    // is nested a few levels
+    const size_t stackSize = static_cast<size_t>(Function::MAX_CALL_DEPTH) << 15;
+    pthread_attr_t attributes;
+    if (pthread_attr_init(&attributes) == 0) {
+        bool sized = pthread_attr_setstacksize(&attributes, stackSize) == 0
+                     && pthread_setattr_default_np(&attributes) == 0;
+        pthread_attr_destroy(&attributes);
+        if (sized) {
+            try {
+                int status = EXIT_FAILURE;
+                std::thread thread([&] { status = main(); });
+                thread.join();
+                return status;
+            }
+            catch (std::system_error const&) {
+            }
+        }
+    }
+#endif
+    return main();
+}
+
+
+// The programs of a batch, in the order they are reported
+static bool listPrograms(const std::string& source, std::vector<std::string>& paths) {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    if (fs::is_directory(source, error)) {
+        for (auto& entry : fs::directory_iterator(source, error))
+            if (entry.is_regular_file(error))
+                paths.push_back(entry.path().string());
+        std::sort(paths.begin(), paths.end());
+        return !error;
+    }
+    std::ifstream list(source);
+    if (!list)
+        return false;
+    std::string line;
+    while (std::getline(list, line)) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        size_t last = line.find_last_not_of(" \t\r");
+        paths.push_back(line.substr(first, last - first + 1));
+    }
+    return true;
+}
+
+
+// Latency below which a fraction of the programs ran (nearest rank), sorted is in ascending order
+static double percentile(const std::vector<double>& sorted, double fraction) {
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+
+int runBatch(const std::string& source, const std::string& outputDir, const RunOptions& options) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> paths;
+    if (!listPrograms(source, paths)) {
+        std::cerr << "Cannot read the programs of " << source << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (paths.empty()) {
+        std::cerr << "No programs in " << source << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Every program writes its own files, so their names can't repeat
+    std::vector<std::string> outputFiles;
+    if (!outputDir.empty()) {
+        std::error_code error;
+        fs::create_directories(outputDir, error);
+        if (!fs::is_directory(outputDir)) {
+            std::cerr << "Cannot create " << outputDir << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::set<std::string> names;
+        for (auto& path : paths) {
+            std::string name = fs::path(path).filename().string();
+            if (!names.insert(name).second) {
+                std::cerr << "More than one program called " << name << " in " << source << std::endl;
+                return EXIT_FAILURE;
+            }
+            outputFiles.push_back((fs::path(outputDir) / name).string());
+        }
+    }
+
+    using Clock = std::chrono::steady_clock;
+    int numPrograms = paths.size();
+    std::vector<std::string> outputs(numPrograms);
+    std::vector<std::string> errors(numPrograms);
+    std::vector<int> statuses(numPrograms);
+    std::vector<double> latencies(numPrograms);
+    Clock::time_point start = Clock::now();
+
+    ThreadPool::shared().run(numPrograms, [&](int k) {
+        Clock::time_point programStart = Clock::now();
+        std::ostringstream text;
+        std::ostringstream errorText;
+        OutputSink* previous = &OutputSink::current();
+        {
+            OutputSink sink(text, OutputSink::BUFFERED);
+            OutputSink::setCurrent(&sink);
+            statuses[k] = runFile(paths[k], options, errorText);
+            OutputSink::setCurrent(previous);
+        }
+        if (outputFiles.empty()) {
+            outputs[k] = text.str();
+            errors[k] = errorText.str();
+        }
+        else {
+            std::ofstream(outputFiles[k], std::ios::binary | std::ios::trunc) << text.str();
+            std::string errorFile = outputFiles[k] + ".err";
+            if (errorText.str().empty())
+                std::remove(errorFile.c_str());
+            else
+                std::ofstream(errorFile, std::ios::binary | std::ios::trunc) << errorText.str();
+        }
+        latencies[k] = std::chrono::duration<double, std::milli>(Clock::now() - programStart).count();
+    });
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    OutputSink& output = OutputSink::current();
+    if (outputFiles.empty()) {
+        for (int k = 0; k < numPrograms; k++) {
+            output.printText("[program " + paths[k] + "]\n" + outputs[k]);
+            // The first line of the error tells which program it comes from, like the instances do
+            if (!errors[k].empty()) {
+                output.flush();
+                size_t firstLine = std::min(errors[k].find('\n'), errors[k].size());
+                std::cerr << errors[k].substr(0, firstLine) << " (program " << paths[k] << ")"
+                          << errors[k].substr(firstLine);
+            }
+        }
+    }
+    output.flush();
+
+    int failed = 0;
+    for (int k = 0; k < numPrograms; k++) {
+        if (statuses[k] != EXIT_SUCCESS) {
+            std::cerr << "Failed: " << paths[k] << " (exit status " << statuses[k] << ")" << std::endl;
+            failed++;
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cerr << std::fixed << std::setprecision(3)
+              << "Batch: " << numPrograms << " programs, " << failed << " failed, " << seconds << " s, "
+              << std::setprecision(1) << numPrograms / std::max(seconds, 1e-9) << " programs/s on " << ThreadPool::shared().getThreads()
+              << " threads" << std::endl
+              << std::setprecision(3) << "Latency (ms): p50 " << percentile(latencies, 0.5) << ", p90 " << percentile(latencies, 0.9)
+              << ", p99 " << percentile(latencies, 0.99) << ", max " << latencies.back() << std::endl;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
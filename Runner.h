@@ -0,0 +1,66 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Node.h"
+#include "Token.h"
+#include "ExpressionManager.h"
+
+//How the command line asks to compile and run a program
+struct RunOptions {
+    int optLevel = 0;
+    std::string passList;           //replaces optLevel when not empty
+    bool printPassStats = false;
+    std::string engine = "tree";
+    bool disasm = false;
+    int tierThreshold = 1000;
+    bool tierLog = false;
+    //array -> file, see Environment::bindArrayToFile
+    std::vector<std::pair<std::string, std::string>> persistentArrays;
+};
+
+//The steps from the source of a program to the end of its run, shared by the command line and the
+//batch mode. A step that fails writes its error on err, with the messages of the command line, and
+//returns false, nullptr or EXIT_FAILURE. The program prints on the current OutputSink, which is
+//flushed before an error is written
+
+bool tokenizeProgram(std::istream& source, const std::string& fileName, std::vector<Token>& tokens, std::ostream& err);
+
+//compiles the tokens straight to bytecode and runs them (see StreamCompiler). Returns the exit
+//status, or -1 if the program can't be compiled and has to be parsed as usual
+int runOnePass(std::vector<Token>& tokens, const RunOptions& options, std::ostream& err);
+
+//parses and optimizes the tokens, the nodes are owned by manager
+Program* parseProgram(ExpressionManager& manager, std::vector<Token>& tokens, const RunOptions& options, std::ostream& err);
+
+//runs the program with the engine of options. The programs an engine can't compile run on the
+//EvaluationVisitor. Returns the exit status
+int runProgram(Program* program, const RunOptions& options, std::ostream& err);
+
+//all the steps for the program in the file at path, without printing its tokens and its tree
+int runFile(const std::string& path, const RunOptions& options, std::ostream& err);
+
+//runs main on a thread with room on its native stack for Function::MAX_CALL_DEPTH calls of the
+//EvaluationVisitor, each one nested as deep as a function body may reasonably be. The threads
+//started from there, like the ones of the ThreadPool and of the server, get as much. Where the
+//size of the stack can't be set, main runs on the caller. Returns the result of main
+int runWithCallStack(const std::function<int()>& main);
+
+//Batch mode: runs every program listed by source, a directory (all its files, by name) or a file
+//with a path on every line (blank lines and lines starting with # are skipped). The programs run
+//at the same time on the threads of the shared ThreadPool, which steal them from each other, and
+//their parallel loops run serially. Every program has its own output: with outputDir, a file called
+//like the program in outputDir, and one with .err added for its errors if it has any. Otherwise the
+//outputs are printed in the order of the programs, each one under a line with its path, and the
+//errors on std::cerr, with the path after their first line. Then a summary with the exit status of the programs that failed, the
+//throughput and the percentiles of the latency is written on std::cerr.
+//Returns EXIT_FAILURE if a program fails
+int runBatch(const std::string& source, const std::string& outputDir, const RunOptions& options);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <cstdint>
+#include <vector>
+
+//wrap-around arithmetic, which is what the EvaluationVisitor gets from the hardware
+inline int32_t wrapAdd(int32_t l, int32_t r) {return static_cast<int32_t>(static_cast<uint32_t>(l) + static_cast<uint32_t>(r));}
+inline int32_t wrapSub(int32_t l, int32_t r) {return static_cast<int32_t>(static_cast<uint32_t>(l) - static_cast<uint32_t>(r));}
+inline int32_t wrapMul(int32_t l, int32_t r) {return static_cast<int32_t>(static_cast<uint32_t>(l) * static_cast<uint32_t>(r));}
+
+//An array of a program run by one of the compiled engines. Cells hold ints, and bools as 0/1
+struct RuntimeArray {
+    std::vector<int32_t> cells;
+    //a cell can be read only after its first assignment
+    std::vector<uint8_t> initialized;
+    bool declared = false;
+
+    //like in the Environment, declaring an array again (inside a loop) keeps its contents
+    void declare(int size) {
+        if(declared)
+            return;
+        cells.assign(size, 0);
+        initialized.assign(size, 0);
+        declared = true;
+    }
+};
+
+#endif
@@ -0,0 +1,248 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#include "Server.h"
+#include "Token.h"
+#include "PassManager.h"
+#include "OutputSink.h"
+#include "ThreadPool.h"
+#include "Runner.h"
+
+#ifdef SERVER_AVAILABLE
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Protocol.h"
+#endif
+
+
+std::shared_ptr<CachedProgram> ProgramCache::find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(key);
+    if (found == index.end())
+        return nullptr;
+    entries.splice(entries.begin(), entries, found->second);
+    return found->second->second;
+}
+
+
+void ProgramCache::insert(const std::string& key, std::shared_ptr<CachedProgram> program) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Two requests may have parsed the same program at the same time
+    if (index.count(key) || capacity == 0)
+        return;
+    entries.emplace_front(key, std::move(program));
+    index[key] = entries.begin();
+    if (entries.size() > capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+
+#ifdef SERVER_AVAILABLE
+
+namespace {
+
+// Sends what is written on it as frames of one kind, when it is flushed or its buffer is full.
+// Once the client is gone the rest is dropped, and the program runs to its end
+class FrameBuffer : public std::streambuf {
+public:
+    static constexpr size_t SIZE = 1 << 16;
+
+    FrameBuffer(int f, protocol::Kind k) : fd{f}, kind{k}, lost{false}, buffer(SIZE) {
+        setp(buffer.data(), buffer.data() + SIZE);
+    }
+    ~FrameBuffer() override {sync();}
+
+protected:
+    int overflow(int c) override {
+        send();
+        if (c != traits_type::eof()) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        send();
+        return 0;
+    }
+
+private:
+    int fd;
+    protocol::Kind kind;
+    bool lost;
+    std::vector<char> buffer;
+
+    void send() {
+        size_t size = pptr() - pbase();
+        if (size > 0 && !lost)
+            lost = !protocol::writeFrame(fd, kind, pbase(), size);
+        setp(buffer.data(), buffer.data() + SIZE);
+    }
+};
+
+
+// The options of a request, see runServer. Returns false, with a message in error, on anything else
+bool parseArguments(const std::vector<std::string>& arguments, RunOptions& options, std::string& error) {
+    for (auto& arg : arguments) {
+        if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '0' + PassManager::MAX_OPT_LEVEL)
+            options.optLevel = arg[2] - '0';
+        else if (arg.rfind("--passes=", 0) == 0)
+            options.passList = arg.substr(std::string("--passes=").size());
+        else if (arg.rfind("--engine=", 0) == 0) {
+            std::string& engine = options.engine = arg.substr(std::string("--engine=").size());
+            if (engine == "onepass")
+                engine = "bytecode";
+            if (engine != "tree" && engine != "bytecode" && engine != "closure" && engine != "jit" && engine != "tiered") {
+                error = "Unknown engine " + engine;
+                return false;
+            }
+        }
+        else if (arg.rfind("--tier-threshold=", 0) == 0) {
+            try {
+                options.tierThreshold = std::stoi(arg.substr(std::string("--tier-threshold=").size()));
+            }
+            catch (std::exception const&) {
+                options.tierThreshold = -1;
+            }
+            if (options.tierThreshold < 0) {
+                error = "Invalid tier threshold " + arg;
+                return false;
+            }
+        }
+        else {
+            error = "Option not available on the server " + arg;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Reads the request of a connection, runs it and sends back the response. Returns the exit status
+int serve(int fd, ProgramCache& cache) {
+    std::vector<std::string> arguments;
+    std::string source;
+    protocol::Kind kind;
+    std::string payload;
+    while (true) {
+        if (!protocol::readFrame(fd, kind, payload))
+            return EXIT_FAILURE;
+        if (kind == protocol::SOURCE)
+            break;
+        if (kind != protocol::ARGUMENT)
+            return EXIT_FAILURE;
+        arguments.push_back(payload);
+    }
+    source.swap(payload);
+
+    FrameBuffer errorFrames(fd, protocol::ERROR);
+    std::ostream err(&errorFrames);
+    RunOptions options;
+    std::string error;
+    if (!parseArguments(arguments, options, error)) {
+        err << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // The same source parsed with other passes is another program
+    std::string key = (options.passList.empty() ? "-O" + std::to_string(options.optLevel) : "--passes=" + options.passList)
+                      + '\n' + source;
+    std::shared_ptr<CachedProgram> cached = cache.find(key);
+    if (!cached) {
+        std::istringstream input(source);
+        std::vector<Token> tokens;
+        if (!tokenizeProgram(input, "the request", tokens, err))
+            return EXIT_FAILURE;
+        cached = std::make_shared<CachedProgram>();
+        cached->program = parseProgram(cached->manager, tokens, options, err);
+        if (!cached->program)
+            return EXIT_FAILURE;
+        cache.insert(key, cached);
+    }
+
+    FrameBuffer outputFrames(fd, protocol::OUTPUT);
+    std::ostream out(&outputFrames);
+    OutputSink sink(out, OutputSink::BUFFERED);
+    OutputSink::setCurrent(&sink);
+    int status = runProgram(cached->program, options, err);
+    sink.flush();
+    OutputSink::setCurrent(nullptr);
+    return status;
+}
+
+
+void serveConnections(int listener, ProgramCache& cache) {
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        int status = serve(fd, cache);
+        protocol::writeExit(fd, status);
+        close(fd);
+    }
+}
+
+}
+
+
+int runServer(const std::string& socketPath, size_t cacheSize) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof address.sun_path) {
+        std::cerr << "Socket path too long " << socketPath << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+
+    // The socket of a server that is no longer running is replaced, any other file is left alone
+    struct stat info;
+    if (stat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+        unlink(socketPath.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof address) < 0
+        || listen(listener, SOMAXCONN) < 0) {
+        std::cerr << "Cannot listen on " << socketPath << std::endl;
+        std::cerr << std::strerror(errno) << std::endl;
+        if (listener >= 0)
+            close(listener);
+        return EXIT_FAILURE;
+    }
+
+    // Every thread waits for its own connections, the caller too
+    ProgramCache cache(cacheSize);
+    int threads = ThreadPool::shared().getThreads();
+    std::cerr << "Listening on " << socketPath << " with " << threads << " threads" << std::endl;
+    std::vector<std::thread> workers;
+    for (int k = 1; k < threads; k++)
+        workers.emplace_back(serveConnections, listener, std::ref(cache));
+    serveConnections(listener, cache);
+    return EXIT_SUCCESS;
+}
+
+#else
+
+int runServer(const std::string& socketPath, size_t) {
+    std::cerr << "The server is not available on this platform" << std::endl;
+    return EXIT_FAILURE;
+}
+
+#endif
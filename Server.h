@@ -0,0 +1,55 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "Node.h"
+#include "ExpressionManager.h"
+
+//the server needs POSIX Unix domain sockets
+#if defined(__unix__)
+#define SERVER_AVAILABLE
+#endif
+
+//A program parsed and optimized once and run by many requests: runs don't change the tree
+struct CachedProgram {
+    ExpressionManager manager;
+    Program* program = nullptr;
+};
+
+//The programs parsed by the server, looked up by their source and by the passes run on them.
+//When more than capacity are cached, the least recently used one is dropped: the requests that are
+//still running it keep it alive. Safe to use from many threads
+class ProgramCache {
+public:
+    explicit ProgramCache(size_t c) : capacity{c} {}
+
+    //nullptr if the program is not cached
+    std::shared_ptr<CachedProgram> find(const std::string& key);
+    void insert(const std::string& key, std::shared_ptr<CachedProgram> program);
+
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<CachedProgram>>;
+
+    const size_t capacity;
+    std::mutex mutex;
+    //most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
+
+//Server mode: listens on the Unix domain socket at socketPath and runs the programs sent by the
+//clients, with the messages of Protocol.h. Every connection sends one request and gets back what the
+//program prints, while it is printed, and its exit status. The options of a request are -O<n>,
+//--passes=, --engine= and --tier-threshold=: onepass runs on the bytecode VM, since the cached
+//programs are already parsed. The connections are served at the same time by a thread for every
+//thread of the shared ThreadPool, and their parallel loops run on the pool when nothing else is
+//using it. Runs until it is killed; returns EXIT_FAILURE if the socket can't be opened
+int runServer(const std::string& socketPath, size_t cacheSize);
+
+#endif
@@ -0,0 +1,612 @@
+#include <limits>
+
+#include "StreamCompiler.h"
+#include "Runtime.h"
+
+namespace {
+
+//the compare-and-branch instruction replacing a comparison, same order of the comparisons in OpCode
+const OpCode branchOps[] = {OP_BEQ, OP_BNE, OP_BLT, OP_BLE, OP_BGT, OP_BGE};
+const OpCode negatedBranchOps[] = {OP_BNE, OP_BEQ, OP_BGE, OP_BGT, OP_BLE, OP_BLT};
+
+}
+
+BytecodeProgram StreamCompiler::operator()()
+{
+    //the functions are linked to their calls at the end of the program, by the Parser
+    if(tag() == Token::INT || tag() == Token::BOOL)
+        throw CompileError("functions are not compiled");
+    //a break outside of any loop skips the rest of the program
+    breakJumps.push_back({});
+    compileBlock();
+    if(tokenItr != streamEnd)
+        throw ParseError("Unexpected end of input");
+    patchHere(breakJumps.back());
+    breakJumps.pop_back();
+    out.emit(OP_HALT, {});
+    return std::move(out);
+}
+
+std::string StreamCompiler::parseId()
+{
+    if(tag() != Token::ID)
+        throw ParseError{"Expected identifier, not found"};
+    std::string name = tokenItr->word;
+    safe_next();
+    return name;
+}
+
+void StreamCompiler::compileBlock()
+{
+    consumeToken(Token::LEFT_CURLY);
+    std::vector<std::string> declaredHere;
+    while(tag() == Token::BOOL || tag() == Token::INT)
+        declaredHere.push_back(compileDecl());
+    while(tag() != Token::RIGHT_CURLY)
+        compileStmt();
+    consumeToken(Token::RIGHT_CURLY);
+
+    for(auto& name : declaredHere)
+        symbols[name].visible = false;
+}
+
+std::string StreamCompiler::compileDecl()
+{
+    Type::TypeCode type = tag() == Token::INT ? Type::INT : Type::BOOL;
+    safe_next();
+
+    bool isArray = false;
+    int size = 0;
+    std::vector<int> dims;
+    while(tag() == Token::LEFT_SQUARE)
+    {
+        safe_next();
+        if(tag() != Token::NUM)
+            throw ParseError{"Expected numeric constant, not found"};
+        isArray = true;
+        dims.push_back(std::stoi(tokenItr->word));
+        if(static_cast<long long>(dims.size() == 1 ? 1 : size) * dims.back() > std::numeric_limits<int>::max())
+            throw ParseError{"Array has too many cells"};
+        size = dims.size() == 1 ? dims.back() : size * dims.back();
+        safe_next();
+        consumeToken(Token::RIGHT_SQUARE);
+    }
+
+    std::string name = parseId();
+    //double declaration checking, like in the Parser
+    if(!declaredVars.insert(name).second)
+        throw ParseError("identifier " + name + "has already been declared");
+    consumeToken(Token::END_STMT);
+
+    //scalars live in registers which are already zero, arrays are allocated when declared
+    Variable var{type, isArray, 0, true, dims};
+    if(isArray)
+    {
+        var.slot = out.addArray(name, type, size);
+        out.emit(OP_DECLA, {var.slot});
+    }
+    else
+        var.slot = out.addRegister(name);
+    symbols[name] = var;
+    return name;
+}
+
+void StreamCompiler::compileStmt()
+{
+    //no temporary survives a statement
+    nextTemp = 0;
+
+    switch(tag())
+    {
+        case Token::ID:
+        {
+            std::string name = parseId();
+            if(tag() == Token::LEFT_SQUARE)  //assignment to array cell
+            {
+                int indexStart = out.here();
+                Operand index = compileIndex(name);
+                consumeToken(Token::ASSIGN);
+                int valueStart = out.here();
+                Operand value = compileExpression();
+                consumeToken(Token::END_STMT);
+
+                Variable& array = lookup(name, true);
+                expect(value, array.type);
+                expect(index, Type::INT);
+                //the value is evaluated before the index, like in the EvaluationVisitor: its code is
+                //moved first when both of them can fail, so that the first error is the same
+                if(index.canFail && value.canFail)
+                    out.rotate(indexStart, valueStart);
+                int i = materialize(index);
+                out.emit(OP_ASTORE, {array.slot, i, materialize(value)});
+            }
+            else    //assignment to primitive type
+            {
+                consumeToken(Token::ASSIGN);
+                Operand value = compileExpression();
+                consumeToken(Token::END_STMT);
+
+                Variable& var = lookup(name, false);
+                expect(value, var.type);
+                moveTo(value, var.slot);
+            }
+            break;
+        }
+
+        case Token::IF:
+        {
+            safe_next();
+            consumeToken(Token::LP);
+            Operand cond = compileExpression();
+            consumeToken(Token::RP);
+            expect(cond, Type::BOOL);
+            int skip = branch(cond, false);
+            compileStmt();
+            if(tag() == Token::ELSE)
+            {
+                safe_next();
+                int toEnd = out.emit(OP_JMP, {0}) + 1;
+                patchHere({skip});
+                compileStmt();
+                out.patch(toEnd, out.here());
+            }
+            else
+                patchHere({skip});
+            break;
+        }
+
+        case Token::WHILE:
+        {
+            //the condition is moved after the body once the body has been compiled,
+            //so that an iteration costs a single jump
+            safe_next();
+            consumeToken(Token::LP);
+            int toTest = out.emit(OP_JMP, {0}) + 1;
+            int condStart = out.here();
+            Operand cond = compileExpression();
+            consumeToken(Token::RP);
+            expect(cond, Type::BOOL);
+            int back = branch(cond, true);
+            int bodyStart = out.here();
+
+            breakJumps.push_back({});
+            compileStmt();
+            int condLength = bodyStart - condStart;
+            int bodyLength = out.here() - bodyStart;
+            out.rotate(condStart, bodyStart);
+
+            out.patch(toTest, condStart + bodyLength);
+            if(back != -1)
+                out.patch(back + bodyLength, condStart);
+            for(int& pos : breakJumps.back())
+                pos -= condLength;
+            patchHere(breakJumps.back());
+            breakJumps.pop_back();
+            break;
+        }
+
+        case Token::DO:
+        {
+            safe_next();
+            int bodyStart = out.here();
+            breakJumps.push_back({});
+            compileStmt();
+            consumeToken(Token::WHILE);
+            consumeToken(Token::LP);
+            nextTemp = 0;
+            Operand cond = compileExpression();
+            consumeToken(Token::RP);
+            consumeToken(Token::END_STMT);
+            expect(cond, Type::BOOL);
+            int back = branch(cond, true);
+            if(back != -1)
+                out.patch(back, bodyStart);
+            patchHere(breakJumps.back());
+            breakJumps.pop_back();
+            break;
+        }
+
+        case Token::BREAK:
+            safe_next();
+            consumeToken(Token::END_STMT);
+            breakJumps.back().push_back(out.emit(OP_JMP, {0}) + 1);
+            break;
+
+        case Token::PRINT:
+        {
+            safe_next();
+            consumeToken(Token::LP);
+            Operand value = compileExpression();
+            consumeToken(Token::RP);
+            consumeToken(Token::END_STMT);
+            out.emit(value.type == Type::INT ? OP_PRINTI : OP_PRINTB, {materialize(value)});
+            break;
+        }
+
+        //files are read and written by the Environment, in the tree walker
+        case Token::LOAD:
+        case Token::STORE:
+            throw CompileError("load and store are not compiled");
+
+        //its body is checked on the tree (see checkParallelFor), which this compiler doesn't build
+        case Token::PARALLEL:
+            throw CompileError("parallel for is not compiled");
+
+        //only a function can return, and its program is not compiled
+        case Token::RETURN:
+            throw CompileError("return is not compiled");
+
+        case Token::LEFT_CURLY:
+            compileBlock();
+            break;
+
+        default:
+            throw ParseError("No valid symbol at start of Stmt Parsing");
+    }
+}
+
+//<bool> -> <join> (|| <join>)*, like in the Parser. The result is built in a temporary,
+//and the right operands are skipped as soon as it is known
+
+StreamCompiler::Operand StreamCompiler::compileExpression()
+{
+    Operand exp = compileAnd();
+    bool chained = false;
+    while(tag() == Token::OR)
+    {
+        safe_next();
+        expect(exp, Type::BOOL);
+        int t = chained ? exp.reg : newTemp();
+        moveTo(exp, t);
+        int toEnd = out.emit(OP_JNZ, {t, 0}) + 2;
+        Operand right = compileAnd();
+        expect(right, Type::BOOL);
+        moveTo(right, t);
+        out.patch(toEnd, out.here());
+        exp = Operand{Type::BOOL, false, 0, t, -1, -1, exp.canFail || right.canFail};
+        chained = true;
+    }
+    return exp;
+}
+
+StreamCompiler::Operand StreamCompiler::compileAnd()
+{
+    Operand exp = compileEquality();
+    bool chained = false;
+    while(tag() == Token::AND)
+    {
+        safe_next();
+        expect(exp, Type::BOOL);
+        int t = chained ? exp.reg : newTemp();
+        moveTo(exp, t);
+        int toEnd = out.emit(OP_JZ, {t, 0}) + 2;
+        Operand right = compileEquality();
+        expect(right, Type::BOOL);
+        moveTo(right, t);
+        out.patch(toEnd, out.here());
+        exp = Operand{Type::BOOL, false, 0, t, -1, -1, exp.canFail || right.canFail};
+        chained = true;
+    }
+    return exp;
+}
+
+StreamCompiler::Operand StreamCompiler::compileEquality()
+{
+    Operand exp = compileRel();
+    while(tag() == Token::EQ || tag() == Token::NOT_EQ)
+    {
+        Op::BinOpCode op = tag() == Token::EQ ? Op::EQ : Op::NOT_EQ;
+        safe_next();
+        Operand right = compileRel();
+        //both operands must have the type of the right one
+        if(exp.type != right.type)
+            throw CompileError("Comparing expressions of different types");
+        exp = binary(op, exp, right);
+    }
+    return exp;
+}
+
+StreamCompiler::Operand StreamCompiler::compileRel()
+{
+    Operand left = compileLowerPrecedenceBinOp();
+    OpCode op;
+    switch(tag())
+    {
+        case Token::LESS:    op = OP_LT; break;
+        case Token::LESS_EQ: op = OP_LE; break;
+        case Token::MORE:    op = OP_GT; break;
+        case Token::MORE_EQ: op = OP_GE; break;
+        default:
+            return left;
+    }
+    safe_next();
+    Operand right = compileLowerPrecedenceBinOp();
+    expect(left, Type::INT);
+    expect(right, Type::INT);
+
+    if(left.isConstant && right.isConstant)
+    {
+        const bool values[] = {left.value < right.value, left.value <= right.value,
+                               left.value > right.value, left.value >= right.value};
+        return constant(Type::BOOL, values[op - OP_LT]);
+    }
+    int a = materialize(left);
+    int b = materialize(right);
+    Operand rel = result(Type::BOOL, out.emit(op, {newTemp(), a, b}), left.canFail || right.canFail);
+    rel.comparePos = out.here() - 4;
+    return rel;
+}
+
+StreamCompiler::Operand StreamCompiler::compileLowerPrecedenceBinOp()
+{
+    Operand exp = compileHigherPrecedenceBinOp();
+    while(tag() == Token::ADD || tag() == Token::MIN)
+    {
+        Op::BinOpCode op = tag() == Token::ADD ? Op::ADD : Op::SUB;
+        safe_next();
+        exp = binary(op, exp, compileHigherPrecedenceBinOp());
+    }
+    return exp;
+}
+
+StreamCompiler::Operand StreamCompiler::compileHigherPrecedenceBinOp()
+{
+    Operand exp = compileUnaryOp();
+    while(tag() == Token::MUL || tag() == Token::DIV)
+    {
+        Op::BinOpCode op = tag() == Token::MUL ? Op::MUL : Op::DIV;
+        safe_next();
+        exp = binary(op, exp, compileUnaryOp());
+    }
+    return exp;
+}
+
+StreamCompiler::Operand StreamCompiler::compileUnaryOp()
+{
+    switch(tag())
+    {
+        case Token::NOT:
+        {
+            safe_next();
+            Operand exp = compileUnaryOp();
+            expect(exp, Type::BOOL);
+            if(exp.isConstant)
+                return constant(Type::BOOL, !exp.value);
+            int a = materialize(exp);
+            return result(Type::BOOL, out.emit(OP_NOT, {newTemp(), a}), exp.canFail);
+        }
+
+        case Token::MIN:
+        {
+            safe_next();
+            Operand exp = compileUnaryOp();
+            expect(exp, Type::INT);
+            if(exp.isConstant)
+                return constant(Type::INT, wrapSub(0, exp.value));
+            int a = materialize(exp);
+            return result(Type::INT, out.emit(OP_NEG, {newTemp(), a}), exp.canFail);
+        }
+
+        default:
+            return compileFactor();
+    }
+}
+
+StreamCompiler::Operand StreamCompiler::compileFactor()
+{
+    switch(tag())
+    {
+        case Token::LP:
+        {
+            safe_next();
+            Operand exp = compileExpression();
+            consumeToken(Token::RP);
+            return exp;
+        }
+
+        case Token::ID:
+        {
+            std::string name = parseId();
+            if(tag() == Token::LP)
+                throw CompileError("calls are not compiled");
+            if(tag() == Token::LEFT_SQUARE)
+            {
+                Operand index = compileIndex(name);
+                Variable& array = lookup(name, true);
+                expect(index, Type::INT);
+                int i = materialize(index);
+                return result(array.type, out.emit(OP_ALOAD, {newTemp(), array.slot, i}), true);
+            }
+            Variable& var = lookup(name, false);
+            return Operand{var.type, false, 0, var.slot, -1, -1, false};
+        }
+
+        case Token::NUM:
+        {
+            int32_t value = std::stoi(tokenItr->word);
+            safe_next();
+            return constant(Type::INT, value);
+        }
+
+        case Token::TRUE:
+        case Token::FALSE:
+        {
+            bool value = tag() == Token::TRUE;
+            safe_next();
+            return constant(Type::BOOL, value);
+        }
+
+        default:
+            throw ParseError("Error while parsing expression");
+    }
+}
+
+StreamCompiler::Operand StreamCompiler::binary(Op::BinOpCode op, Operand l, Operand r)
+{
+    bool equality = op == Op::EQ || op == Op::NOT_EQ;
+    if(!equality)
+    {
+        expect(l, Type::INT);
+        expect(r, Type::INT);
+    }
+    Type::TypeCode type = equality ? Type::BOOL : Type::INT;
+    bool canFail = l.canFail || r.canFail || op == Op::DIV;
+
+    //divisions are left to the VM, which reports the division by 0
+    if(l.isConstant && r.isConstant && op != Op::DIV)
+    {
+        switch(op)
+        {
+            case Op::ADD: return constant(type, wrapAdd(l.value, r.value));
+            case Op::SUB: return constant(type, wrapSub(l.value, r.value));
+            case Op::MUL: return constant(type, wrapMul(l.value, r.value));
+            case Op::EQ:  return constant(type, l.value == r.value);
+            default:      return constant(type, l.value != r.value);
+        }
+    }
+
+    //additions and multiplications by a literal take it as immediate operand
+    if((op == Op::ADD || op == Op::SUB || op == Op::MUL) && r.isConstant)
+    {
+        int32_t imm = op == Op::SUB ? wrapSub(0, r.value) : r.value;
+        int a = materialize(l);
+        return result(type, out.emit(op == Op::MUL ? OP_MULI : OP_ADDI, {newTemp(), a, imm}), canFail);
+    }
+    if((op == Op::ADD || op == Op::MUL) && l.isConstant)
+    {
+        int a = materialize(r);
+        return result(type, out.emit(op == Op::MUL ? OP_MULI : OP_ADDI, {newTemp(), a, l.value}), canFail);
+    }
+
+    const OpCode ops[] = {OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_EQ, OP_NE};  //same order of Op::BinOpCode
+    int a = materialize(l);
+    int b = materialize(r);
+    Operand exp = result(type, out.emit(ops[op], {newTemp(), a, b}), canFail);
+    if(equality)
+        exp.comparePos = out.here() - 4;
+    return exp;
+}
+
+//a single subscript is the index itself. Several ones are all evaluated, and then
+//OP_INDEX checks them and folds them into the position of the cell
+StreamCompiler::Operand StreamCompiler::compileIndex(const std::string& name)
+{
+    std::vector<Operand> subscripts;
+    while(tag() == Token::LEFT_SQUARE)
+    {
+        safe_next();
+        subscripts.push_back(compileExpression());
+        consumeToken(Token::RIGHT_SQUARE);
+    }
+    if(subscripts.size() == 1)
+        return subscripts[0];
+
+    Variable& array = lookup(name, true);
+    if(subscripts.size() != array.dims.size())
+        throw CompileError("Wrong number of subscripts for " + name + " array");
+    std::vector<int> regs;
+    for(auto& subscript : subscripts)
+    {
+        expect(subscript, Type::INT);
+        regs.push_back(materialize(subscript));
+    }
+    int partial = regs.size() > 2 ? newTemp() : -1;
+    int left = regs[0];
+    int cells = array.dims[0];
+    int pos = -1;
+    for(size_t k = 1; k < regs.size(); k++)
+    {
+        int target = k + 1 == regs.size() ? newTemp() : partial;
+        pos = out.emit(OP_INDEX, {target, left, regs[k], cells, array.dims[k], array.slot});
+        left = target;
+        cells *= array.dims[k];
+    }
+    return result(Type::INT, pos, true);
+}
+
+StreamCompiler::Variable& StreamCompiler::lookup(const std::string& name, bool asArray)
+{
+    auto it = symbols.find(name);
+    if(it == symbols.end() || !it->second.visible)
+        throw CompileError("identifier " + name + " is used outside of the block that declares it");
+    if(it->second.isArray != asArray)
+        throw CompileError("identifier " + name + (asArray ? " is not an array" : " is an array"));
+    return it->second;
+}
+
+void StreamCompiler::expect(const Operand& op, Type::TypeCode type)
+{
+    if(op.type != type)
+        throw CompileError(std::string("Expecting an expression of type ") + Type::typeid2String[type]);
+}
+
+int StreamCompiler::newTemp()
+{
+    if(nextTemp == temps.size())
+        temps.push_back(out.addRegister(""));
+    return temps[nextTemp++];
+}
+
+StreamCompiler::Operand StreamCompiler::constant(Type::TypeCode type, int32_t value)
+{
+    return Operand{type, true, value, -1, -1, -1, false};
+}
+
+StreamCompiler::Operand StreamCompiler::result(Type::TypeCode type, int pos, bool canFail)
+{
+    return Operand{type, false, 0, out.getCode()[pos + 1], pos + 1, -1, canFail};
+}
+
+int StreamCompiler::materialize(const Operand& op)
+{
+    if(!op.isConstant)
+        return op.reg;
+    int t = newTemp();
+    out.emit(OP_LOADI, {t, op.value});
+    return t;
+}
+
+void StreamCompiler::moveTo(const Operand& op, int dest)
+{
+    if(op.isConstant)
+        out.emit(OP_LOADI, {dest, op.value});
+    else if(op.reg == dest)
+        return;
+    else if(op.destPos != -1)
+        out.patch(op.destPos, dest);     //computed into dest instead of the temporary
+    else
+        out.emit(OP_MOV, {dest, op.reg});
+}
+
+int StreamCompiler::branch(const Operand& cond, bool jumpIf)
+{
+    if(cond.isConstant)
+    {
+        if((cond.value != 0) != jumpIf)
+            return -1;
+        return out.emit(OP_JMP, {0}) + 1;
+    }
+
+    //a comparison just emitted becomes a compare-and-branch
+    int pos = cond.comparePos;
+    if(pos != -1 && pos + 4 == out.here())
+    {
+        const std::vector<int32_t>& code = out.getCode();
+        int rel = code[pos] - OP_EQ;
+        int32_t a = code[pos + 2];
+        int32_t b = code[pos + 3];
+        out.patch(pos, jumpIf ? branchOps[rel] : negatedBranchOps[rel]);
+        out.patch(pos + 1, a);
+        out.patch(pos + 2, b);
+        out.patch(pos + 3, 0);
+        return pos + 3;
+    }
+    return out.emit(jumpIf ? OP_JNZ : OP_JZ, {materialize(cond), 0}) + 2;
+}
+
+void StreamCompiler::patchHere(const std::vector<int>& jumps)
+{
+    for(int pos : jumps)
+        if(pos != -1)
+            out.patch(pos, out.here());
+}
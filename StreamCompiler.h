@@ -0,0 +1,133 @@
+#ifndef STREAM_COMPILER_H
+#define STREAM_COMPILER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Node.h"
+#include "Token.h"
+#include "Bytecode.h"
+#include "Exceptions.h"
+
+//Single-pass compiler from the token stream to bytecode, for one-shot runs of large programs:
+//it follows the recursive descent of the Parser and emits the code of every construct as soon as
+//it is read, without building the tree. Syntax errors are the ParseErrors of the Parser, with the
+//same messages. What the Resolver rejects (type errors, uses of identifiers outside of the block
+//declaring them) is rejected with CompileError: the program then goes through the Parser and the
+//EvaluationVisitor as usual. Optimization passes don't apply to the compiled program
+class StreamCompiler {
+public:
+    StreamCompiler(std::vector<Token>& tokenStream) : streamEnd{tokenStream.end()}, nextTemp{0} {
+        if(tokenStream.empty())
+            throw ParseError("Program has no contents");
+        tokenItr = tokenStream.begin();
+    }
+    ~StreamCompiler() = default;
+    StreamCompiler(StreamCompiler const&) = delete;
+    StreamCompiler& operator=(StreamCompiler const&) = delete;
+
+    BytecodeProgram operator()();
+
+private:
+    //a variable or an array, with its register or its array slot
+    struct Variable {
+        Type::TypeCode type;
+        bool isArray;
+        int slot;
+        bool visible;   //inside the block declaring it
+        std::vector<int> dims;  //sizes of the dimensions, arrays only
+    };
+
+    //the value of an expression compiled so far
+    struct Operand {
+        Type::TypeCode type;
+        bool isConstant;
+        int32_t value;      //constants are kept out of the code until they are needed
+        int reg;
+        //position of the destination of the last instruction, when it computes the operand
+        //into a temporary, so that the result can be moved to a variable instead
+        int destPos;
+        //position of the last instruction, when it is a comparison that a branch can replace
+        int comparePos;
+        //evaluating it can raise an EvaluationError
+        bool canFail;
+    };
+
+    std::vector<Token>::const_iterator streamEnd;
+    std::vector<Token>::const_iterator tokenItr;
+
+    BytecodeProgram out;
+
+    std::unordered_map<std::string, Variable> symbols;
+    //every identifier declared so far, which can't be declared again (see Parser)
+    std::unordered_set<std::string> declaredVars;
+
+    //temporaries are registers with no name, taken like a stack from temps
+    std::vector<int> temps;
+    size_t nextTemp;
+
+    //for every enclosing loop, the positions of the jumps emitted by its breaks
+    std::vector<std::vector<int>> breakJumps;
+
+    void compileBlock();
+    //returns the name of the declared identifier
+    std::string compileDecl();
+    void compileStmt();
+
+    Operand compileExpression();
+    Operand compileAnd();
+    Operand compileEquality();
+    Operand compileRel();
+    Operand compileLowerPrecedenceBinOp();
+    Operand compileHigherPrecedenceBinOp();
+    Operand compileUnaryOp();
+    Operand compileFactor();
+    //the subscripts of a cell of the array, from the left bracket
+    Operand compileIndex(const std::string& name);
+
+    Variable& lookup(const std::string& name, bool asArray);
+
+    int newTemp();
+    static Operand constant(Type::TypeCode type, int32_t value);
+    Operand result(Type::TypeCode type, int pos, bool canFail);
+    //the register holding the operand, loading it if it is a constant
+    int materialize(const Operand& op);
+    //leaves the value of the operand in dest
+    void moveTo(const Operand& op, int dest);
+    //emits a jump taken when the bool operand is jumpIf, returns the position of its target
+    int branch(const Operand& cond, bool jumpIf);
+    void expect(const Operand& op, Type::TypeCode type);
+    Operand binary(Op::BinOpCode op, Operand l, Operand r);
+    void patchHere(const std::vector<int>& jumps);
+
+    int tag() const {
+        if(tokenItr == streamEnd)
+            throw ParseError("Unexpected end of input");
+        return tokenItr->tag;
+    }
+
+    // Safely skipping token
+    void safe_next() {
+        if(tokenItr == streamEnd)
+            throw ParseError("Unexpected end of input");
+        ++tokenItr;
+    }
+
+    //Checking that token is the expected one before skipping it
+    void consumeToken(const int tokenId) {
+        if(tag() == tokenId)
+            safe_next();
+        else
+            throw ParseError{
+            std::string("Expecting ").
+            append(Token::id2word[tokenId]).
+            append(", instead found ").
+            append(Token::id2word[tokenItr->tag])};
+    }
+
+    std::string parseId();
+};
+
+#endif
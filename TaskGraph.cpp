@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <bitset>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#include "TaskGraph.h"
+#include "Fused.h"
+#include "OutputSink.h"
+#include "ThreadPool.h"
+
+namespace {
+
+//the dependences are found between every pair of tasks, and reachability is kept in a bitset
+const int MAX_TASKS = 256;
+
+//What a statement reads and writes, and whether it can run apart from the rest of its block
+struct Effects {
+    std::set<std::string> reads;
+    std::set<std::string> writes;
+    bool hasLoop = false;
+    bool separable = true;      //no break out of the block, no load, store or call
+};
+
+void collectReads(Expression* exp, Effects& effects)
+{
+    switch(exp->getKind())
+    {
+        case Node::FUSED:
+            collectReads(static_cast<Fused*>(exp)->getOriginal(), effects);
+            break;
+        case Node::ID:
+            effects.reads.insert(static_cast<Id*>(exp)->getName());
+            break;
+        case Node::ACCESS:
+            effects.reads.insert(static_cast<Access*>(exp)->getId()->getName());
+            collectReads(static_cast<Access*>(exp)->getIndex(), effects);
+            break;
+        case Node::INDEX:
+            for(Expression* subscript : static_cast<Index*>(exp)->getSubscripts())
+                collectReads(subscript, effects);
+            break;
+        case Node::NOT:
+            collectReads(static_cast<Not*>(exp)->getExp(), effects);
+            break;
+        case Node::UNARY:
+            collectReads(static_cast<Unary*>(exp)->getExp(), effects);
+            break;
+        case Node::AND:
+            collectReads(static_cast<And*>(exp)->getLeftExp(), effects);
+            collectReads(static_cast<And*>(exp)->getRightExp(), effects);
+            break;
+        case Node::OR:
+            collectReads(static_cast<Or*>(exp)->getLeftExp(), effects);
+            collectReads(static_cast<Or*>(exp)->getRightExp(), effects);
+            break;
+        case Node::REL:
+            collectReads(static_cast<Rel*>(exp)->getLeftExp(), effects);
+            collectReads(static_cast<Rel*>(exp)->getRightExp(), effects);
+            break;
+        case Node::ARITHM:
+            collectReads(static_cast<Arithm*>(exp)->getLeftExp(), effects);
+            collectReads(static_cast<Arithm*>(exp)->getRightExp(), effects);
+            break;
+        //a function may read and write any variable of the program
+        case Node::CALL:
+            effects.separable = false;
+            break;
+        default:
+            break;
+    }
+}
+
+//inLoop: stmt is in a loop nested in the statement, which its breaks leave
+void collectEffects(Stmt* stmt, bool inLoop, Effects& effects)
+{
+    switch(stmt->getKind())
+    {
+        //a declaration clears a variable, or allocates an array
+        case Node::BLOCK:
+        {
+            auto block = static_cast<Block*>(stmt);
+            for(Decls* decls = block->getDecls(); decls; decls = decls->getDecls())
+                effects.writes.insert(decls->getDecl()->getId()->getName());
+            for(Seq* seq = block->getSeq(); seq; seq = seq->getSeq())
+                collectEffects(seq->getStmt(), inLoop, effects);
+            break;
+        }
+        case Node::SET:
+            effects.writes.insert(static_cast<Set*>(stmt)->getId()->getName());
+            collectReads(static_cast<Set*>(stmt)->getExp(), effects);
+            break;
+        case Node::SET_ELEM:
+            effects.writes.insert(static_cast<SetElem*>(stmt)->getId()->getName());
+            collectReads(static_cast<SetElem*>(stmt)->getExp(), effects);
+            collectReads(static_cast<SetElem*>(stmt)->getIndex(), effects);
+            break;
+        case Node::IF:
+            collectReads(static_cast<If*>(stmt)->getCondition(), effects);
+            collectEffects(static_cast<If*>(stmt)->getStmt(), inLoop, effects);
+            break;
+        case Node::ELSE:
+            collectReads(static_cast<Else*>(stmt)->getCondition(), effects);
+            collectEffects(static_cast<Else*>(stmt)->getifTrueStmt(), inLoop, effects);
+            collectEffects(static_cast<Else*>(stmt)->getifFalseStmt(), inLoop, effects);
+            break;
+        case Node::WHILE:
+            effects.hasLoop = true;
+            collectReads(static_cast<While*>(stmt)->getCondition(), effects);
+            collectEffects(static_cast<While*>(stmt)->getStmt(), true, effects);
+            break;
+        case Node::DO:
+            effects.hasLoop = true;
+            collectReads(static_cast<Do*>(stmt)->getCondition(), effects);
+            collectEffects(static_cast<Do*>(stmt)->getStmt(), true, effects);
+            break;
+        case Node::PARALLEL_FOR:
+        {
+            auto loop = static_cast<ParallelFor*>(stmt);
+            effects.hasLoop = true;
+            effects.writes.insert(loop->getId()->getName());
+            collectReads(loop->getFirst(), effects);
+            collectReads(loop->getLast(), effects);
+            for(auto& reduction : loop->getReductions())
+                effects.writes.insert(reduction.var->getName());
+            collectEffects(loop->getStmt(), true, effects);
+            break;
+        }
+        case Node::PRINT:
+            collectReads(static_cast<Print*>(stmt)->getExp(), effects);
+            break;
+        case Node::BREAK:
+            if(!inLoop)
+                effects.separable = false;
+            break;
+        default:
+            effects.separable = false;
+            break;
+    }
+}
+
+bool intersect(const std::set<std::string>& a, const std::set<std::string>& b)
+{
+    auto i = a.begin();
+    auto j = b.begin();
+    while(i != a.end() && j != b.end())
+    {
+        if(*i < *j)
+            ++i;
+        else if(*j < *i)
+            ++j;
+        else
+            return true;
+    }
+    return false;
+}
+
+}
+
+bool analyzeBlock(Block* block, BlockGraph& result)
+{
+    std::vector<Effects> effects;
+    std::vector<bool> hasLoop;
+    for(Seq* seq = block->getSeq(); seq; seq = seq->getSeq())
+    {
+        Effects stmtEffects;
+        collectEffects(seq->getStmt(), false, stmtEffects);
+        if(!stmtEffects.separable)
+            return false;
+        //a task ends with its statement with a loop
+        if(effects.empty() || hasLoop.back())
+        {
+            result.tasks.push_back({});
+            effects.push_back({});
+            hasLoop.push_back(false);
+        }
+        result.tasks.back().push_back(seq->getStmt());
+        hasLoop.back() = stmtEffects.hasLoop;
+        effects.back().reads.insert(stmtEffects.reads.begin(), stmtEffects.reads.end());
+        effects.back().writes.insert(stmtEffects.writes.begin(), stmtEffects.writes.end());
+    }
+    int numTasks = result.tasks.size();
+    if(std::count(hasLoop.begin(), hasLoop.end(), true) < 2 || numTasks > MAX_TASKS)
+        return false;
+
+    result.successors.assign(numTasks, {});
+    for(int k = 0; k < numTasks; k++)
+    {
+        for(int j = 0; j < k; j++)
+        {
+            if(intersect(effects[j].writes, effects[k].reads) || intersect(effects[j].writes, effects[k].writes)
+               || intersect(effects[j].reads, effects[k].writes))
+                result.successors[j].push_back(k);
+        }
+    }
+
+    //the tasks reached from every task, going backwards so that its successors are done first
+    std::vector<std::bitset<MAX_TASKS>> reached(numTasks);
+    for(int j = numTasks - 1; j >= 0; j--)
+    {
+        for(int k : result.successors[j])
+        {
+            reached[j] |= reached[k];
+            reached[j].set(k);
+        }
+    }
+    bool concurrent = false;
+    for(int j = 0; j < numTasks && !concurrent; j++)
+        for(int k = j + 1; k < numTasks && !concurrent; k++)
+            concurrent = hasLoop[j] && hasLoop[k] && !reached[j].test(k);
+    if(!concurrent)
+        return false;
+
+    for(auto& task : effects)
+        result.writes.push_back(task.writes);
+    return true;
+}
+
+bool runTaskGraph(const TaskGraph& graph, int32_t* registers, int numRegisters,
+                  const std::function<void(int, int32_t*)>& runTask)
+{
+    ThreadPool& pool = ThreadPool::shared();
+    if(pool.getThreads() < 2)
+        return false;
+
+    //everything below is guarded by mutex
+    std::mutex mutex;
+    std::condition_variable changed;
+    int numTasks = graph.tasks.size();
+    std::vector<int> waiting(numTasks);
+    std::set<int> ready;
+    for(int k = 0; k < numTasks; k++)
+    {
+        waiting[k] = graph.tasks[k].predecessors;
+        if(waiting[k] == 0)
+            ready.insert(k);
+    }
+    int finished = 0;
+    std::vector<std::exception_ptr> errors(numTasks);
+    //the first task that raised an error: the tasks after it are not started
+    int firstError = numTasks;
+
+    //like the chunks of an ordered loop (see runParallelLoop), the tasks print on their own sink
+    OutputSink& output = OutputSink::current();
+    std::vector<std::string> printed(numTasks);
+    std::vector<char> done(numTasks);
+    int written = 0;
+
+    //every thread of the pool takes the ready tasks until all of them are done
+    pool.run(pool.getThreads(), [&](int) {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;)
+        {
+            changed.wait(lock, [&] {return !ready.empty() || finished == numTasks;});
+            if(ready.empty())
+                return;
+            int k = *ready.begin();
+            ready.erase(ready.begin());
+            const TaskGraph::Task& task = graph.tasks[k];
+
+            if(k < firstError)
+            {
+                std::vector<int32_t> r(registers, registers + numRegisters);
+                lock.unlock();
+                std::ostringstream text;
+                std::unique_ptr<OutputSink> sink;
+                OutputSink* previous = &OutputSink::current();
+                if(task.prints)
+                {
+                    sink = std::make_unique<OutputSink>(text, OutputSink::BUFFERED);
+                    OutputSink::setCurrent(sink.get());
+                }
+                std::exception_ptr error;
+                try {
+                    runTask(k, r.data());
+                }
+                catch (...) {
+                    error = std::current_exception();
+                }
+                if(task.prints)
+                {
+                    OutputSink::setCurrent(previous);
+                    sink->flush();
+                }
+                lock.lock();
+                if(error)
+                {
+                    errors[k] = error;
+                    firstError = std::min(firstError, k);
+                }
+                else
+                {
+                    for(int reg : task.writes)
+                        registers[reg] = r[reg];
+                }
+                printed[k] = text.str();
+            }
+
+            done[k] = true;
+            for(; written < numTasks && done[written]; written++)
+            {
+                output.printText(printed[written]);
+                std::string().swap(printed[written]);
+                //nothing after an error is printed
+                if(errors[written])
+                    written = numTasks;
+            }
+            finished++;
+            for(int successor : task.successors)
+                if(--waiting[successor] == 0)
+                    ready.insert(successor);
+            changed.notify_all();
+        }
+    });
+
+    if(firstError < numTasks)
+        std::rethrow_exception(errors[firstError]);
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Node.h"
+#include "Bytecode.h"
+
+//The statements of a block split in tasks, found by analyzeBlock. Every statement with a loop makes up
+//a task with the statements without loops before it, and the statements after the last one a task too
+struct BlockGraph {
+    std::vector<std::vector<Stmt*>> tasks;
+    //the variables and arrays written by every task
+    std::vector<std::set<std::string>> writes;
+    //the tasks after a task that read or write something it writes, or write something it reads
+    std::vector<std::vector<int>> successors;
+};
+
+//Dependence analysis of the statements of a block of a resolved program. The block is worth
+//running as a graph of tasks when two of its statements with a loop can run at the same time,
+//that is neither of them depends on the other through a chain of dependences. Blocks with a break
+//out of them, load, store, calls, or more than 256 tasks are left to their serial code
+bool analyzeBlock(Block* block, BlockGraph& result);
+
+//Runs a task graph of a bytecode program which is about to start, on the registers of the block:
+//every task starts once the tasks it depends on are done, runTask runs its code on a copy of
+//registers taken then, and the registers it writes are copied back when it ends. The first task
+//ready in the order of the block goes first.
+//Returns false, without running anything, if there is a single thread. Like for the serial code,
+//the lines printed by the tasks are written to the sink of the caller in the order of the tasks,
+//and if some tasks raise an error the one of the first of them is raised. The tasks after it
+//which are already running are waited for
+bool runTaskGraph(const TaskGraph& graph, int32_t* registers, int numRegisters,
+                  const std::function<void(int, int32_t*)>& runTask);
+
+#endif
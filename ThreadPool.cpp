@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "ThreadPool.h"
+
+namespace {
+
+int sharedThreads = 0;
+
+}
+
+ThreadPool::ThreadPool(int threads) : task{nullptr}, active{0}, generation{0}, stopping{false},
+    ranges(std::max(threads, 1))
+{
+    for(int i = 1; i < threads; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(auto& worker : workers)
+        worker.join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool(sharedThreads > 0 ? sharedThreads : std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+void ThreadPool::setSharedThreads(int threads)
+{
+    sharedThreads = threads;
+}
+
+void ThreadPool::run(int count, const std::function<void(int)>& job)
+{
+    std::unique_lock<std::mutex> running(runMutex, std::try_to_lock);
+    if(!running || workers.empty())
+    {
+        for(int i = 0; i < count; i++)
+            job(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &job;
+        int threads = ranges.size();
+        for(int i = 0; i < threads; i++)
+        {
+            std::lock_guard<std::mutex> rangeLock(ranges[i].mutex);
+            ranges[i].begin = int64_t{count} * i / threads;
+            ranges[i].end = int64_t{count} * (i + 1) / threads;
+        }
+        active = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+    work(0);
+
+    //job must outlive the workers still running its last tasks
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] {return active == 0;});
+    task = nullptr;
+}
+
+void ThreadPool::workerLoop(int index)
+{
+    unsigned long seen = 0;
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] {return stopping || generation != seen;});
+            if(stopping)
+                return;
+            seen = generation;
+        }
+        work(index);
+        std::lock_guard<std::mutex> lock(mutex);
+        if(--active == 0)
+            done.notify_one();
+    }
+}
+
+void ThreadPool::work(int index)
+{
+    int next;
+    while(take(index, next) || steal(index, next))
+        (*task)(next);
+}
+
+bool ThreadPool::take(int index, int& next)
+{
+    Range& range = ranges[index];
+    std::lock_guard<std::mutex> lock(range.mutex);
+    if(range.begin == range.end)
+        return false;
+    next = range.begin++;
+    return true;
+}
+
+//the stolen tasks are out of every range until the thief puts them in its own, which is empty:
+//a thread finding nothing to steal in the meantime stops, and the thief runs them
+bool ThreadPool::steal(int index, int& next)
+{
+    int threads = ranges.size();
+    for(int i = 1; i < threads; i++)
+    {
+        Range& victim = ranges[(index + i) % threads];
+        int begin, end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            int left = victim.end - victim.begin;
+            if(left == 0)
+                continue;
+            end = victim.end;
+            begin = victim.end -= (left + 1) / 2;
+        }
+        Range& own = ranges[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        next = begin;
+        own.begin = begin + 1;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
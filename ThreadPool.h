@@ -0,0 +1,63 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//A fixed set of threads running the tasks of a parallel loop. The tasks of a run are numbered and
+//split in contiguous ranges, one for each thread of the pool and one for the caller. A thread runs
+//the tasks of its range in order, and when it has none left it steals the last half of the tasks
+//left in the range of another thread, so that the threads with less work help the others
+class ThreadPool {
+public:
+    //threads counts the caller too: a pool of 1 thread has no workers
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    int getThreads() const {return workers.size() + 1;}
+
+    //runs task(0) ... task(count - 1) and returns when all of them are done. Tasks must not throw.
+    //A run started while another one is going on (from a task, or from another thread) runs
+    //its tasks on the caller
+    void run(int count, const std::function<void(int)>& task);
+
+    //the pool of the parallel loops, created on first use
+    static ThreadPool& shared();
+    //threads of the shared pool, to be set before its first use. The default is one per core
+    static void setSharedThreads(int threads);
+
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex runMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    //the current run, started when generation changes
+    const std::function<void(int)>* task;
+    int active;
+    unsigned long generation;
+    bool stopping;
+
+    //the tasks not taken yet of a thread: begin to end - 1
+    struct Range {
+        std::mutex mutex;
+        int begin = 0;
+        int end = 0;
+    };
+    std::vector<Range> ranges;
+
+    void workerLoop(int index);
+    //runs the tasks of the current run from the range of the thread index, and then the ones it
+    //steals, until none is left
+    void work(int index);
+    bool take(int index, int& next);
+    bool steal(int index, int& next);
+};
+
+#endif
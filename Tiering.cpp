@@ -0,0 +1,309 @@
+#include <set>
+
+#include "Tiering.h"
+#include "BytecodeCompiler.h"
+#include "Exceptions.h"
+#include "OutputSink.h"
+
+namespace {
+
+const char* loopName(Stmt* loop)
+{
+    if(loop->getKind() == Node::PARALLEL_FOR)
+        return "parallel for";
+    return loop->getKind() == Node::WHILE ? "while" : "do";
+}
+
+//names declared by the blocks nested in stmt
+void collectDecls(Stmt* stmt, std::vector<std::string>& names)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+        {
+            auto block = static_cast<Block*>(stmt);
+            for(Decls* decls = block->getDecls(); decls; decls = decls->getDecls())
+                names.push_back(decls->getDecl()->getId()->getName());
+            for(Seq* seq = block->getSeq(); seq; seq = seq->getSeq())
+                collectDecls(seq->getStmt(), names);
+            break;
+        }
+        case Node::IF:
+            collectDecls(static_cast<If*>(stmt)->getStmt(), names);
+            break;
+        case Node::ELSE:
+            collectDecls(static_cast<Else*>(stmt)->getifTrueStmt(), names);
+            collectDecls(static_cast<Else*>(stmt)->getifFalseStmt(), names);
+            break;
+        case Node::WHILE:
+            collectDecls(static_cast<While*>(stmt)->getStmt(), names);
+            break;
+        case Node::DO:
+            collectDecls(static_cast<Do*>(stmt)->getStmt(), names);
+            break;
+        case Node::PARALLEL_FOR:
+            collectDecls(static_cast<ParallelFor*>(stmt)->getStmt(), names);
+            break;
+        default:
+            break;
+    }
+}
+
+//names of the variables and arrays read or written by exp
+void collectUses(Expression* exp, std::set<std::string>& names)
+{
+    switch(exp->getKind())
+    {
+        case Node::FUSED:
+            collectUses(static_cast<Fused*>(exp)->getOriginal(), names);
+            break;
+        case Node::ID:
+            names.insert(static_cast<Id*>(exp)->getName());
+            break;
+        case Node::ACCESS:
+            names.insert(static_cast<Access*>(exp)->getId()->getName());
+            collectUses(static_cast<Access*>(exp)->getIndex(), names);
+            break;
+        case Node::INDEX:
+            for(Expression* subscript : static_cast<Index*>(exp)->getSubscripts())
+                collectUses(subscript, names);
+            break;
+        case Node::NOT:
+            collectUses(static_cast<Not*>(exp)->getExp(), names);
+            break;
+        case Node::UNARY:
+            collectUses(static_cast<Unary*>(exp)->getExp(), names);
+            break;
+        case Node::AND:
+            collectUses(static_cast<And*>(exp)->getLeftExp(), names);
+            collectUses(static_cast<And*>(exp)->getRightExp(), names);
+            break;
+        case Node::OR:
+            collectUses(static_cast<Or*>(exp)->getLeftExp(), names);
+            collectUses(static_cast<Or*>(exp)->getRightExp(), names);
+            break;
+        case Node::REL:
+            collectUses(static_cast<Rel*>(exp)->getLeftExp(), names);
+            collectUses(static_cast<Rel*>(exp)->getRightExp(), names);
+            break;
+        case Node::ARITHM:
+            collectUses(static_cast<Arithm*>(exp)->getLeftExp(), names);
+            collectUses(static_cast<Arithm*>(exp)->getRightExp(), names);
+            break;
+        default:
+            break;
+    }
+}
+
+void collectUses(Stmt* stmt, std::set<std::string>& names)
+{
+    switch(stmt->getKind())
+    {
+        case Node::BLOCK:
+            for(Seq* seq = static_cast<Block*>(stmt)->getSeq(); seq; seq = seq->getSeq())
+                collectUses(seq->getStmt(), names);
+            break;
+        case Node::SET:
+            names.insert(static_cast<Set*>(stmt)->getId()->getName());
+            collectUses(static_cast<Set*>(stmt)->getExp(), names);
+            break;
+        case Node::SET_ELEM:
+            names.insert(static_cast<SetElem*>(stmt)->getId()->getName());
+            collectUses(static_cast<SetElem*>(stmt)->getExp(), names);
+            collectUses(static_cast<SetElem*>(stmt)->getIndex(), names);
+            break;
+        case Node::IF:
+            collectUses(static_cast<If*>(stmt)->getCondition(), names);
+            collectUses(static_cast<If*>(stmt)->getStmt(), names);
+            break;
+        case Node::ELSE:
+            collectUses(static_cast<Else*>(stmt)->getCondition(), names);
+            collectUses(static_cast<Else*>(stmt)->getifTrueStmt(), names);
+            collectUses(static_cast<Else*>(stmt)->getifFalseStmt(), names);
+            break;
+        case Node::WHILE:
+            collectUses(static_cast<While*>(stmt)->getCondition(), names);
+            collectUses(static_cast<While*>(stmt)->getStmt(), names);
+            break;
+        case Node::DO:
+            collectUses(static_cast<Do*>(stmt)->getCondition(), names);
+            collectUses(static_cast<Do*>(stmt)->getStmt(), names);
+            break;
+        case Node::PARALLEL_FOR:
+        {
+            auto loop = static_cast<ParallelFor*>(stmt);
+            names.insert(loop->getId()->getName());
+            collectUses(loop->getFirst(), names);
+            collectUses(loop->getLast(), names);
+            for(auto& reduction : loop->getReductions())
+                names.insert(reduction.var->getName());
+            collectUses(loop->getStmt(), names);
+            break;
+        }
+        case Node::PRINT:
+            collectUses(static_cast<Print*>(stmt)->getExp(), names);
+            break;
+        default:
+            break;
+    }
+}
+
+}
+
+std::ostream& TierController::logLine()
+{
+    //the lines printed by the program so far come first
+    OutputSink::current().flush();
+    return *log;
+}
+
+TierController::LoopProfile& TierController::profile(Stmt* loop)
+{
+    auto it = loops.find(loop);
+    if(it == loops.end())
+    {
+        it = loops.emplace(loop, LoopProfile()).first;
+        it->second.ordinal = loops.size();
+        //a parallel for has no back-edges, and runs on the VM to use the threads right away
+        it->second.threshold = loop->getKind() == Node::PARALLEL_FOR ? 0 : threshold;
+    }
+    return it->second;
+}
+
+bool TierController::enterLoop(Stmt* loop)
+{
+    LoopProfile& p = profile(loop);
+    if(p.state == COLD && p.threshold == 0)
+        tierUp(loop, p);
+    if(p.state != COMPILED)
+        return false;
+    runCompiled(p);
+    return true;
+}
+
+bool TierController::backEdge(Stmt* loop)
+{
+    LoopProfile& p = profile(loop);
+    if(p.state != COLD || ++p.backEdges < p.threshold)
+        return false;
+    if(!tierUp(loop, p))
+        return false;
+    //the VM enters the loop at the same point: the condition of a While, the body of a Do
+    runCompiled(p);
+    return true;
+}
+
+bool TierController::tierUp(Stmt* loop, LoopProfile& p)
+{
+    //the Resolver needs every identifier of the loop, so the declarations it has not run yet
+    //would be compiled as new variables unknown to the Environment: wait for them
+    std::vector<std::string> names;
+    collectDecls(loop, names);
+    for(auto& name : names)
+        if(!env.isAlreadyDeclared(name))
+        {
+            if(log)
+                logLine() << "tier-up: " << loopName(loop) << " loop #" << p.ordinal << " postponed, "
+                           << name << " is not declared yet" << std::endl;
+            p.backEdges = 0;
+            p.threshold = 2 * p.threshold + 1;
+            return false;
+        }
+
+    //only the state used by the loop is moved to the VM and back
+    std::set<std::string> used(names.begin(), names.end());
+    collectUses(loop, used);
+    p.scalars.clear();
+    p.arrays.clear();
+    for(auto& var : env.getDeclaredVars())
+        if(used.count(var.first))
+            p.scalars.push_back({var.first, var.second.getTypeCode(), false, 0, static_cast<int>(p.scalars.size())});
+    for(auto& array : env.getDeclaredArrays())
+    {
+        if(!used.count(array.first))
+            continue;
+        //the arrays of the VM are dense
+        if(array.second->isSparse())
+        {
+            if(log)
+                logLine() << "tier-up: " << loopName(loop) << " loop #" << p.ordinal << " stays interpreted: "
+                           << array.first << " is a sparse array" << std::endl;
+            p.state = FAILED;
+            return false;
+        }
+        p.arrays.push_back({array.first, array.second->typeCode, true, array.second->size, static_cast<int>(p.arrays.size()),
+                            array.second->dimensions});
+    }
+
+    std::vector<Symbol> declared(p.scalars);
+    declared.insert(declared.end(), p.arrays.begin(), p.arrays.end());
+    try {
+        BytecodeCompiler compiler;
+        p.bytecode = compiler.compileLoop(loop, declared);
+    }
+    catch (CompileError const& ce) {
+        if(log)
+            logLine() << "tier-up: " << loopName(loop) << " loop #" << p.ordinal << " stays interpreted: "
+                       << ce.what() << std::endl;
+        p.state = FAILED;
+        return false;
+    }
+    p.vm.reset(new VM(p.bytecode));
+    p.state = COMPILED;
+    if(log)
+        logLine() << "tier-up: " << loopName(loop) << " loop #" << p.ordinal << " after " << p.backEdges
+                   << " back-edges (" << p.bytecode.getCode().size() << " bytecode words)" << std::endl;
+    return true;
+}
+
+void TierController::runCompiled(LoopProfile& p)
+{
+    copyIn(p);
+    p.vm->run();
+    copyOut(p);
+}
+
+void TierController::copyIn(LoopProfile& p)
+{
+    //bools are 0/1 in the VM
+    for(auto& var : p.scalars)
+    {
+        Value value = env.getIdValue(var.name);
+        p.vm->setRegister(var.slot, var.type == Type::INT ? value.getInt() : value.getBool());
+    }
+    for(auto& array : p.arrays)
+    {
+        const arrayCells& source = env.getArray(array.name)->getCells();
+        RuntimeArray& target = p.vm->getArray(array.slot);
+        target.initialized.resize(array.size);
+        target.declared = true;
+        if(array.type == Type::INT)
+            target.cells.assign(source.ints, source.ints + array.size);
+        else
+        {
+            target.cells.resize(array.size);
+            for(int i = 0; i < array.size; i++)
+                target.cells[i] = source.getBool(i);
+        }
+        for(int i = 0; i < array.size; i++)
+            target.initialized[i] = source.isInitialized(i);
+    }
+}
+
+void TierController::copyOut(LoopProfile& p)
+{
+    for(auto& var : p.scalars)
+    {
+        int32_t value = p.vm->getRegister(var.slot);
+        env.assignConstant(var.name, var.type == Type::INT ? Value::fromInt(value) : Value::fromBool(value != 0));
+    }
+    for(auto& array : p.arrays)
+    {
+        const RuntimeArray& source = p.vm->getArray(array.slot);
+        arrayStruct* target = env.getArray(array.name);
+        for(int i = 0; i < array.size; i++)
+            if(source.initialized[i])
+                target->setCell(i, array.type == Type::INT ? Value::fromInt(source.cells[i])
+                                                           : Value::fromBool(source.cells[i] != 0));
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef TIERING_H
+#define TIERING_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+
+#include "Node.h"
+#include "Visitor.h"
+#include "Resolver.h"
+#include "Bytecode.h"
+#include "VM.h"
+
+//Tiered execution: the program starts in the EvaluationVisitor, which reports to the
+//TierController every loop it starts and every back-edge it takes. When a loop has taken
+//threshold back-edges it is compiled to bytecode, and the rest of it runs on the VM: the
+//variables and arrays of the Environment are copied into the VM before it starts and back
+//afterwards, so cold code keeps running in the tree walker on the same state.
+//A loop that can't be compiled (see Resolver) stays in the tree walker
+class TierController : public LoopObserver {
+public:
+    //with a log, every tier-up and every loop that can't be compiled is reported on it
+    TierController(Environment& e, int threshold, std::ostream* log = nullptr) : env{e}, threshold{threshold}, log{log} {}
+    ~TierController() = default;
+    TierController(TierController const&) = delete;
+    TierController& operator=(TierController const&) = delete;
+
+    bool enterLoop(Stmt* loop) override;
+    bool backEdge(Stmt* loop) override;
+
+private:
+    enum State {COLD, FAILED, COMPILED};
+
+    struct LoopProfile {
+        int ordinal;        //loops are numbered in the order they are first started
+        long backEdges = 0;
+        long threshold;     //raised while the loop uses identifiers not declared yet
+        State state = COLD;
+        //the variables and arrays the loop shares with the Environment, in the order of their slots
+        std::vector<Symbol> scalars;
+        std::vector<Symbol> arrays;
+        BytecodeProgram bytecode;
+        std::unique_ptr<VM> vm;
+    };
+
+    Environment& env;
+    const int threshold;
+    std::ostream* log;
+
+    //the nodes of a loop are never moved, so they identify it
+    std::unordered_map<Stmt*, LoopProfile> loops;
+
+    LoopProfile& profile(Stmt* loop);
+    std::ostream& logLine();
+    //returns true if the loop has been compiled
+    bool tierUp(Stmt* loop, LoopProfile& p);
+    //runs the rest of a compiled loop on the state of the Environment
+    void runCompiled(LoopProfile& p);
+
+    void copyIn(LoopProfile& p);
+    void copyOut(LoopProfile& p);
+};
+
+#endif
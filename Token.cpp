@@ -11,8 +11,9 @@ std::ostream& operator<<(std::ostream& os, const Token& t) {
 
 const char* Token::id2word[]{
 	"(", ")","{","}","[","]","+", "-", "*", "/", "||", "&&", "==", "!=", "<", "<=", ">", ">=", "!", "=", ";", "NUM", "ID", "if", "else", "do",
-	"while", "break", "int", "boolean", "true", "false","print"
+	"while", "break", "int", "boolean", "true", "false","print", ",", "STRING", "load", "store", "parallel", "for", "return"
 };
 
 const int Token::keywordsId[]{Token::IF, Token::ELSE,Token::DO, Token::WHILE, Token::BREAK,
-Token::INT, Token::BOOL, Token::TRUE, Token::FALSE, Token::PRINT};
+Token::INT, Token::BOOL, Token::TRUE, Token::FALSE, Token::PRINT, Token::LOAD, Token::STORE,
+Token::PARALLEL, Token::FOR, Token::RETURN};
@@ -57,13 +57,22 @@ struct Token {
 	static constexpr int FALSE = 31;
 	static constexpr int PRINT = 32;
 
+	//aggiunti dopo le keyword, per non cambiare gli id precedenti
+	static constexpr int COMMA = 33;
+	static constexpr int STRING = 34;	//a string literal, word holds its contents without quotes
+	static constexpr int LOAD = 35;
+	static constexpr int STORE = 36;
+	static constexpr int PARALLEL = 37;
+	static constexpr int FOR = 38;
+	static constexpr int RETURN = 39;
+
 	// si rende id2word non constexpr, in questo modo può essere indicizzata anche con indici non costanti 
 	static const char* id2word[];
 	
 	//keywords_id contiene gli id numerici dei token keyword 
 	static const int keywordsId[];
 
-	static const int keywordsIdSize = 10;
+	static const int keywordsIdSize = 15;
 
 	Token(int t, const char* w) : tag{ t }, word{ w } { }
 	Token(int t, std::string w) : tag{ t }, word{ w } { }
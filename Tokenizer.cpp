@@ -21,7 +21,7 @@ bool Tokenizer::isKeyword(std::string word, int& token_id)
 
 
 
-void Tokenizer::tokenizeInputFile(std::ifstream& inputFile,
+void Tokenizer::tokenizeInputFile(std::istream& inputFile,
 	std::vector<Token>& inputTokens) {
 
 	char ch;
@@ -128,6 +128,23 @@ void Tokenizer::tokenizeInputFile(std::ifstream& inputFile,
 			inputTokens.push_back(Token{ Token::END_STMT, Token::id2word[Token::END_STMT] });
 		}
 
+		else if (ch == ',') {
+			inputTokens.push_back(Token{ Token::COMMA, Token::id2word[Token::COMMA] });
+		}
+
+		//string literal, used for file names: it has no escapes and can't span lines
+		else if (ch == '"') {
+			std::string contents;
+			ch = inputFile.get();
+			while (ch != '"') {
+				if (inputFile.eof() || ch == '\n')
+					throw LexicalError("Errore lessicale: stringa non terminata");
+				contents += ch;
+				ch = inputFile.get();
+			}
+			inputTokens.push_back(Token{ Token::STRING, contents });
+		}
+
 		//tokenizing of either identifier or keyword 
 		else if (std::isalpha(ch)){
 
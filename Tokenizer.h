@@ -2,7 +2,7 @@
 #define TOKENIZER_H
 
 #include <vector>
-#include <fstream>
+#include <istream>
 
 #include "Token.h"
 
@@ -14,7 +14,7 @@ public:
 	Tokenizer(Token const&) = delete;
 	Token& operator=(Token const&) = delete;
 
-	std::vector<Token> operator()(std::ifstream& inputFile) {
+	std::vector<Token> operator()(std::istream& inputFile) {
 		std::vector<Token> inputTokens;
 		tokenizeInputFile(inputFile, inputTokens);
 		return inputTokens;
@@ -24,7 +24,7 @@ private:
 	//this function is used to differentiate between keywords and simple identifiers
     bool isKeyword(std::string stream,  int& token_id);
 
-	void tokenizeInputFile(std::ifstream& inputFile, std::vector<Token>& inputTokens);
+	void tokenizeInputFile(std::istream& inputFile, std::vector<Token>& inputTokens);
 
 };
 
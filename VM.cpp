@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <cstring>
+
+#include "VM.h"
+#include "Exceptions.h"
+#include "OutputSink.h"
+#include "LoopParallelizer.h"
+#include "TaskGraph.h"
+
+VM::VM(const BytecodeProgram& p) : program{p}, registers(p.getNumRegisters(), 0), arrays(p.getArrays().size())
+{
+    int largest = 0;
+    for(auto& function : p.getFunctions())
+        largest = std::max(largest, function.numRegisters);
+    if(largest > 0)
+        frames.reset(new int32_t[static_cast<size_t>(Function::MAX_CALL_DEPTH) * largest]);
+}
+
+void VM::thread(const void* const* labels)
+{
+    const std::vector<int32_t>& code = program.getCode();
+    threaded.resize(code.size());
+    size_t pc = 0;
+    while(pc < code.size())
+    {
+        OpCode op = static_cast<OpCode>(code[pc]);
+        if(labels)
+            threaded[pc].label = labels[op];
+        else
+            threaded[pc].operand = op;
+        int n = BytecodeProgram::numOperands(op);
+        for(int k = 1; k <= n; k++)
+            threaded[pc + k].operand = code[pc + k];
+        pc += 1 + n;
+    }
+}
+
+bool VM::runParallel(int loop, int32_t* r, int32_t bound)
+{
+    const ParallelLoop& parallel = program.getParallelLoops()[loop];
+    return runParallelLoop(parallel, r, registers.size(), bound,
+                           [this, &parallel](int32_t* chunk) {execute(parallel.entry, chunk);});
+}
+
+bool VM::runTasks(int graph, int32_t* r)
+{
+    const TaskGraph& tasks = program.getTaskGraphs()[graph];
+    return runTaskGraph(tasks, r, registers.size(),
+                        [this, &tasks](int task, int32_t* copy) {execute(tasks.tasks[task].entry, copy);});
+}
+
+void VM::outOfBounds(int array)
+{
+    throw EvaluationError("Out of bounds error on " + program.getArrays()[array].name + " array");
+}
+
+#define R(k) r[pc[k].operand]
+#define IMM(k) pc[k].operand
+#define JUMP(k) pc = code + pc[k].operand; DISPATCH()
+
+#ifdef VM_COMPUTED_GOTO
+#define CASE(op) L_##op:
+#define DISPATCH() goto *pc->label
+#else
+#define CASE(op) case op:
+#define DISPATCH() continue
+#endif
+
+#define NEXT(n) pc += (n); DISPATCH()
+
+#define BINARY(op, expr) CASE(op) R(1) = (expr); NEXT(4);
+#define BRANCH(op, cond) CASE(op) if(cond) {JUMP(3);} NEXT(4);
+
+void VM::run()
+{
+    execute(0, registers.data());
+}
+
+void VM::execute(int start, int32_t* r)
+{
+#ifdef VM_COMPUTED_GOTO
+    //same order of OpCode
+    static const void* const labels[NUM_OPCODES] = {
+        &&L_OP_HALT, &&L_OP_LOADI, &&L_OP_MOV,
+        &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV,
+        &&L_OP_ADDI, &&L_OP_MULI,
+        &&L_OP_NEG, &&L_OP_NOT,
+        &&L_OP_EQ, &&L_OP_NE, &&L_OP_LT, &&L_OP_LE, &&L_OP_GT, &&L_OP_GE,
+        &&L_OP_JMP,
+        &&L_OP_JZ, &&L_OP_JNZ,
+        &&L_OP_BEQ, &&L_OP_BNE, &&L_OP_BLT, &&L_OP_BLE, &&L_OP_BGT, &&L_OP_BGE,
+        &&L_OP_BEQI, &&L_OP_BNEI, &&L_OP_BLTI, &&L_OP_BLEI, &&L_OP_BGTI, &&L_OP_BGEI,
+        &&L_OP_DECLA, &&L_OP_ALOAD, &&L_OP_ASTORE, &&L_OP_INDEX,
+        &&L_OP_PRINTI, &&L_OP_PRINTB,
+        &&L_OP_PARLOOP, &&L_OP_TASKS,
+        &&L_OP_CALL, &&L_OP_RET, &&L_OP_TAILCALL, &&L_OP_GLOAD, &&L_OP_GSTORE, &&L_OP_NORET
+    };
+    if(threaded.empty())
+        thread(labels);
+#else
+    if(threaded.empty())
+        thread(nullptr);
+#endif
+
+    const Slot* code = threaded.data();
+    const Slot* pc = code + start;
+    OutputSink& out = OutputSink::current();
+
+    //the registers of the program, and the first free register of the frames
+    int32_t* const g = r;
+    int32_t* top = frames.get();
+    //for every running call, its instruction and the registers of its caller
+    struct Caller {
+        const Slot* pc;
+        int32_t* r;
+    };
+    std::vector<Caller> calls;
+    const std::vector<FunctionInfo>& functions = program.getFunctions();
+
+#ifdef VM_COMPUTED_GOTO
+    DISPATCH();
+#else
+    for(;;) switch(pc->operand) {
+#endif
+
+    CASE(OP_HALT)
+        return;
+
+    CASE(OP_LOADI)
+        R(1) = IMM(2);
+        NEXT(3);
+
+    CASE(OP_MOV)
+        R(1) = R(2);
+        NEXT(3);
+
+    BINARY(OP_ADD, wrapAdd(R(2), R(3)))
+    BINARY(OP_SUB, wrapSub(R(2), R(3)))
+    BINARY(OP_MUL, wrapMul(R(2), R(3)))
+    BINARY(OP_ADDI, wrapAdd(R(2), IMM(3)))
+    BINARY(OP_MULI, wrapMul(R(2), IMM(3)))
+
+    CASE(OP_DIV)
+        if(R(3) == 0)
+            throw EvaluationError("Division by 0");
+        R(1) = R(2) / R(3);
+        NEXT(4);
+
+    CASE(OP_NEG)
+        R(1) = wrapSub(0, R(2));
+        NEXT(3);
+
+    CASE(OP_NOT)
+        R(1) = !R(2);
+        NEXT(3);
+
+    BINARY(OP_EQ, R(2) == R(3))
+    BINARY(OP_NE, R(2) != R(3))
+    BINARY(OP_LT, R(2) < R(3))
+    BINARY(OP_LE, R(2) <= R(3))
+    BINARY(OP_GT, R(2) > R(3))
+    BINARY(OP_GE, R(2) >= R(3))
+
+    CASE(OP_JMP)
+        JUMP(1);
+
+    CASE(OP_JZ)
+        if(!R(1)) {JUMP(2);}
+        NEXT(3);
+
+    CASE(OP_JNZ)
+        if(R(1)) {JUMP(2);}
+        NEXT(3);
+
+    BRANCH(OP_BEQ, R(1) == R(2))
+    BRANCH(OP_BNE, R(1) != R(2))
+    BRANCH(OP_BLT, R(1) < R(2))
+    BRANCH(OP_BLE, R(1) <= R(2))
+    BRANCH(OP_BGT, R(1) > R(2))
+    BRANCH(OP_BGE, R(1) >= R(2))
+    BRANCH(OP_BEQI, R(1) == IMM(2))
+    BRANCH(OP_BNEI, R(1) != IMM(2))
+    BRANCH(OP_BLTI, R(1) < IMM(2))
+    BRANCH(OP_BLEI, R(1) <= IMM(2))
+    BRANCH(OP_BGTI, R(1) > IMM(2))
+    BRANCH(OP_BGEI, R(1) >= IMM(2))
+
+    CASE(OP_DECLA)
+        arrays[IMM(1)].declare(program.getArrays()[IMM(1)].size);
+        NEXT(2);
+
+    CASE(OP_ALOAD)
+    {
+        RuntimeArray& array = arrays[IMM(2)];
+        uint32_t index = R(3);
+        if(index >= array.cells.size())
+            outOfBounds(IMM(2));
+        if(!array.initialized[index])
+            throw EvaluationError("Trying to retrieve a cell from an array which has not been declared");
+        R(1) = array.cells[index];
+        NEXT(4);
+    }
+
+    CASE(OP_ASTORE)
+    {
+        RuntimeArray& array = arrays[IMM(1)];
+        uint32_t index = R(2);
+        if(index >= array.cells.size())
+            outOfBounds(IMM(1));
+        array.cells[index] = R(3);
+        array.initialized[index] = 1;
+        NEXT(4);
+    }
+
+    //both subscripts are checked with a single branch, negative ones are large unsigned
+    CASE(OP_INDEX)
+    {
+        uint32_t row = R(2);
+        uint32_t column = R(3);
+        if((row >= static_cast<uint32_t>(IMM(4))) | (column >= static_cast<uint32_t>(IMM(5))))
+            outOfBounds(IMM(6));
+        R(1) = row * IMM(5) + column;
+        NEXT(7);
+    }
+
+    CASE(OP_PRINTI)
+        out.printInt(R(1));
+        NEXT(2);
+
+    CASE(OP_PRINTB)
+        out.printBool(R(1) != 0);
+        NEXT(2);
+
+    CASE(OP_PARLOOP)
+        if(runParallel(IMM(1), r, R(2))) {JUMP(3);}
+        NEXT(4);
+
+    CASE(OP_TASKS)
+        if(runTasks(IMM(1), r)) {JUMP(2);}
+        NEXT(3);
+
+    //the arguments become the first locals of the new frame, the other locals start at 0
+    CASE(OP_CALL)
+    {
+        const FunctionInfo& function = functions[IMM(2)];
+        if(static_cast<int>(calls.size()) == Function::MAX_CALL_DEPTH)
+            throw EvaluationError("Stack overflow calling " + function.name);
+        std::copy(&R(3), &R(3) + function.numParams, top);
+        std::fill(top + function.numParams, top + function.numLocals, 0);
+        calls.push_back({pc, r});
+        r = top;
+        top += function.numRegisters;
+        pc = code + function.entry;
+        DISPATCH();
+    }
+
+    //the value goes to the destination of the call
+    CASE(OP_RET)
+    {
+        int32_t value = R(1);
+        top = r;
+        pc = calls.back().pc;
+        r = calls.back().r;
+        calls.pop_back();
+        R(1) = value;
+        NEXT(4);
+    }
+
+    //the callee takes the frame of the caller, and returns to its caller
+    CASE(OP_TAILCALL)
+    {
+        const FunctionInfo& function = functions[IMM(1)];
+        std::memmove(r, &R(2), function.numParams * sizeof(int32_t));
+        std::fill(r + function.numParams, r + function.numLocals, 0);
+        top = r + function.numRegisters;
+        pc = code + function.entry;
+        DISPATCH();
+    }
+
+    CASE(OP_GLOAD)
+        R(1) = g[IMM(2)];
+        NEXT(3);
+
+    CASE(OP_GSTORE)
+        g[IMM(1)] = R(2);
+        NEXT(3);
+
+    CASE(OP_NORET)
+        throw EvaluationError("Function " + functions[IMM(1)].name + " ended without returning a value");
+
+#ifndef VM_COMPUTED_GOTO
+    default:
+        throw EvaluationError("Invalid bytecode");
+    }
+#endif
+}
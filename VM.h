@@ -0,0 +1,64 @@
+#ifndef VM_H
+#define VM_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Bytecode.h"
+#include "Runtime.h"
+
+//with GCC and Clang the VM dispatches with computed gotos (labels as values),
+//elsewhere it falls back to a switch
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO
+#endif
+
+//Executes a BytecodeProgram. Runtime errors are reported with the same
+//EvaluationError messages of the EvaluationVisitor. Parallel loops run on the shared ThreadPool.
+//The frames of the calls are stacked one after the other in a single block of registers, which
+//has room for Function::MAX_CALL_DEPTH of the largest one
+class VM {
+public:
+    VM(const BytecodeProgram& p);
+    ~VM() = default;
+    VM(VM const&) = delete;
+    VM& operator=(VM const&) = delete;
+
+    void run();
+    //runs the code from start with the state set through setRegister and getArray, used to go on
+    //with an instance of a BatchVM
+    void resume(int start) {execute(start, registers.data());}
+
+    //state of the program, read and written between runs
+    int32_t getRegister(int r) const {return registers[r];}
+    void setRegister(int r, int32_t value) {registers[r] = value;}
+    RuntimeArray& getArray(int array) {return arrays[array];}
+
+private:
+    //a slot of the threaded code: opcodes are replaced by the address of their handler
+    union Slot {
+        const void* label;
+        int32_t operand;
+    };
+
+    const BytecodeProgram& program;
+    std::vector<Slot> threaded;
+    std::vector<int32_t> registers;
+    std::vector<RuntimeArray> arrays;
+    //the frames of the calls, left uninitialized: a call zeroes its locals, and writes its temporaries
+    //before reading them. Only the program calls functions, never its parallel loops and tasks
+    std::unique_ptr<int32_t[]> frames;
+
+    void thread(const void* const* labels);
+
+    //runs the code from start on the registers r. The chunks of a parallel loop, and the tasks of a
+    //task graph, run at the same time on the same VM, each one with its own registers
+    void execute(int start, int32_t* r);
+    bool runParallel(int loop, int32_t* r, int32_t bound);
+    bool runTasks(int graph, int32_t* r);
+
+    [[noreturn]] void outOfBounds(int array);
+};
+
+#endif
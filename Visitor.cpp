@@ -0,0 +1,8 @@
+#include "Visitor.h"
+
+Value* EvaluationVisitor::cacheSlot(Id* id, ExpressionCache& cache)
+{
+    cache.slot = env.getIdSlot(id->getName());
+    cache.specialization = Expression::CACHED_VARIABLE;
+    return cache.slot;
+}
@@ -8,6 +8,7 @@
 #include "Exceptions.h"
 #include "ExpressionManager.h"
 #include "Environment.h"
+#include "OutputSink.h"
 
 class Environment;
 
@@ -36,6 +37,7 @@ public:
     virtual Constant* visitBinOp(Arithm* arithNode) = 0;
     virtual Constant* visitUnaryOp(Unary* unaryNode) = 0;
     virtual Constant* visitAccess(Access* accessNode) = 0;
+    virtual Constant* visitIndex(Index* indexNode) = 0;
     virtual Constant* visitIf(If* ifNode) = 0;
     virtual Constant* visitElse(Else* elseNode) = 0;
     virtual Constant* visitWhile(While* whileNode) = 0;
@@ -44,306 +46,652 @@ public:
     virtual Constant* visitSetElem(SetElem* setElemNode) = 0;
     virtual Constant* visitBreak(Break* breakNode) = 0;
     virtual Constant* visitPrint(Print* printNode) = 0;
+    virtual Constant* visitLoad(Load* loadNode) = 0;
+    virtual Constant* visitStore(Store* storeNode) = 0;
+    virtual Constant* visitParallelFor(ParallelFor* parallelForNode) = 0;
     virtual Constant* visitNot(Not* notNode) = 0;
     virtual Constant* visitAnd(And* andNode) = 0;
     virtual Constant* visitOr(Or* andNode) = 0;
     virtual Constant* visitRel(Rel* relNode) = 0;
+    virtual Constant* visitFunction(Function* functionNode) = 0;
+    virtual Constant* visitCall(Call* callNode) = 0;
+    virtual Constant* visitReturn(Return* returnNode) = 0;
 
+    //a fused node is visited as the node it replaces, unless a visitor cares about the difference
+    virtual Constant* visitFused(Fused* fusedNode) {return fusedNode->getOriginal()->accept(this);}
 
 
+
+};
+
+//Hook of the EvaluationVisitor on its loops, used by the tiered execution (see Tiering.h).
+//When one of the calls returns true, the rest of the loop has been run somewhere else
+class LoopObserver {
+public:
+    virtual ~LoopObserver() = default;
+    //a loop is starting
+    virtual bool enterLoop(Stmt* loop) = 0;
+    //a loop is jumping back: for a While before evaluating its condition again,
+    //for a Do after its condition has been found true
+    virtual bool backEdge(Stmt* loop) = 0;
 };
 
-// Visitor concreto per la valutazione delle espressioni
+//What an expression has observed in the executions of a run (see Expression::Specialization)
+struct ExpressionCache {
+    Expression::Specialization specialization = Expression::UNINITIALIZED;
+    int index = 0;                  //CONSTANT_INDEX Access: its index, already checked
+    union {
+        Value* slot = nullptr;      //CACHED_VARIABLE Id: the slot of its variable
+        arrayStruct* array;         //CACHED_ARRAY and CONSTANT_INDEX Access: its array
+    };
+};
+
+// Visitor concreto per la valutazione delle espressioni.
+// The evaluation itself doesn't go through accept: execute and evaluate dispatch on the kind
+// of the node with a switch. The visit methods are kept so that the evaluator can still be
+// started with program->accept(v), like every other Visitor.
+// The tree is only read: what a run keeps between the executions of a node is in the caches of
+// its EvaluationVisitor, so any number of runs, each with its own Environment, can share a Program
 class EvaluationVisitor : public Visitor {
 public:
-    EvaluationVisitor(Environment& e) : env {e}, 
-    boolConst{new boolConstant()}, intConst{new intConstant()}, breakFlag{false}{
+    EvaluationVisitor(Environment& e) : env {e}, breakFlag{false}, loopObserver{nullptr}{
     }
     
-    ~EvaluationVisitor(){
-        delete intConst;
-        delete boolConst;
-    }
+    ~EvaluationVisitor() = default;
 
     EvaluationVisitor(EvaluationVisitor const&) = delete;
     EvaluationVisitor& operator=(EvaluationVisitor const&) = delete;
 
-    Constant* visitProgram(Program* programNode) override {
-        programNode->getBlock()->accept(this);
-        return nullptr;
+    //evaluates an expression exactly once and returns its value
+    Value evaluate(Expression* exp) {
+        switch(exp->getKind())
+        {
+            case Node::INT_CONSTANT:
+                return Value::fromInt(static_cast<intConstant*>(exp)->getInt());
+            case Node::BOOL_CONSTANT:
+                return Value::fromBool(static_cast<boolConstant*>(exp)->getBool());
+            case Node::ID:
+                return *variableSlot(static_cast<Id*>(exp));
+            case Node::ACCESS:
+                return evaluateAccess(static_cast<Access*>(exp));
+            case Node::INDEX:
+                return evaluateIndex(static_cast<Index*>(exp));
+            case Node::ARITHM:
+                return evaluateBinOp(static_cast<Arithm*>(exp));
+            case Node::UNARY:
+                return evaluateUnaryOp(static_cast<Unary*>(exp));
+            case Node::REL:
+                return evaluateRel(static_cast<Rel*>(exp));
+            case Node::NOT:
+                return Value::fromBool(!evaluate(static_cast<Not*>(exp)->getExp()).getBool());
+            case Node::AND:
+                return evaluateAnd(static_cast<And*>(exp));
+            case Node::OR:
+                return evaluateOr(static_cast<Or*>(exp));
+            case Node::FUSED:
+                return static_cast<Fused*>(exp)->evaluate(*this);
+            case Node::CALL:
+                return evaluateCall(static_cast<Call*>(exp));
+            default:
+                throw EvaluationError("Invalid expression");
+        }
     }
 
-    Constant* visitBlock(Block* block) override {
-        if(block->getDecls()) 
-            block->getDecls()->accept(this);
-        if(block->getSeq()) 
-            block->getSeq()->accept(this);
-        return nullptr;
+    void execute(Stmt* stmt) {
+        switch(stmt->getKind())
+        {
+            case Node::BLOCK:
+                executeBlock(static_cast<Block*>(stmt));
+                break;
+            case Node::SET:
+                executeSet(static_cast<Set*>(stmt));
+                break;
+            case Node::SET_ELEM:
+                executeSetElem(static_cast<SetElem*>(stmt));
+                break;
+            case Node::IF:
+                executeIf(static_cast<If*>(stmt));
+                break;
+            case Node::ELSE:
+                executeElse(static_cast<Else*>(stmt));
+                break;
+            case Node::WHILE:
+                executeWhile(static_cast<While*>(stmt));
+                break;
+            case Node::DO:
+                executeDo(static_cast<Do*>(stmt));
+                break;
+            case Node::PARALLEL_FOR:
+                executeParallelFor(static_cast<ParallelFor*>(stmt));
+                break;
+            case Node::PRINT:
+                executePrint(static_cast<Print*>(stmt));
+                break;
+            case Node::LOAD:
+                env.loadArray(static_cast<Load*>(stmt)->getId()->getName(), static_cast<Load*>(stmt)->getPath());
+                break;
+            case Node::STORE:
+                env.storeArray(static_cast<Store*>(stmt)->getId()->getName(), static_cast<Store*>(stmt)->getPath());
+                break;
+            case Node::BREAK:
+                breakFlag = true;
+                break;
+            case Node::RETURN:
+                executeReturn(static_cast<Return*>(stmt));
+                break;
+            default:
+                throw EvaluationError("Invalid statement");
+        }
     }
 
-     Constant* visitType(Type* type) {return nullptr;}
-     Constant* visitVectorType(vectorType* vectorTypeNode) {return nullptr;}
-
-
-    Constant* visitDecls(Decls* decls) override {
-        //to ensure that declarations are done in order, it's important to visit the decl object first
-        decls->getDecl()->accept(this);
-        if(decls->getDecls())
-            decls->getDecls()->accept(this);
-        return nullptr;
+    void executeBlock(Block* block) {
+        //to ensure that declarations are done in order, the list is walked from its head
+        for(Decls* decls = block->getDecls(); decls; decls = decls->getDecls())
+            executeDecl(decls->getDecl());
+        executeSeq(block->getSeq());
     }
 
-    Constant* visitDecl(Decl* decl) override { 
-        //if downcasting succeeds, (vType != nullptr) = 1, so if statement is executed
-        //if it doesnt succeed, vType = nullptr = 0, so else statement is executed  
-        if(auto vType = dynamic_cast<vectorType*>(decl->getType()))
-            env.declareArrayVar(decl->getId()->getName(), vType);
+    void executeDecl(Decl* decl) {
+        //the locals of a function are in its frame from the start of the call
+        if(decl->getId()->getLocal() >= 0)
+            return;
+        Type* type = decl->getType();
+        if(type->getKind() == Node::VECTOR_TYPE)
+            env.declareArrayVar(decl->getId()->getName(), static_cast<vectorType*>(type));
         else
-            env.declareVar(decl->getId()->getName(),decl->getType());
-        return nullptr;
+            env.declareVar(decl->getId()->getName(), type);
     }
 
-    Constant* visitSeq(Seq* seqNode) override {
+    void executeSeq(Seq* seq) {
         //statements that are after a break, are not to be executed until we encounter a while/do while 
-        if(breakFlag) return nullptr;
+        for(; seq && !breakFlag; seq = seq->getSeq())
+            execute(seq->getStmt());
+    }
 
-        seqNode->getStmt()->accept(this);
+    //Visitor interface, every visit is forwarded to execute/evaluate
 
-        if(seqNode->getSeq())
-            seqNode->getSeq()->accept(this);
+    Constant* visitProgram(Program* programNode) override {
+        caches.assign(programNode->getNumCaches(), ExpressionCache{});
+        executeBlock(programNode->getBlock());
+        return nullptr;
+    }
 
+    Constant* visitBlock(Block* block) override {executeBlock(block); return nullptr;}
+    Constant* visitType(Type* type) override {return nullptr;}
+    Constant* visitVectorType(vectorType* vectorTypeNode) override {return nullptr;}
+
+    Constant* visitDecls(Decls* decls) override {
+        for(; decls; decls = decls->getDecls())
+            executeDecl(decls->getDecl());
         return nullptr;
-    }    
+    }
 
+    Constant* visitDecl(Decl* decl) override {executeDecl(decl); return nullptr;}
+    Constant* visitSeq(Seq* seqNode) override {executeSeq(seqNode); return nullptr;}
+    Constant* visitPrint(Print* printNode) override {execute(printNode); return nullptr;}
+    Constant* visitLoad(Load* loadNode) override {execute(loadNode); return nullptr;}
+    Constant* visitStore(Store* storeNode) override {execute(storeNode); return nullptr;}
+    Constant* visitIf(If* ifNode) override {execute(ifNode); return nullptr;}
+    Constant* visitElse(Else* elseNode) override {execute(elseNode); return nullptr;}
+    Constant* visitWhile(While* whileNode) override {execute(whileNode); return nullptr;}
+    Constant* visitDo(Do* doNode) override {execute(doNode); return nullptr;}
+    Constant* visitParallelFor(ParallelFor* parallelForNode) override {execute(parallelForNode); return nullptr;}
+    Constant* visitSet(Set* setNode) override {execute(setNode); return nullptr;}
+    Constant* visitSetElem(SetElem* setElemNode) override {execute(setElemNode); return nullptr;}
+    Constant* visitBreak(Break* breakNode) override {execute(breakNode); return nullptr;}
+    Constant* visitReturn(Return* returnNode) override {execute(returnNode); return nullptr;}
+    //a function runs only when it is called
+    Constant* visitFunction(Function* functionNode) override {return nullptr;}
+
+    //the value of an expression visited through accept is stored in lastValue
+    Constant* visitId(Id* idNode) override {lastValue = evaluate(idNode); return nullptr;}
+    Constant* visitNot(Not* notNode) override {lastValue = evaluate(notNode); return nullptr;}
+    Constant* visitAnd(And* andNode) override {lastValue = evaluate(andNode); return nullptr;}
+    Constant* visitOr(Or* orNode) override {lastValue = evaluate(orNode); return nullptr;}
+    Constant* visitRel(Rel* relNode) override {lastValue = evaluate(relNode); return nullptr;}
+    Constant* visitBinOp(Arithm* arithmNode) override {lastValue = evaluate(arithmNode); return nullptr;}
+    Constant* visitUnaryOp(Unary* unaryNode) override {lastValue = evaluate(unaryNode); return nullptr;}
+    Constant* visitIntConstant(intConstant* numNode) override {lastValue = evaluate(numNode); return nullptr;}
+    Constant* visitBoolConstant(boolConstant* numNode) override {lastValue = evaluate(numNode); return nullptr;}
+    Constant* visitAccess(Access* accessNode) override {lastValue = evaluate(accessNode); return nullptr;}
+    Constant* visitIndex(Index* indexNode) override {lastValue = evaluate(indexNode); return nullptr;}
+    Constant* visitFused(Fused* fusedNode) override {lastValue = evaluate(fusedNode); return nullptr;}
+    Constant* visitCall(Call* callNode) override {lastValue = evaluate(callNode); return nullptr;}
+
+    Value getLastValue() {return lastValue;}
+
+    void setLoopObserver(LoopObserver* observer) {loopObserver = observer;}
+
+    //value of a variable, used by the fused nodes to load their operands
+    Value readVariable(Id* id) {return *variableSlot(id);}
 
-     Constant* visitPrint(Print* printNode) {
-        Constant* expr = printNode->getExp()->accept(this); 
-        switch(expr->getTypeCode())
+private:
+    void executePrint(Print* printNode) {
+        Value value = evaluate(printNode->getExp()); 
+        switch(value.getTypeCode())
         {
             case Type::INT:
-                std::cout<<expr->getInt()<<std::endl;
+                OutputSink::current().printInt(value.getInt());
                 break;
             case Type::BOOL:
-                std::cout<<expr->getBool()<<std::endl;
+                OutputSink::current().printBool(value.getBool());
                 break;
             default:
                 throw EvaluationError("Invalid expression type during print statement");
                 break;
         }
-        return nullptr;
-    };
-
-    Constant* visitIf(If* ifNode) override {
-
-        if (ifNode->getCondition()->accept(this)->getBool())
-            ifNode->getStmt()->accept(this);
-        return nullptr;
     }
 
+    void executeIf(If* ifNode) {
+        if (evaluate(ifNode->getCondition()).getBool())
+            execute(ifNode->getStmt());
+    }
 
-    Constant* visitElse(Else* elseNode) override {
-
-        if (elseNode->getCondition()->accept(this)->getBool())
-            elseNode->getifTrueStmt()->accept(this);
+    void executeElse(Else* elseNode) {
+        if (evaluate(elseNode->getCondition()).getBool())
+            execute(elseNode->getifTrueStmt());
         else
-            elseNode->getifFalseStmt()->accept(this);
-        return nullptr;
+            execute(elseNode->getifFalseStmt());
     }
 
-    Constant* visitWhile(While* whileNode) override {
-        while(whileNode->getCondition()->accept(this)->getBool())
+    void executeWhile(While* whileNode) {
+        if(loopObserver && loopObserver->enterLoop(whileNode))
+            return;
+        while(evaluate(whileNode->getCondition()).getBool())
         {
-            whileNode->getStmt()->accept(this);
+            execute(whileNode->getStmt());
+            //a return goes on leaving the blocks of its function
             if(breakFlag) 
             {
-                breakFlag = false;
+                breakFlag = returnFlag;
                 break;
             }
+            if(loopObserver && loopObserver->backEdge(whileNode))
+                return;
         }
-        return nullptr;
     }
 
-    Constant* visitDo(Do* doNode) override {
-        do
-        {   //we exit the loop and deactivate the breakFlag
+    void executeDo(Do* doNode) {
+        if(loopObserver && loopObserver->enterLoop(doNode))
+            return;
+        for(;;)
+        {
+            execute(doNode->getStmt());
+            //we exit the loop and deactivate the breakFlag, without evaluating the condition again
             if(breakFlag)
             {
-                breakFlag = false;
+                breakFlag = returnFlag;
                 break;
             }
-            doNode->getStmt()->accept(this);
-        } while(doNode->getCondition()->accept(this)->getBool());
-        return nullptr;
+            if(!evaluate(doNode->getCondition()).getBool())
+                break;
+            if(loopObserver && loopObserver->backEdge(doNode))
+                return;
+        }
     }
 
-    Constant* visitSet(Set* setNode) override {
-        std::string idName =  setNode->getId()->getName();
-        Constant* value = setNode->getExp()->accept(this);
-
-        if(env.getIdValue(idName)->getTypeCode() != value->getTypeCode())
-            throw EvaluationError("Trying to assign an expression of type different to that of identifier");
+    //the iterations run in order, which is one of the orders they may run in (see ParallelFor).
+    //The && and || reductions start every iteration at true (false), and are combined at its end
+    void executeParallelFor(ParallelFor* loop) {
+        //the private variables exist from the start of the loop, so that a compiled loop can share them
+        std::vector<Decl*> privates = loop->getPrivates();
+        for(Decl* decl : privates)
+            executeDecl(decl);
+        if(loopObserver && loopObserver->enterLoop(loop))
+            return;
+
+        Value first = evaluate(loop->getFirst());
+        Value last = evaluate(loop->getLast());
+        Value* index = variableSlot(loop->getId());
+        if(first.getTypeCode() != Type::INT || last.getTypeCode() != Type::INT || index->getTypeCode() != Type::INT)
+            throw EvaluationError("The index and the bounds of a parallel for must be int");
+
+        std::vector<std::pair<Value*, ReductionOp>> logical;
+        std::vector<bool> totals;
+        for(auto& reduction : loop->getReductions())
+        {
+            Value* slot = variableSlot(reduction.var);
+            bool isLogical = reduction.op == REDUCE_AND || reduction.op == REDUCE_OR;
+            if(slot->getTypeCode() != (isLogical ? Type::BOOL : Type::INT))
+                throw EvaluationError("Reduction " + reduction.var->getName() + " has a type different to that of its operation");
+            if(isLogical)
+            {
+                logical.push_back({slot, reduction.op});
+                totals.push_back(slot->getBool());
+            }
+        }
 
-        env.assignConstant(idName, value);
-        return nullptr;
+        for(int32_t i = first.getInt(); i < last.getInt(); i++)
+        {
+            *index = Value::fromInt(i);
+            for(Decl* decl : privates)
+            {
+                *variableSlot(decl->getId()) = decl->getType()->getTypeCode() == Type::INT ? Value::fromInt(0)
+                                                                                         : Value::fromBool(false);
+            }
+            for(auto& reduction : logical)
+                *reduction.first = Value::fromBool(reduction.second == REDUCE_AND);
+            execute(loop->getStmt());
+            for(size_t k = 0; k < logical.size(); k++)
+            {
+                bool value = logical[k].first->getBool();
+                totals[k] = logical[k].second == REDUCE_AND ? totals[k] && value : totals[k] || value;
+            }
+        }
+        for(size_t k = 0; k < logical.size(); k++)
+            *logical[k].first = Value::fromBool(totals[k]);
+        *index = first.getInt() < last.getInt() ? last : first;
     }
 
-    Constant* visitSetElem(SetElem* setElemNode) override {
-        std::string idName =  setElemNode->getId()->getName();
-        
-        Constant* value = setElemNode->getExp()->accept(this);
-        if(env.getArray(idName)->typeCode != value->getTypeCode())
-            throw EvaluationError("Trying to assign an expression of type different to that of identifier");
-     
-        env.assignConstantToArray(idName,value,setElemNode->getIndex()->accept(this)->getInt());
-        return nullptr;
+    //the arguments are pushed on the stack, where they become the first locals of the frame of the call.
+    //A tail call of the body reuses the frame, so it runs in the same loop instead of recursing
+    Value evaluateCall(Call* call) {
+        CallScope scope(*this);
+        size_t base = scope.base;
+        for(Expression* arg : call->getArgs())
+            stack.push_back(evaluate(arg));
+
+        Function* function = call->getFunction();
+        if(depth == Function::MAX_CALL_DEPTH)
+            throw EvaluationError("Stack overflow calling " + function->getName());
+        //the loops of a function are not tiered
+        loopObserver = nullptr;
+        depth++;
+        for(;;)
+        {
+            const std::vector<Decl*>& locals = function->getLocals();
+            int numParams = function->getNumParams();
+            for(int k = 0; k < numParams; k++)
+            {
+                if(stack[base + k].getTypeCode() != locals[k]->getType()->getTypeCode())
+                    throw EvaluationError("Argument " + locals[k]->getId()->getName() + " of " + function->getName()
+                                          + " has the wrong type");
+            }
+            stack.resize(base + locals.size());
+            for(size_t k = numParams; k < locals.size(); k++)
+                stack[base + k] = locals[k]->getType()->getTypeCode() == Type::INT ? Value::fromInt(0) : Value::fromBool(false);
+            frame = base;
+            current = function;
+
+            executeBlock(function->getBody());
+            if(!returnFlag)
+                throw EvaluationError("Function " + function->getName() + " ended without returning a value");
+            breakFlag = returnFlag = false;
+            if(!tailCall)
+                break;
+            //the arguments of the tail call are at the top of the stack
+            function = tailCall->getFunction();
+            tailCall = nullptr;
+            size_t args = stack.size() - function->getNumParams();
+            std::move(stack.begin() + args, stack.end(), stack.begin() + base);
+            stack.resize(base + function->getNumParams());
+        }
+        return returnValue;
     }
 
-     Constant* visitBreak(Break* breakNode) {
-        breakFlag = true;
-        return nullptr;
+    void executeReturn(Return* returnNode) {
+        Call* call = returnNode->getTailCall(current);
+        if(call)
+        {
+            for(Expression* arg : call->getArgs())
+                stack.push_back(evaluate(arg));
+            tailCall = call;
+        }
+        else
+        {
+            returnValue = evaluate(returnNode->getExp());
+            if(returnValue.getTypeCode() != current->getReturnType())
+                throw EvaluationError("Function " + current->getName() + " returns a value of the wrong type");
+        }
+        breakFlag = returnFlag = true;
     }
 
-     Constant* visitId(Id* idNode) {
-        return env.getIdValue(idNode->getName());
-    }
+    void executeSet(Set* setNode) {
+        Value value = evaluate(setNode->getExp());
+        Value* slot = variableSlot(setNode->getId());
 
+        if(slot->getTypeCode() != value.getTypeCode())
+            throw EvaluationError("Trying to assign an expression of type different to that of identifier");
 
-    Constant* visitNot(Not* notNode) override {
-        return boolConst->set(!notNode->getExp()->accept(this)->getBool());
+        *slot = value;
     }
 
-    Constant* visitAnd(And* andNode) override {
-        return boolConst->set(
-            andNode->getLeftExp()->accept(this)->getBool() && 
-            andNode->getRightExp()->accept(this)->getBool());
+    void executeSetElem(SetElem* setElemNode) {
+        const std::string& idName =  setElemNode->getId()->getName();
+        
+        Value value = evaluate(setElemNode->getExp());
+        if(env.getArray(idName)->typeCode != value.getTypeCode())
+            throw EvaluationError("Trying to assign an expression of type different to that of identifier");
+     
+        env.assignConstantToArray(idName, value, evaluate(setElemNode->getIndex()).getInt());
     }
 
-    Constant* visitOr(Or* orNode) override {
-        return boolConst->set(
-            orNode->getLeftExp()->accept(this)->getBool() || 
-            orNode->getRightExp()->accept(this)->getBool());
+    //the right operand is evaluated only if needed
+    Value evaluateAnd(And* andNode) {
+        return Value::fromBool(evaluate(andNode->getLeftExp()).getBool() && 
+            evaluate(andNode->getRightExp()).getBool());
     }
 
-    Constant* visitRel(Rel* relNode) override {
-        
+    Value evaluateOr(Or* orNode) {
+        return Value::fromBool(evaluate(orNode->getLeftExp()).getBool() || 
+            evaluate(orNode->getRightExp()).getBool());
+    }
+
+    Value evaluateRel(Rel* relNode) {
+        int left = evaluate(relNode->getLeftExp()).getInt();
+        int right = evaluate(relNode->getRightExp()).getInt();
+
         switch(relNode->getOp())
         {
             case Rel::MORE:
-                return boolConst->set(relNode->getLeftExp()->accept(this)->getInt() > 
-                relNode->getRightExp()->accept(this)->getInt());
-                break;
-
+                return Value::fromBool(left > right);
             case Rel::MORE_EQ:
-                return boolConst->set(relNode->getLeftExp()->accept(this)->getInt() >= 
-                relNode->getRightExp()->accept(this)->getInt());
-                break;
-
+                return Value::fromBool(left >= right);
             case Rel::LESS:
-                return boolConst->set(relNode->getLeftExp()->accept(this)->getInt() <
-                relNode->getRightExp()->accept(this)->getInt());
-                break;
-
+                return Value::fromBool(left < right);
             case Rel::LESS_EQ:
-                return boolConst->set(relNode->getLeftExp()->accept(this)->getInt() <= 
-                relNode->getRightExp()->accept(this)->getInt());
-                break;
-    
+                return Value::fromBool(left <= right);
             default:
                 throw EvaluationError("Invalid relational operator");
         }
     }
 
-    Constant* visitBinOp(Arithm* arithmNode)
+    Value evaluateBinOp(Arithm* arithmNode)
     {
+        Value left = evaluate(arithmNode->getLeftExp());
+        Value right = evaluate(arithmNode->getRightExp());
+
         switch(arithmNode->getOp())
         {
             case Op::ADD:
-                return intConst->set(arithmNode->getLeftExp()->accept(this)->getInt() 
-                + arithmNode->getRightExp()->accept(this)->getInt());
-                break;
+                return Value::fromInt(left.getInt() + right.getInt());
             case Op::SUB:
-                return intConst->set(arithmNode->getLeftExp()->accept(this)->getInt() 
-                - arithmNode->getRightExp()->accept(this)->getInt());
-                break;
+                return Value::fromInt(left.getInt() - right.getInt());
             case Op::MUL:
-                return intConst->set(arithmNode->getLeftExp()->accept(this)->getInt() 
-                * arithmNode->getRightExp()->accept(this)->getInt());
-                break;
+                return Value::fromInt(left.getInt() * right.getInt());
             case Op::DIV:
-                if(arithmNode->getRightExp()->accept(this)->getInt()==0)
+                if(right.getInt()==0)
                    throw EvaluationError("Division by 0");
-                return intConst->set(arithmNode->getLeftExp()->accept(this)->getInt() 
-                / arithmNode->getRightExp()->accept(this)->getInt());
-                break;
-            case Op::EQ:               
-                if(arithmNode->getRightExp()->accept(this)->getTypeCode() == Type::INT)
-                    return boolConst->set(arithmNode->getLeftExp()->accept(this)->getInt() 
-                    == arithmNode->getRightExp()->accept(this)->getInt());
-
-                //eq operations between bools are also allowed
-                else if(arithmNode->getRightExp()->accept(this)->getTypeCode() == Type::BOOL) 
-                    return boolConst->set(arithmNode->getLeftExp()->accept(this)->getBool()
-                     == arithmNode->getRightExp()->accept(this)->getBool());
-                break;
-
+                return Value::fromInt(left.getInt() / right.getInt());
+            case Op::EQ:
+                return Value::fromBool(evaluateEquality(arithmNode, left, right));
             case Op::NOT_EQ:
-                if(arithmNode->getRightExp()->accept(this)->getTypeCode() == Type::INT)
-                    return boolConst->set(arithmNode->getLeftExp()->accept(this)->getInt() 
-                    != arithmNode->getRightExp()->accept(this)->getInt());
-                else if(arithmNode->getRightExp()->accept(this)->getTypeCode() == Type::BOOL)
-                    return boolConst->set(arithmNode->getLeftExp()->accept(this)->getBool() 
-                    != arithmNode->getRightExp()->accept(this)->getBool());
-                break;
-            
+                return Value::fromBool(!evaluateEquality(arithmNode, left, right));
             default:
                 throw EvaluationError("Invalid arithmetic operator");
-            
         }
-        return nullptr;
     }
 
-    Constant* visitUnaryOp(Unary* unaryNode)
+    Value evaluateUnaryOp(Unary* unaryNode)
     {   
         switch (unaryNode->getOp())
         {
         case Op::UNARY_MIN:
-            return intConst->set(-unaryNode->getExp()->accept(this)->getInt());
-            break;
-        
+            return Value::fromInt(-evaluate(unaryNode->getExp()).getInt());
         default:
             throw EvaluationError("Invalid unary arithmetic operator");
-            break;
         }
     }
 
-    Constant* visitIntConstant(intConstant* numNode) 
+    //Nodes specialize on what they observe in their first executions (see
+    //Expression::Specialization), and keep checking it with a cheap guard. When a guard fails
+    //the node goes back to the generic path
+
+    //the cache of a node in this run, which starts from visitProgram
+    ExpressionCache& cacheOf(Expression* exp) {return caches[exp->getCacheIndex()];}
+
+    //an Id caches the slot of its variable, which stays valid as long as the Environment
+    Value* variableSlot(Id* id)
     {
-        return numNode;
+        //the locals of a function are in the frame of its running call
+        if(id->getLocal() >= 0)
+            return &stack[frame + id->getLocal()];
+        ExpressionCache& cache = cacheOf(id);
+        if(cache.specialization == Expression::CACHED_VARIABLE)
+            return cache.slot;
+        return cacheSlot(id, cache);
     }
-    
-    Constant* visitBoolConstant(boolConstant* numNode)
+
+    //the lookup is kept apart, so that the fast path above is small enough to be inlined
+    Value* cacheSlot(Id* id, ExpressionCache& cache);
+
+    //an equality becomes an int-only or a bool-only comparison. On a mixed pair of operands it
+    //becomes generic for good: the type of the right operand decides the comparison,
+    //eq operations between bools are also allowed
+    bool evaluateEquality(Arithm* arithmNode, Value left, Value right)
     {
-        return numNode;
-    } 
+        ExpressionCache& cache = cacheOf(arithmNode);
+        switch(cache.specialization)
+        {
+            case Expression::INT_EQUALITY:
+                if(left.getTypeCode() == Type::INT && right.getTypeCode() == Type::INT)
+                    return left.getInt() == right.getInt();
+                cache.specialization = Expression::GENERIC;
+                break;
+            case Expression::BOOL_EQUALITY:
+                if(left.getTypeCode() == Type::BOOL && right.getTypeCode() == Type::BOOL)
+                    return left.getBool() == right.getBool();
+                cache.specialization = Expression::GENERIC;
+                break;
+            case Expression::UNINITIALIZED:
+                if(left.getTypeCode() != right.getTypeCode())
+                    cache.specialization = Expression::GENERIC;
+                else if(right.getTypeCode() == Type::INT)
+                    cache.specialization = Expression::INT_EQUALITY;
+                else
+                    cache.specialization = Expression::BOOL_EQUALITY;
+                break;
+            default:
+                break;
+        }
+        if(right.getTypeCode() == Type::INT)
+            return left.getInt() == right.getInt();
+        return left.getBool() == right.getBool();
+    }
 
-    Constant* visitAccess(Access* accessNode)
+    //an Access caches its array, and with a literal index also the bounds check of the index
+    Value evaluateAccess(Access* accessNode)
     {
-        return env.getArrayValue(accessNode->getId()->getName(), accessNode->getIndex()->accept(this)->getInt());
+        ExpressionCache& cache = cacheOf(accessNode);
+        if(cache.specialization == Expression::CONSTANT_INDEX)
+            return cache.array->getCell(cache.index);
+
+        int index = evaluate(accessNode->getIndex()).getInt();
+        arrayStruct* array;
+        if(cache.specialization == Expression::CACHED_ARRAY)
+            array = cache.array;
+        else
+            array = env.getArray(accessNode->getId()->getName());
+
+        if(index < 0 || index >= array->size)
+            throw EvaluationError("Out of bounds error on " + accessNode->getId()->getName() + " array");
+
+        cache.array = array;
+        if(accessNode->getIndex()->getKind() == Node::INT_CONSTANT)
+        {
+            cache.index = index;
+            cache.specialization = Expression::CONSTANT_INDEX;
+        }
+        else
+            cache.specialization = Expression::CACHED_ARRAY;
+        return array->getCell(index);
     }
 
+    //position of a cell of a multi-dimensional array: the subscripts are evaluated from left to right,
+    //and then checked all together against the dimensions
+    Value evaluateIndex(Index* indexNode)
+    {
+        const std::string& name = indexNode->getId()->getName();
+        const std::vector<int>& dims = env.getArray(name)->dimensions;
+        const std::vector<Expression*>& subscripts = indexNode->getSubscripts();
+        if(subscripts.size() != dims.size())
+            throw EvaluationError("Wrong number of subscripts for " + name + " array");
+
+        //a negative subscript is a large unsigned one, and the offset is meaningless once out of bounds
+        uint32_t offset = 0;
+        bool outOfBounds = false;
+        for(size_t k = 0; k < subscripts.size(); k++)
+        {
+            uint32_t subscript = static_cast<uint32_t>(evaluate(subscripts[k]).getInt());
+            outOfBounds |= subscript >= static_cast<uint32_t>(dims[k]);
+            offset = offset * dims[k] + subscript;
+        }
+        if(outOfBounds)
+            throw EvaluationError("Out of bounds error on " + name + " array");
+        return Value::fromInt(static_cast<int32_t>(offset));
+    }
 
-    
-private:
-    //these consts are used to store temporary evaluations of expressions, they are used 
-    //to avoid making heap allocations in every visit function 
-    intConstant* intConst;
-    boolConstant* boolConst;
+    //value of the last expression visited through accept
+    Value lastValue;
         
     //Used to tell the visitor when a break is encountered 
     bool breakFlag;
 
     //The environment in which all the dynamically allocated variables are stored
     Environment& env;
+
+    //notified of the loops by the tiered execution, nullptr otherwise
+    LoopObserver* loopObserver;
+
+    //indexed by Expression::getCacheIndex
+    std::vector<ExpressionCache> caches;
+
+    //the locals of the running calls, one frame after the other (see evaluateCall). No pointer
+    //to them is kept across a call, which may move them
+    std::vector<Value> stack;
+    //start of the frame of the running call, and its function (nullptr out of the functions)
+    size_t frame = 0;
+    Function* current = nullptr;
+    //calls running, but the tail calls
+    int depth = 0;
+
+    //the state of the caller of a call, restored when the call returns or fails
+    struct CallScope {
+        EvaluationVisitor& v;
+        size_t base;
+        size_t frame;
+        Function* current;
+        LoopObserver* loopObserver;
+        int depth;
+
+        CallScope(EvaluationVisitor& visitor) : v{visitor}, base{visitor.stack.size()}, frame{visitor.frame},
+            current{visitor.current}, loopObserver{visitor.loopObserver}, depth{visitor.depth} {}
+        ~CallScope() {
+            v.stack.resize(base);
+            v.frame = frame;
+            v.current = current;
+            v.loopObserver = loopObserver;
+            v.depth = depth;
+            v.breakFlag = v.returnFlag = false;
+            v.tailCall = nullptr;
+        }
+    };
+
+    //set by a return together with breakFlag, so that the loops and blocks of the function stop
+    bool returnFlag = false;
+    Value returnValue;
+    //the call of a return that is a tail call, whose arguments are at the top of the stack
+    Call* tailCall = nullptr;
 };
 
 
@@ -357,6 +705,11 @@ public:
 
     Constant* visitProgram(Program* program) override {
         std::cout<<"Program(";
+        for(Function* function : program->getFunctions())
+        {
+            function->accept(this);
+            std::cout<<", ";
+        }
         program->getBlock()->accept(this);
         std::cout<<")";
         return nullptr;
@@ -411,7 +764,9 @@ public:
     Constant* visitVectorType(vectorType* type) override {
         std::cout<<"VectorType(";
         std::cout<<Type::typeid2String[type->getTypeCode()];
-        std::cout<<", ["<<type->getSize()<<"]";
+        std::cout<<", ";
+        for(int dim : type->getDimensions())
+            std::cout<<"["<<dim<<"]";
         std::cout<<")";
 
         return nullptr;
@@ -478,6 +833,25 @@ public:
         return nullptr;
     }
 
+    Constant* visitParallelFor(ParallelFor* parallelForNode) override {
+        const char* ops[] = {"+", "*", "&&", "||"};     //same order of ReductionOp
+        std::cout<<"ParallelFor(";
+        parallelForNode->getId()->accept(this);
+        std::cout<<", ";
+        parallelForNode->getFirst()->accept(this);
+        std::cout<<", ";
+        parallelForNode->getLast()->accept(this);
+        for(auto& reduction : parallelForNode->getReductions())
+        {
+            std::cout<<", "<<ops[reduction.op]<<" ";
+            reduction.var->accept(this);
+        }
+        std::cout<<", ";
+        parallelForNode->getStmt()->accept(this);
+        std::cout<<")";
+        return nullptr;
+    }
+
     Constant* visitSet(Set* setNode) override {
         std::cout<<"Set(";
         setNode->getId()->accept(this);
@@ -510,6 +884,20 @@ public:
         return nullptr;
     }
 
+    Constant* visitLoad(Load* loadNode) override {
+        std::cout<<"Load(";
+        loadNode->getId()->accept(this);
+        std::cout<<", \""<<loadNode->getPath()<<"\")";
+        return nullptr;
+    }
+
+    Constant* visitStore(Store* storeNode) override {
+        std::cout<<"Store(";
+        storeNode->getId()->accept(this);
+        std::cout<<", \""<<storeNode->getPath()<<"\")";
+        return nullptr;
+    }
+
     Constant* visitNot(Not* notNode) override {
         std::cout<<"Not(";
         notNode->getExp()->accept(this);
@@ -546,6 +934,37 @@ public:
         return nullptr;
     }
 
+    Constant* visitFunction(Function* functionNode) override {
+        std::cout<<"Function("<<Type::typeid2String[functionNode->getReturnType()]<<", "<<functionNode->getName();
+        for(int k = 0; k < functionNode->getNumParams(); k++)
+        {
+            std::cout<<", ";
+            functionNode->getLocals()[k]->accept(this);
+        }
+        std::cout<<", ";
+        functionNode->getBody()->accept(this);
+        std::cout<<")";
+        return nullptr;
+    }
+
+    Constant* visitCall(Call* callNode) override {
+        std::cout<<"Call("<<callNode->getName();
+        for(Expression* arg : callNode->getArgs())
+        {
+            std::cout<<", ";
+            arg->accept(this);
+        }
+        std::cout<<")";
+        return nullptr;
+    }
+
+    Constant* visitReturn(Return* returnNode) override {
+        std::cout<<"Return(";
+        returnNode->getExp()->accept(this);
+        std::cout<<")";
+        return nullptr;
+    }
+
     Constant* visitIntConstant(intConstant* numNode) 
     {
         std::cout<<"IntConstant("<<numNode->getInt()<<")";
@@ -590,6 +1009,252 @@ public:
         return nullptr;
     }
 
+    Constant* visitIndex(Index* indexNode) override
+    {
+        std::cout<<"Index(";
+        for(Expression* subscript : indexNode->getSubscripts())
+        {
+            subscript->accept(this);
+            std::cout<<",";
+        }
+        std::cout<<")";
+        return nullptr;
+    }
+
+};
+
+
+// Visitor concreto per il conteggio dei nodi dell'albero (usato dal PassManager)
+class NodeCountVisitor : public Visitor {
+public:
+    NodeCountVisitor() : count{0} {}
+    ~NodeCountVisitor() = default;
+    NodeCountVisitor(NodeCountVisitor const&) = delete;
+    NodeCountVisitor& operator=(NodeCountVisitor const&) = delete;
+
+    int getCount() {return count;}
+
+    Constant* visitProgram(Program* program) override {
+        count++;
+        for(Function* function : program->getFunctions())
+            function->accept(this);
+        program->getBlock()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitBlock(Block* block) override {
+        count++;
+        if(block->getDecls())
+            block->getDecls()->accept(this);
+        if(block->getSeq())
+            block->getSeq()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitDecls(Decls* decls) override {
+        count++;
+        decls->getDecl()->accept(this);
+        if(decls->getDecls())
+            decls->getDecls()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitDecl(Decl* decl) override {
+        count++;
+        decl->getType()->accept(this);
+        decl->getId()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitType(Type* type) override {count++; return nullptr;}
+    Constant* visitVectorType(vectorType* type) override {count++; return nullptr;}
+    Constant* visitId(Id* id) override {count++; return nullptr;}
+    Constant* visitBreak(Break* breakNode) override {count++; return nullptr;}
+    Constant* visitIntConstant(intConstant* numNode) override {count++; return nullptr;}
+    Constant* visitBoolConstant(boolConstant* numNode) override {count++; return nullptr;}
+
+    Constant* visitSeq(Seq* seq) override {
+        count++;
+        seq->getStmt()->accept(this);
+        if(seq->getSeq())
+            seq->getSeq()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitIf(If* ifNode) override {
+        count++;
+        ifNode->getCondition()->accept(this);
+        ifNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitElse(Else* elseNode) override {
+        count++;
+        elseNode->getCondition()->accept(this);
+        elseNode->getifTrueStmt()->accept(this);
+        elseNode->getifFalseStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitWhile(While* whileNode) override {
+        count++;
+        whileNode->getCondition()->accept(this);
+        whileNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitDo(Do* doNode) override {
+        count++;
+        doNode->getCondition()->accept(this);
+        doNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitParallelFor(ParallelFor* parallelForNode) override {
+        count++;
+        parallelForNode->getId()->accept(this);
+        parallelForNode->getFirst()->accept(this);
+        parallelForNode->getLast()->accept(this);
+        for(auto& reduction : parallelForNode->getReductions())
+            reduction.var->accept(this);
+        parallelForNode->getStmt()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitSet(Set* setNode) override {
+        count++;
+        setNode->getId()->accept(this);
+        setNode->getExp()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitSetElem(SetElem* setElemNode) override {
+        count++;
+        setElemNode->getId()->accept(this);
+        setElemNode->getIndex()->accept(this);
+        setElemNode->getExp()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitPrint(Print* printNode) override {
+        count++;
+        printNode->getExp()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitLoad(Load* loadNode) override {
+        count++;
+        loadNode->getId()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitStore(Store* storeNode) override {
+        count++;
+        storeNode->getId()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitNot(Not* notNode) override {
+        count++;
+        notNode->getExp()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitAnd(And* andNode) override {
+        count++;
+        andNode->getLeftExp()->accept(this);
+        andNode->getRightExp()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitOr(Or* orNode) override {
+        count++;
+        orNode->getLeftExp()->accept(this);
+        orNode->getRightExp()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitRel(Rel* relNode) override {
+        count++;
+        relNode->getLeftExp()->accept(this);
+        relNode->getRightExp()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitBinOp(Arithm* arithmNode) override {
+        count++;
+        arithmNode->getLeftExp()->accept(this);
+        arithmNode->getRightExp()->accept(this);
+        return nullptr;
+    }
+
+    //a fused node counts as one, together with the leaves (variables and literals) fused into it
+    Constant* visitFused(Fused* fusedNode) override {
+        count++;
+        Expression* original = fusedNode->getOriginal();
+        Expression* operands[2];
+        if(original->getKind() == Node::REL)
+        {
+            operands[0] = static_cast<Rel*>(original)->getLeftExp();
+            operands[1] = static_cast<Rel*>(original)->getRightExp();
+        }
+        else
+        {
+            operands[0] = static_cast<Arithm*>(original)->getLeftExp();
+            operands[1] = static_cast<Arithm*>(original)->getRightExp();
+        }
+        for(Expression* operand : operands)
+        {
+            if(operand->getKind() != Node::ID && operand->getKind() != Node::INT_CONSTANT)
+                operand->accept(this);
+        }
+        return nullptr;
+    }
+
+    Constant* visitUnaryOp(Unary* unaryNode) override {
+        count++;
+        unaryNode->getExp()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitFunction(Function* functionNode) override {
+        count++;
+        for(int k = 0; k < functionNode->getNumParams(); k++)
+            functionNode->getLocals()[k]->accept(this);
+        functionNode->getBody()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitCall(Call* callNode) override {
+        count++;
+        for(Expression* arg : callNode->getArgs())
+            arg->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitReturn(Return* returnNode) override {
+        count++;
+        returnNode->getExp()->accept(this);
+        return nullptr;
+    }
+
+    Constant* visitAccess(Access* accessNode) override {
+        count++;
+        accessNode->getId()->accept(this);
+        accessNode->getIndex()->accept(this);
+        return nullptr;
+    }
+
+    //the array is the one of the Access or SetElem, already counted
+    Constant* visitIndex(Index* indexNode) override {
+        count++;
+        for(Expression* subscript : indexNode->getSubscripts())
+            subscript->accept(this);
+        return nullptr;
+    }
+
+private:
+    int count;
 };
 
 
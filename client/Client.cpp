@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../Protocol.h"
+
+extern char** environ;
+
+// Client of the server mode of the interpreter (--serve): sends it a program to run and prints
+// what the program prints, with its exit status. With --bench=N the program is sent N times and
+// the latency of the requests is printed instead, and with --cold=<interpreter> it is compared
+// with N runs of a new process of the interpreter
+
+
+// Runs the program on the server at socketPath. The output of the program is written on out and its
+// errors on err. Returns its exit status, or -1 if the server can't be reached
+static int request(const std::string& socketPath, const std::vector<std::string>& arguments, const std::string& source,
+                   std::ostream& out, std::ostream& err) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof address.sun_path - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    int status = -1;
+    bool sent = true;
+    for (auto& argument : arguments)
+        sent = sent && protocol::writeFrame(fd, protocol::ARGUMENT, argument);
+    if (sent && protocol::writeFrame(fd, protocol::SOURCE, source)) {
+        protocol::Kind kind;
+        std::string payload;
+        while (protocol::readFrame(fd, kind, payload)) {
+            if (kind == protocol::OUTPUT)
+                out.write(payload.data(), payload.size()).flush();
+            else if (kind == protocol::ERROR)
+                err.write(payload.data(), payload.size()).flush();
+            else if (kind == protocol::EXIT && payload.size() == 4) {
+                status = static_cast<int>(protocol::decodeSize(payload.data()));
+                break;
+            }
+        }
+    }
+    close(fd);
+    return status;
+}
+
+
+// Runs interpreter -q with the arguments on file, with its output thrown away. Returns its exit status
+static int runCold(const std::string& interpreter, const std::vector<std::string>& arguments, const std::string& file) {
+    std::vector<std::string> words = {interpreter, "-q"};
+    words.insert(words.end(), arguments.begin(), arguments.end());
+    words.push_back(file);
+    std::vector<char*> argv;
+    for (auto& word : words)
+        argv.push_back(&word[0]);
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid;
+    int error = posix_spawn(&pid, interpreter.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0)
+        return -1;
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
+}
+
+
+// Latency below which a fraction of the runs ended (nearest rank), sorted is in ascending order
+static double percentile(const std::vector<double>& sorted, double fraction) {
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+
+static void printLatencies(const std::string& name, std::vector<double>& latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::fixed << std::setprecision(3) << name << " latency (ms): p50 " << percentile(latencies, 0.5)
+              << ", p90 " << percentile(latencies, 0.9) << ", p99 " << percentile(latencies, 0.99)
+              << ", max " << latencies.back() << std::endl;
+}
+
+
+int main(int argc, char* argv[]) {
+    std::string socketPath;
+    std::string fileName;
+    std::string interpreter;
+    long runs = 0;
+    std::vector<std::string> arguments;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--socket=", 0) == 0)
+            socketPath = arg.substr(std::string("--socket=").size());
+        else if (arg.rfind("--bench=", 0) == 0) {
+            try {
+                runs = std::stol(arg.substr(std::string("--bench=").size()));
+            }
+            catch (std::exception const&) {
+                runs = 0;
+            }
+            if (runs <= 0) {
+                std::cerr << "Invalid number of runs " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg.rfind("--cold=", 0) == 0)
+            interpreter = arg.substr(std::string("--cold=").size());
+        else if (arg[0] == '-')
+            // the options of the run, checked by the server
+            arguments.push_back(arg);
+        else
+            fileName = arg;
+    }
+    if (socketPath.empty() || fileName.empty() || (!interpreter.empty() && runs == 0)) {
+        std::cerr << "Usage: " << argv[0] << " --socket=<path> [-O0|-O1|-O2|-O3] [--passes=p1,p2,...]"
+                  << " [--engine=tree|bytecode|closure|jit|tiered|onepass] [--tier-threshold=N] <file_name>" << std::endl;
+        std::cerr << "       " << argv[0] << " --socket=<path> [options] --bench=N [--cold=<interpreter>] <file_name>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file) {
+        std::cerr << "Cannot open " << fileName << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ostringstream source;
+    source << file.rdbuf();
+
+    if (runs == 0) {
+        int status = request(socketPath, arguments, source.str(), std::cout, std::cerr);
+        if (status < 0) {
+            std::cerr << "Cannot reach the server on " << socketPath << std::endl;
+            return EXIT_FAILURE;
+        }
+        return status;
+    }
+
+    // Every request but the first finds the program in the cache of the server
+    using Clock = std::chrono::steady_clock;
+    std::vector<double> latencies;
+    for (long k = 0; k < runs; k++) {
+        std::ostringstream out, err;
+        Clock::time_point start = Clock::now();
+        if (request(socketPath, arguments, source.str(), out, err) < 0) {
+            std::cerr << "Cannot reach the server on " << socketPath << std::endl;
+            return EXIT_FAILURE;
+        }
+        latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    printLatencies("Server", latencies);
+    double serverMedian = percentile(latencies, 0.5);
+
+    if (!interpreter.empty()) {
+        latencies.clear();
+        for (long k = 0; k < runs; k++) {
+            Clock::time_point start = Clock::now();
+            if (runCold(interpreter, arguments, fileName) < 0) {
+                std::cerr << "Cannot run " << interpreter << std::endl;
+                return EXIT_FAILURE;
+            }
+            latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+        printLatencies("Cold", latencies);
+        std::cout << std::setprecision(1) << "Speedup at p50: " << percentile(latencies, 0.5) / std::max(serverMedian, 1e-9)
+                  << "x" << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+#!/bin/sh
+# Regression tests of the interpreter: tests/run.sh <interpreter>
+#   tests/*.txt     run on every engine, the output (and the errors) must be the .out next to them
+#   tests/c/*.txt   translated with --emit-c and built with cc: the output of the translation, or of the
+#                   program when it builds, must be the .out next to them
+#   tests/async/*.txt   run many times with --output=async and a writer thread flushing all the time:
+#                   the last line printed, then the errors, must be the .out next to them
+# The programs run in a temporary directory, where they can write their files
+if [ -z "$1" ]; then
+    echo "Usage: $0 <interpreter>" >&2
+    exit 2
+fi
+interpreter=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+dir=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work" || exit 2
+failed=0
+
+fail() {
+    echo "FAIL: $1"
+    failed=$((failed + 1))
+}
+
+for test in "$dir"/*.txt; do
+    [ -e "$test" ] || continue
+    for engine in tree bytecode closure jit onepass tiered "tiered --tier-threshold=0"; do
+        timeout 60 "$interpreter" -q --engine=$engine "$test" > "$work/out" 2>&1
+        cmp -s "$work/out" "${test%.txt}.out" || fail "$(basename "$test") --engine=$engine"
+    done
+done
+
+for test in "$dir"/c/*.txt; do
+    [ -e "$test" ] || continue
+    if "$interpreter" -q --emit-c="$work/program.c" "$test" > "$work/out" 2>&1; then
+        cc -O1 -o "$work/program" "$work/program.c" && timeout 60 "$work/program" > "$work/out" 2>&1
+    fi
+    cmp -s "$work/out" "${test%.txt}.out" || fail "c/$(basename "$test")"
+done
+
+for test in "$dir"/async/*.txt; do
+    [ -e "$test" ] || continue
+    for run in $(seq 20); do
+        timeout 60 "$interpreter" -q --output=async --flush-ms=1 --flush-bytes=64 "$test" 2> "$work/err" | tail -n 1 > "$work/out"
+        cat "$work/err" >> "$work/out"
+        if ! cmp -s "$work/out" "${test%.txt}.out"; then
+            fail "async/$(basename "$test") (run $run)"
+            break
+        fi
+    done
+done
+
+if [ $failed -ne 0 ]; then
+    echo "$failed failed"
+    exit 1
+fi
+echo "All tests passed"